@@ -0,0 +1,17 @@
+-- ============================================================================
+-- Wigma — WAL Replay Position
+-- Tags updates replayed from a server's write-ahead log with the log's id
+-- and the position replay had reached, so a server that crashes after
+-- storing a batch but before saving its cursor skips the batch on restart
+-- instead of inserting it again (scene ops such as move are relative and
+-- must not apply twice).
+--
+-- Updates written straight to the table leave both columns NULL.
+-- ============================================================================
+
+ALTER TABLE yjs_updates
+  ADD COLUMN IF NOT EXISTS wal_id  TEXT,
+  ADD COLUMN IF NOT EXISTS wal_pos BIGINT;
+
+CREATE INDEX IF NOT EXISTS idx_yjs_updates_wal
+  ON yjs_updates(wal_id, wal_pos DESC) WHERE wal_id IS NOT NULL;
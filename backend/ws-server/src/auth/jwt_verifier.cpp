@@ -12,7 +12,7 @@
 #include <chrono>
 #include <cstring>
 #include <algorithm>
-#include <iostream>
+#include "log/logger.h"
 
 using json = nlohmann::json;
 
@@ -28,7 +28,8 @@ static size_t curl_write_cb(char* ptr, size_t size, size_t nmemb, void* userdata
 
 JwtVerifier::JwtVerifier(const std::string& supabase_url, const std::string& legacy_secret)
   : legacy_secret_(legacy_secret) {
-  load_jwks(supabase_url);
+  // Offline deployments have no JWKS endpoint: HS256 only
+  if (!supabase_url.empty()) load_jwks(supabase_url);
 }
 
 JwtVerifier::~JwtVerifier() {
@@ -42,11 +43,11 @@ JwtVerifier::~JwtVerifier() {
 
 void JwtVerifier::load_jwks(const std::string& supabase_url) {
   std::string jwks_url = supabase_url + "/auth/v1/.well-known/jwks.json";
-  std::cout << "[jwt] fetching JWKS from " << jwks_url << std::endl;
+  LOG_INFO(Jwt) << "fetching JWKS from " << jwks_url;
 
   CURL* curl = curl_easy_init();
   if (!curl) {
-    std::cerr << "[jwt] ERROR: curl_easy_init failed" << std::endl;
+    LOG_ERROR(Jwt) << "curl_easy_init failed";
     return;
   }
 
@@ -63,8 +64,8 @@ void JwtVerifier::load_jwks(const std::string& supabase_url) {
   curl_easy_cleanup(curl);
 
   if (res != CURLE_OK || http_code != 200) {
-    std::cerr << "[jwt] ERROR: JWKS fetch failed: "
-              << curl_easy_strerror(res) << " HTTP " << http_code << std::endl;
+    LOG_ERROR(Jwt) << "JWKS fetch failed: "
+                   << curl_easy_strerror(res) << " HTTP " << http_code;
     return;
   }
 
@@ -72,7 +73,7 @@ void JwtVerifier::load_jwks(const std::string& supabase_url) {
     auto jwks = json::parse(body);
     auto& keys = jwks["keys"];
     if (!keys.is_array() || keys.empty()) {
-      std::cerr << "[jwt] ERROR: JWKS has no keys" << std::endl;
+      LOG_ERROR(Jwt) << "JWKS has no keys";
       return;
     }
 
@@ -88,7 +89,7 @@ void JwtVerifier::load_jwks(const std::string& supabase_url) {
         std::string kid   = key.value("kid", "");
 
         if (x_b64.empty() || y_b64.empty()) {
-          std::cerr << "[jwt] ERROR: EC key missing x or y" << std::endl;
+          LOG_ERROR(Jwt) << "EC key missing x or y";
           continue;
         }
 
@@ -97,26 +98,26 @@ void JwtVerifier::load_jwks(const std::string& supabase_url) {
 
         ec_pubkey_ = build_ec_key(x_bytes, y_bytes);
         if (ec_pubkey_) {
-          std::cout << "[jwt] loaded EC P-256 public key (kid: " << kid << ")" << std::endl;
+          LOG_INFO(Jwt) << "loaded EC P-256 public key (kid: " << kid << ")";
         } else {
-          std::cerr << "[jwt] ERROR: failed to build EC key" << std::endl;
+          LOG_ERROR(Jwt) << "failed to build EC key";
         }
         break;
       }
     }
 
     if (!ec_pubkey_) {
-      std::cerr << "[jwt] WARNING: no EC P-256 key found in JWKS, ES256 verification disabled" << std::endl;
+      LOG_WARN(Jwt) << "no EC P-256 key found in JWKS, ES256 verification disabled";
     }
   } catch (const std::exception& e) {
-    std::cerr << "[jwt] ERROR: JWKS parse failed: " << e.what() << std::endl;
+    LOG_ERROR(Jwt) << "JWKS parse failed: " << e.what();
   }
 }
 
 EVP_PKEY* JwtVerifier::build_ec_key(const std::string& x_bytes, const std::string& y_bytes) {
   if (x_bytes.size() != 32 || y_bytes.size() != 32) {
-    std::cerr << "[jwt] ERROR: EC key x/y must be 32 bytes each, got "
-              << x_bytes.size() << "/" << y_bytes.size() << std::endl;
+    LOG_ERROR(Jwt) << "EC key x/y must be 32 bytes each, got "
+                   << x_bytes.size() << "/" << y_bytes.size();
     return nullptr;
   }
 
@@ -149,7 +150,7 @@ EVP_PKEY* JwtVerifier::build_ec_key(const std::string& x_bytes, const std::strin
     unsigned long err = ERR_get_error();
     char buf[256];
     ERR_error_string_n(err, buf, sizeof(buf));
-    std::cerr << "[jwt] OpenSSL EC key build error: " << buf << std::endl;
+    LOG_ERROR(Jwt) << "OpenSSL EC key build error: " << buf;
     pkey = nullptr;
   }
 
@@ -196,7 +197,8 @@ std::optional<JwtVerifier::Claims> JwtVerifier::verify(std::string_view token) c
   }
 
   if (!sig_valid) {
-    std::cerr << "[jwt] signature verification failed (alg=" << alg << ")" << std::endl;
+    // One bad client retrying can produce thousands of these
+    LOG_SAMPLED(Jwt, Warn, 5) << "signature verification failed (alg=" << alg << ")";
     return std::nullopt;
   }
 
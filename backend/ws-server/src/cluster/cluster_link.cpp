@@ -0,0 +1,280 @@
+#include "cluster_link.h"
+#include <libusockets.h>
+#include <unistd.h>
+#include <cstring>
+#include <stdexcept>
+#include "log/logger.h"
+
+namespace {
+
+constexpr size_t kHighWater    = 4 * 1024 * 1024;    // send() starts returning false
+constexpr size_t kMaxBuffered  = 64 * 1024 * 1024;   // Frames dropped, link closed
+constexpr size_t kMaxFrameBody = 16 * 1024 * 1024 + ClusterLink::kHeaderSize;
+
+/** "unix:/path" or "host:port" ("[v6]:port" allowed). */
+struct Address {
+  bool        unix_socket = false;
+  std::string host;   // Or socket path
+  int         port = 0;
+};
+
+bool parse_address(const std::string& text, Address& out) {
+  if (text.rfind("unix:", 0) == 0) {
+    out.unix_socket = true;
+    out.host = text.substr(5);
+    return !out.host.empty();
+  }
+  auto colon = text.rfind(':');
+  if (colon == std::string::npos) return false;
+  out.host = text.substr(0, colon);
+  if (out.host.size() >= 2 && out.host.front() == '[' && out.host.back() == ']') {
+    out.host = out.host.substr(1, out.host.size() - 2);
+  }
+  try {
+    out.port = std::stoi(text.substr(colon + 1));
+  } catch (...) {
+    return false;
+  }
+  return out.port > 0 && out.port < 65536;
+}
+
+void put_u32(char* p, uint32_t v) {
+  for (int i = 0; i < 4; ++i) p[i] = static_cast<char>(v >> (8 * i));
+}
+
+uint32_t get_u32(const char* p) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+  return v;
+}
+
+} // namespace
+
+// ── ClusterLink ──────────────────────────────────────────────────────────────
+
+void ClusterLink::write(const char* data, size_t len, bool more) {
+  if (connected_ && out_.empty()) {
+    int n = us_socket_write(0, socket_, data, static_cast<int>(len), more ? 1 : 0);
+    if (n > 0) {
+      data += n;
+      len  -= static_cast<size_t>(n);
+    }
+  }
+  out_.append(data, len);
+}
+
+bool ClusterLink::flush() {
+  if (out_.empty()) return true;
+  int n = us_socket_write(0, socket_, out_.data(), static_cast<int>(out_.size()), 0);
+  if (n > 0) out_.erase(0, static_cast<size_t>(n));
+  return out_.empty();
+}
+
+bool ClusterLink::send(LinkFrame kind, uint32_t sid, const char* data, size_t len) {
+  if (!socket_ || overflow_) return false;
+  if (out_.size() + len > kMaxBuffered) {
+    // Peer node stopped reading; closing here could re-enter a fan-out,
+    // so the transport's sweep closes it instead
+    overflow_ = true;
+    return false;
+  }
+
+  char header[kHeaderSize];
+  put_u32(header, static_cast<uint32_t>(len + kHeaderSize - 4));
+  header[4] = static_cast<char>(kind);
+  put_u32(header + 5, sid);
+
+  write(header, sizeof(header), len > 0);
+  if (len > 0) write(data, len, false);
+  return out_.size() < kHighWater;
+}
+
+bool ClusterLink::send_close(uint32_t sid, uint16_t code, std::string_view reason) {
+  std::string payload(2, '\0');
+  payload[0] = static_cast<char>(code & 0xFF);
+  payload[1] = static_cast<char>(code >> 8);
+  payload.append(reason);
+  return send(LinkFrame::Close, sid, payload.data(), payload.size());
+}
+
+// ── ClusterTransport ─────────────────────────────────────────────────────────
+
+ClusterTransport* ClusterTransport::from(us_socket_t* s) {
+  return *static_cast<ClusterTransport**>(us_socket_context_ext(0, us_socket_context(0, s)));
+}
+
+ClusterLink*& ClusterTransport::link_of(us_socket_t* s) {
+  return *static_cast<ClusterLink**>(us_socket_ext(0, s));
+}
+
+ClusterTransport::ClusterTransport(us_loop_t* loop, Handlers handlers)
+  : handlers_(std::move(handlers)) {
+  us_socket_context_options_t options{};
+  context_ = us_create_socket_context(0, loop, sizeof(ClusterTransport*), options);
+  if (!context_) throw std::runtime_error("ClusterTransport: cannot create socket context");
+  *static_cast<ClusterTransport**>(us_socket_context_ext(0, context_)) = this;
+
+  us_socket_context_on_open(0, context_, [](us_socket_t* s, int is_client, char*, int) {
+    auto* self = from(s);
+    if (is_client) {
+      auto* link = link_of(s);
+      link->connected_ = true;
+      link->flush();
+      LOG_INFO(Cluster) << "Link to node " << link->node_id_ << " up";
+    } else {
+      self->add_link(s, {});
+    }
+    return s;
+  });
+
+  us_socket_context_on_data(0, context_, [](us_socket_t* s, char* data, int length) {
+    if (auto* link = link_of(s)) from(s)->receive(*link, data, static_cast<size_t>(length));
+    return s;
+  });
+
+  us_socket_context_on_writable(0, context_, [](us_socket_t* s) {
+    auto* link = link_of(s);
+    if (link && !link->out_.empty() && link->flush()) from(s)->handlers_.drain(*link);
+    return s;
+  });
+
+  us_socket_context_on_close(0, context_, [](us_socket_t* s, int, void*) {
+    if (auto* link = link_of(s)) {
+      link_of(s) = nullptr;
+      from(s)->remove_link(*link);
+    }
+    return s;
+  });
+  us_socket_context_on_connect_error(0, context_, [](us_socket_t* s, int code) {
+    if (auto* link = link_of(s)) {
+      LOG_WARN(Cluster) << "Cannot reach node " << link->node_id_ << " (" << code << ")";
+      link_of(s) = nullptr;
+      from(s)->remove_link(*link);
+    }
+    return s;
+  });
+
+  us_socket_context_on_end(0, context_, [](us_socket_t* s) {
+    return us_socket_close(0, s, 0, nullptr);
+  });
+  us_socket_context_on_timeout(0, context_, [](us_socket_t* s) { return s; });
+}
+
+ClusterTransport::~ClusterTransport() {
+  if (listener_) us_listen_socket_close(0, listener_);
+  us_socket_context_close(0, context_);   // Reports each open link as closed
+  us_socket_context_free(0, context_);
+}
+
+bool ClusterTransport::listen(const std::string& address) {
+  Address addr;
+  if (!parse_address(address, addr)) {
+    LOG_ERROR(Cluster) << "Invalid listen address " << address;
+    return false;
+  }
+
+  if (addr.unix_socket) {
+    ::unlink(addr.host.c_str());   // Stale socket from a previous run
+    listener_ = us_socket_context_listen_unix(0, context_, addr.host.c_str(), 0, sizeof(ClusterLink*));
+  } else {
+    const char* host = addr.host.empty() || addr.host == "*" ? nullptr : addr.host.c_str();
+    listener_ = us_socket_context_listen(0, context_, host, addr.port, 0, sizeof(ClusterLink*));
+  }
+  if (!listener_) {
+    LOG_ERROR(Cluster) << "Failed to listen on " << address;
+    return false;
+  }
+  LOG_INFO(Cluster) << "Accepting links on " << address;
+  return true;
+}
+
+ClusterLink* ClusterTransport::link_to(const ClusterNode& node) {
+  if (auto it = outbound_.find(node.id); it != outbound_.end()) return it->second;
+
+  Address addr;
+  if (!parse_address(node.address, addr)) {
+    LOG_ERROR(Cluster) << "Invalid address for node " << node.id << ": " << node.address;
+    return nullptr;
+  }
+
+  us_socket_t* s = addr.unix_socket
+    ? us_socket_context_connect_unix(0, context_, addr.host.c_str(), 0, sizeof(ClusterLink*))
+    : us_socket_context_connect(0, context_, addr.host.c_str(), addr.port, nullptr, 0, sizeof(ClusterLink*));
+  if (!s) {
+    LOG_ERROR(Cluster) << "Cannot connect to node " << node.id << " at " << node.address;
+    return nullptr;
+  }
+
+  auto& link = add_link(s, node.id);
+  link.connected_ = false;   // Writes are buffered until on_open
+  outbound_[node.id] = &link;
+  return &link;
+}
+
+void ClusterTransport::sweep() {
+  for (auto& [id, link] : links_) {
+    if (link->overflow_ && link->socket_) {
+      LOG_WARN(Cluster) << "Closing link " << id << ": send buffer overflow";
+      us_socket_close(0, link->socket_, 0, nullptr);
+      return;   // links_ changed; the rest wait for the next sweep
+    }
+  }
+}
+
+ClusterLink& ClusterTransport::add_link(us_socket_t* s, std::string node_id) {
+  auto link = std::make_unique<ClusterLink>();
+  link->id_        = next_id_++;
+  link->node_id_   = std::move(node_id);
+  link->socket_    = s;
+  link->connected_ = true;
+  link_of(s) = link.get();
+
+  auto& ref = *link;
+  links_.emplace(ref.id_, std::move(link));
+  return ref;
+}
+
+void ClusterTransport::remove_link(ClusterLink& link) {
+  link.socket_ = nullptr;
+  handlers_.closed(link);
+
+  if (!link.node_id_.empty()) {
+    auto it = outbound_.find(link.node_id_);
+    if (it != outbound_.end() && it->second == &link) outbound_.erase(it);
+  }
+  links_.erase(link.id_);
+}
+
+void ClusterTransport::receive(ClusterLink& link, const char* data, size_t len) {
+  size_t used;
+  if (link.in_.empty()) {
+    // Fast path: frames are dispatched straight from the read buffer
+    used = dispatch(link, data, len);
+    if (used != std::string::npos) link.in_.assign(data + used, len - used);
+  } else {
+    link.in_.append(data, len);
+    used = dispatch(link, link.in_.data(), link.in_.size());
+    if (used != std::string::npos) link.in_.erase(0, used);
+  }
+
+  if (used == std::string::npos && link.socket_) {
+    LOG_ERROR(Cluster) << "Malformed frame on link " << link.id_ << ", closing";
+    us_socket_close(0, link.socket_, 0, nullptr);
+  }
+}
+
+size_t ClusterTransport::dispatch(ClusterLink& link, const char* p, size_t n) {
+  size_t off = 0;
+  while (n - off >= 4) {
+    const uint32_t body = get_u32(p + off);
+    if (body < ClusterLink::kHeaderSize - 4 || body > kMaxFrameBody) return std::string::npos;
+    if (n - off - 4 < body) break;
+
+    const auto kind = static_cast<LinkFrame>(static_cast<uint8_t>(p[off + 4]));
+    const uint32_t sid = get_u32(p + off + 5);
+    handlers_.frame(link, kind, sid,
+                    std::string_view(p + off + ClusterLink::kHeaderSize, body - (ClusterLink::kHeaderSize - 4)));
+    off += 4 + body;
+  }
+  return off;
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include "hash_ring.h"
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+struct us_loop_t;
+struct us_socket_t;
+struct us_socket_context_t;
+struct us_listen_socket_t;
+
+/**
+ * Frame kinds on an inter-node link. Every frame is
+ *   [u32 LE body length][u8 kind][u32 LE session id][payload]
+ * where the body is everything after the length. Session ids are chosen
+ * by the edge node (the one holding the client socket).
+ */
+enum class LinkFrame : uint8_t {
+  Text         = 1,   // WebSocket text frame, either direction
+  Binary       = 2,   // WebSocket binary frame, either direction
+  Close        = 3,   // Session ended; payload [u16 LE close code][reason]
+  Backpressure = 4,   // Edge → owner: the client's socket is backed up
+  Drain        = 5,   // Edge → owner: the client's socket has drained
+};
+
+/**
+ * One persistent inter-node connection (TCP or Unix socket) carrying
+ * many client sessions. Writes go straight to the socket while it keeps
+ * up and are buffered otherwise.
+ */
+class ClusterLink {
+public:
+  static constexpr size_t kHeaderSize = 9;
+
+  uint32_t id() const { return id_; }
+
+  /** Peer node ID for links this node opened; empty for accepted ones. */
+  const std::string& node_id() const { return node_id_; }
+
+  size_t buffered() const { return out_.size(); }
+
+  /**
+   * Queue a frame. Returns false once the link is above its high-water
+   * mark (the frame is still queued, like uWS backpressure) or if the
+   * frame had to be dropped because the link is past its hard limit.
+   */
+  bool send(LinkFrame kind, uint32_t sid, const char* data, size_t len);
+
+  /** Send a Close frame carrying a WebSocket close code and reason. */
+  bool send_close(uint32_t sid, uint16_t code, std::string_view reason);
+
+private:
+  friend class ClusterTransport;
+
+  uint32_t     id_;
+  std::string  node_id_;
+  us_socket_t* socket_    = nullptr;
+  bool         connected_ = false;   // Outbound: false until the connect completes
+  bool         overflow_  = false;   // Hit the hard limit; closed on the next sweep
+  std::string  out_;                 // Unsent bytes
+  std::string  in_;                  // Partial inbound frame
+
+  void write(const char* data, size_t len, bool more);
+  bool flush();
+};
+
+/**
+ * Owns the inter-node sockets: accepts links from other nodes, opens
+ * links to them on demand, and turns the byte streams into frames.
+ *
+ * Runs on the uWS event loop via its own uSockets context, so handlers
+ * are called on the loop thread and need no locking. A link that fails
+ * or closes is reported once through `closed` and then destroyed; the
+ * next link_to() for that node reconnects.
+ */
+class ClusterTransport {
+public:
+  struct Handlers {
+    std::function<void(ClusterLink&, LinkFrame, uint32_t sid, std::string_view payload)> frame;
+    std::function<void(ClusterLink&)> drain;    // Send buffer emptied
+    std::function<void(ClusterLink&)> closed;   // Link is about to be destroyed
+  };
+
+  ClusterTransport(us_loop_t* loop, Handlers handlers);
+  ~ClusterTransport();
+
+  ClusterTransport(const ClusterTransport&) = delete;
+  ClusterTransport& operator=(const ClusterTransport&) = delete;
+
+  /** Accept links on "host:port" or "unix:/path". */
+  bool listen(const std::string& address);
+
+  /** The link to a node, connecting if there is none; nullptr on failure. */
+  ClusterLink* link_to(const ClusterNode& node);
+
+  /** Close links that overflowed their send buffer (call from a timer). */
+  void sweep();
+
+  size_t link_count() const { return links_.size(); }
+
+private:
+  us_socket_context_t* context_ = nullptr;
+  us_listen_socket_t*  listener_ = nullptr;
+  Handlers             handlers_;
+  uint32_t             next_id_ = 1;
+
+  std::unordered_map<uint32_t, std::unique_ptr<ClusterLink>> links_;
+  std::unordered_map<std::string, ClusterLink*> outbound_;   // node id → link
+
+  ClusterLink& add_link(us_socket_t* s, std::string node_id);
+  void remove_link(ClusterLink& link);
+  void receive(ClusterLink& link, const char* data, size_t len);
+
+  /** Dispatch every complete frame in [p, p+n); bytes consumed or npos on a bad frame. */
+  size_t dispatch(ClusterLink& link, const char* p, size_t n);
+
+  static ClusterTransport* from(us_socket_t* s);
+  static ClusterLink*& link_of(us_socket_t* s);
+};
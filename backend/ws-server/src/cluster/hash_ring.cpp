@@ -0,0 +1,93 @@
+#include "hash_ring.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+std::string_view trim(std::string_view s) {
+  const auto first = s.find_first_not_of(" \t\r");
+  if (first == std::string_view::npos) return {};
+  return s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+}
+
+} // namespace
+
+bool parse_cluster_nodes(std::string_view text, std::vector<ClusterNode>& out) {
+  bool ok = true;
+  while (!text.empty()) {
+    auto end  = text.find_first_of(",\n");
+    auto item = text.substr(0, end);
+    text = end == std::string_view::npos ? std::string_view{} : text.substr(end + 1);
+
+    if (auto hash = item.find('#'); hash != std::string_view::npos) item = item.substr(0, hash);
+    item = trim(item);
+    if (item.empty()) continue;
+
+    auto sep = item.find_first_of("= \t");
+    auto id      = sep == std::string_view::npos ? std::string_view{} : trim(item.substr(0, sep));
+    auto address = sep == std::string_view::npos ? std::string_view{} : trim(item.substr(sep + 1));
+    if (id.empty() || address.empty()) {
+      ok = false;
+      continue;
+    }
+    out.push_back({ std::string(id), std::string(address) });
+  }
+  return ok;
+}
+
+bool load_cluster_nodes(const std::string& path, std::vector<ClusterNode>& out) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::stringstream buf;
+  buf << in.rdbuf();
+  return parse_cluster_nodes(buf.str(), out);
+}
+
+uint64_t HashRing::hash(std::string_view key) {
+  // FNV-1a, then a splitmix64 finalizer so similar keys ("a#1", "a#2")
+  // land far apart on the ring
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (unsigned char c : key) {
+    h ^= c;
+    h *= 0x100000001b3ULL;
+  }
+  h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+void HashRing::set_nodes(std::vector<ClusterNode> nodes) {
+  std::sort(nodes.begin(), nodes.end(), [](auto& a, auto& b) { return a.id < b.id; });
+  nodes.erase(std::unique(nodes.begin(), nodes.end(),
+                          [](auto& a, auto& b) { return a.id == b.id; }), nodes.end());
+  nodes_ = std::move(nodes);
+
+  points_.clear();
+  points_.reserve(nodes_.size() * vnodes_);
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    for (uint32_t v = 0; v < vnodes_; ++v) {
+      points_.push_back({ hash(nodes_[i].id + "#" + std::to_string(v)), i });
+    }
+  }
+  // Ties (vanishingly rare) resolve by node order, the same on every node
+  std::sort(points_.begin(), points_.end(), [](const Point& a, const Point& b) {
+    return a.hash != b.hash ? a.hash < b.hash : a.node < b.node;
+  });
+}
+
+const ClusterNode* HashRing::owner(std::string_view key) const {
+  if (points_.empty()) return nullptr;
+  const uint64_t h = hash(key);
+  auto it = std::lower_bound(points_.begin(), points_.end(), h,
+                             [](const Point& p, uint64_t v) { return p.hash < v; });
+  if (it == points_.end()) it = points_.begin();   // Wrap around
+  return &nodes_[it->node];
+}
+
+const ClusterNode* HashRing::find(std::string_view id) const {
+  auto it = std::lower_bound(nodes_.begin(), nodes_.end(), id,
+                             [](const ClusterNode& n, std::string_view v) { return n.id < v; });
+  return it != nodes_.end() && it->id == id ? &*it : nullptr;
+}
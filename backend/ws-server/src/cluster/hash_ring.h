@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/** One cluster member: a stable node ID and its link address. */
+struct ClusterNode {
+  std::string id;
+  std::string address;   // "host:port" or "unix:/path/to.sock"
+
+  bool operator==(const ClusterNode&) const = default;
+};
+
+/**
+ * Parse a node list: entries "id=address" (or "id address") separated by
+ * commas or newlines; blank entries and '#' comments are skipped.
+ * Returns false if any entry is malformed.
+ */
+bool parse_cluster_nodes(std::string_view text, std::vector<ClusterNode>& out);
+
+/** Read a discovery file in parse_cluster_nodes() format. */
+bool load_cluster_nodes(const std::string& path, std::vector<ClusterNode>& out);
+
+/**
+ * Consistent-hash ring mapping project IDs to owner nodes.
+ *
+ * Each node is placed at `vnodes` pseudo-random points (hashes of
+ * "id#n"); a key belongs to the first point at or after its own hash.
+ * Adding or removing a node therefore only moves the keys on the arcs it
+ * gains or loses, about 1/N of them, and every node that sees the same
+ * member list computes the same owners.
+ *
+ * Not thread-safe: owned and used by the event loop thread only.
+ */
+class HashRing {
+public:
+  explicit HashRing(uint32_t vnodes = 128) : vnodes_(vnodes) {}
+
+  /** Replace the member list (order does not matter). */
+  void set_nodes(std::vector<ClusterNode> nodes);
+
+  const std::vector<ClusterNode>& nodes() const { return nodes_; }
+  bool empty() const { return nodes_.empty(); }
+
+  /** Owner of a key, or nullptr if the ring is empty. */
+  const ClusterNode* owner(std::string_view key) const;
+
+  /** Member with the given ID, or nullptr. */
+  const ClusterNode* find(std::string_view id) const;
+
+private:
+  struct Point {
+    uint64_t hash;
+    uint32_t node;   // Index in nodes_
+  };
+
+  uint32_t vnodes_;
+  std::vector<ClusterNode> nodes_;   // Sorted by id
+  std::vector<Point>       points_;  // Sorted by hash
+
+  static uint64_t hash(std::string_view key);
+};
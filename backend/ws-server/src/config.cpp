@@ -1,5 +1,33 @@
 #include "config.h"
 #include <cstdlib>
+#include <string>
+#include <string_view>
+
+namespace {
+
+/** Parse "update=60/512,awareness=20/32" into specs; unknown keys are ignored. */
+void parse_rate_specs(std::string_view text, RateSpecs& specs) {
+  while (!text.empty()) {
+    auto comma = text.find(',');
+    auto item  = text.substr(0, comma);
+    text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+
+    auto eq    = item.find('=');
+    auto slash = item.find('/');
+    if (eq == std::string_view::npos || slash == std::string_view::npos || slash < eq) continue;
+
+    auto key = item.substr(0, eq);
+    RateSpec spec;
+    spec.frames_per_sec = static_cast<uint32_t>(std::stoul(std::string(item.substr(eq + 1, slash - eq - 1))));
+    spec.kb_per_sec     = static_cast<uint32_t>(std::stoul(std::string(item.substr(slash + 1))));
+
+    if (key == "update")         specs.update = spec;
+    else if (key == "awareness") specs.awareness = spec;
+    else if (key == "other")     specs.other = spec;
+  }
+}
+
+} // namespace
 
 Config Config::from_env() {
   Config cfg;
@@ -7,6 +35,18 @@ Config Config::from_env() {
   if (auto* v = std::getenv("WS_PORT"))
     cfg.port = static_cast<uint16_t>(std::stoi(v));
 
+  if (auto* v = std::getenv("TLS_CERT_FILE"))
+    cfg.tls_cert_file = v;
+
+  if (auto* v = std::getenv("TLS_KEY_FILE"))
+    cfg.tls_key_file = v;
+
+  if (auto* v = std::getenv("TLS_TICKET_KEY_FILE"))
+    cfg.tls_ticket_key_file = v;
+
+  if (auto* v = std::getenv("TLS_TICKET_LIFETIME_S"))
+    cfg.tls_ticket_lifetime_s = static_cast<uint32_t>(std::stoi(v));
+
   if (auto* v = std::getenv("SUPABASE_URL"))
     cfg.supabase_url = v;
 
@@ -22,8 +62,134 @@ Config Config::from_env() {
   if (auto* v = std::getenv("MAX_PEERS"))
     cfg.max_peers = static_cast<uint32_t>(std::stoi(v));
 
-  if (auto* v = std::getenv("SNAPSHOT_INTERVAL_MS"))
-    cfg.snapshot_interval_ms = static_cast<uint32_t>(std::stoi(v));
+  if (auto* v = std::getenv("MAX_SPECTATORS"))
+    cfg.max_spectators = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("SPECTATOR_TICK_MS"))
+    cfg.spectator_tick_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("OP_RING_OPS"))
+    cfg.op_ring_ops = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("OP_RING_KB"))
+    cfg.op_ring_kb = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("RESUME_GRACE_MS"))
+    cfg.resume_grace_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("JOIN_TIMEOUT_MS"))
+    cfg.join_timeout_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("ROOM_LINGER_MS"))
+    cfg.room_linger_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("MEMORY_BUDGET_MB"))
+    cfg.memory_budget_mb = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("SPILL_FILE"))
+    cfg.spill_file = v;
+
+  if (auto* v = std::getenv("ZSTD_DICT_PATH"))
+    cfg.zstd_dict_path = v;
+
+  if (auto* v = std::getenv("ZSTD_LEVEL"))
+    cfg.zstd_level = std::stoi(v);
+
+  if (auto* v = std::getenv("RATE_LIMIT_PEER"))
+    parse_rate_specs(v, cfg.rate_peer);
+
+  if (auto* v = std::getenv("RATE_LIMIT_ROOM"))
+    parse_rate_specs(v, cfg.rate_room);
+
+  if (auto* v = std::getenv("RATE_BURST_SECS"))
+    cfg.rate_burst_secs = std::stof(v);
+
+  if (auto* v = std::getenv("COALESCE_WINDOW_MS"))
+    cfg.coalesce_window_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("COALESCE_MAX_MS"))
+    cfg.coalesce_max_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("PERSISTENCE_BACKEND"))
+    cfg.persistence_backend = v;
+
+  if (auto* v = std::getenv("DATABASE_URL"))
+    cfg.database_url = v;
+
+  if (auto* v = std::getenv("PG_POOL_SIZE"))
+    cfg.pg_pool_size = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("SQLITE_PATH"))
+    cfg.sqlite_path = v;
+
+  if (auto* v = std::getenv("CLUSTER_NODE_ID"))
+    cfg.cluster_node_id = v;
+
+  if (auto* v = std::getenv("CLUSTER_NODES"))
+    cfg.cluster_nodes = v;
+
+  if (auto* v = std::getenv("CLUSTER_DISCOVERY_FILE"))
+    cfg.cluster_discovery_file = v;
+
+  if (auto* v = std::getenv("CLUSTER_LISTEN"))
+    cfg.cluster_listen = v;
+
+  if (auto* v = std::getenv("CLUSTER_VNODES"))
+    cfg.cluster_vnodes = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("HANDOFF_SOCKET"))
+    cfg.handoff_socket = v;
+
+  if (auto* v = std::getenv("HANDOFF_TIMEOUT_MS"))
+    cfg.handoff_timeout_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("WAL_DIR"))
+    cfg.wal_dir = v;
+
+  if (auto* v = std::getenv("WAL_SEGMENT_MB"))
+    cfg.wal_segment_mb = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("WAL_COMMIT_INTERVAL_MS"))
+    cfg.wal_commit_interval_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("WAL_REPLAY_BATCH"))
+    cfg.wal_replay_batch = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("TRACE_SAMPLE"))
+    cfg.trace_sample = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("TRACE_FILE"))
+    cfg.trace_file = v;
+
+  if (auto* v = std::getenv("CAPTURE_FILE"))
+    cfg.capture_file = v;
+
+  if (auto* v = std::getenv("CAPTURE_REDACT"))
+    cfg.capture_redact = v;
+
+  if (auto* v = std::getenv("CAPTURE_MAX_MB"))
+    cfg.capture_max_mb = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("OVERLOAD_AWARENESS_LAG_MS"))
+    cfg.overload_awareness_lag_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("OVERLOAD_DEFER_LAG_MS"))
+    cfg.overload_defer_lag_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("OVERLOAD_REJECT_LAG_MS"))
+    cfg.overload_reject_lag_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("OVERLOAD_AWARENESS_INTERVAL_MS"))
+    cfg.overload_awareness_interval_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("OVERLOAD_RETRY_AFTER_MS"))
+    cfg.overload_retry_after_ms = static_cast<uint32_t>(std::stoi(v));
+
+  if (auto* v = std::getenv("LOG_LEVELS"))
+    cfg.log_levels = v;
+
+  if (auto* v = std::getenv("LOG_FORMAT"))
+    cfg.log_format = v;
 
   return cfg;
 }
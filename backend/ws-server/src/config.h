@@ -2,17 +2,112 @@
 #include <string>
 #include <cstdint>
 
+/** Inbound budget for one message class; 0 = unlimited. */
+struct RateSpec {
+  uint32_t frames_per_sec = 0;
+  uint32_t kb_per_sec     = 0;
+};
+
+struct RateSpecs {
+  RateSpec update;      // 0x02 scene ops / Yjs updates
+  RateSpec awareness;   // 0x03 presence
+  RateSpec other;       // Sync and anything else
+};
+
 /**
  * Server configuration loaded from environment variables.
  */
 struct Config {
   uint16_t    port           = 9001;
+
+  // In-process TLS (SSLApp) when both are set; reloaded when they change
+  std::string tls_cert_file;           // PEM certificate chain
+  std::string tls_key_file;            // PEM private key (unencrypted)
+  std::string tls_ticket_key_file;     // 80 shared bytes (empty = random per process)
+  uint32_t    tls_ticket_lifetime_s = 7200;
   std::string supabase_url;
   std::string supabase_service_key;   // Service-role key for server-side ops
   std::string jwt_secret;             // Supabase JWT secret for token verification
   uint32_t    max_rooms      = 1024;
-  uint32_t    max_peers      = 64;    // Per room
-  uint32_t    snapshot_interval_ms = 60000; // Compact Yjs every 60s
+  uint32_t    max_peers      = 64;    // Editors per room
+  uint32_t    max_spectators = 1024;  // Read-only viewers per room, outside max_peers
+  uint32_t    spectator_tick_ms = 100; // Spectators get one batched frame per tick
+  uint32_t    op_ring_ops    = 512;   // Recent sequenced updates kept per room
+  uint32_t    op_ring_kb     = 512;   // Byte bound for the same ring
+  uint32_t    resume_grace_ms = 30000; // Hold a dropped peer's slot (0 = off)
+  uint32_t    join_timeout_ms = 10000; // Close sockets that send no join/resume (0 = off)
+  uint32_t    room_linger_ms  = 30000; // Keep an empty room's state for a rejoin (0 = off)
+
+  // Room memory budget (0 = unlimited). Past it the coldest rooms' cached
+  // sync state is evicted, to spill_file if set (else reloaded from storage)
+  uint32_t    memory_budget_mb = 0;
+  std::string spill_file;
+  std::string zstd_dict_path;          // Trained dictionary (empty = no zstd frames)
+  int         zstd_level     = 3;
+
+  // Flood protection, "update=F/K,awareness=F/K,other=F/K" (frames/s, KB/s)
+  RateSpecs   rate_peer      = { { 60, 512 },  { 20, 32 },  { 2, 4096 } };
+  RateSpecs   rate_room      = { { 600, 4096 }, { 400, 512 }, { 20, 16384 } };
+  float       rate_burst_secs = 2.0f;  // Bucket depth, in seconds of rate
+
+  // Move/modify coalescing before persistence: a room's pending ops are
+  // stored once it has been quiet for the window (0 = store every op).
+  // With WAL_DIR every op is logged on arrival and merged on replay instead
+  uint32_t    coalesce_window_ms = 250;
+  uint32_t    coalesce_max_ms    = 5000; // Upper bound on how long an op waits
+
+  // Storage: "supabase" (PostgREST), "postgres" (libpq, DATABASE_URL)
+  // or "sqlite" (embedded file at SQLITE_PATH, no network)
+  std::string persistence_backend = "supabase";
+  std::string database_url;            // libpq conninfo / postgres:// URI
+  uint32_t    pg_pool_size   = 4;      // Connections per backend instance
+  std::string sqlite_path    = "wigma.db";
+
+  // Cluster mode (empty node id = single node). Rooms are owned by the
+  // node the project id hashes to; other nodes proxy their clients there.
+  std::string cluster_node_id;
+  std::string cluster_nodes;           // "id=host:port,id=unix:/path,..."
+  std::string cluster_discovery_file;  // Same format, one per line; re-read every second
+  std::string cluster_listen;          // Link address (default: this node's entry)
+  uint32_t    cluster_vnodes = 128;    // Ring points per node
+
+  // Hot restart: rendezvous between the running process and its successor
+  std::string handoff_socket;              // Unix socket path (empty = off)
+  uint32_t    handoff_timeout_ms = 10000;  // Successor's wait for the state
+
+  // Write-ahead log (empty dir = disabled, updates go straight to Supabase)
+  std::string wal_dir;
+  uint32_t    wal_segment_mb         = 64;
+  uint32_t    wal_commit_interval_ms = 5;    // Group-commit window
+  uint32_t    wal_replay_batch       = 256;  // Updates per Supabase insert
+
+  // Tracing: spans for 1 in trace_sample relayed frames, plus every join
+  // and WAL commit (0 = off). SIGUSR1 writes them to trace_file as Chrome
+  // trace-event JSON
+  uint32_t    trace_sample = 0;
+  std::string trace_file   = "wigma-trace.json";
+
+  // Traffic capture: every inbound client frame to capture_file (empty =
+  // off) for tools/replay. Tokens are always cut out; "payload" also zeroes
+  // binary payloads, "none" keeps them
+  std::string capture_file;
+  std::string capture_redact = "payload";
+  uint32_t    capture_max_mb = 1024;   // Recording stops at this file size
+
+  // Overload: smoothed event loop lag (ms) at which each shedding stage
+  // starts (0 = stage off). Stages add up: awareness relayed at most once
+  // per overload_awareness_interval_ms per peer, then joins that need a
+  // storage load refused, then all joins refused with RETRY_AFTER
+  uint32_t    overload_awareness_lag_ms = 50;
+  uint32_t    overload_defer_lag_ms     = 100;
+  uint32_t    overload_reject_lag_ms    = 250;
+  uint32_t    overload_awareness_interval_ms = 250;
+  uint32_t    overload_retry_after_ms   = 2000;  // Base hint; jittered up to 2x
+
+  // Logging: "info" or per category, e.g. "default=info,jwt=warn,pg=debug"
+  // (categories: ws cluster jwt persistence pg sqlite supabase wal zstd)
+  std::string log_levels = "info";
+  std::string log_format = "json";       // "json" (one object per line) or "text"
 
   static Config from_env();
 };
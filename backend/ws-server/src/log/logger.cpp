@@ -0,0 +1,318 @@
+#include "logger.h"
+#include <unistd.h>
+#include <chrono>
+#include <ctime>
+#include <cerrno>
+#include <cstdio>
+
+namespace {
+
+constexpr const char* kLevelNames[] = { "debug", "info", "warn", "error", "off" };
+constexpr const char* kCategoryNames[] = {
+  "ws", "cluster", "jwt", "persistence", "pg", "sqlite", "supabase", "wal", "zstd"
+};
+static_assert(std::size(kCategoryNames) == static_cast<size_t>(LogCategory::Count));
+
+constexpr size_t kFlushBytes = 64 * 1024;   // Write out at least this often while draining
+
+bool parse_level(std::string_view name, LogLevel& out) {
+  for (size_t i = 0; i < std::size(kLevelNames); ++i) {
+    if (name == kLevelNames[i]) {
+      out = static_cast<LogLevel>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+  return s;
+}
+
+void append_json_string(std::string& out, std::string_view s) {
+  out += '"';
+  for (char c : s) {
+    switch (c) {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n";  break;
+      case '\r': out += "\\r";  break;
+      case '\t': out += "\\t";  break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+/** ISO 8601 UTC with microseconds. */
+void append_time(std::string& out, int64_t time_us) {
+  const time_t secs = static_cast<time_t>(time_us / 1000000);
+  std::tm tm;
+  gmtime_r(&secs, &tm);
+  char buf[40];
+  size_t n = std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+  std::snprintf(buf + n, sizeof(buf) - n, ".%06dZ", static_cast<int>(time_us % 1000000));
+  out += buf;
+}
+
+void write_all(int fd, const std::string& data) {
+  const char* p = data.data();
+  size_t left = data.size();
+  while (left > 0) {
+    ssize_t n = ::write(fd, p, left);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return;   // Nowhere left to report it
+    }
+    p    += n;
+    left -= static_cast<size_t>(n);
+  }
+}
+
+} // namespace
+
+// ── Logger ───────────────────────────────────────────────────────────────────
+
+Logger& Logger::instance() {
+  static Logger logger;
+  return logger;
+}
+
+Logger::Logger() : slots_(std::make_unique<Slot[]>(kSlots)) {
+  static_assert((kSlots & (kSlots - 1)) == 0, "kSlots must be a power of two");
+  for (size_t i = 0; i < kSlots; ++i) slots_[i].seq.store(i, std::memory_order_relaxed);
+  for (auto& level : levels_) level.store(LogLevel::Info, std::memory_order_relaxed);
+  writer_ = std::thread([this] { writer_loop(); });
+}
+
+Logger::~Logger() {
+  stopping_.store(true, std::memory_order_release);
+  if (writer_.joinable()) writer_.join();
+}
+
+bool Logger::configure(std::string_view spec, bool json) {
+  json_.store(json, std::memory_order_relaxed);
+
+  bool ok = true;
+  while (!spec.empty()) {
+    auto end  = spec.find(',');
+    auto item = trim(spec.substr(0, end));
+    spec = end == std::string_view::npos ? std::string_view{} : spec.substr(end + 1);
+    if (item.empty()) continue;
+
+    auto eq = item.find('=');
+    auto name = eq == std::string_view::npos ? std::string_view("default") : trim(item.substr(0, eq));
+    LogLevel level;
+    if (!parse_level(eq == std::string_view::npos ? item : trim(item.substr(eq + 1)), level)) {
+      ok = false;
+      continue;
+    }
+
+    // Applied left to right, so "default=warn,ws=info" works as expected
+    for (size_t i = 0; i < std::size(kCategoryNames); ++i) {
+      if (name == "default" || name == kCategoryNames[i]) {
+        levels_[i].store(level, std::memory_order_relaxed);
+      }
+    }
+  }
+  return ok;
+}
+
+void Logger::submit(LogCategory category, LogLevel level, uint32_t suppressed,
+                    std::string_view message, std::string_view fields) {
+  // Bounded MPMC queue (Vyukov): a slot is free for position p when its
+  // seq == p, and holds a record for the reader when seq == p + 1
+  uint64_t pos = head_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &slots_[pos & (kSlots - 1)];
+    const uint64_t seq = slot->seq.load(std::memory_order_acquire);
+    const int64_t  dif = static_cast<int64_t>(seq - pos);
+    if (dif == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (dif < 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);   // Full: never block the caller
+      return;
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  slot->suppressed  = suppressed;
+  slot->level       = level;
+  slot->category    = category;
+  slot->message_len = static_cast<uint16_t>(std::min(message.size(), kMaxMessage));
+  slot->fields_len  = static_cast<uint16_t>(std::min(fields.size(), kMaxFields));
+  std::memcpy(slot->message, message.data(), slot->message_len);
+  std::memcpy(slot->fields, fields.data(), slot->fields_len);
+  slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+void Logger::writer_loop() {
+  std::string out;
+  uint64_t reported_drops = 0;
+  int idle_ms = 1;
+
+  for (;;) {
+    const bool stopping = stopping_.load(std::memory_order_acquire);
+    const bool any = drain(out);
+
+    if (uint64_t drops = dropped(); drops != reported_drops) {
+      Slot note{};
+      note.time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+      note.level    = LogLevel::Warn;
+      note.category = LogCategory::Ws;
+      int n = std::snprintf(note.message, kMaxMessage, "Log ring full, dropped %llu records",
+                            static_cast<unsigned long long>(drops - reported_drops));
+      note.message_len = static_cast<uint16_t>(n);
+      render(note, out);
+      reported_drops = drops;
+    }
+
+    if (!out.empty()) {
+      write_all(STDOUT_FILENO, out);
+      out.clear();
+    }
+
+    if (any) {
+      idle_ms = 1;
+    } else if (stopping) {
+      return;   // Drained after the stop request: nothing is lost
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(idle_ms));
+      idle_ms = std::min(idle_ms * 2, 10);
+    }
+  }
+}
+
+bool Logger::drain(std::string& out) {
+  bool any = false;
+  for (;;) {
+    Slot& slot = slots_[tail_ & (kSlots - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != tail_ + 1) return any;
+
+    render(slot, out);
+    slot.seq.store(tail_ + kSlots, std::memory_order_release);
+    ++tail_;
+    any = true;
+
+    if (out.size() >= kFlushBytes) {
+      write_all(STDOUT_FILENO, out);
+      out.clear();
+    }
+  }
+}
+
+void Logger::render(const Slot& slot, std::string& out) const {
+  const bool json = json_.load(std::memory_order_relaxed);
+  const std::string_view message(slot.message, slot.message_len);
+  const char* level    = kLevelNames[static_cast<size_t>(slot.level)];
+  const char* category = kCategoryNames[static_cast<size_t>(slot.category)];
+
+  if (json) {
+    out += "{\"ts\":\"";
+    append_time(out, slot.time_us);
+    out += "\",\"level\":\"";
+    out += level;
+    out += "\",\"cat\":\"";
+    out += category;
+    out += "\",\"msg\":";
+    append_json_string(out, message);
+  } else {
+    append_time(out, slot.time_us);
+    out += ' ';
+    out += level;
+    out += " [";
+    out += category;
+    out += "] ";
+    out += message;
+  }
+
+  // Fields: [u8 key len][key][u8 kind][u16 value len][value]
+  std::string_view fields(slot.fields, slot.fields_len);
+  while (fields.size() >= 4) {
+    const size_t klen = static_cast<uint8_t>(fields[0]);
+    if (fields.size() < 1 + klen + 3) break;
+    auto key  = fields.substr(1, klen);
+    char kind = fields[1 + klen];
+    const size_t vlen = static_cast<uint8_t>(fields[2 + klen])
+                      | (static_cast<size_t>(static_cast<uint8_t>(fields[3 + klen])) << 8);
+    if (fields.size() < 4 + klen + vlen) break;
+    auto value = fields.substr(4 + klen, vlen);
+    fields.remove_prefix(4 + klen + vlen);
+
+    if (json) {
+      out += ',';
+      append_json_string(out, key);
+      out += ':';
+      if (kind == 'n' && !value.empty()) {
+        out += value;
+      } else {
+        append_json_string(out, value);
+      }
+    } else {
+      out += ' ';
+      out += key;
+      out += '=';
+      out += value;
+    }
+  }
+
+  if (slot.suppressed) {
+    if (json) {
+      out += ",\"suppressed\":";
+      out += std::to_string(slot.suppressed);
+    } else {
+      out += " (" + std::to_string(slot.suppressed) + " similar suppressed)";
+    }
+  }
+  out += json ? "}\n" : "\n";
+}
+
+// ── LogLine / LogSampler ─────────────────────────────────────────────────────
+
+LogLine& LogLine::add_field(std::string_view key, char kind, std::string_view value) {
+  key   = key.substr(0, UINT8_MAX);
+  value = value.substr(0, UINT16_MAX);
+  const size_t need = 4 + key.size() + value.size();
+  if (fields_len_ + need > sizeof(fields_)) return *this;
+
+  char* p = fields_ + fields_len_;
+  *p++ = static_cast<char>(key.size());
+  std::memcpy(p, key.data(), key.size());
+  p += key.size();
+  *p++ = kind;
+  *p++ = static_cast<char>(value.size() & 0xFF);
+  *p++ = static_cast<char>(value.size() >> 8);
+  std::memcpy(p, value.data(), value.size());
+  fields_len_ += need;
+  return *this;
+}
+
+bool LogSampler::admit(uint32_t& skipped) {
+  const uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+
+  uint64_t window = window_.load(std::memory_order_relaxed);
+  if (window != now && window_.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+    count_.store(0, std::memory_order_relaxed);
+  }
+  if (count_.fetch_add(1, std::memory_order_relaxed) < per_sec_) {
+    skipped = suppressed_.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+  suppressed_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
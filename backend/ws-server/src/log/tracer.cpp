@@ -0,0 +1,166 @@
+#include "tracer.h"
+#include <unistd.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+
+namespace {
+
+/**
+ * One thread's spans. Single writer; dump() reads concurrently, so each
+ * slot is a seqlock: odd while being written, and a reader keeps a copy
+ * only if the sequence was even and unchanged around it.
+ */
+struct Ring {
+  struct Event {
+    std::atomic<uint64_t>    seq{0};
+    std::atomic<const char*> category{nullptr};
+    std::atomic<const char*> name{nullptr};
+    std::atomic<const char*> arg_name{nullptr};
+    std::atomic<uint64_t>    start{0};
+    std::atomic<uint64_t>    dur{0};
+    std::atomic<uint64_t>    id{0};
+    std::atomic<uint64_t>    arg{0};
+  };
+
+  uint32_t    tid;
+  std::atomic<const char*> thread_name{nullptr};
+  uint64_t    next = 0;   // Writer only
+  std::unique_ptr<Event[]> events = std::make_unique<Event[]>(Tracer::kRingEvents);
+};
+
+struct Copy {
+  const char* category;
+  const char* name;
+  const char* arg_name;
+  uint64_t start, dur, id, arg;
+};
+
+std::mutex                         g_rings_mutex;   // Registration and dump only
+std::vector<std::unique_ptr<Ring>> g_rings;         // Never shrinks: threads are long-lived
+thread_local Ring*                 t_ring = nullptr;
+
+Ring& this_ring() {
+  if (!t_ring) {
+    std::lock_guard lock(g_rings_mutex);
+    auto ring = std::make_unique<Ring>();
+    ring->tid = static_cast<uint32_t>(g_rings.size() + 1);
+    t_ring = ring.get();
+    g_rings.push_back(std::move(ring));
+  }
+  return *t_ring;
+}
+
+void append_string(std::string& out, const char* s) {
+  // Names are literals from our own call sites: no escaping needed
+  out += '"';
+  out += s;
+  out += '"';
+}
+
+} // namespace
+
+uint64_t Tracer::now_us() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Tracer::set_thread_name(const char* name) {
+  if (!enabled()) return;   // Do not allocate a ring for nothing
+  this_ring().thread_name.store(name, std::memory_order_relaxed);
+}
+
+void Tracer::record(const char* category, const char* name, uint64_t start_us, uint64_t end_us,
+                    uint64_t id, const char* arg_name, uint64_t arg) {
+  Ring& ring = this_ring();
+  auto& e = ring.events[ring.next % kRingEvents];
+  const uint64_t seq = 2 * (ring.next / kRingEvents + 1);   // Even, new per lap
+  ++ring.next;
+
+  e.seq.store(seq - 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  e.category.store(category, std::memory_order_relaxed);
+  e.name.store(name, std::memory_order_relaxed);
+  e.arg_name.store(arg_name, std::memory_order_relaxed);
+  e.start.store(start_us, std::memory_order_relaxed);
+  e.dur.store(end_us >= start_us ? end_us - start_us : 0, std::memory_order_relaxed);
+  e.id.store(id, std::memory_order_relaxed);
+  e.arg.store(arg, std::memory_order_relaxed);
+  e.seq.store(seq, std::memory_order_release);
+}
+
+std::string Tracer::render(size_t* events) {
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  const auto pid = std::to_string(::getpid());
+  size_t count = 0;
+  bool first = true;
+  auto separator = [&] {
+    if (!first) out += ',';
+    first = false;
+  };
+
+  std::lock_guard lock(g_rings_mutex);
+  std::vector<Copy> copies;
+  for (auto& ring : g_rings) {
+    const std::string tid = std::to_string(ring->tid);
+    if (const char* thread = ring->thread_name.load(std::memory_order_relaxed)) {
+      separator();
+      out += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + pid + ",\"tid\":" + tid
+           + ",\"args\":{\"name\":";
+      append_string(out, thread);
+      out += "}}";
+    }
+
+    copies.clear();
+    for (size_t i = 0; i < kRingEvents; ++i) {
+      auto& e = ring->events[i];
+      const uint64_t before = e.seq.load(std::memory_order_acquire);
+      if (before == 0 || (before & 1)) continue;
+      Copy c{
+        e.category.load(std::memory_order_relaxed), e.name.load(std::memory_order_relaxed),
+        e.arg_name.load(std::memory_order_relaxed), e.start.load(std::memory_order_relaxed),
+        e.dur.load(std::memory_order_relaxed), e.id.load(std::memory_order_relaxed),
+        e.arg.load(std::memory_order_relaxed)
+      };
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (e.seq.load(std::memory_order_relaxed) != before) continue;   // Overwritten meanwhile
+      copies.push_back(c);
+    }
+
+    for (auto& c : copies) {
+      separator();
+      out += "{\"ph\":\"X\",\"cat\":";
+      append_string(out, c.category);
+      out += ",\"name\":";
+      append_string(out, c.name);
+      out += ",\"pid\":" + pid + ",\"tid\":" + tid
+           + ",\"ts\":" + std::to_string(c.start) + ",\"dur\":" + std::to_string(c.dur)
+           + ",\"args\":{\"id\":" + std::to_string(c.id);
+      if (c.arg_name) {
+        out += ',';
+        append_string(out, c.arg_name);
+        out += ':' + std::to_string(c.arg);
+      }
+      out += "}}";
+    }
+    count += copies.size();
+  }
+
+  out += "]}\n";
+  if (events) *events = count;
+  return out;
+}
+
+bool Tracer::dump(const std::string& path, size_t* events) {
+  auto json = render(events);
+  const std::string tmp = path + ".tmp";
+  std::FILE* f = std::fopen(tmp.c_str(), "wb");
+  if (!f) return false;
+  bool ok = std::fwrite(json.data(), 1, json.size(), f) == json.size();
+  ok = std::fclose(f) == 0 && ok;
+  if (ok) ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+  if (!ok) std::remove(tmp.c_str());
+  return ok;
+}
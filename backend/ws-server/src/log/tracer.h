@@ -0,0 +1,100 @@
+#pragma once
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Sampled span tracing, exported as Chrome trace-event JSON
+ * (chrome://tracing, ui.perfetto.dev).
+ *
+ * Each thread records complete spans into its own fixed ring (the oldest
+ * are overwritten); dump() snapshots every ring without stopping the
+ * writers. Spans of one relayed frame or join share an id, so they line
+ * up under each other in the viewer.
+ *
+ * Off by default (TRACE_SAMPLE=0): sample() is then one relaxed load and
+ * a TraceSpan built from id 0 never reads the clock.
+ */
+class Tracer {
+public:
+  static constexpr size_t kRingEvents = 8192;   // Per thread (64 bytes each)
+
+  /** Trace one in every `every` frames (0 = off). */
+  static void configure(uint32_t every) { every_.store(every, std::memory_order_relaxed); }
+
+  static bool enabled() { return every_.load(std::memory_order_relaxed) != 0; }
+
+  /** A fresh trace id if this event is sampled, else 0. */
+  static uint64_t sample() {
+    const uint32_t every = every_.load(std::memory_order_relaxed);
+    if (every == 0) return 0;
+    if (++countdown_ < every) return 0;
+    countdown_ = 0;
+    return next_id();
+  }
+
+  /** A fresh trace id if tracing is on at all (rare events), else 0. */
+  static uint64_t always() { return enabled() ? next_id() : 0; }
+
+  static uint64_t now_us();
+
+  /** Label this thread's track in the trace (no-op while tracing is off). */
+  static void set_thread_name(const char* name);
+
+  /**
+   * Record a span on this thread's ring. `category`, `name` and `arg_name`
+   * must be string literals: only the pointers are kept.
+   */
+  static void record(const char* category, const char* name, uint64_t start_us, uint64_t end_us,
+                     uint64_t id, const char* arg_name = nullptr, uint64_t arg = 0);
+
+  /** All threads' retained spans as a Chrome trace JSON document. */
+  static std::string render(size_t* events = nullptr);
+
+  /** Write render() to path (via a temp file + rename); false on error. */
+  static bool dump(const std::string& path, size_t* events = nullptr);
+
+private:
+  static inline std::atomic<uint32_t> every_{0};
+  static inline std::atomic<uint64_t> ids_{0};
+  static inline thread_local uint32_t countdown_ = 0;
+
+  static uint64_t next_id() { return ids_.fetch_add(1, std::memory_order_relaxed) + 1; }
+};
+
+/**
+ * Records [construction, end()) as one span when id != 0:
+ *   TraceSpan span(id, "frame", "decode");
+ *   ...
+ *   span.end();   // Or at scope exit
+ */
+class TraceSpan {
+public:
+  TraceSpan(uint64_t id, const char* category, const char* name)
+    : id_(id), category_(category), name_(name), start_(id ? Tracer::now_us() : 0) {}
+
+  ~TraceSpan() { end(); }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+  /** Attach one numeric argument (name must be a literal). */
+  void arg(const char* name, uint64_t value) {
+    arg_name_ = name;
+    arg_      = value;
+  }
+
+  void end() {
+    if (!id_) return;
+    Tracer::record(category_, name_, start_, Tracer::now_us(), id_, arg_name_, arg_);
+    id_ = 0;
+  }
+
+private:
+  uint64_t    id_;
+  const char* category_;
+  const char* name_;
+  uint64_t    start_;
+  const char* arg_name_ = nullptr;
+  uint64_t    arg_ = 0;
+};
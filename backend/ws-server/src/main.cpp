@@ -1,43 +1,75 @@
 #include "server/ws_server.h"
 #include "config.h"
-#include <iostream>
+#include "log/logger.h"
+#include "log/tracer.h"
 #include <csignal>
 
 static WsServer* g_server = nullptr;
 
 void signal_handler(int sig) {
-  std::cout << "\n[wigma-ws] Caught signal " << sig << ", shutting down..." << std::endl;
+  LOG_INFO(Ws) << "Caught signal " << sig << ", shutting down...";
   if (g_server) g_server->stop();
 }
 
-int main() {
-  std::cout << "═══════════════════════════════════════" << std::endl;
-  std::cout << "  Wigma WebSocket Server v0.1.0" << std::endl;
-  std::cout << "  Real-time collaboration relay" << std::endl;
-  std::cout << "═══════════════════════════════════════" << std::endl;
+void trace_signal_handler(int) {
+  if (g_server) g_server->dump_trace();
+}
 
+int main() {
   // Load config from environment
   auto config = Config::from_env();
+  if (!Logger::instance().configure(config.log_levels, config.log_format != "text")) {
+    LOG_WARN(Ws) << "Ignoring malformed entries in LOG_LEVELS=" << config.log_levels;
+  }
+
+  Tracer::configure(config.trace_sample);
+
+  LOG_INFO(Ws) << "Wigma WebSocket Server v0.1.0 starting";
 
-  if (config.supabase_url.empty() || config.jwt_secret.empty()) {
-    std::cerr << "[wigma-ws] ERROR: SUPABASE_URL and JWT_SECRET must be set" << std::endl;
+  if (config.jwt_secret.empty()
+      || (config.supabase_url.empty() && config.persistence_backend == "supabase")) {
+    LOG_ERROR(Ws) << "SUPABASE_URL and JWT_SECRET must be set"
+                  << " (SUPABASE_URL is optional with PERSISTENCE_BACKEND=sqlite|postgres)";
     return 1;
   }
 
-  std::cout << "[wigma-ws] Port: " << config.port << std::endl;
-  std::cout << "[wigma-ws] Max rooms: " << config.max_rooms << std::endl;
-  std::cout << "[wigma-ws] Max peers/room: " << config.max_peers << std::endl;
-  std::cout << "[wigma-ws] Snapshot interval: " << config.snapshot_interval_ms << "ms" << std::endl;
+  LOG_INFO(Ws) << "Port: " << config.port;
+  LOG_INFO(Ws) << "TLS: "
+               << (config.tls_cert_file.empty() || config.tls_key_file.empty() ? std::string("disabled")
+                                                                               : config.tls_cert_file);
+  LOG_INFO(Ws) << "Max rooms: " << config.max_rooms;
+  LOG_INFO(Ws) << "Max peers/room: " << config.max_peers;
+  LOG_INFO(Ws) << "Persistence: " << config.persistence_backend;
+  LOG_INFO(Ws) << "Room memory budget: "
+               << (config.memory_budget_mb ? std::to_string(config.memory_budget_mb) + " MB, spill "
+                                             + (config.spill_file.empty() ? std::string("off") : config.spill_file)
+                                           : std::string("unlimited"));
+  LOG_INFO(Ws) << "WAL: " << (config.wal_dir.empty() ? "disabled" : config.wal_dir);
+  LOG_INFO(Ws) << "Hot restart: "
+               << (config.handoff_socket.empty() ? "disabled" : config.handoff_socket);
+  LOG_INFO(Ws) << "Tracing: "
+               << (config.trace_sample ? "1 in " + std::to_string(config.trace_sample) + " frames, SIGUSR1 writes "
+                                         + config.trace_file
+                                       : std::string("disabled"));
+  LOG_INFO(Ws) << "Traffic capture: "
+               << (config.capture_file.empty() ? std::string("disabled")
+                                               : config.capture_file + " (redact " + config.capture_redact + ")");
+  LOG_INFO(Ws) << "Overload lag thresholds (awareness/cold joins/joins): "
+               << config.overload_awareness_lag_ms << "/" << config.overload_defer_lag_ms << "/"
+               << config.overload_reject_lag_ms << " ms";
+  LOG_INFO(Ws) << "Cluster: "
+               << (config.cluster_node_id.empty() ? "disabled" : "node " + config.cluster_node_id);
 
   // Register signal handlers
   std::signal(SIGINT, signal_handler);
   std::signal(SIGTERM, signal_handler);
+  std::signal(SIGUSR1, trace_signal_handler);
 
   // Create and run server
   WsServer server(config);
   g_server = &server;
   server.run();
 
-  std::cout << "[wigma-ws] Server stopped." << std::endl;
+  LOG_INFO(Ws) << "Server stopped.";
   return 0;
 }
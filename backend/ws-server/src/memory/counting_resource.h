@@ -0,0 +1,47 @@
+#pragma once
+#include <memory_resource>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Memory resource that forwards to an upstream one and counts what goes
+ * through it. Placed under a pool or arena, it shows how much the pool
+ * actually holds from the heap, which is what /metrics reports.
+ *
+ * Not thread-safe; every pool it backs is used on the event loop only.
+ */
+class CountingResource : public std::pmr::memory_resource {
+public:
+  explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+    : upstream_(upstream) {}
+
+  CountingResource(const CountingResource&) = delete;
+  CountingResource& operator=(const CountingResource&) = delete;
+
+  /** Bytes currently held from upstream. */
+  size_t bytes() const { return bytes_; }
+
+  /** Upstream allocations made so far. */
+  uint64_t allocations() const { return allocations_; }
+
+private:
+  std::pmr::memory_resource* upstream_;
+  size_t   bytes_ = 0;
+  uint64_t allocations_ = 0;
+
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    void* p = upstream_->allocate(bytes, alignment);
+    bytes_ += bytes;
+    ++allocations_;
+    return p;
+  }
+
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    upstream_->deallocate(p, bytes, alignment);
+    bytes_ -= bytes;
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
@@ -0,0 +1,20 @@
+#include "frame_arena.h"
+#include <algorithm>
+
+FrameArena::FrameArena(size_t block_bytes, std::pmr::memory_resource* upstream)
+  : block_bytes_(std::max<size_t>(block_bytes, 1))
+  , block_(std::make_unique<std::byte[]>(block_bytes_))
+  , arena_(block_.get(), block_bytes_, upstream) {}
+
+void FrameArena::reset() {
+  if (used_ == 0) return;
+  arena_.release();   // Rewinds to the start of block_
+  used_ = 0;
+}
+
+void* FrameArena::do_allocate(size_t bytes, size_t alignment) {
+  void* p = arena_.allocate(bytes, alignment);
+  used_ += bytes;
+  high_water_ = std::max(high_water_, used_);
+  return p;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <memory_resource>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Bump allocator for scratch memory that lives for one event loop
+ * iteration: encoded frames on their way into a socket's send buffer,
+ * per-tick batches, lists built for a single reply.
+ *
+ * Allocation is a pointer bump in a block owned by the arena; requests
+ * that do not fit go to the upstream resource. reset(), called at the
+ * start of every loop iteration, drops everything at once and returns
+ * the overflow upstream, so a one-off large frame (a multi-megabyte
+ * initial sync) does not stay resident.
+ *
+ * Usable as a std::pmr resource for containers that do not outlive the
+ * iteration. Event loop thread only.
+ */
+class FrameArena : public std::pmr::memory_resource {
+public:
+  FrameArena(size_t block_bytes, std::pmr::memory_resource* upstream);
+
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  /** Release everything allocated since the last reset. */
+  void reset();
+
+  /** Bytes handed out since the last reset. */
+  size_t used() const { return used_; }
+
+  /** Most bytes handed out within one iteration. */
+  size_t high_water() const { return high_water_; }
+
+private:
+  size_t block_bytes_;
+  std::unique_ptr<std::byte[]> block_;
+  std::pmr::monotonic_buffer_resource arena_;
+  size_t used_ = 0;
+  size_t high_water_ = 0;
+
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void*, size_t, size_t) override {}   // Freed by reset()
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <memory_resource>
+#include <vector>
+#include <new>
+#include <utility>
+#include <cstddef>
+
+/**
+ * Fixed-size object pool for long-lived records created and destroyed at
+ * connection rate (rooms, remote peers).
+ *
+ * Objects are carved from chunks of chunk_objects slots taken from the
+ * upstream resource; a destroyed object's slot goes on a free list and
+ * is handed out again before any new chunk is allocated, most recently
+ * freed first (still warm in cache). Chunks are kept until the slab
+ * itself goes away, so churn never returns memory to the general heap
+ * in odd-sized pieces to fragment it.
+ *
+ * The slab does not track which slots are live: owners destroy their
+ * objects before the slab is destroyed. Not thread-safe.
+ */
+template <typename T>
+class Slab {
+public:
+  explicit Slab(size_t chunk_objects = 64,
+                std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+    : chunk_objects_(chunk_objects ? chunk_objects : 1), upstream_(upstream) {}
+
+  ~Slab() {
+    for (Node* chunk : chunks_) {
+      upstream_->deallocate(chunk, chunk_objects_ * sizeof(Node), alignof(Node));
+    }
+  }
+
+  Slab(const Slab&) = delete;
+  Slab& operator=(const Slab&) = delete;
+
+  /** Construct a T in a free slot; its constructor's exceptions propagate. */
+  template <typename... Args>
+  T* create(Args&&... args) {
+    if (!free_) grow();
+    Node* node = free_;
+    free_ = node->next;
+    try {
+      T* obj = ::new (static_cast<void*>(node->storage)) T(std::forward<Args>(args)...);
+      ++live_;
+      return obj;
+    } catch (...) {
+      node->next = free_;
+      free_ = node;
+      throw;
+    }
+  }
+
+  /** Destroy an object from create() and recycle its slot. */
+  void destroy(T* obj) {
+    if (!obj) return;
+    obj->~T();
+    auto* node = reinterpret_cast<Node*>(obj);
+    node->next = free_;
+    free_ = node;
+    --live_;
+  }
+
+  /** Live objects. */
+  size_t size() const { return live_; }
+
+  /** Slots allocated (live + free). */
+  size_t capacity() const { return chunks_.size() * chunk_objects_; }
+
+private:
+  union Node {
+    Node* next;
+    alignas(T) std::byte storage[sizeof(T)];
+  };
+
+  size_t chunk_objects_;
+  std::pmr::memory_resource* upstream_;
+  std::vector<Node*> chunks_;
+  Node*  free_ = nullptr;
+  size_t live_ = 0;
+
+  void grow() {
+    auto* chunk = static_cast<Node*>(upstream_->allocate(chunk_objects_ * sizeof(Node), alignof(Node)));
+    chunks_.push_back(chunk);
+    // Thread the new slots onto the free list, lowest address first out
+    for (size_t i = chunk_objects_; i > 0; --i) {
+      chunk[i - 1].next = free_;
+      free_ = &chunk[i - 1];
+    }
+  }
+};
@@ -0,0 +1,274 @@
+#include "blob_codec.h"
+#include <algorithm>
+#include <cstring>
+#include "log/logger.h"
+
+#ifdef WIGMA_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+// First four bytes of a zstd frame, and of the skippable frame used as
+// the batch marker (magic 0x184D2A57, size 4, payload "WUB1").
+constexpr uint8_t kZstdMagic[4]   = { 0x28, 0xB5, 0x2F, 0xFD };
+constexpr uint8_t kBatchMarker[12] = { 0x57, 0x2A, 0x4D, 0x18, 4, 0, 0, 0, 'W', 'U', 'B', '1' };
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+} // namespace
+
+// ── BlobCodec ────────────────────────────────────────────────────────────────
+
+void BlobCodec::append_hex(std::string& out, const uint8_t* data, size_t len) {
+  const size_t base = out.size();
+  out.resize(base + len * 2);
+  char* p = out.data() + base;
+  for (size_t i = 0; i < len; ++i) {
+    *p++ = kHexDigits[data[i] >> 4];
+    *p++ = kHexDigits[data[i] & 0x0F];
+  }
+}
+
+bool BlobCodec::split_batch(const std::vector<uint8_t>& body, std::vector<std::vector<uint8_t>>& out) {
+  size_t pos = 0;
+  while (pos < body.size()) {
+    if (body.size() - pos < 4) return false;
+    const uint32_t len = static_cast<uint32_t>(body[pos])
+                       | static_cast<uint32_t>(body[pos + 1]) << 8
+                       | static_cast<uint32_t>(body[pos + 2]) << 16
+                       | static_cast<uint32_t>(body[pos + 3]) << 24;
+    pos += 4;
+    if (body.size() - pos < len) return false;
+    out.emplace_back(body.begin() + static_cast<ptrdiff_t>(pos),
+                     body.begin() + static_cast<ptrdiff_t>(pos + len));
+    pos += len;
+  }
+  return true;
+}
+
+bool BlobCodec::compresses() {
+#ifdef WIGMA_HAVE_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+// ── BlobEncoder / BlobDecoder (shared by both builds) ────────────────────────
+
+void BlobEncoder::emit(const uint8_t* data, size_t len) {
+  if (output_ == Output::Hex) {
+    BlobCodec::append_hex(out_, data, len);
+  } else {
+    out_.append(reinterpret_cast<const char*>(data), len);
+  }
+}
+
+BlobDecoder::BlobDecoder(std::vector<uint8_t>& out, size_t max_size)
+  : out_(out), max_size_(max_size) {}
+
+bool BlobDecoder::write(const uint8_t* data, size_t len) {
+  if (state_ == State::Failed) return false;
+  if (len == 0) return true;
+
+  if (state_ == State::Header) {
+    size_t take = std::min(len, sizeof(header_) - header_len_);
+    std::memcpy(header_ + header_len_, data, take);
+    header_len_ = static_cast<uint8_t>(header_len_ + take);
+    data += take;
+    len  -= take;
+    if (header_len_ < sizeof(header_)) return true;
+
+    batched_ = std::memcmp(header_, kBatchMarker, 4) == 0;
+    state_   = batched_ || std::memcmp(header_, kZstdMagic, 4) == 0 ? State::Compressed : State::Raw;
+    if (!route(header_, sizeof(header_))) return false;
+  }
+
+  return route(data, len);
+}
+
+bool BlobDecoder::write_hex(std::string_view text) {
+  if (text.size() < 2 || text[0] != '\\' || text[1] != 'x') {
+    // Not a hex literal: take the text as the bytes themselves
+    return write(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+  }
+  text.remove_prefix(2);
+  if (text.size() % 2 != 0) {
+    state_ = State::Failed;
+    return false;
+  }
+
+  uint8_t chunk[4096];
+  while (!text.empty()) {
+    size_t n = std::min(sizeof(chunk), text.size() / 2);
+    for (size_t i = 0; i < n; ++i) {
+      int hi = hex_value(text[2 * i]);
+      int lo = hex_value(text[2 * i + 1]);
+      if (hi < 0 || lo < 0) {
+        state_ = State::Failed;
+        return false;
+      }
+      chunk[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    if (!write(chunk, n)) return false;
+    text.remove_prefix(n * 2);
+  }
+  return true;
+}
+
+bool BlobDecoder::route(const uint8_t* data, size_t len) {
+  if (len == 0) return true;
+
+  if (state_ == State::Raw) {
+    if (out_.size() + len > max_size_) {
+      state_ = State::Failed;
+      return false;
+    }
+    out_.insert(out_.end(), data, data + len);
+    return true;
+  }
+
+  if (!inflate(data, len)) {
+    state_ = State::Failed;
+    return false;
+  }
+  return true;
+}
+
+bool BlobDecoder::finish() {
+  switch (state_) {
+    case State::Header:
+      // Shorter than a magic number: necessarily raw
+      state_ = State::Raw;
+      return route(header_, header_len_);
+    case State::Raw:        return true;
+    case State::Compressed: return !frame_open_;
+    case State::Failed:     return false;
+  }
+  return false;
+}
+
+#ifdef WIGMA_HAVE_ZSTD
+
+// ── BlobEncoder ──────────────────────────────────────────────────────────────
+
+BlobEncoder::BlobEncoder(std::string& out, bool batch, Output output, int level)
+  : out_(out), output_(output), window_(ZSTD_CStreamOutSize()) {
+  if (output_ == Output::Hex) out_ += "\\\\x";
+  if (batch) emit(kBatchMarker, sizeof(kBatchMarker));
+
+  auto* cctx = ZSTD_createCCtx();
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+  cctx_ = cctx;
+}
+
+BlobEncoder::~BlobEncoder() {
+  ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(cctx_));
+}
+
+bool BlobEncoder::write(const uint8_t* data, size_t len) {
+  return flush(ZSTD_e_continue, data, len);
+}
+
+bool BlobEncoder::write_update(const uint8_t* data, size_t len) {
+  const uint32_t n = static_cast<uint32_t>(len);
+  const uint8_t prefix[4] = {
+    static_cast<uint8_t>(n), static_cast<uint8_t>(n >> 8),
+    static_cast<uint8_t>(n >> 16), static_cast<uint8_t>(n >> 24)
+  };
+  return flush(ZSTD_e_continue, prefix, sizeof(prefix)) && flush(ZSTD_e_continue, data, len);
+}
+
+bool BlobEncoder::finish() {
+  return flush(ZSTD_e_end, nullptr, 0);
+}
+
+bool BlobEncoder::flush(int mode, const uint8_t* data, size_t len) {
+  if (!cctx_) return false;
+
+  const auto directive = static_cast<ZSTD_EndDirective>(mode);
+  ZSTD_inBuffer in { data, len, 0 };
+  for (;;) {
+    ZSTD_outBuffer window { window_.data(), window_.size(), 0 };
+    size_t remaining = ZSTD_compressStream2(static_cast<ZSTD_CCtx*>(cctx_), &window, &in, directive);
+    if (ZSTD_isError(remaining)) {
+      LOG_ERROR(Zstd) << "blob compression failed: " << ZSTD_getErrorName(remaining);
+      return false;
+    }
+    emit(window_.data(), window.pos);
+
+    const bool done = directive == ZSTD_e_end ? remaining == 0 : in.pos == in.size;
+    if (done) return true;
+  }
+}
+
+// ── BlobDecoder ──────────────────────────────────────────────────────────────
+
+BlobDecoder::~BlobDecoder() {
+  ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(dctx_));
+}
+
+bool BlobDecoder::inflate(const uint8_t* data, size_t len) {
+  if (!dctx_) dctx_ = ZSTD_createDCtx();
+  if (!dctx_) return false;
+
+  const size_t step = ZSTD_DStreamOutSize();
+  ZSTD_inBuffer in { data, len, 0 };
+  while (in.pos < in.size || frame_open_) {
+    const size_t base = out_.size();
+    if (base > max_size_) return false;
+    out_.resize(base + step);
+
+    ZSTD_outBuffer window { out_.data() + base, step, 0 };
+    size_t hint = ZSTD_decompressStream(static_cast<ZSTD_DCtx*>(dctx_), &window, &in);
+    out_.resize(base + window.pos);
+    if (ZSTD_isError(hint)) {
+      LOG_ERROR(Zstd) << "blob decompression failed: " << ZSTD_getErrorName(hint);
+      return false;
+    }
+    if (out_.size() > max_size_) return false;
+
+    frame_open_ = hint != 0;
+    // Input exhausted and the window wasn't filled: wait for more input
+    if (in.pos == in.size && window.pos < step) break;
+  }
+  return true;
+}
+
+#else  // !WIGMA_HAVE_ZSTD
+
+BlobEncoder::BlobEncoder(std::string& out, bool batch, Output output, int /*level*/)
+  : out_(out), output_(output) {
+  if (output_ == Output::Hex) out_ += "\\\\x";
+  if (batch) emit(kBatchMarker, sizeof(kBatchMarker));
+}
+
+BlobEncoder::~BlobEncoder() = default;
+
+bool BlobEncoder::write(const uint8_t* data, size_t len) {
+  emit(data, len);
+  return true;
+}
+
+// Batches are only written compressed; callers check BlobCodec::compresses().
+bool BlobEncoder::write_update(const uint8_t*, size_t) { return false; }
+bool BlobEncoder::finish() { return true; }
+bool BlobEncoder::flush(int, const uint8_t*, size_t) { return false; }
+
+BlobDecoder::~BlobDecoder() = default;
+
+bool BlobDecoder::inflate(const uint8_t*, size_t) {
+  LOG_ERROR(Zstd) << "built without zstd support, cannot read compressed blob";
+  return false;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Storage codec for bytea columns (yjs_snapshots.snapshot, yjs_updates.data).
+ *
+ * On the wire to PostgREST a blob is a Postgres hex literal (`\x0a1b…`)
+ * inside a JSON string — binary-safe, and at most 2× the stored size
+ * instead of the unbounded escaping of raw bytes in JSON.
+ *
+ * Stored blobs come in three shapes, told apart by their first four bytes:
+ *   - a zstd frame                       → compressed snapshot / update
+ *   - a batch marker + zstd frame        → several updates, each framed
+ *                                          as [u32 len LE][bytes]
+ *   - anything else                      → legacy uncompressed bytes
+ *
+ * The batch marker is a zstd skippable frame, so any zstd decoder still
+ * reads the stored blob as a plain compressed stream.
+ *
+ * Encoder and decoder both stream through a fixed-size window so that a
+ * multi-MB snapshot is only ever held once on each side of the codec.
+ * Built without zstd (WIGMA_HAVE_ZSTD undefined), blobs are written as
+ * uncompressed hex and compressed blobs cannot be read back.
+ */
+namespace BlobCodec {
+
+/** Upper bound on a decoded blob; guards against decompression bombs. */
+constexpr size_t kMaxBlobSize = 256 * 1024 * 1024;
+
+constexpr int kDefaultLevel = 3;
+
+/** False when built without zstd: blobs are stored uncompressed. */
+bool compresses();
+
+/** Append len bytes as lowercase hex digits. */
+void append_hex(std::string& out, const uint8_t* data, size_t len);
+
+/** Split a decoded batch body back into individual updates. */
+bool split_batch(const std::vector<uint8_t>& body, std::vector<std::vector<uint8_t>>& out);
+
+} // namespace BlobCodec
+
+/**
+ * Streaming compressor that appends a blob to out: as a bytea hex literal
+ * for a JSON body under construction (the caller closes the surrounding
+ * JSON string), or as raw bytes for a binary query parameter. write() the
+ * blob in as many pieces as convenient, then finish().
+ */
+class BlobEncoder {
+public:
+  enum class Output : uint8_t { Hex, Binary };
+
+  /** batch: prefix the batch marker; use write_update() for the contents. */
+  explicit BlobEncoder(std::string& out, bool batch = false, Output output = Output::Hex,
+                       int level = BlobCodec::kDefaultLevel);
+  ~BlobEncoder();
+
+  BlobEncoder(const BlobEncoder&) = delete;
+  BlobEncoder& operator=(const BlobEncoder&) = delete;
+
+  bool write(const uint8_t* data, size_t len);
+
+  /** Append one length-prefixed update to a batch. */
+  bool write_update(const uint8_t* data, size_t len);
+
+  bool finish();
+
+private:
+  bool flush(int mode, const uint8_t* data, size_t len);
+  void emit(const uint8_t* data, size_t len);
+
+  std::string&         out_;
+  Output               output_;
+  std::vector<uint8_t> window_;
+  void*                cctx_ = nullptr;   // ZSTD_CCtx
+};
+
+/**
+ * Streaming decompressor fed with stored bytes in arbitrary chunks (raw
+ * from an octet-stream response, or via write_hex() from a JSON field).
+ * Output is appended to the caller's vector.
+ */
+class BlobDecoder {
+public:
+  explicit BlobDecoder(std::vector<uint8_t>& out, size_t max_size = BlobCodec::kMaxBlobSize);
+  ~BlobDecoder();
+
+  BlobDecoder(const BlobDecoder&) = delete;
+  BlobDecoder& operator=(const BlobDecoder&) = delete;
+
+  bool write(const uint8_t* data, size_t len);
+
+  /** Feed a bytea hex literal as returned by PostgREST (`\x…`). */
+  bool write_hex(std::string_view text);
+
+  /** False if the stream was corrupt, truncated or over max_size. */
+  bool finish();
+
+  /** True once any input has been seen. */
+  bool started() const { return state_ != State::Header || header_len_ > 0; }
+
+  /** True if the blob carried the batch marker (see split_batch()). */
+  bool batched() const { return batched_; }
+
+private:
+  enum class State : uint8_t { Header, Raw, Compressed, Failed };
+
+  bool route(const uint8_t* data, size_t len);
+  bool inflate(const uint8_t* data, size_t len);
+
+  std::vector<uint8_t>& out_;
+  size_t                max_size_;
+  State                 state_ = State::Header;
+  bool                  batched_ = false;
+  uint8_t               header_[4];
+  uint8_t               header_len_ = 0;
+  void*                 dctx_ = nullptr;   // ZSTD_DCtx
+  bool                  frame_open_ = false;
+};
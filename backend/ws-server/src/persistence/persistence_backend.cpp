@@ -0,0 +1,38 @@
+#include "persistence_backend.h"
+#include "supabase_client.h"
+#include "sqlite_backend.h"
+#include "config.h"
+#include <stdexcept>
+
+#ifdef WIGMA_HAVE_LIBPQ
+#include "pg_backend.h"
+#endif
+
+ProjectRole parse_project_role(std::string_view role) {
+  if (role == "owner" || role == "editor") return ProjectRole::Editor;
+  if (role == "viewer") return ProjectRole::Viewer;
+  return ProjectRole::None;
+}
+
+std::unique_ptr<PersistenceBackend> PersistenceBackend::create(const Config& config) {
+  if (config.persistence_backend == "supabase") {
+    return std::make_unique<SupabaseClient>(config.supabase_url, config.supabase_service_key);
+  }
+
+  if (config.persistence_backend == "postgres") {
+#ifdef WIGMA_HAVE_LIBPQ
+    if (config.database_url.empty()) {
+      throw std::runtime_error("PERSISTENCE_BACKEND=postgres requires DATABASE_URL");
+    }
+    return std::make_unique<PgBackend>(config.database_url, config.pg_pool_size);
+#else
+    throw std::runtime_error("PERSISTENCE_BACKEND=postgres: built without libpq (WIGMA_WITH_LIBPQ=OFF)");
+#endif
+  }
+
+  if (config.persistence_backend == "sqlite") {
+    return std::make_unique<SqliteBackend>(config.sqlite_path);
+  }
+
+  throw std::runtime_error("Unknown PERSISTENCE_BACKEND: " + config.persistence_backend);
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <cstdint>
+#include <limits>
+
+struct Config;
+
+/** What a user may do in a project's room. */
+enum class ProjectRole : uint8_t {
+  None,     // No access
+  Viewer,   // project_users.role = 'viewer': read-only spectator
+  Editor,   // 'editor' or 'owner'
+};
+
+/** Map a project_users.role value; unknown roles get no access. */
+ProjectRole parse_project_role(std::string_view role);
+
+/**
+ * Storage for Yjs state and project membership.
+ *
+ * Implementations:
+ *   - SupabaseClient   PostgREST over HTTPS (default)
+ *   - PgBackend        libpq straight to Postgres (PERSISTENCE_BACKEND=postgres)
+ *   - SqliteBackend    embedded single-file store (PERSISTENCE_BACKEND=sqlite)
+ *
+ * Updates are ordered by a per-backend increasing row id; readers get the
+ * highest id they saw so compaction only drops what the snapshot covers.
+ *
+ * Blobs are handed over uncompressed; each backend owns its storage
+ * encoding (see BlobCodec) and reads back anything another backend wrote
+ * to the same tables.
+ *
+ * An instance is used from one thread at a time unless the implementation
+ * says otherwise; the server gives the WAL replay thread its own instance.
+ */
+class PersistenceBackend {
+public:
+  struct UpdateRow {
+    std::string_view project_id;
+    const uint8_t*   data;
+    size_t           len;
+  };
+
+  virtual ~PersistenceBackend() = default;
+
+  /** Backend selected by config.persistence_backend. Throws on bad config. */
+  static std::unique_ptr<PersistenceBackend> create(const Config& config);
+
+  /** Fetch the latest Yjs snapshot for a project. */
+  virtual std::optional<std::vector<uint8_t>> get_snapshot(std::string_view project_id) = 0;
+
+  /** Upsert (insert or update) a Yjs snapshot. */
+  virtual bool upsert_snapshot(std::string_view project_id, const uint8_t* data, size_t len) = 0;
+
+  /**
+   * Append the updates with id > after_id to out, oldest first. Returns
+   * the highest id read (after_id if there were none), or -1 on failure.
+   */
+  virtual int64_t get_updates(std::string_view project_id, int64_t after_id,
+                              std::vector<std::vector<uint8_t>>& out) = 0;
+
+  /** Append a Yjs incremental update. */
+  virtual bool append_update(std::string_view project_id, const uint8_t* data, size_t len) = 0;
+
+  /**
+   * Append a batch of Yjs updates replayed from a write-ahead log, all or
+   * nothing, tagged with the log's id and the position replay reached.
+   */
+  virtual bool append_updates(const std::vector<UpdateRow>& rows,
+                              std::string_view wal_id, int64_t wal_pos) = 0;
+
+  /**
+   * Highest position stored by append_updates for a log (0 if none), or
+   * -1 on failure. Replay skips records up to it.
+   */
+  virtual int64_t replayed_through(std::string_view wal_id) = 0;
+
+  /** Delete the updates with id <= through_id. */
+  virtual bool truncate_updates(std::string_view project_id, int64_t through_id) = 0;
+
+  /** Delete all updates for a project. */
+  bool clear_updates(std::string_view project_id) {
+    return truncate_updates(project_id, std::numeric_limits<int64_t>::max());
+  }
+
+  /**
+   * Write a compacted snapshot and drop the updates (id <= through_id) it
+   * covers. The default issues the two calls back to back; backends with
+   * transactions override.
+   */
+  virtual bool compact(std::string_view project_id, const uint8_t* data, size_t len, int64_t through_id) {
+    return upsert_snapshot(project_id, data, len) && truncate_updates(project_id, through_id);
+  }
+
+  /**
+   * Look up a user's role in a project. Adds the user as an editor when
+   * they are not a member and the project has link sharing enabled.
+   */
+  virtual ProjectRole check_project_access(std::string_view project_id, std::string_view user_id) = 0;
+};
@@ -0,0 +1,576 @@
+#include "pg_backend.h"
+#include "blob_codec.h"
+#include <poll.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include "log/logger.h"
+
+namespace {
+
+using Result = std::unique_ptr<PGresult, decltype(&PQclear)>;
+
+constexpr int kIoTimeoutMs = 10000;  // Same bound as the PostgREST client
+
+// Parameter types, pinned at prepare time
+constexpr Oid kUuidOid  = 2950;
+constexpr Oid kByteaOid = 17;
+constexpr Oid kInt8Oid  = 20;
+constexpr Oid kTextOid  = 25;
+
+struct Statement {
+  const char* name;
+  const char* sql;
+  int         n_params;
+  Oid         types[3];
+};
+
+constexpr Statement kStatements[] = {
+  { "get_snapshot",
+    "SELECT snapshot FROM yjs_snapshots WHERE project_id = $1",
+    1, { kUuidOid } },
+  { "upsert_snapshot",
+    "INSERT INTO yjs_snapshots (project_id, snapshot, updated_at) VALUES ($1, $2, now()) "
+    "ON CONFLICT (project_id) DO UPDATE SET snapshot = EXCLUDED.snapshot, updated_at = now()",
+    2, { kUuidOid, kByteaOid } },
+  { "get_updates",
+    "SELECT id, data FROM yjs_updates WHERE project_id = $1 AND id > $2 ORDER BY id",
+    2, { kUuidOid, kInt8Oid } },
+  { "append_update",
+    "INSERT INTO yjs_updates (project_id, data) VALUES ($1, $2)",
+    2, { kUuidOid, kByteaOid } },
+  { "replayed_through",
+    "SELECT coalesce(max(wal_pos), 0) FROM yjs_updates WHERE wal_id = $1",
+    1, { kTextOid } },
+  { "truncate_updates",
+    "DELETE FROM yjs_updates WHERE project_id = $1 AND id <= $2",
+    2, { kUuidOid, kInt8Oid } },
+  { "is_member",
+    "SELECT role::text FROM project_users WHERE project_id = $1 AND user_id = $2",
+    2, { kUuidOid, kUuidOid } },
+  { "is_link_shared",
+    "SELECT 1 FROM projects WHERE id = $1 AND link_sharing",
+    1, { kUuidOid } },
+  { "add_editor",
+    "INSERT INTO project_users (project_id, user_id, role) VALUES ($1, $2, 'editor') "
+    "ON CONFLICT DO NOTHING",
+    2, { kUuidOid, kUuidOid } },
+};
+
+/** Wait until the connection's socket is ready for events. */
+bool wait_socket(PGconn* conn, short events) {
+  pollfd pfd { PQsocket(conn), events, 0 };
+  int n;
+  do {
+    n = ::poll(&pfd, 1, kIoTimeoutMs);
+  } while (n < 0 && errno == EINTR);
+  return n > 0;
+}
+
+/** Push everything queued in libpq's output buffer to the server. */
+bool flush(PGconn* conn) {
+  for (;;) {
+    int r = PQflush(conn);
+    if (r == 0) return true;
+    if (r < 0 || !wait_socket(conn, POLLOUT | POLLIN)) return false;
+    // The server may be blocked writing to us; read to unblock it
+    if (!PQconsumeInput(conn)) return false;
+  }
+}
+
+/** Next result, blocking on the socket (not in libpq) until it is complete. */
+Result next_result(PGconn* conn, bool& failed) {
+  while (PQisBusy(conn)) {
+    if (!wait_socket(conn, POLLIN) || !PQconsumeInput(conn)) {
+      failed = true;
+      return { nullptr, &PQclear };
+    }
+  }
+  return { PQgetResult(conn), &PQclear };
+}
+
+/**
+ * Prepared statements queued in pipeline mode and flushed with a single
+ * sync; run() returns one result per statement, in order.
+ */
+class Pipeline {
+public:
+  explicit Pipeline(PGconn* conn) : conn_(conn), ok_(PQenterPipelineMode(conn) == 1) {}
+
+  void send(const char* stmt, int n_params, const char* const* values,
+            const int* lengths = nullptr, const int* formats = nullptr) {
+    ok_ = ok_ && PQsendQueryPrepared(conn_, stmt, n_params, values, lengths, formats,
+                                     /*resultFormat=*/1) == 1;
+    ++queued_;
+  }
+
+  /** Empty on transport failure; the connection should then be discarded. */
+  std::vector<Result> run() {
+    std::vector<Result> results;
+    if (!ok_ || PQpipelineSync(conn_) != 1 || !flush(conn_)) return results;
+
+    bool failed = false;
+    for (int i = 0; i < queued_; ++i) {
+      results.push_back(next_result(conn_, failed));
+      // Each statement's results end with a null
+      while (!failed && next_result(conn_, failed)) {}
+      if (failed || !results.back()) return {};
+    }
+
+    Result sync = next_result(conn_, failed);
+    if (failed || !sync || PQresultStatus(sync.get()) != PGRES_PIPELINE_SYNC) return {};
+    if (PQexitPipelineMode(conn_) != 1) return {};
+    return results;
+  }
+
+private:
+  PGconn* conn_;
+  bool    ok_;
+  int     queued_ = 0;
+};
+
+bool succeeded(const Result& res) {
+  auto status = PQresultStatus(res.get());
+  return status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK;
+}
+
+void log_error(const char* what, PGconn* conn, const std::vector<Result>& results) {
+  for (auto& res : results) {
+    if (!succeeded(res) && PQresultStatus(res.get()) != PGRES_PIPELINE_ABORTED) {
+      LOG_SAMPLED(Pg, Error, 5) << what << " failed: " << PQresultErrorMessage(res.get());
+      return;
+    }
+  }
+  LOG_SAMPLED(Pg, Error, 5) << what << " failed: " << PQerrorMessage(conn);
+}
+
+/** Decode a stored blob (binary result cell) into out. */
+bool decode_cell(const PGresult* res, int row, int col, std::vector<uint8_t>& blob, bool& batched) {
+  BlobDecoder decoder(blob);
+  auto* data = reinterpret_cast<const uint8_t*>(PQgetvalue(res, row, col));
+  if (!decoder.write(data, static_cast<size_t>(PQgetlength(res, row, col))) || !decoder.finish()) {
+    return false;
+  }
+  batched = decoder.batched();
+  return true;
+}
+
+/** Binary-format int8 result cell. */
+int64_t int8_cell(const PGresult* res, int row, int col) {
+  auto* p = reinterpret_cast<const uint8_t*>(PQgetvalue(res, row, col));
+  uint64_t v = 0;
+  for (int i = 0; i < 8; ++i) v = v << 8 | p[i];
+  return static_cast<int64_t>(v);
+}
+
+/** Canonical text UUID → 16 bytes, for binary COPY. */
+bool parse_uuid(std::string_view text, uint8_t out[16]) {
+  int n = 0;
+  int hi = -1;
+  for (char c : text) {
+    if (c == '-') continue;
+    int v;
+    if (c >= '0' && c <= '9')      v = c - '0';
+    else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+    else return false;
+
+    if (hi < 0) {
+      hi = v;
+    } else {
+      if (n == 16) return false;
+      out[n++] = static_cast<uint8_t>(hi << 4 | v);
+      hi = -1;
+    }
+  }
+  return n == 16 && hi < 0;
+}
+
+void put_be16(std::string& out, uint16_t v) {
+  out += static_cast<char>(v >> 8);
+  out += static_cast<char>(v);
+}
+
+void put_be32(std::string& out, uint32_t v) {
+  out += static_cast<char>(v >> 24);
+  out += static_cast<char>(v >> 16);
+  out += static_cast<char>(v >> 8);
+  out += static_cast<char>(v);
+}
+
+void put_be64(std::string& out, uint64_t v) {
+  put_be32(out, static_cast<uint32_t>(v >> 32));
+  put_be32(out, static_cast<uint32_t>(v));
+}
+
+/** Queue COPY data, waiting for socket space whenever libpq's buffer is full. */
+bool put_copy_data(PGconn* conn, const std::string& data) {
+  for (;;) {
+    int r = PQputCopyData(conn, data.data(), static_cast<int>(data.size()));
+    if (r == 1) return true;
+    if (r < 0 || !wait_socket(conn, POLLOUT) || !flush(conn)) return false;
+  }
+}
+
+} // namespace
+
+// ── Lifecycle / pool ─────────────────────────────────────────────────────────
+
+PgBackend::PgBackend(std::string conninfo, uint32_t pool_size)
+  : conninfo_(std::move(conninfo)), pool_size_(pool_size ? pool_size : 1) {
+  PGconn* conn = connect();
+  if (!conn) {
+    throw std::runtime_error("PgBackend: cannot connect to Postgres");
+  }
+  idle_.push_back(conn);
+  open_ = 1;
+}
+
+PgBackend::~PgBackend() {
+  for (PGconn* conn : idle_) PQfinish(conn);
+}
+
+PGconn* PgBackend::connect() {
+  PGconn* conn = PQconnectdb(conninfo_.c_str());
+  if (PQstatus(conn) != CONNECTION_OK) {
+    LOG_ERROR(Pg) << "connect failed: " << PQerrorMessage(conn);
+    PQfinish(conn);
+    return nullptr;
+  }
+
+  for (auto& stmt : kStatements) {
+    Result res(PQprepare(conn, stmt.name, stmt.sql, stmt.n_params, stmt.types), &PQclear);
+    if (PQresultStatus(res.get()) != PGRES_COMMAND_OK) {
+      LOG_ERROR(Pg) << "prepare " << stmt.name << " failed: "
+                    << PQresultErrorMessage(res.get());
+      PQfinish(conn);
+      return nullptr;
+    }
+  }
+
+  PQsetnonblocking(conn, 1);
+  return conn;
+}
+
+PGconn* PgBackend::acquire() {
+  std::unique_lock lock(mutex_);
+  available_.wait(lock, [this] { return !idle_.empty() || open_ < pool_size_; });
+
+  if (!idle_.empty()) {
+    PGconn* conn = idle_.back();
+    idle_.pop_back();
+    return conn;
+  }
+
+  ++open_;
+  lock.unlock();
+  PGconn* conn = connect();
+  if (!conn) {
+    lock.lock();
+    --open_;
+    available_.notify_one();
+  }
+  return conn;
+}
+
+void PgBackend::release(PGconn* conn, bool healthy) {
+  if (!healthy || PQstatus(conn) != CONNECTION_OK) {
+    PQfinish(conn);
+    std::lock_guard lock(mutex_);
+    --open_;
+  } else {
+    std::lock_guard lock(mutex_);
+    idle_.push_back(conn);
+  }
+  available_.notify_one();
+}
+
+// ── Yjs Persistence ──────────────────────────────────────────────────────────
+
+std::optional<std::vector<uint8_t>> PgBackend::get_snapshot(std::string_view project_id) {
+  Lease conn(*this);
+  if (!conn) return std::nullopt;
+
+  std::string id(project_id);
+  const char* values[] = { id.c_str() };
+
+  Pipeline pipeline(conn.get());
+  pipeline.send("get_snapshot", 1, values);
+  auto results = pipeline.run();
+  if (results.empty() || !succeeded(results[0])) {
+    if (results.empty()) conn.discard();
+    log_error("get_snapshot", conn.get(), results);
+    return std::nullopt;
+  }
+
+  const PGresult* res = results[0].get();
+  if (PQntuples(res) == 0) return std::nullopt;
+
+  std::vector<uint8_t> snapshot;
+  bool batched = false;
+  if (!decode_cell(res, 0, 0, snapshot, batched)) {
+    LOG_ERROR(Pg) << "corrupt snapshot for project " << project_id;
+    return std::nullopt;
+  }
+  return snapshot;
+}
+
+bool PgBackend::upsert_snapshot(std::string_view project_id, const uint8_t* data, size_t len) {
+  std::string blob;
+  BlobEncoder encoder(blob, /*batch=*/false, BlobEncoder::Output::Binary);
+  if (!encoder.write(data, len) || !encoder.finish()) return false;
+
+  Lease conn(*this);
+  if (!conn) return false;
+
+  std::string id(project_id);
+  const char* values[]  = { id.c_str(), blob.data() };
+  const int   lengths[] = { 0, static_cast<int>(blob.size()) };
+  const int   formats[] = { 0, 1 };
+
+  Pipeline pipeline(conn.get());
+  pipeline.send("upsert_snapshot", 2, values, lengths, formats);
+  auto results = pipeline.run();
+  if (results.empty()) conn.discard();
+  if (results.empty() || !succeeded(results[0])) {
+    log_error("upsert_snapshot", conn.get(), results);
+    return false;
+  }
+  return true;
+}
+
+int64_t PgBackend::get_updates(std::string_view project_id, int64_t after_id,
+                               std::vector<std::vector<uint8_t>>& out) {
+  Lease conn(*this);
+  if (!conn) return -1;
+
+  std::string id(project_id);
+  std::string after = std::to_string(after_id);
+  const char* values[] = { id.c_str(), after.c_str() };
+
+  Pipeline pipeline(conn.get());
+  pipeline.send("get_updates", 2, values);
+  auto results = pipeline.run();
+  if (results.empty()) conn.discard();
+  if (results.empty() || !succeeded(results[0])) {
+    log_error("get_updates", conn.get(), results);
+    return -1;
+  }
+
+  const PGresult* res = results[0].get();
+  const int rows = PQntuples(res);
+  int64_t last_id = after_id;
+  out.reserve(out.size() + static_cast<size_t>(rows));
+  for (int row = 0; row < rows; ++row) {
+    last_id = int8_cell(res, row, 0);
+
+    std::vector<uint8_t> blob;
+    bool batched = false;
+    if (!decode_cell(res, row, 1, blob, batched)) {
+      LOG_ERROR(Pg) << "skipping corrupt update for project " << project_id;
+    } else if (!batched) {
+      out.push_back(std::move(blob));
+    } else if (!BlobCodec::split_batch(blob, out)) {
+      LOG_ERROR(Pg) << "truncated update batch for project " << project_id;
+    }
+  }
+  return last_id;
+}
+
+bool PgBackend::append_update(std::string_view project_id, const uint8_t* data, size_t len) {
+  Lease conn(*this);
+  if (!conn) return false;
+
+  std::string id(project_id);
+  const char* values[]  = { id.c_str(), reinterpret_cast<const char*>(data) };
+  const int   lengths[] = { 0, static_cast<int>(len) };
+  const int   formats[] = { 0, 1 };
+
+  Pipeline pipeline(conn.get());
+  pipeline.send("append_update", 2, values, lengths, formats);
+  auto results = pipeline.run();
+  if (results.empty()) conn.discard();
+  if (results.empty() || !succeeded(results[0])) {
+    log_error("append_update", conn.get(), results);
+    return false;
+  }
+  return true;
+}
+
+bool PgBackend::append_updates(const std::vector<UpdateRow>& rows,
+                               std::string_view wal_id, int64_t wal_pos) {
+  if (rows.empty()) return true;
+
+  // Binary COPY stream: signature, flags, header extension, then tuples of
+  // (int16 field count, [int32 length, bytes] per field), then -1.
+  static constexpr char kSignature[] = "PGCOPY\n\377\r\n";
+  std::string buf(kSignature, sizeof(kSignature));
+  put_be32(buf, 0);
+  put_be32(buf, 0);
+
+  for (auto& row : rows) {
+    uint8_t uuid[16];
+    if (!parse_uuid(row.project_id, uuid)) {
+      LOG_ERROR(Pg) << "invalid project id " << row.project_id << ", dropping update";
+      continue;
+    }
+    put_be16(buf, 4);
+    put_be32(buf, 16);
+    buf.append(reinterpret_cast<const char*>(uuid), 16);
+    put_be32(buf, static_cast<uint32_t>(row.len));
+    buf.append(reinterpret_cast<const char*>(row.data), row.len);
+    put_be32(buf, static_cast<uint32_t>(wal_id.size()));
+    buf.append(wal_id);
+    put_be32(buf, 8);
+    put_be64(buf, static_cast<uint64_t>(wal_pos));
+  }
+  put_be16(buf, 0xFFFF);
+
+  Lease conn(*this);
+  if (!conn) return false;
+  PGconn* pg = conn.get();
+
+  // COPY is not allowed in pipeline mode; connections idle outside it.
+  // One statement, so the batch and its log position land together.
+  if (!PQsendQuery(pg, "COPY yjs_updates (project_id, data, wal_id, wal_pos) FROM STDIN (FORMAT binary)")
+      || !flush(pg)) {
+    conn.discard();
+    LOG_ERROR(Pg) << "COPY failed: " << PQerrorMessage(pg);
+    return false;
+  }
+
+  bool failed = false;
+  Result start = next_result(pg, failed);
+  if (failed || PQresultStatus(start.get()) != PGRES_COPY_IN) {
+    if (failed) conn.discard();
+    LOG_ERROR(Pg) << "COPY failed: " << PQerrorMessage(pg);
+    while (!failed && next_result(pg, failed)) {}
+    return false;
+  }
+
+  bool sent = put_copy_data(pg, buf);
+  while (sent) {
+    int r = PQputCopyEnd(pg, nullptr);
+    if (r == 1) break;
+    if (r < 0 || !wait_socket(pg, POLLOUT) || !flush(pg)) sent = false;
+  }
+  if (!sent || !flush(pg)) {
+    conn.discard();
+    LOG_ERROR(Pg) << "COPY failed: " << PQerrorMessage(pg);
+    return false;
+  }
+
+  Result done = next_result(pg, failed);
+  bool ok = !failed && PQresultStatus(done.get()) == PGRES_COMMAND_OK;
+  if (!ok) {
+    LOG_ERROR(Pg) << "COPY failed: " << PQerrorMessage(pg);
+  }
+  while (!failed && next_result(pg, failed)) {}
+  if (failed) conn.discard();
+  return ok;
+}
+
+int64_t PgBackend::replayed_through(std::string_view wal_id) {
+  Lease conn(*this);
+  if (!conn) return -1;
+
+  std::string id(wal_id);
+  const char* values[] = { id.c_str() };
+
+  Pipeline pipeline(conn.get());
+  pipeline.send("replayed_through", 1, values);
+  auto results = pipeline.run();
+  if (results.empty()) conn.discard();
+  if (results.empty() || !succeeded(results[0]) || PQntuples(results[0].get()) != 1) {
+    log_error("replayed_through", conn.get(), results);
+    return -1;
+  }
+  return int8_cell(results[0].get(), 0, 0);
+}
+
+bool PgBackend::truncate_updates(std::string_view project_id, int64_t through_id) {
+  Lease conn(*this);
+  if (!conn) return false;
+
+  std::string id(project_id);
+  std::string through = std::to_string(through_id);
+  const char* values[] = { id.c_str(), through.c_str() };
+
+  Pipeline pipeline(conn.get());
+  pipeline.send("truncate_updates", 2, values);
+  auto results = pipeline.run();
+  if (results.empty()) conn.discard();
+  if (results.empty() || !succeeded(results[0])) {
+    log_error("truncate_updates", conn.get(), results);
+    return false;
+  }
+  return true;
+}
+
+bool PgBackend::compact(std::string_view project_id, const uint8_t* data, size_t len, int64_t through_id) {
+  std::string blob;
+  BlobEncoder encoder(blob, /*batch=*/false, BlobEncoder::Output::Binary);
+  if (!encoder.write(data, len) || !encoder.finish()) return false;
+
+  Lease conn(*this);
+  if (!conn) return false;
+
+  std::string id(project_id);
+  std::string through = std::to_string(through_id);
+  const char* values[]  = { id.c_str(), blob.data() };
+  const int   lengths[] = { 0, static_cast<int>(blob.size()) };
+  const int   formats[] = { 0, 1 };
+  const char* truncate_values[] = { id.c_str(), through.c_str() };
+
+  // Both statements before one sync: a single implicit transaction
+  Pipeline pipeline(conn.get());
+  pipeline.send("upsert_snapshot", 2, values, lengths, formats);
+  pipeline.send("truncate_updates", 2, truncate_values);
+  auto results = pipeline.run();
+  if (results.empty()) conn.discard();
+  if (results.empty() || !succeeded(results[0]) || !succeeded(results[1])) {
+    log_error("compact", conn.get(), results);
+    return false;
+  }
+  return true;
+}
+
+// ── Auth Helpers ─────────────────────────────────────────────────────────────
+
+ProjectRole PgBackend::check_project_access(std::string_view project_id, std::string_view user_id) {
+  Lease conn(*this);
+  if (!conn) return ProjectRole::None;
+
+  std::string project(project_id);
+  std::string user(user_id);
+  const char* values[] = { project.c_str(), user.c_str() };
+
+  // 1 + 2. Direct membership and link sharing, in one round trip
+  Pipeline lookup(conn.get());
+  lookup.send("is_member", 2, values);
+  lookup.send("is_link_shared", 1, values);
+  auto results = lookup.run();
+  if (results.empty()) conn.discard();
+  if (results.empty() || !succeeded(results[0]) || !succeeded(results[1])) {
+    log_error("check_project_access", conn.get(), results);
+    return ProjectRole::None;
+  }
+
+  if (PQntuples(results[0].get()) > 0) {
+    // Binary text is the raw label
+    const auto* res = results[0].get();
+    return parse_project_role({ PQgetvalue(res, 0, 0), static_cast<size_t>(PQgetlength(res, 0, 0)) });
+  }
+  if (PQntuples(results[1].get()) == 0) return ProjectRole::None;
+
+  // 3. Auto-add user as editor (link sharing is enabled)
+  Pipeline insert(conn.get());
+  insert.send("add_editor", 2, values);
+  if (insert.run().empty()) conn.discard();
+
+  LOG_INFO(Pg) << "Auto-added user " << user_id
+               << " to project " << project_id << " via link sharing";
+
+  return ProjectRole::Editor;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "persistence_backend.h"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <libpq-fe.h>
+
+/**
+ * Persistence straight to Postgres over libpq, bypassing PostgREST.
+ *
+ *   - Statements are prepared once per connection and sent in pipeline
+ *     mode, so multi-statement operations (compaction, access checks)
+ *     cost one round trip; compaction's statements share one implicit
+ *     transaction.
+ *   - bytea travels as binary parameters/results — no JSON, no hex.
+ *   - Batched appends (WAL replay) use COPY ... FROM STDIN (FORMAT binary).
+ *
+ * Connections are opened lazily into a pool of up to pool_size and run
+ * in non-blocking mode; every call leases one, so an instance is safe to
+ * share between threads.
+ *
+ * Tables are the same ones SupabaseClient uses; rows written by either
+ * backend are readable by the other (see BlobCodec).
+ */
+class PgBackend : public PersistenceBackend {
+public:
+  /** Throws std::runtime_error if the first connection cannot be opened. */
+  PgBackend(std::string conninfo, uint32_t pool_size);
+  ~PgBackend() override;
+
+  PgBackend(const PgBackend&) = delete;
+  PgBackend& operator=(const PgBackend&) = delete;
+
+  std::optional<std::vector<uint8_t>> get_snapshot(std::string_view project_id) override;
+  bool upsert_snapshot(std::string_view project_id, const uint8_t* data, size_t len) override;
+  int64_t get_updates(std::string_view project_id, int64_t after_id,
+                      std::vector<std::vector<uint8_t>>& out) override;
+  bool append_update(std::string_view project_id, const uint8_t* data, size_t len) override;
+  bool append_updates(const std::vector<UpdateRow>& rows,
+                      std::string_view wal_id, int64_t wal_pos) override;
+  int64_t replayed_through(std::string_view wal_id) override;
+  bool truncate_updates(std::string_view project_id, int64_t through_id) override;
+  bool compact(std::string_view project_id, const uint8_t* data, size_t len, int64_t through_id) override;
+  ProjectRole check_project_access(std::string_view project_id, std::string_view user_id) override;
+
+private:
+  /** RAII connection lease; discard() drops a connection left in a bad state. */
+  class Lease {
+  public:
+    explicit Lease(PgBackend& backend) : backend_(backend), conn_(backend.acquire()) {}
+    ~Lease() { if (conn_) backend_.release(conn_, healthy_); }
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    PGconn* get() const { return conn_; }
+    explicit operator bool() const { return conn_ != nullptr; }
+    void discard() { healthy_ = false; }
+
+  private:
+    PgBackend& backend_;
+    PGconn*    conn_;
+    bool       healthy_ = true;
+  };
+
+  PGconn* acquire();
+  void release(PGconn* conn, bool healthy);
+
+  /** Open a connection, prepare all statements, switch to non-blocking. */
+  PGconn* connect();
+
+  std::string conninfo_;
+  uint32_t    pool_size_;
+
+  std::mutex              mutex_;
+  std::condition_variable available_;
+  std::vector<PGconn*>    idle_;
+  uint32_t                open_ = 0;
+};
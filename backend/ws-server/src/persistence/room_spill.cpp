@@ -0,0 +1,150 @@
+#include "room_spill.h"
+#include "blob_codec.h"
+#include "log/logger.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint64_t kCompactMinBytes = 64ull * 1024 * 1024;   // Garbage tolerated regardless
+
+/** Create path and unlink it at once; returns the descriptor or -1. */
+int open_unlinked(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd >= 0) ::unlink(path.c_str());
+  return fd;
+}
+
+bool write_all(int fd, const char* data, size_t len, uint64_t offset) {
+  while (len > 0) {
+    ssize_t n = ::pwrite(fd, data, len, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data   += n;
+    len    -= static_cast<size_t>(n);
+    offset += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+bool read_all(int fd, char* data, size_t len, uint64_t offset) {
+  while (len > 0) {
+    ssize_t n = ::pread(fd, data, len, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data   += n;
+    len    -= static_cast<size_t>(n);
+    offset += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+} // namespace
+
+RoomSpill::RoomSpill(std::string path)
+  : path_(std::move(path)), fd_(open_unlinked(path_)) {
+  if (fd_ < 0) {
+    throw std::runtime_error("RoomSpill: cannot create " + path_ + ": " + std::strerror(errno));
+  }
+}
+
+RoomSpill::~RoomSpill() {
+  ::close(fd_);
+}
+
+bool RoomSpill::store(uint32_t slot, uint32_t generation, uint64_t seq, const uint8_t* data, size_t len) {
+  auto it = index_.find(slot);
+  if (it != index_.end()) {
+    if (it->second.generation == generation && it->second.seq == seq) return true;
+    drop(it);
+  }
+
+  buf_.clear();
+  BlobEncoder encoder(buf_, false, BlobEncoder::Output::Binary);
+  if (!encoder.write(data, len) || !encoder.finish()) return false;
+
+  if (!write_all(fd_, buf_.data(), buf_.size(), end_)) {
+    LOG_SAMPLED(Persistence, Warn, 1) << "Spill write to " << path_ << " failed: " << std::strerror(errno);
+    return false;
+  }
+  index_.emplace(slot, Record{ end_, buf_.size(), generation, seq });
+  end_  += buf_.size();
+  live_ += buf_.size();
+
+  if (end_ > kCompactMinBytes && end_ > 2 * live_) compact();
+  return true;
+}
+
+bool RoomSpill::load(uint32_t slot, uint32_t generation, uint64_t seq, std::vector<uint8_t>& out) {
+  auto it = index_.find(slot);
+  if (it == index_.end()) return false;
+  const Record rec = it->second;
+  if (rec.generation != generation || rec.seq != seq) {
+    drop(it);
+    return false;
+  }
+
+  buf_.resize(rec.size);
+  out.clear();
+  BlobDecoder decoder(out);
+  if (!read_all(fd_, buf_.data(), buf_.size(), rec.offset)
+      || !decoder.write(reinterpret_cast<const uint8_t*>(buf_.data()), buf_.size())
+      || !decoder.finish()) {
+    LOG_SAMPLED(Persistence, Warn, 1) << "Spilled state of room slot " << slot << " unreadable, dropped";
+    drop(index_.find(slot));
+    out.clear();
+    return false;
+  }
+  return true;
+}
+
+void RoomSpill::retain(const std::function<bool(uint32_t, uint32_t)>& keep) {
+  for (auto it = index_.begin(); it != index_.end();) {
+    auto next = std::next(it);
+    if (!keep(it->first, it->second.generation)) drop(it);
+    it = next;
+  }
+}
+
+void RoomSpill::drop(std::unordered_map<uint32_t, Record>::iterator it) {
+  live_ -= it->second.size;
+  index_.erase(it);
+  if (index_.empty()) {
+    // Nothing live: start the file over
+    if (::ftruncate(fd_, 0) == 0) end_ = 0;
+  }
+}
+
+void RoomSpill::compact() {
+  int fd = open_unlinked(path_);
+  if (fd < 0) {
+    LOG_SAMPLED(Persistence, Warn, 1) << "Spill compaction: cannot create " << path_ << ": " << std::strerror(errno);
+    return;
+  }
+
+  uint64_t end = 0;
+  std::string copy;
+  for (auto& [slot, rec] : index_) {
+    copy.resize(rec.size);
+    if (!read_all(fd_, copy.data(), copy.size(), rec.offset) || !write_all(fd, copy.data(), copy.size(), end)) {
+      LOG_SAMPLED(Persistence, Warn, 1) << "Spill compaction of " << path_ << " failed: " << std::strerror(errno);
+      ::close(fd);
+      return;   // Old file and offsets still valid
+    }
+    end += rec.size;
+  }
+
+  // Offsets follow index order in the new file
+  end = 0;
+  for (auto& [slot, rec] : index_) {
+    rec.offset = end;
+    end += rec.size;
+  }
+  ::close(fd_);
+  fd_   = fd;
+  end_  = end;
+  live_ = end;
+}
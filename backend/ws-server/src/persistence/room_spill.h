@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+
+/**
+ * Node-local spill file for room documents evicted from memory.
+ *
+ * When the room memory budget is exceeded, the coldest rooms' cached
+ * initial-sync state is compressed (BlobEncoder: zstd when built with it,
+ * raw otherwise) and appended here instead of being dropped, so the next
+ * joiner of such a room reads it back from local disk rather than from
+ * the database.
+ *
+ * A record is keyed by room slot and tagged with the room's generation
+ * and sequence number at eviction: load() only returns it while both
+ * still match, i.e. the room has not been recreated and no update has
+ * arrived since. Storing a slot again replaces its record; the space of
+ * replaced records is reclaimed by rewriting the live ones into a fresh
+ * file once more than half of the file is garbage.
+ *
+ * The file is unlinked as soon as it is opened: its contents mean nothing
+ * to another process, and a crash leaves nothing behind. Reads and writes
+ * are synchronous (local disk, only under memory pressure or on a join).
+ *
+ * Not thread-safe; used on the event loop.
+ */
+class RoomSpill {
+public:
+  /** Create the spill file at path. Throws std::runtime_error on failure. */
+  explicit RoomSpill(std::string path);
+  ~RoomSpill();
+
+  RoomSpill(const RoomSpill&) = delete;
+  RoomSpill& operator=(const RoomSpill&) = delete;
+
+  /** Spill a room's state; a no-op if the same version is already held. */
+  bool store(uint32_t slot, uint32_t generation, uint64_t seq, const uint8_t* data, size_t len);
+
+  /**
+   * Read back a slot's state if it was stored at this generation and seq
+   * (a stale record is dropped). The record is kept, so evicting the same
+   * version again costs no write.
+   */
+  bool load(uint32_t slot, uint32_t generation, uint64_t seq, std::vector<uint8_t>& out);
+
+  /** Whether load() would succeed, without reading the record. */
+  bool holds(uint32_t slot, uint32_t generation, uint64_t seq) const {
+    auto it = index_.find(slot);
+    return it != index_.end() && it->second.generation == generation && it->second.seq == seq;
+  }
+
+  /** Drop records for which keep(slot, generation) is false. */
+  void retain(const std::function<bool(uint32_t slot, uint32_t generation)>& keep);
+
+  size_t records()    const { return index_.size(); }
+  uint64_t file_bytes() const { return end_; }
+
+private:
+  struct Record {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t generation;
+    uint64_t seq;
+  };
+
+  std::string path_;
+  int         fd_;
+  uint64_t    end_  = 0;   // Append offset
+  uint64_t    live_ = 0;   // Bytes of indexed records
+  std::unordered_map<uint32_t, Record> index_;   // By room slot
+  std::string buf_;                              // Compressed record scratch
+
+  void drop(std::unordered_map<uint32_t, Record>::iterator it);
+  void compact();
+};
@@ -0,0 +1,370 @@
+#include "sqlite_backend.h"
+#include "blob_codec.h"
+#include <sqlite3.h>
+#include <iterator>
+#include <stdexcept>
+#include "log/logger.h"
+
+namespace {
+
+constexpr const char* kSchema = R"sql(
+  CREATE TABLE IF NOT EXISTS projects (
+    id            TEXT PRIMARY KEY,
+    link_sharing  INTEGER NOT NULL DEFAULT 0
+  );
+  CREATE TABLE IF NOT EXISTS project_users (
+    project_id  TEXT NOT NULL,
+    user_id     TEXT NOT NULL,
+    role        TEXT NOT NULL DEFAULT 'editor',
+    PRIMARY KEY (project_id, user_id)
+  ) WITHOUT ROWID;
+  CREATE TABLE IF NOT EXISTS yjs_snapshots (
+    project_id  TEXT PRIMARY KEY,
+    snapshot    BLOB NOT NULL,
+    updated_at  INTEGER NOT NULL
+  );
+  CREATE TABLE IF NOT EXISTS yjs_updates (
+    id          INTEGER PRIMARY KEY AUTOINCREMENT,
+    project_id  TEXT NOT NULL,
+    data        BLOB NOT NULL,
+    wal_id      TEXT,
+    wal_pos     INTEGER
+  );
+  CREATE INDEX IF NOT EXISTS idx_yjs_updates_project ON yjs_updates(project_id, id);
+)sql";
+
+// Files created before replayed updates carried their WAL position
+constexpr const char* kHasWalColumns =
+  "SELECT 1 FROM pragma_table_info('yjs_updates') WHERE name = 'wal_id'";
+constexpr const char* kAddWalColumns = R"sql(
+  ALTER TABLE yjs_updates ADD COLUMN wal_id TEXT;
+  ALTER TABLE yjs_updates ADD COLUMN wal_pos INTEGER;
+)sql";
+
+constexpr const char* kWalIndex =
+  "CREATE INDEX IF NOT EXISTS idx_yjs_updates_wal ON yjs_updates(wal_id, wal_pos) "
+  "WHERE wal_id IS NOT NULL";
+
+// Indexed by SqliteBackend::Stmt. AUTOINCREMENT keeps update ids from
+// being reused after a truncate, which compaction's through_id relies on.
+constexpr const char* kStatements[] = {
+  "BEGIN IMMEDIATE",
+  "COMMIT",
+  "ROLLBACK",
+  "SELECT snapshot FROM yjs_snapshots WHERE project_id = ?1",
+  "INSERT INTO yjs_snapshots (project_id, snapshot, updated_at) VALUES (?1, ?2, strftime('%s', 'now')) "
+  "ON CONFLICT (project_id) DO UPDATE SET snapshot = excluded.snapshot, updated_at = excluded.updated_at",
+  "SELECT id, data FROM yjs_updates WHERE project_id = ?1 AND id > ?2 ORDER BY id",
+  "INSERT INTO yjs_updates (project_id, data) VALUES (?1, ?2)",
+  "INSERT INTO yjs_updates (project_id, data, wal_id, wal_pos) VALUES (?1, ?2, ?3, ?4)",
+  "SELECT max(wal_pos) FROM yjs_updates WHERE wal_id = ?1",
+  "DELETE FROM yjs_updates WHERE project_id = ?1 AND id <= ?2",
+  "SELECT role FROM project_users WHERE project_id = ?1 AND user_id = ?2",
+  "SELECT link_sharing FROM projects WHERE id = ?1",
+  "INSERT OR IGNORE INTO project_users (project_id, user_id, role) VALUES (?1, ?2, ?3)",
+};
+
+/** Binds parameters left to right; resets the statement when done. */
+class Query {
+public:
+  explicit Query(sqlite3_stmt* stmt) : stmt_(stmt) {}
+  ~Query() {
+    sqlite3_reset(stmt_);
+    sqlite3_clear_bindings(stmt_);
+  }
+
+  Query(const Query&) = delete;
+  Query& operator=(const Query&) = delete;
+
+  Query& bind(std::string_view text) {
+    sqlite3_bind_text(stmt_, ++index_, text.data(), static_cast<int>(text.size()), SQLITE_STATIC);
+    return *this;
+  }
+  Query& bind(int64_t value) {
+    sqlite3_bind_int64(stmt_, ++index_, value);
+    return *this;
+  }
+  Query& bind(const uint8_t* data, size_t len) {
+    sqlite3_bind_blob64(stmt_, ++index_, data, len, SQLITE_STATIC);
+    return *this;
+  }
+
+  /** SQLITE_ROW / SQLITE_DONE / error code. */
+  int step() { return sqlite3_step(stmt_); }
+  bool run() { return step() == SQLITE_DONE; }
+
+  sqlite3_stmt* get() const { return stmt_; }
+
+private:
+  sqlite3_stmt* stmt_;
+  int           index_ = 0;
+};
+
+bool decode_column(sqlite3_stmt* stmt, int col, std::vector<uint8_t>& blob, bool& batched) {
+  BlobDecoder decoder(blob);
+  auto* data = static_cast<const uint8_t*>(sqlite3_column_blob(stmt, col));
+  if (!decoder.write(data, static_cast<size_t>(sqlite3_column_bytes(stmt, col))) || !decoder.finish()) {
+    return false;
+  }
+  batched = decoder.batched();
+  return true;
+}
+
+} // namespace
+
+// ── Lifecycle ────────────────────────────────────────────────────────────────
+
+SqliteBackend::SqliteBackend(const std::string& path) {
+  static_assert(std::size(kStatements) == kStmtCount, "kStatements must match Stmt");
+
+  int rc = sqlite3_open_v2(path.c_str(), &db_,
+                           SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr);
+  if (rc != SQLITE_OK) {
+    std::string err = db_ ? sqlite3_errmsg(db_) : sqlite3_errstr(rc);
+    sqlite3_close(db_);
+    throw std::runtime_error("SqliteBackend: cannot open " + path + ": " + err);
+  }
+
+  sqlite3_busy_timeout(db_, 5000);   // Writers from the other instance
+
+  int wal_columns = 0;
+  int (*count_rows)(void*, int, char**, char**) =
+    [](void* n, int, char**, char**) { ++*static_cast<int*>(n); return 0; };
+
+  const char* setup[] = {
+    "PRAGMA journal_mode = WAL",
+    "PRAGMA synchronous = NORMAL",     // Durable at checkpoint; no fsync per commit
+    "PRAGMA mmap_size = 268435456",    // 256 MB read mapping
+    "PRAGMA temp_store = MEMORY",
+    kSchema,
+    kHasWalColumns,
+    kAddWalColumns,
+    kWalIndex,
+  };
+  for (const char* sql : setup) {
+    if (sql == kAddWalColumns && wal_columns > 0) continue;
+    char* err = nullptr;
+    if (sqlite3_exec(db_, sql, sql == kHasWalColumns ? count_rows : nullptr,
+                     &wal_columns, &err) != SQLITE_OK) {
+      std::string msg = err ? err : "unknown error";
+      sqlite3_free(err);
+      sqlite3_close(db_);
+      throw std::runtime_error("SqliteBackend: " + msg);
+    }
+  }
+
+  for (int i = 0; i < kStmtCount; ++i) {
+    if (sqlite3_prepare_v3(db_, kStatements[i], -1, SQLITE_PREPARE_PERSISTENT,
+                           &stmts_[i], nullptr) != SQLITE_OK) {
+      std::string msg = sqlite3_errmsg(db_);
+      for (auto* stmt : stmts_) sqlite3_finalize(stmt);
+      sqlite3_close(db_);
+      throw std::runtime_error("SqliteBackend: prepare failed: " + msg);
+    }
+  }
+}
+
+SqliteBackend::~SqliteBackend() {
+  for (auto* stmt : stmts_) sqlite3_finalize(stmt);
+  sqlite3_close(db_);
+}
+
+bool SqliteBackend::exec(Stmt stmt) {
+  Query q(stmts_[stmt]);
+  return q.run();
+}
+
+void SqliteBackend::log_error(const char* what) {
+  LOG_SAMPLED(Sqlite, Error, 5) << what << " failed: " << sqlite3_errmsg(db_);
+}
+
+// ── Yjs Persistence ──────────────────────────────────────────────────────────
+
+std::optional<std::vector<uint8_t>> SqliteBackend::get_snapshot(std::string_view project_id) {
+  Query q(stmts_[kGetSnapshot]);
+  q.bind(project_id);
+
+  int rc = q.step();
+  if (rc != SQLITE_ROW) {
+    if (rc != SQLITE_DONE) log_error("get_snapshot");
+    return std::nullopt;
+  }
+
+  std::vector<uint8_t> snapshot;
+  bool batched = false;
+  if (!decode_column(q.get(), 0, snapshot, batched)) {
+    LOG_ERROR(Sqlite) << "corrupt snapshot for project " << project_id;
+    return std::nullopt;
+  }
+  return snapshot;
+}
+
+bool SqliteBackend::upsert_snapshot(std::string_view project_id, const uint8_t* data, size_t len) {
+  std::string blob;
+  BlobEncoder encoder(blob, /*batch=*/false, BlobEncoder::Output::Binary);
+  if (!encoder.write(data, len) || !encoder.finish()) return false;
+
+  Query q(stmts_[kUpsertSnapshot]);
+  q.bind(project_id).bind(reinterpret_cast<const uint8_t*>(blob.data()), blob.size());
+  if (!q.run()) {
+    log_error("upsert_snapshot");
+    return false;
+  }
+  return true;
+}
+
+int64_t SqliteBackend::get_updates(std::string_view project_id, int64_t after_id,
+                                   std::vector<std::vector<uint8_t>>& out) {
+  Query q(stmts_[kGetUpdates]);
+  q.bind(project_id).bind(after_id);
+
+  int64_t last_id = after_id;
+  int rc;
+  while ((rc = q.step()) == SQLITE_ROW) {
+    last_id = sqlite3_column_int64(q.get(), 0);
+
+    std::vector<uint8_t> blob;
+    bool batched = false;
+    if (!decode_column(q.get(), 1, blob, batched)) {
+      LOG_ERROR(Sqlite) << "skipping corrupt update for project " << project_id;
+    } else if (!batched) {
+      out.push_back(std::move(blob));
+    } else if (!BlobCodec::split_batch(blob, out)) {
+      LOG_ERROR(Sqlite) << "truncated update batch for project " << project_id;
+    }
+  }
+
+  if (rc != SQLITE_DONE) {
+    log_error("get_updates");
+    return -1;
+  }
+  return last_id;
+}
+
+bool SqliteBackend::append_update(std::string_view project_id, const uint8_t* data, size_t len) {
+  Query q(stmts_[kAppendUpdate]);
+  q.bind(project_id).bind(data, len);
+  if (!q.run()) {
+    log_error("append_update");
+    return false;
+  }
+  return true;
+}
+
+bool SqliteBackend::append_updates(const std::vector<UpdateRow>& rows,
+                                   std::string_view wal_id, int64_t wal_pos) {
+  if (rows.empty()) return true;
+  if (!exec(kBegin)) {
+    log_error("begin");
+    return false;
+  }
+
+  for (auto& row : rows) {
+    Query q(stmts_[kAppendReplayed]);
+    q.bind(row.project_id).bind(row.data, row.len).bind(wal_id).bind(wal_pos);
+    if (!q.run()) {
+      log_error("append_updates");
+      exec(kRollback);
+      return false;
+    }
+  }
+
+  if (!exec(kCommit)) {
+    log_error("commit");
+    exec(kRollback);
+    return false;
+  }
+  return true;
+}
+
+int64_t SqliteBackend::replayed_through(std::string_view wal_id) {
+  Query q(stmts_[kReplayedThrough]);
+  q.bind(wal_id);
+  if (q.step() != SQLITE_ROW) {
+    log_error("replayed_through");
+    return -1;
+  }
+  return sqlite3_column_int64(q.get(), 0);   // NULL (no rows) reads as 0
+}
+
+bool SqliteBackend::truncate_updates(std::string_view project_id, int64_t through_id) {
+  Query q(stmts_[kTruncateUpdates]);
+  q.bind(project_id).bind(through_id);
+  if (!q.run()) {
+    log_error("truncate_updates");
+    return false;
+  }
+  return true;
+}
+
+bool SqliteBackend::compact(std::string_view project_id, const uint8_t* data, size_t len, int64_t through_id) {
+  if (!exec(kBegin)) {
+    log_error("begin");
+    return false;
+  }
+
+  if (!upsert_snapshot(project_id, data, len) || !truncate_updates(project_id, through_id)) {
+    exec(kRollback);
+    return false;
+  }
+
+  if (!exec(kCommit)) {
+    log_error("commit");
+    exec(kRollback);
+    return false;
+  }
+  return true;
+}
+
+// ── Auth Helpers ─────────────────────────────────────────────────────────────
+
+ProjectRole SqliteBackend::check_project_access(std::string_view project_id, std::string_view user_id) {
+  // 1. Check direct membership in project_users
+  {
+    Query q(stmts_[kIsMember]);
+    q.bind(project_id).bind(user_id);
+    int rc = q.step();
+    if (rc == SQLITE_ROW) {
+      auto* role = reinterpret_cast<const char*>(sqlite3_column_text(q.get(), 0));
+      return parse_project_role(role ? role : "");
+    }
+    if (rc != SQLITE_DONE) {
+      log_error("check_project_access");
+      return ProjectRole::None;
+    }
+  }
+
+  // 2. Link sharing; an unknown project grants nothing
+  {
+    Query q(stmts_[kProjectSharing]);
+    q.bind(project_id);
+    int rc = q.step();
+    if (rc != SQLITE_ROW) {
+      if (rc != SQLITE_DONE) log_error("check_project_access");
+      return ProjectRole::None;
+    }
+    if (sqlite3_column_int(q.get(), 0) == 0) return ProjectRole::None;
+  }
+
+  // 3. Auto-add user as editor, then report the role actually stored (a
+  //    concurrent insert from another instance may have won)
+  {
+    Query q(stmts_[kAddMember]);
+    q.bind(project_id).bind(user_id).bind(std::string_view("editor"));
+    if (!q.run()) {
+      log_error("check_project_access");
+      return ProjectRole::None;
+    }
+  }
+  Query q(stmts_[kIsMember]);
+  q.bind(project_id).bind(user_id);
+  if (q.step() != SQLITE_ROW) {
+    log_error("check_project_access");
+    return ProjectRole::None;
+  }
+  auto* role = reinterpret_cast<const char*>(sqlite3_column_text(q.get(), 0));
+
+  LOG_INFO(Sqlite) << "Auto-added user " << user_id << " to project " << project_id
+                   << " via link sharing";
+  return parse_project_role(role ? role : "");
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "persistence_backend.h"
+#include <string>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+/**
+ * Embedded persistence in a single SQLite file, for offline / on-prem
+ * nodes that run without Supabase.
+ *
+ * The database runs in WAL journal mode with synchronous=NORMAL and a
+ * memory-mapped read path, so an update append is a page write into the
+ * journal rather than a network round trip. Statements are prepared
+ * once; multi-row writes (batched appends, compaction) are transactions.
+ *
+ * Tables mirror the Postgres schema (projects, project_users,
+ * yjs_snapshots, yjs_updates) and are created on open. Access control
+ * follows the same rules: projects and their members are provisioned in
+ * the file, and only link sharing adds members on its own.
+ *
+ * One instance per thread (the connection is opened without a mutex);
+ * several instances on the same file are fine.
+ */
+class SqliteBackend : public PersistenceBackend {
+public:
+  /** Throws std::runtime_error if the database cannot be opened or migrated. */
+  explicit SqliteBackend(const std::string& path);
+  ~SqliteBackend() override;
+
+  SqliteBackend(const SqliteBackend&) = delete;
+  SqliteBackend& operator=(const SqliteBackend&) = delete;
+
+  std::optional<std::vector<uint8_t>> get_snapshot(std::string_view project_id) override;
+  bool upsert_snapshot(std::string_view project_id, const uint8_t* data, size_t len) override;
+  int64_t get_updates(std::string_view project_id, int64_t after_id,
+                      std::vector<std::vector<uint8_t>>& out) override;
+  bool append_update(std::string_view project_id, const uint8_t* data, size_t len) override;
+  bool append_updates(const std::vector<UpdateRow>& rows,
+                      std::string_view wal_id, int64_t wal_pos) override;
+  int64_t replayed_through(std::string_view wal_id) override;
+  bool truncate_updates(std::string_view project_id, int64_t through_id) override;
+  bool compact(std::string_view project_id, const uint8_t* data, size_t len, int64_t through_id) override;
+  ProjectRole check_project_access(std::string_view project_id, std::string_view user_id) override;
+
+private:
+  enum Stmt {
+    kBegin, kCommit, kRollback,
+    kGetSnapshot, kUpsertSnapshot,
+    kGetUpdates, kAppendUpdate, kAppendReplayed, kReplayedThrough, kTruncateUpdates,
+    kIsMember, kProjectSharing, kAddMember,
+    kStmtCount
+  };
+
+  /** Run a parameterless statement (BEGIN / COMMIT / ROLLBACK). */
+  bool exec(Stmt stmt);
+
+  void log_error(const char* what);
+
+  sqlite3*      db_ = nullptr;
+  sqlite3_stmt* stmts_[kStmtCount] = {};
+};
@@ -1,9 +1,11 @@
 #include "supabase_client.h"
+#include "blob_codec.h"
 #include <nlohmann/json.hpp>
 #include <sstream>
 #include <stdexcept>
-#include <iostream>
+#include "log/logger.h"
 #include <cstring>
+#include <algorithm>
 
 using json = nlohmann::json;
 
@@ -25,10 +27,30 @@ SupabaseClient::~SupabaseClient() {
 
 // ── libcurl write callback ───────────────────────────────────────────────────
 
+namespace {
+
+struct WriteTarget {
+  CURL*                                          curl;
+  std::string*                                   body;
+  const std::function<bool(const char*, size_t)>* sink;
+};
+
+} // namespace
+
 size_t SupabaseClient::write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
-  auto* response_body = static_cast<std::string*>(userdata);
+  auto* target = static_cast<WriteTarget*>(userdata);
   size_t total = size * nmemb;
-  response_body->append(ptr, total);
+
+  if (target->sink) {
+    // Headers are in by now; error bodies are still buffered for logging
+    long http_code = 0;
+    curl_easy_getinfo(target->curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (http_code >= 200 && http_code < 300) {
+      return (*target->sink)(ptr, total) ? total : 0;
+    }
+  }
+
+  target->body->append(ptr, total);
   return total;
 }
 
@@ -38,7 +60,8 @@ SupabaseClient::Response SupabaseClient::request(
     std::string_view method,
     std::string_view path,
     std::string_view body,
-    const std::vector<std::pair<std::string, std::string>>& extra_headers) {
+    const std::vector<std::pair<std::string, std::string>>& extra_headers,
+    const BodySink* sink) {
 
   if (!curl_) return { 500, R"({"error":"curl not initialized"})" };
 
@@ -49,11 +72,12 @@ SupabaseClient::Response SupabaseClient::request(
 
   // Response body accumulator
   std::string response_body;
+  WriteTarget target { curl_, &response_body, sink };
 
   // Basic options
   curl_easy_setopt(curl_, CURLOPT_URL, full_url.c_str());
   curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, write_callback);
-  curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response_body);
+  curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &target);
   curl_easy_setopt(curl_, CURLOPT_TIMEOUT, 10L);
   curl_easy_setopt(curl_, CURLOPT_CONNECTTIMEOUT, 5L);
 
@@ -83,11 +107,10 @@ SupabaseClient::Response SupabaseClient::request(
 
   curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers);
 
-  // Body
-  std::string body_str(body);
-  if (!body_str.empty()) {
-    curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, body_str.c_str());
-    curl_easy_setopt(curl_, CURLOPT_POSTFIELDSIZE, static_cast<long>(body_str.size()));
+  // Body (not copied: callers keep it alive across the blocking perform)
+  if (!body.empty()) {
+    curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, body.data());
+    curl_easy_setopt(curl_, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(body.size()));
   }
 
   // Execute
@@ -97,8 +120,8 @@ SupabaseClient::Response SupabaseClient::request(
   curl_slist_free_all(headers);
 
   if (res != CURLE_OK) {
-    std::cerr << "[supabase] curl error: " << curl_easy_strerror(res)
-              << " url: " << full_url << std::endl;
+    LOG_SAMPLED(Supabase, Error, 5) << "curl error: " << curl_easy_strerror(res)
+                                    << " url: " << full_url;
     return { 500, std::string(R"({"error":")") + curl_easy_strerror(res) + "\"}" };
   }
 
@@ -108,72 +131,171 @@ SupabaseClient::Response SupabaseClient::request(
 // ── Yjs Persistence (unchanged API, now backed by real HTTP) ─────────────────
 
 std::optional<std::vector<uint8_t>> SupabaseClient::get_snapshot(std::string_view project_id) {
+  // Ask PostgREST for the raw bytea so the body can be decompressed as it
+  // arrives, without a JSON/hex copy of the whole snapshot.
   std::string path = "/rest/v1/yjs_snapshots?project_id=eq." + std::string(project_id) + "&select=snapshot";
-  auto resp = request("GET", path);
-  if (!resp.ok()) return std::nullopt;
 
-  try {
-    auto arr = json::parse(resp.body);
-    if (arr.empty() || !arr.is_array()) return std::nullopt;
+  std::vector<uint8_t> result;
+  BlobDecoder decoder(result);
+  BodySink sink = [&decoder](const char* data, size_t len) {
+    return decoder.write(reinterpret_cast<const uint8_t*>(data), len);
+  };
 
-    auto& data_str = arr[0]["snapshot"].get_ref<const std::string&>();
-    std::vector<uint8_t> result(data_str.begin(), data_str.end());
-    return result;
-  } catch (...) {
+  auto resp = request("GET", path, "", {{"Accept", "application/octet-stream"}}, &sink);
+  if (!resp.ok() || !decoder.started()) return std::nullopt;
+
+  if (!decoder.finish()) {
+    LOG_ERROR(Supabase) << "corrupt snapshot for project " << project_id;
     return std::nullopt;
   }
+  return result;
 }
 
 bool SupabaseClient::upsert_snapshot(std::string_view project_id, const uint8_t* data, size_t len) {
-  json body;
-  body["project_id"] = project_id;
-  body["snapshot"]   = std::string(reinterpret_cast<const char*>(data), len);
+  // Built by hand so the snapshot is streamed through the compressor
+  // straight into the request body.
+  std::string body;
+  body.reserve(64 + len);
+  body += R"({"project_id":)";
+  body += json(project_id).dump();
+  body += R"(,"snapshot":")";
+
+  BlobEncoder encoder(body);
+  if (!encoder.write(data, len) || !encoder.finish()) return false;
+  body += "\"}";
 
   auto resp = request("POST", "/rest/v1/yjs_snapshots",
-    body.dump(),
+    body,
     {{"Prefer", "resolution=merge-duplicates"}});
   return resp.ok();
 }
 
-std::vector<std::vector<uint8_t>> SupabaseClient::get_updates(std::string_view project_id, int64_t after_id) {
+int64_t SupabaseClient::get_updates(std::string_view project_id, int64_t after_id,
+                                    std::vector<std::vector<uint8_t>>& out) {
   std::string path = "/rest/v1/yjs_updates?project_id=eq." + std::string(project_id)
     + "&id=gt." + std::to_string(after_id)
-    + "&order=id.asc&select=data";
+    + "&order=id.asc&select=id,data";
 
   auto resp = request("GET", path);
-  std::vector<std::vector<uint8_t>> updates;
-
-  if (!resp.ok()) return updates;
+  if (!resp.ok()) return -1;
 
+  int64_t last_id = after_id;
   try {
     auto arr = json::parse(resp.body);
-    if (!arr.is_array()) return updates;
-    updates.reserve(arr.size());
+    if (!arr.is_array()) return -1;
+    out.reserve(out.size() + arr.size());
     for (auto& row : arr) {
+      last_id = row["id"].get<int64_t>();
       auto& s = row["data"].get_ref<const std::string&>();
-      updates.emplace_back(s.begin(), s.end());
+
+      std::vector<uint8_t> blob;
+      BlobDecoder decoder(blob);
+      if (!decoder.write_hex(s) || !decoder.finish()) {
+        LOG_ERROR(Supabase) << "skipping corrupt update for project " << project_id;
+        continue;
+      }
+
+      if (!decoder.batched()) {
+        out.push_back(std::move(blob));
+      } else if (!BlobCodec::split_batch(blob, out)) {
+        LOG_ERROR(Supabase) << "truncated update batch for project " << project_id;
+      }
     }
-  } catch (...) {}
+  } catch (...) {
+    return -1;
+  }
 
-  return updates;
+  return last_id;
 }
 
 bool SupabaseClient::append_update(std::string_view project_id, const uint8_t* data, size_t len) {
-  json body;
-  body["project_id"] = project_id;
-  body["data"]       = std::string(reinterpret_cast<const char*>(data), len);
+  // Single updates are too small to gain from compression; hex only
+  std::string body;
+  body.reserve(48 + len * 2);
+  body += R"({"project_id":)";
+  body += json(project_id).dump();
+  body += R"(,"data":"\\x)";
+  BlobCodec::append_hex(body, data, len);
+  body += "\"}";
+
+  auto resp = request("POST", "/rest/v1/yjs_updates", body);
+  return resp.ok();
+}
+
+bool SupabaseClient::append_updates(const std::vector<UpdateRow>& rows,
+                                    std::string_view wal_id, int64_t wal_pos) {
+  if (rows.empty()) return true;
+
+  // Every row carries the batch's log position; the array is one insert,
+  // so the batch is stored whole or not at all
+  const std::string tag = R"(,"wal_id":)" + json(wal_id).dump()
+                        + R"(,"wal_pos":)" + std::to_string(wal_pos) + '}';
+
+  std::string body = "[";
+  if (!BlobCodec::compresses()) {
+    for (auto& row : rows) {
+      if (body.size() > 1) body += ',';
+      body += R"({"project_id":)";
+      body += json(row.project_id).dump();
+      body += R"(,"data":"\\x)";
+      BlobCodec::append_hex(body, row.data, row.len);
+      body += '"';
+      body += tag;
+    }
+  } else {
+    // One compressed row per project, updates kept in arrival order
+    std::vector<std::string_view> projects;
+    for (auto& row : rows) {
+      if (std::find(projects.begin(), projects.end(), row.project_id) == projects.end()) {
+        projects.push_back(row.project_id);
+      }
+    }
 
-  auto resp = request("POST", "/rest/v1/yjs_updates", body.dump());
+    for (auto& project_id : projects) {
+      if (body.size() > 1) body += ',';
+      body += R"({"project_id":)";
+      body += json(project_id).dump();
+      body += R"(,"data":")";
+
+      BlobEncoder encoder(body, /*batch=*/true);
+      for (auto& row : rows) {
+        if (row.project_id == project_id && !encoder.write_update(row.data, row.len)) return false;
+      }
+      if (!encoder.finish()) return false;
+      body += '"';
+      body += tag;
+    }
+  }
+  body += ']';
+
+  auto resp = request("POST", "/rest/v1/yjs_updates", body);
   return resp.ok();
 }
 
-bool SupabaseClient::clear_updates(std::string_view project_id) {
-  std::string path = "/rest/v1/yjs_updates?project_id=eq." + std::string(project_id);
+int64_t SupabaseClient::replayed_through(std::string_view wal_id) {
+  std::string path = "/rest/v1/yjs_updates?wal_id=eq." + std::string(wal_id)
+    + "&select=wal_pos&order=wal_pos.desc&limit=1";
+
+  auto resp = request("GET", path);
+  if (!resp.ok()) return -1;
+
+  try {
+    auto arr = json::parse(resp.body);
+    if (!arr.is_array()) return -1;
+    return arr.empty() ? 0 : arr[0]["wal_pos"].get<int64_t>();
+  } catch (...) {
+    return -1;
+  }
+}
+
+bool SupabaseClient::truncate_updates(std::string_view project_id, int64_t through_id) {
+  std::string path = "/rest/v1/yjs_updates?project_id=eq." + std::string(project_id)
+    + "&id=lte." + std::to_string(through_id);
   auto resp = request("DELETE", path);
   return resp.ok();
 }
 
-bool SupabaseClient::check_project_access(std::string_view project_id, std::string_view user_id) {
+ProjectRole SupabaseClient::check_project_access(std::string_view project_id, std::string_view user_id) {
   // 1. Check direct membership in project_users
   std::string path = "/rest/v1/project_users?project_id=eq." + std::string(project_id)
     + "&user_id=eq." + std::string(user_id)
@@ -183,7 +305,9 @@ bool SupabaseClient::check_project_access(std::string_view project_id, std::stri
   if (resp.ok()) {
     try {
       auto arr = json::parse(resp.body);
-      if (arr.is_array() && !arr.empty()) return true;
+      if (arr.is_array() && !arr.empty()) {
+        return parse_project_role(arr[0].value("role", std::string{}));
+      }
     } catch (...) {}
   }
 
@@ -192,13 +316,13 @@ bool SupabaseClient::check_project_access(std::string_view project_id, std::stri
     + "&link_sharing=eq.true&select=id";
 
   auto link_resp = request("GET", link_path);
-  if (!link_resp.ok()) return false;
+  if (!link_resp.ok()) return ProjectRole::None;
 
   try {
     auto arr = json::parse(link_resp.body);
-    if (!arr.is_array() || arr.empty()) return false;
+    if (!arr.is_array() || arr.empty()) return ProjectRole::None;
   } catch (...) {
-    return false;
+    return ProjectRole::None;
   }
 
   // 3. Auto-add user as editor (link sharing is enabled)
@@ -209,8 +333,8 @@ bool SupabaseClient::check_project_access(std::string_view project_id, std::stri
   request("POST", "/rest/v1/project_users", body.dump(),
     {{"Prefer", "resolution=merge-duplicates"}});
 
-  std::cout << "[wigma-ws] Auto-added user " << user_id
-            << " to project " << project_id << " via link sharing" << std::endl;
+  LOG_INFO(Supabase) << "Auto-added user " << user_id
+                     << " to project " << project_id << " via link sharing";
 
-  return true;
+  return ProjectRole::Editor;
 }
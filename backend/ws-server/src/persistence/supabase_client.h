@@ -1,4 +1,5 @@
 #pragma once
+#include "persistence_backend.h"
 #include <string>
 #include <string_view>
 #include <vector>
@@ -15,10 +16,10 @@
  * Thread-safety: a single CURL handle is reused across calls;
  * callers must serialise access (fine for our single-threaded event loop).
  */
-class SupabaseClient {
+class SupabaseClient : public PersistenceBackend {
 public:
   SupabaseClient(std::string url, std::string service_key);
-  ~SupabaseClient();
+  ~SupabaseClient() override;
 
   // Non-copyable, movable
   SupabaseClient(const SupabaseClient&) = delete;
@@ -32,39 +33,60 @@ public:
 
   // ── Yjs Persistence ────────────────────────────────────────────────────
 
-  /** Fetch the latest Yjs snapshot for a project. */
-  std::optional<std::vector<uint8_t>> get_snapshot(std::string_view project_id);
+  // Blobs travel as bytea hex literals; snapshots and update batches are
+  // zstd-compressed at rest (see BlobCodec).
+
+  /** Fetch the latest Yjs snapshot for a project (streamed, decompressed). */
+  std::optional<std::vector<uint8_t>> get_snapshot(std::string_view project_id) override;
 
   /** Upsert (insert or update) a Yjs snapshot. */
-  bool upsert_snapshot(std::string_view project_id, const uint8_t* data, size_t len);
+  bool upsert_snapshot(std::string_view project_id, const uint8_t* data, size_t len) override;
 
-  /** Fetch all Yjs incremental updates after a given ID. */
-  std::vector<std::vector<uint8_t>> get_updates(std::string_view project_id, int64_t after_id = 0);
+  /** Fetch Yjs incremental updates after a given ID; returns the last ID read. */
+  int64_t get_updates(std::string_view project_id, int64_t after_id,
+                      std::vector<std::vector<uint8_t>>& out) override;
 
   /** Append a Yjs incremental update. */
-  bool append_update(std::string_view project_id, const uint8_t* data, size_t len);
+  bool append_update(std::string_view project_id, const uint8_t* data, size_t len) override;
+
+  /**
+   * Append a batch of Yjs updates in a single bulk insert. Updates for the
+   * same project are packed into one compressed row.
+   */
+  bool append_updates(const std::vector<UpdateRow>& rows,
+                      std::string_view wal_id, int64_t wal_pos) override;
 
-  /** Delete all updates for a project (after snapshot compaction). */
-  bool clear_updates(std::string_view project_id);
+  /** Highest wal_pos stored for a log (one indexed row). */
+  int64_t replayed_through(std::string_view wal_id) override;
+
+  /** Delete updates up to and including through_id (after compaction). */
+  bool truncate_updates(std::string_view project_id, int64_t through_id) override;
 
   // ── Auth Helpers ──────────────────────────────────────────────────────
 
   /** Check if a user has access to a project (project_users row exists). */
-  bool check_project_access(std::string_view project_id, std::string_view user_id);
+  ProjectRole check_project_access(std::string_view project_id, std::string_view user_id) override;
 
 private:
   std::string url_;
   std::string service_key_;
   CURL* curl_ = nullptr;
 
-  /** Perform an HTTP request to Supabase REST API via libcurl. */
+  /** Receives a successful response body chunk by chunk; false aborts. */
+  using BodySink = std::function<bool(const char* data, size_t len)>;
+
+  /**
+   * Perform an HTTP request to Supabase REST API via libcurl. With a sink,
+   * a 2xx body is streamed to it instead of being buffered in Response.
+   */
   Response request(
     std::string_view method,
     std::string_view path,
     std::string_view body = "",
-    const std::vector<std::pair<std::string, std::string>>& extra_headers = {}
+    const std::vector<std::pair<std::string, std::string>>& extra_headers = {},
+    const BodySink* sink = nullptr
   );
 
-  /** libcurl write callback — appends data to a std::string. */
+  /** libcurl write callback — appends to the body or forwards to the sink. */
   static size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata);
 };
@@ -0,0 +1,470 @@
+#include "write_ahead_log.h"
+#include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include "log/logger.h"
+#include "log/tracer.h"
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t   kHeaderSize = 8;                  // u32 body_len + u32 crc
+constexpr size_t   kReadChunk  = 1024 * 1024;
+constexpr uint32_t kMaxBackoffMs = 5000;
+constexpr uint64_t kMaxSegmentBytes = 1ull << 39;     // Offsets stay within Position::key()
+
+uint32_t load_u32(const char* p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint32_t crc_of(const char* data, size_t len) {
+  return static_cast<uint32_t>(
+    crc32(0L, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(len)));
+}
+
+bool write_all(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(fd, data, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += n;
+    len  -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool read_at(int fd, char* out, size_t len, uint64_t offset) {
+  while (len > 0) {
+    ssize_t n = ::pread(fd, out, len, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) continue;
+    if (n == 0) errno = 0;           // Unexpected end of file
+    if (n <= 0) return false;
+    out    += n;
+    len    -= static_cast<size_t>(n);
+    offset += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+/** Length of the valid record prefix of a segment file. */
+uint64_t scan_valid_prefix(int fd, uint64_t file_size) {
+  std::string body;
+  char header[kHeaderSize];
+  uint64_t pos = 0;
+  while (pos + kHeaderSize <= file_size) {
+    if (!read_at(fd, header, kHeaderSize, pos)) break;
+    uint32_t len = load_u32(header);
+    uint32_t crc = load_u32(header + 4);
+    if (len < 2 || pos + kHeaderSize + len > file_size) break;
+    body.resize(len);
+    if (!read_at(fd, body.data(), len, pos + kHeaderSize)) break;
+    if (crc_of(body.data(), len) != crc) break;
+    pos += kHeaderSize + len;
+  }
+  return pos;
+}
+
+void fsync_dir(const std::string& dir) {
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) return;
+  ::fsync(fd);
+  ::close(fd);
+}
+
+} // namespace
+
+// ── Lifecycle ────────────────────────────────────────────────────────────────
+
+WriteAheadLog::WriteAheadLog(Options options, ReplaySink sink)
+  : options_(std::move(options)), sink_(std::move(sink)) {
+  options_.segment_bytes = std::min(options_.segment_bytes, kMaxSegmentBytes);
+
+  std::error_code ec;
+  fs::create_directories(options_.dir, ec);
+  if (ec) {
+    throw std::runtime_error("WriteAheadLog: cannot create " + options_.dir + ": " + ec.message());
+  }
+
+  recover();
+
+  writer_   = std::thread([this] { writer_loop(); });
+  replayer_ = std::thread([this] { replayer_loop(); });
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  write_cv_.notify_all();
+  replay_cv_.notify_all();
+
+  if (writer_.joinable())   writer_.join();
+  if (replayer_.joinable()) replayer_.join();
+
+  if (segment_fd_ >= 0) ::close(segment_fd_);
+}
+
+// ── Append (event loop thread) ───────────────────────────────────────────────
+
+uint64_t WriteAheadLog::append(std::string_view project_id, const uint8_t* data, size_t len) {
+  if (project_id.size() > UINT16_MAX) {
+    LOG_SAMPLED(Wal, Error, 1) << "rejecting update: project id of " << project_id.size()
+                               << " bytes does not fit a record";
+    return 0;
+  }
+
+  const uint16_t project_len = static_cast<uint16_t>(project_id.size());
+  const uint32_t body_len    = static_cast<uint32_t>(sizeof(project_len) + project_id.size() + len);
+
+  uLong crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc, reinterpret_cast<const Bytef*>(&project_len), sizeof(project_len));
+  crc = crc32(crc, reinterpret_cast<const Bytef*>(project_id.data()), static_cast<uInt>(project_id.size()));
+  crc = crc32(crc, data, static_cast<uInt>(len));
+  const uint32_t crc32v = static_cast<uint32_t>(crc);
+
+  std::lock_guard lock(mutex_);
+  bool was_empty = pending_.empty();
+
+  pending_.append(reinterpret_cast<const char*>(&body_len), sizeof(body_len));
+  pending_.append(reinterpret_cast<const char*>(&crc32v), sizeof(crc32v));
+  pending_.append(reinterpret_cast<const char*>(&project_len), sizeof(project_len));
+  pending_.append(project_id);
+  pending_.append(reinterpret_cast<const char*>(data), len);
+
+  pending_lsn_ = next_lsn_++;
+  if (was_empty) write_cv_.notify_one();
+  return pending_lsn_;
+}
+
+// ── Writer thread (group commit) ─────────────────────────────────────────────
+
+void WriteAheadLog::writer_loop() {
+  Tracer::set_thread_name("wal-writer");
+  std::string batch;
+
+  for (;;) {
+    uint64_t lsn;
+    bool stop;
+    {
+      std::unique_lock lock(mutex_);
+      write_cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+
+      // Commit window: let appends from the same burst share one fdatasync
+      if (!stopping_ && options_.commit_interval_ms > 0) {
+        write_cv_.wait_for(lock, std::chrono::milliseconds(options_.commit_interval_ms),
+                           [this] { return stopping_; });
+      }
+
+      stop = stopping_;
+      batch.swap(pending_);
+      lsn = pending_lsn_;
+    }
+
+    if (!batch.empty()) {
+      TraceSpan span(Tracer::always(), "wal", "wal.commit");
+      span.arg("lsn", lsn);
+      uint32_t backoff_ms = 10;
+      while (!write_all(segment_fd_, batch.data(), batch.size()) || ::fdatasync(segment_fd_) != 0) {
+        LOG_WARN(Wal) << "write failed: " << std::strerror(errno)
+                      << " (segment " << segment_id_ << "), retrying";
+        // Drop any partial write so the segment stays a clean record sequence
+        if (::ftruncate(segment_fd_, static_cast<off_t>(segment_size_)) == 0) {
+          ::lseek(segment_fd_, static_cast<off_t>(segment_size_), SEEK_SET);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms));
+        backoff_ms = std::min(backoff_ms * 2, kMaxBackoffMs);
+      }
+
+      segment_size_ += batch.size();
+      batch.clear();
+      durable_lsn_.store(lsn, std::memory_order_release);
+      span.end();
+      const Position end{ segment_id_, segment_size_ };
+
+      if (segment_size_ >= options_.segment_bytes) {
+        try {
+          open_segment(segment_id_ + 1);
+        } catch (const std::exception& e) {
+          // Keep appending to the current segment; retry rotation next commit
+          LOG_ERROR(Wal) << e.what();
+        }
+      }
+
+      {
+        std::lock_guard lock(mutex_);
+        committed_ = { segment_id_, segment_size_ };
+        marks_.push_back({ end, lsn });
+      }
+      replay_cv_.notify_one();
+    }
+
+    if (stop) return;
+  }
+}
+
+void WriteAheadLog::open_segment(uint64_t id) {
+  std::string path = segment_path(id);
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("WriteAheadLog: cannot open " + path + ": " + std::strerror(errno));
+  }
+  fsync_dir(options_.dir);
+
+  if (segment_fd_ >= 0) ::close(segment_fd_);
+  segment_fd_   = fd;
+  segment_id_   = id;
+  segment_size_ = 0;
+}
+
+// ── Replayer thread ──────────────────────────────────────────────────────────
+
+void WriteAheadLog::replayer_loop() {
+  std::string buf;
+  std::vector<Record> batch;
+  uint32_t backoff_ms = 0;
+
+  auto behind = [this](const Position& limit) { return cursor_.before(limit); };
+
+  for (;;) {
+    Position limit;
+    {
+      std::unique_lock lock(mutex_);
+      if (backoff_ms > 0) {
+        replay_cv_.wait_for(lock, std::chrono::milliseconds(backoff_ms), [this] { return stopping_; });
+      } else {
+        replay_cv_.wait(lock, [&] { return stopping_ || behind(committed_); });
+      }
+      if (stopping_) return;
+      limit = committed_;
+    }
+
+    if (!behind(limit)) continue;
+
+    // Sealed segments are read to EOF; the active one up to the commit point
+    const bool sealed = cursor_.segment < limit.segment;
+    const std::string path = segment_path(cursor_.segment);
+
+    batch.clear();
+    uint64_t end = 0;
+    uint64_t consumed = 0;
+    bool corrupt = false;
+    const char* failed = nullptr;   // I/O step that failed; retried, nothing skipped
+    int error = 0;
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st {};
+    if (fd < 0) {
+      error = errno;
+      // A sealed segment removed by hand has nothing left to replay
+      if (error == ENOENT && sealed) {
+        LOG_ERROR(Wal) << "segment " << cursor_.segment << " is missing, skipping it";
+      } else {
+        failed = "open";
+      }
+    } else if (::fstat(fd, &st) != 0) {
+      error = errno;
+      failed = "stat";
+    } else {
+      end = sealed ? static_cast<uint64_t>(st.st_size) : limit.offset;
+    }
+
+    // Parse whole records from one chunk
+    if (!failed && cursor_.offset < end) {
+      size_t avail = static_cast<size_t>(end - cursor_.offset);
+      buf.resize(std::min(avail, kReadChunk));
+      if (!read_at(fd, buf.data(), buf.size(), cursor_.offset)) {
+        error = errno;
+        failed = "read";
+      }
+
+      size_t pos = 0;
+      while (!failed && batch.size() < options_.replay_batch && pos + kHeaderSize <= buf.size()) {
+        uint32_t len = load_u32(buf.data() + pos);
+        uint32_t crc = load_u32(buf.data() + pos + 4);
+        if (pos + kHeaderSize + len > avail || len < 2) { corrupt = true; break; }
+
+        if (pos + kHeaderSize + len > buf.size()) {
+          if (!batch.empty()) break;
+          // Single record larger than the chunk — read it whole
+          buf.resize(kHeaderSize + len);
+          if (!read_at(fd, buf.data(), buf.size(), cursor_.offset)) {
+            error = errno;
+            failed = "read";
+            break;
+          }
+        }
+
+        const char* body = buf.data() + pos + kHeaderSize;
+        if (crc_of(body, len) != crc) { corrupt = true; break; }
+
+        uint16_t project_len;
+        std::memcpy(&project_len, body, sizeof(project_len));
+        if (sizeof(project_len) + project_len > len) { corrupt = true; break; }
+
+        pos += kHeaderSize + len;
+        batch.push_back({
+          std::string_view(body + sizeof(project_len), project_len),
+          std::string_view(body + sizeof(project_len) + project_len,
+                           len - sizeof(project_len) - project_len),
+          Position{ cursor_.segment, cursor_.offset + pos }.key()
+        });
+      }
+      consumed = pos;
+    }
+    if (fd >= 0) ::close(fd);
+
+    if (failed) {
+      backoff_ms = std::clamp(backoff_ms * 2, 100u, kMaxBackoffMs);
+      LOG_WARN(Wal) << "cannot " << failed << " segment " << cursor_.segment << ": "
+                    << (error ? std::strerror(error) : "unexpected end of file")
+                    << ", retrying in " << backoff_ms << "ms";
+      continue;
+    }
+
+    if (!batch.empty() && !sink_(id_, batch)) {
+      backoff_ms = std::clamp(backoff_ms * 2, 100u, kMaxBackoffMs);
+      LOG_WARN(Wal) << "replay of " << batch.size() << " updates failed, retrying in "
+                    << backoff_ms << "ms";
+      continue;
+    }
+    backoff_ms = 0;
+    cursor_.offset += consumed;
+
+    if (corrupt || (consumed == 0 && cursor_.offset < end)) {
+      LOG_ERROR(Wal) << "corrupt record in segment " << cursor_.segment
+                     << " at offset " << cursor_.offset << ", skipping rest of segment";
+      cursor_.offset = end;
+    }
+
+    if (sealed && cursor_.offset >= end) {
+      // Fully acknowledged — drop the segment
+      ::unlink(path.c_str());
+      cursor_ = { cursor_.segment + 1, 0 };
+    }
+    save_cursor();
+
+    std::lock_guard lock(mutex_);
+    while (!marks_.empty() && !cursor_.before(marks_.front().end)) {
+      replayed_lsn_.store(marks_.front().lsn, std::memory_order_release);
+      marks_.pop_front();
+    }
+  }
+}
+
+// ── Recovery ─────────────────────────────────────────────────────────────────
+
+void WriteAheadLog::recover() {
+  load_id();
+  auto segments = list_segments();
+  load_cursor();
+
+  if (!segments.empty()) {
+    // Only the last segment can have a torn tail (earlier ones were sealed)
+    std::string path = segment_path(segments.back());
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd >= 0) {
+      struct stat st {};
+      ::fstat(fd, &st);
+      uint64_t size  = static_cast<uint64_t>(st.st_size);
+      uint64_t valid = scan_valid_prefix(fd, size);
+      if (valid < size) {
+        LOG_WARN(Wal) << "truncating torn tail of segment " << segments.back()
+                      << " (" << (size - valid) << " bytes)";
+        if (::ftruncate(fd, static_cast<off_t>(valid)) == 0) ::fdatasync(fd);
+      }
+      ::close(fd);
+    }
+
+    if (cursor_.segment < segments.front()) {
+      cursor_ = { segments.front(), 0 };
+    }
+    LOG_INFO(Wal) << "recovered " << segments.size() << " segment(s), replaying from "
+                  << cursor_.segment << ":" << cursor_.offset;
+  }
+
+  // Never reuse a segment id the cursor has passed: positions must keep
+  // increasing for the sink to tell replayed records apart
+  open_segment(std::max(segments.empty() ? 1 : segments.back() + 1, cursor_.segment));
+  if (segments.empty()) cursor_ = { segment_id_, 0 };
+  committed_ = { segment_id_, 0 };
+
+  // Earlier processes' records count as one LSN, replayed before ours
+  if (cursor_.before(committed_)) {
+    marks_.push_back({ committed_, kRecoveredLsn });
+  } else {
+    replayed_lsn_.store(kRecoveredLsn, std::memory_order_relaxed);
+  }
+}
+
+std::string WriteAheadLog::segment_path(uint64_t id) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.wal", static_cast<unsigned long long>(id));
+  return options_.dir + "/" + name;
+}
+
+std::vector<uint64_t> WriteAheadLog::list_segments() const {
+  std::vector<uint64_t> ids;
+  for (auto& entry : fs::directory_iterator(options_.dir)) {
+    auto name = entry.path().filename().string();
+    if (name.size() != 20 || entry.path().extension() != ".wal") continue;
+    ids.push_back(std::stoull(name.substr(0, 16), nullptr, 16));
+  }
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+void WriteAheadLog::load_id() {
+  const std::string path = options_.dir + "/id";
+  {
+    std::ifstream in(path);
+    if (in >> id_ && !id_.empty()) return;
+  }
+
+  std::random_device rd;
+  char hex[33];
+  std::snprintf(hex, sizeof(hex), "%08x%08x%08x%08x", rd(), rd(), rd(), rd());
+  id_ = hex;
+
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    out << id_ << '\n';
+    if (!out) throw std::runtime_error("WriteAheadLog: cannot write " + path);
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    throw std::runtime_error("WriteAheadLog: cannot write " + path + ": " + std::strerror(errno));
+  }
+  fsync_dir(options_.dir);
+}
+
+void WriteAheadLog::load_cursor() {
+  std::ifstream in(options_.dir + "/cursor");
+  Position pos;
+  if (in >> pos.segment >> pos.offset) cursor_ = pos;
+}
+
+void WriteAheadLog::save_cursor() const {
+  std::string tmp = options_.dir + "/cursor.tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    out << cursor_.segment << ' ' << cursor_.offset << '\n';
+    if (!out) return;
+  }
+  std::rename(tmp.c_str(), (options_.dir + "/cursor").c_str());
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <cstdint>
+
+/**
+ * Durable local write-ahead log for Yjs updates.
+ *
+ * Every persisted update is appended here first and replayed to the
+ * database asynchronously, so the event loop never waits on Supabase and
+ * edits survive database outages and process crashes.
+ *
+ * On-disk layout: a directory of append-only segment files
+ * (<16 hex digits>.wal), each a sequence of CRC-framed records:
+ *
+ *   [u32 body_len][u32 crc32(body)][body]
+ *   body = [u16 project_len][project_id][payload]
+ *
+ * Integers are host byte order (the log is node-local).
+ *
+ * Threads:
+ *   - Writer: group commit. Records appended during one commit window
+ *     are written with a single write() + fdatasync().
+ *   - Replayer: reads committed records in batches, hands them to the
+ *     replay sink (a bulk insert into yjs_updates), then advances a cursor
+ *     file and unlinks fully acknowledged segments. Failed batches and
+ *     segments that cannot be opened or read are retried with backoff;
+ *     the cursor only skips data found corrupt.
+ *
+ * Replay is at-least-once: a crash between the sink storing a batch and
+ * the cursor being saved hands the batch over again. Payloads are scene
+ * ops, some relative (move carries dx/dy), so the sink must not store a
+ * record twice. Each record carries its log position, increasing over the
+ * life of the log directory, and the log has a random id kept in the
+ * directory; a sink stores both with the batch and skips records at or
+ * below the highest position it already holds for the id.
+ *
+ * Recovery (constructor): a torn record at the tail of the last segment
+ * is truncated, replay resumes from the saved cursor, and writing
+ * continues in a fresh segment.
+ *
+ * LSNs number this process's appends. The replayer reports how far the
+ * database has caught up (replayed_lsn) as its cursor passes the end of
+ * each commit, so readers of the database can tell whether it already
+ * holds a given update.
+ */
+class WriteAheadLog {
+public:
+  struct Record {
+    std::string_view project_id;
+    std::string_view payload;
+    uint64_t         position;   // End of the record; orders it in the log
+  };
+
+  /**
+   * Replay callback, given the log's id and a batch in log order. Return
+   * true once the batch is durably stored.
+   */
+  using ReplaySink = std::function<bool(std::string_view log_id, const std::vector<Record>& batch)>;
+
+  struct Options {
+    std::string dir;
+    uint64_t    segment_bytes      = 64ull * 1024 * 1024;
+    uint32_t    commit_interval_ms = 5;
+    uint32_t    replay_batch       = 256;
+  };
+
+  WriteAheadLog(Options options, ReplaySink sink);
+  ~WriteAheadLog();
+
+  WriteAheadLog(const WriteAheadLog&) = delete;
+  WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+  /**
+   * LSN standing for every record recovered from an earlier process;
+   * appends are numbered after it.
+   */
+  static constexpr uint64_t kRecoveredLsn = 1;
+
+  /**
+   * Append an update. Non-blocking: the record becomes durable at the end
+   * of the current commit window. Returns its log sequence number, or 0
+   * (logged) if the record cannot be framed: project id over 64 KiB.
+   */
+  uint64_t append(std::string_view project_id, const uint8_t* data, size_t len);
+
+  /** Highest LSN that has been fdatasync'ed to disk; acks wait for it. */
+  uint64_t durable_lsn() const { return durable_lsn_.load(std::memory_order_acquire); }
+
+  /**
+   * Highest LSN the replay sink has stored, with everything before it:
+   * state read back from the database includes those updates.
+   */
+  uint64_t replayed_lsn() const { return replayed_lsn_.load(std::memory_order_acquire); }
+
+  /** Random id of the log directory, created with it. */
+  const std::string& id() const { return id_; }
+
+private:
+  struct Position {
+    uint64_t segment = 0;
+    uint64_t offset  = 0;
+
+    bool before(const Position& other) const {
+      return segment < other.segment || (segment == other.segment && offset < other.offset);
+    }
+
+    /** Record::position: segment in the high bits, offset in the low 40. */
+    uint64_t key() const { return segment << 40 | offset; }
+  };
+
+  /** End of a commit and the LSN of its last record. */
+  struct Mark {
+    Position end;
+    uint64_t lsn;
+  };
+
+  Options     options_;
+  ReplaySink  sink_;
+  std::string id_;
+
+  // ── Writer state ──────────────────────────────────────────────────────
+  std::mutex              mutex_;
+  std::condition_variable write_cv_;
+  std::condition_variable replay_cv_;
+  std::string             pending_;          // Framed records awaiting commit
+  uint64_t                next_lsn_ = kRecoveredLsn + 1;
+  uint64_t                pending_lsn_ = kRecoveredLsn;  // LSN of last record in pending_
+  Position                committed_;        // End of durable data
+  std::deque<Mark>        marks_;            // Commits not yet replayed, in order
+  bool                    stopping_ = false;
+  std::atomic<uint64_t>   durable_lsn_{kRecoveredLsn};
+  std::atomic<uint64_t>   replayed_lsn_{0};
+
+  int      segment_fd_   = -1;               // Writer thread only
+  uint64_t segment_id_   = 0;
+  uint64_t segment_size_ = 0;
+
+  // ── Replayer state ────────────────────────────────────────────────────
+  Position cursor_;
+
+  std::thread writer_;
+  std::thread replayer_;
+
+  void recover();
+  void open_segment(uint64_t id);
+  void writer_loop();
+  void replayer_loop();
+
+  std::string segment_path(uint64_t id) const;
+  std::vector<uint64_t> list_segments() const;
+  void load_id();
+  void load_cursor();
+  void save_cursor() const;
+};
@@ -1,15 +1,17 @@
 #include "yjs_persistence.h"
 #include <algorithm>
+#include "log/logger.h"
 
-YjsPersistence::YjsPersistence(SupabaseClient& client, uint32_t compaction_threshold)
-  : client_(client), compaction_threshold_(compaction_threshold) {}
+YjsPersistence::YjsPersistence(PersistenceBackend& backend, WriteAheadLog* wal)
+  : backend_(backend), wal_(wal) {}
 
 std::vector<uint8_t> YjsPersistence::load_state(const std::string& project_id) {
   // 1. Load snapshot (full state)
-  auto snapshot = client_.get_snapshot(project_id);
+  auto snapshot = backend_.get_snapshot(project_id);
 
   // 2. Load incremental updates after snapshot
-  auto updates = client_.get_updates(project_id, 0);
+  std::vector<std::vector<uint8_t>> updates;
+  backend_.get_updates(project_id, 0, updates);
 
   if (!snapshot.has_value() && updates.empty()) {
     return {}; // No data — fresh project
@@ -43,33 +45,17 @@ std::vector<uint8_t> YjsPersistence::load_state(const std::string& project_id) {
   return result;
 }
 
-void YjsPersistence::persist_update(const std::string& project_id, const uint8_t* data, size_t len) {
-  // Write incremental update
-  client_.append_update(project_id, data, len);
-
-  // Check if compaction is needed
-  uint32_t count;
-  {
-    std::lock_guard lock(counter_mutex_);
-    count = ++update_counts_[project_id];
+std::optional<uint64_t> YjsPersistence::persist_update(const std::string& project_id, const uint8_t* data,
+                                                       size_t len) {
+  // Write incremental update: durable locally first if the WAL is on
+  if (wal_) {
+    const uint64_t lsn = wal_->append(project_id, data, len);
+    if (lsn == 0) return std::nullopt;
+    return lsn;
   }
-
-  // Compaction trigger is handled by the room, which has the merged Yjs state.
-  // We just track the count here so the room can check it.
-  (void)count; // Room will call compact() when ready
-}
-
-void YjsPersistence::compact(const std::string& project_id, const uint8_t* merged_state, size_t len) {
-  // Atomic compaction:
-  // 1. Write new snapshot
-  client_.upsert_snapshot(project_id, merged_state, len);
-
-  // 2. Delete old incremental updates
-  client_.clear_updates(project_id);
-
-  // 3. Reset counter
-  {
-    std::lock_guard lock(counter_mutex_);
-    update_counts_[project_id] = 0;
+  if (!backend_.append_update(project_id, data, len)) {
+    LOG_SAMPLED(Persistence, Error, 5) << "Failed to persist update for project " << project_id;
+    return std::nullopt;
   }
+  return 0;
 }
@@ -1,27 +1,25 @@
 #pragma once
-#include "supabase_client.h"
+#include "persistence_backend.h"
+#include "write_ahead_log.h"
 #include <string>
 #include <vector>
+#include <optional>
 #include <cstdint>
-#include <mutex>
 
 /**
  * Yjs CRDT persistence layer.
  *
- * Manages incremental update accumulation and periodic snapshot compaction.
- * Each room accumulates binary Yjs updates in memory and flushes to Supabase
- * on a timer or when the update count exceeds a threshold.
+ * Rooms hand over incremental updates as they are stored; joins read back
+ * the stored snapshot. The server holds no merged document, so it never
+ * writes snapshots or compacts updates itself.
  *
- * Compaction strategy:
- *   1. Accumulate incremental updates (small, fast writes)
- *   2. When count > threshold OR timer fires:
- *      a. Merge all updates into a single state vector (snapshot)
- *      b. Write snapshot atomically
- *      c. Delete old incremental updates
+ * With a write-ahead log attached, updates are appended to the local log
+ * and replayed to the backend in batches by the log's replay thread;
+ * without one they are written to the backend synchronously.
  */
 class YjsPersistence {
 public:
-  explicit YjsPersistence(SupabaseClient& client, uint32_t compaction_threshold = 100);
+  explicit YjsPersistence(PersistenceBackend& backend, WriteAheadLog* wal = nullptr);
 
   /**
    * Load full state for a project: snapshot + any updates after it.
@@ -31,21 +29,19 @@ public:
 
   /**
    * Persist an incremental Yjs update.
-   * Triggers compaction if threshold is reached.
+   * Returns its WAL LSN (durable once WriteAheadLog::durable_lsn() reaches
+   * it), 0 if it was written to the backend directly, or nullopt if the
+   * log or the backend rejected it.
    */
-  void persist_update(const std::string& project_id, const uint8_t* data, size_t len);
+  std::optional<uint64_t> persist_update(const std::string& project_id, const uint8_t* data, size_t len);
 
   /**
-   * Force compaction: merge all updates into snapshot.
-   * Called periodically or on room close.
+   * Attach the write-ahead log, or detach it (nullptr) so further
+   * updates go to the backend directly. Event loop thread only.
    */
-  void compact(const std::string& project_id, const uint8_t* merged_state, size_t len);
+  void set_wal(WriteAheadLog* wal) { wal_ = wal; }
 
 private:
-  SupabaseClient& client_;
-  uint32_t compaction_threshold_;
-
-  // Per-project update counter (for compaction trigger)
-  std::mutex counter_mutex_;
-  std::unordered_map<std::string, uint32_t> update_counts_;
+  PersistenceBackend& backend_;
+  WriteAheadLog*      wal_;    // Optional; owned by the server
 };
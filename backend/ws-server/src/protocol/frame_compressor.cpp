@@ -0,0 +1,98 @@
+#include "frame_compressor.h"
+#include <fstream>
+#include <iterator>
+#include "log/logger.h"
+
+#ifdef WIGMA_HAVE_ZSTD
+#include <zstd.h>
+
+FrameCompressor::~FrameCompressor() {
+  ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(cctx_));
+  ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(dctx_));
+  ZSTD_freeCDict(static_cast<ZSTD_CDict*>(cdict_));
+  ZSTD_freeDDict(static_cast<ZSTD_DDict*>(ddict_));
+}
+
+bool FrameCompressor::load_dictionary(const std::string& path, int level) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    LOG_ERROR(Zstd) << "cannot open dictionary " << path;
+    return false;
+  }
+  std::string dict((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  unsigned id = ZSTD_getDictID_fromDict(dict.data(), dict.size());
+  if (id == 0) {
+    LOG_ERROR(Zstd) << path << " is not a trained zstd dictionary";
+    return false;
+  }
+
+  auto* cdict = ZSTD_createCDict(dict.data(), dict.size(), level);
+  auto* ddict = ZSTD_createDDict(dict.data(), dict.size());
+  if (!cdict || !ddict) {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+    return false;
+  }
+
+  if (!cctx_) cctx_ = ZSTD_createCCtx();
+  if (!dctx_) dctx_ = ZSTD_createDCtx();
+  ZSTD_freeCDict(static_cast<ZSTD_CDict*>(cdict_));
+  ZSTD_freeDDict(static_cast<ZSTD_DDict*>(ddict_));
+
+  cdict_   = cdict;
+  ddict_   = ddict;
+  dict_    = std::move(dict);
+  dict_id_ = id;
+  return true;
+}
+
+bool FrameCompressor::compress(const uint8_t* src, size_t len, std::string& out) {
+  if (!cdict_) return false;
+
+  const size_t base = out.size();
+  out.resize(base + ZSTD_compressBound(len));
+  size_t n = ZSTD_compress_usingCDict(static_cast<ZSTD_CCtx*>(cctx_),
+                                      out.data() + base, out.size() - base,
+                                      src, len, static_cast<ZSTD_CDict*>(cdict_));
+  if (ZSTD_isError(n)) {
+    out.resize(base);
+    return false;
+  }
+  out.resize(base + n);
+  return true;
+}
+
+bool FrameCompressor::decompress(const uint8_t* src, size_t len, size_t max_size, std::string& out) {
+  if (!ddict_) return false;
+
+  unsigned long long size = ZSTD_getFrameContentSize(src, len);
+  if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR || size > max_size) {
+    return false;
+  }
+
+  const size_t base = out.size();
+  out.resize(base + size);
+  size_t n = ZSTD_decompress_usingDDict(static_cast<ZSTD_DCtx*>(dctx_),
+                                        out.data() + base, size, src, len,
+                                        static_cast<ZSTD_DDict*>(ddict_));
+  if (ZSTD_isError(n) || n != size) {
+    out.resize(base);
+    return false;
+  }
+  return true;
+}
+
+#else  // !WIGMA_HAVE_ZSTD
+
+FrameCompressor::~FrameCompressor() = default;
+
+bool FrameCompressor::load_dictionary(const std::string& path, int /*level*/) {
+  LOG_ERROR(Zstd) << "built without zstd support, ignoring dictionary " << path;
+  return false;
+}
+
+bool FrameCompressor::compress(const uint8_t*, size_t, std::string&) { return false; }
+bool FrameCompressor::decompress(const uint8_t*, size_t, size_t, std::string&) { return false; }
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+/**
+ * Dictionary-based zstd compression for scene-op and awareness payloads.
+ *
+ * Scene ops and awareness states are small, highly repetitive JSON
+ * documents; a dictionary trained on captured traffic (`zstd --train`)
+ * compresses them far better than per-socket permessage-deflate, and the
+ * server only compresses each frame once, then relays the same bytes to
+ * every zstd-capable peer.
+ *
+ * The dictionary ID doubles as its version: clients report the ID they
+ * hold at join, and get the dictionary pushed (0x06 frame) on mismatch.
+ *
+ * Built without zstd (WIGMA_HAVE_ZSTD undefined), enabled() is always
+ * false and the capability is never negotiated.
+ *
+ * Not thread-safe: reuses one compression and one decompression context.
+ */
+class FrameCompressor {
+public:
+  FrameCompressor() = default;
+  ~FrameCompressor();
+
+  FrameCompressor(const FrameCompressor&) = delete;
+  FrameCompressor& operator=(const FrameCompressor&) = delete;
+
+  /** Load a trained dictionary. Returns false (and stays disabled) on error. */
+  bool load_dictionary(const std::string& path, int level);
+
+  bool enabled() const { return cdict_ != nullptr; }
+
+  /** zstd dictionary ID (0 when disabled). */
+  uint32_t dict_id() const { return dict_id_; }
+
+  /** Raw dictionary bytes, sent to clients holding another version. */
+  std::string_view dictionary() const { return dict_; }
+
+  /** Compress src and append the zstd frame to out. */
+  bool compress(const uint8_t* src, size_t len, std::string& out);
+
+  /**
+   * Decompress a zstd frame (content size must be recorded in the frame
+   * and at most max_size) and append the result to out.
+   */
+  bool decompress(const uint8_t* src, size_t len, size_t max_size, std::string& out);
+
+private:
+  std::string dict_;
+  uint32_t    dict_id_ = 0;
+
+  // Opaque zstd handles (ZSTD_CCtx, ZSTD_DCtx, ZSTD_CDict, ZSTD_DDict)
+  void* cctx_  = nullptr;
+  void* dctx_  = nullptr;
+  void* cdict_ = nullptr;
+  void* ddict_ = nullptr;
+};
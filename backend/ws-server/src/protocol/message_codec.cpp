@@ -1,16 +1,376 @@
 #include "message_codec.h"
-#include <nlohmann/json.hpp>
+#include <charconv>
 #include <cstring>
 
-using json = nlohmann::json;
+namespace {
+
+// ── Serialization ────────────────────────────────────────────────────────────
+
+/** One "key":value pair, left out when !present. Keys are plain literals. */
+template <typename T>
+struct Member {
+  std::string_view key;
+  const T&         value;
+  bool             present;
+};
+
+template <typename T>
+Member<T> member(std::string_view key, const T& value, bool present = true) {
+  return { key, value, present };
+}
+
+void put(std::string& out, std::string_view s) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  out += '"';
+  size_t run = 0;   // Bytes copied through in one append
+  for (size_t i = 0; i < s.size(); ++i) {
+    const auto c = static_cast<unsigned char>(s[i]);
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+    out.append(s.data() + run, i - run);
+    run = i + 1;
+    switch (c) {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n";  break;
+      case '\r': out += "\\r";  break;
+      case '\t': out += "\\t";  break;
+      default:
+        out += "\\u00";
+        out += kHex[c >> 4];
+        out += kHex[c & 0xF];
+    }
+  }
+  out.append(s.data() + run, s.size() - run);
+  out += '"';
+}
+
+template <typename T, typename = std::enable_if_t<std::is_unsigned_v<T>>>
+void put(std::string& out, T value) {
+  char buf[20];
+  auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+  out.append(buf, end);
+}
+
+void put(std::string& out, std::span<const std::string_view> items) {
+  out += '[';
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (i) out += ',';
+    put(out, items[i]);
+  }
+  out += ']';
+}
+
+/** Clear out and write {members...} into it. */
+template <typename... T>
+void write_object(std::string& out, const Member<T>&... members) {
+  out.clear();
+  out += '{';
+  bool first = true;
+  auto write = [&](const auto& m) {
+    if (!m.present) return;
+    if (!first) out += ',';
+    first = false;
+    out += '"';
+    out += m.key;
+    out += "\":";
+    put(out, m.value);
+  };
+  (write(members), ...);
+  out += '}';
+}
+
+// ── Parsing ──────────────────────────────────────────────────────────────────
+
+/**
+ * Single-pass reader for one control object. Strings without escapes are
+ * returned as views of the input; escaped ones are decoded into scratch,
+ * which is reserved to the input size first so earlier views stay valid.
+ */
+class ControlParser {
+public:
+  ControlParser(std::string_view text, std::string& scratch)
+    : p_(text.data()), end_(text.data() + text.size()), size_(text.size()), scratch_(scratch) {}
+
+  bool parse(MessageCodec::ControlMessage& msg) {
+    skip_ws();
+    if (!eat('{')) return false;
+    skip_ws();
+    if (!eat('}')) {
+      do {
+        skip_ws();
+        std::string_view key;
+        if (!string(key)) return false;
+        skip_ws();
+        if (!eat(':')) return false;
+        skip_ws();
+        if (!member(key, msg)) return false;
+        skip_ws();
+      } while (eat(','));
+      if (!eat('}')) return false;
+    }
+    skip_ws();
+    return p_ == end_;
+  }
+
+private:
+  static constexpr int kMaxDepth = 32;
+
+  const char*  p_;
+  const char*  end_;
+  size_t       size_;
+  std::string& scratch_;
+
+  bool member(std::string_view key, MessageCodec::ControlMessage& msg) {
+    if (key == "type")      return string(msg.type);
+    if (key == "projectId") return string(msg.project_id);
+    if (key == "token")     return string(msg.token);
+    if (key == "from")      return number(msg.from_seq);
+    if (key == "to")        return number(msg.to_seq);
+    if (key == "spectate")  return boolean(msg.spectate);
+    if (key == "dictId") {
+      uint64_t id;
+      if (!number(id) || id > UINT32_MAX) return false;
+      msg.dict_id = static_cast<uint32_t>(id);
+      return true;
+    }
+    if (key == "caps")      return peek() == '[' && caps(msg.caps);
+    return skip_value(0);
+  }
+
+  char peek() const { return p_ < end_ ? *p_ : '\0'; }
+
+  bool eat(char c) {
+    if (peek() != c) return false;
+    ++p_;
+    return true;
+  }
+
+  void skip_ws() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) ++p_;
+  }
+
+  bool literal(std::string_view word) {
+    if (static_cast<size_t>(end_ - p_) < word.size()
+        || std::memcmp(p_, word.data(), word.size()) != 0) return false;
+    p_ += word.size();
+    return true;
+  }
+
+  bool boolean(bool& out) {
+    if (literal("true"))  { out = true;  return true; }
+    if (literal("false")) { out = false; return true; }
+    return false;
+  }
+
+  /** Non-negative integer (what the protocol's counters are). */
+  bool number(uint64_t& out) {
+    auto [ptr, ec] = std::from_chars(p_, end_, out);
+    if (ec != std::errc() || ptr == p_) return false;
+    if (*p_ == '0' && ptr - p_ > 1) return false;   // Leading zero
+    p_ = ptr;
+    const char c = peek();
+    return c != '.' && c != 'e' && c != 'E';
+  }
+
+  bool skip_number() {
+    eat('-');
+    if (eat('0')) {
+      // No more integer digits after a leading zero
+    } else if (peek() >= '1' && peek() <= '9') {
+      while (peek() >= '0' && peek() <= '9') ++p_;
+    } else {
+      return false;
+    }
+    if (eat('.')) {
+      if (!(peek() >= '0' && peek() <= '9')) return false;
+      while (peek() >= '0' && peek() <= '9') ++p_;
+    }
+    if (peek() == 'e' || peek() == 'E') {
+      ++p_;
+      if (peek() == '+' || peek() == '-') ++p_;
+      if (!(peek() >= '0' && peek() <= '9')) return false;
+      while (peek() >= '0' && peek() <= '9') ++p_;
+    }
+    return true;
+  }
+
+  static int hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  bool hex4(uint32_t& out) {
+    if (end_ - p_ < 4) return false;
+    out = 0;
+    for (int i = 0; i < 4; ++i) {
+      int d = hex(*p_++);
+      if (d < 0) return false;
+      out = (out << 4) | static_cast<uint32_t>(d);
+    }
+    return true;
+  }
+
+  void put_utf8(uint32_t cp) {
+    if (cp < 0x80) {
+      scratch_ += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+      scratch_ += static_cast<char>(0xC0 | (cp >> 6));
+      scratch_ += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      scratch_ += static_cast<char>(0xE0 | (cp >> 12));
+      scratch_ += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      scratch_ += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+      scratch_ += static_cast<char>(0xF0 | (cp >> 18));
+      scratch_ += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+      scratch_ += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      scratch_ += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+  }
+
+  /** One escape after the backslash; decoded into scratch if decode. */
+  bool escape(bool decode) {
+    if (p_ >= end_) return false;
+    const char c = *p_++;
+    char plain;
+    switch (c) {
+      case '"':  plain = '"';  break;
+      case '\\': plain = '\\'; break;
+      case '/':  plain = '/';  break;
+      case 'b':  plain = '\b'; break;
+      case 'f':  plain = '\f'; break;
+      case 'n':  plain = '\n'; break;
+      case 'r':  plain = '\r'; break;
+      case 't':  plain = '\t'; break;
+      case 'u': {
+        uint32_t cp;
+        if (!hex4(cp)) return false;
+        if (cp >= 0xDC00 && cp <= 0xDFFF) return false;   // Lone low surrogate
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+          uint32_t low;
+          if (!literal("\\u") || !hex4(low) || low < 0xDC00 || low > 0xDFFF) return false;
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        if (decode) put_utf8(cp);
+        return true;
+      }
+      default:
+        return false;
+    }
+    if (decode) scratch_ += plain;
+    return true;
+  }
+
+  /** Read a string (opening quote at p_) as a view of the input or scratch. */
+  bool string(std::string_view& out) {
+    if (!eat('"')) return false;
+    const char* start = p_;
+    while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+      if (static_cast<unsigned char>(*p_) < 0x20) return false;
+      ++p_;
+    }
+    if (p_ >= end_) return false;
+    if (*p_ == '"') {
+      out = std::string_view(start, static_cast<size_t>(p_ - start));
+      ++p_;
+      return true;
+    }
+
+    // Escaped: decoded text is never longer than the input
+    scratch_.reserve(size_);
+    const size_t begin = scratch_.size();
+    scratch_.append(start, p_);
+    while (p_ < end_ && *p_ != '"') {
+      const char c = *p_++;
+      if (c == '\\') {
+        if (!escape(true)) return false;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        return false;
+      } else {
+        scratch_ += c;
+      }
+    }
+    if (!eat('"')) return false;
+    out = std::string_view(scratch_.data() + begin, scratch_.size() - begin);
+    return true;
+  }
+
+  bool skip_string() {
+    if (!eat('"')) return false;
+    while (p_ < end_ && *p_ != '"') {
+      const char c = *p_++;
+      if (c == '\\') {
+        if (!escape(false)) return false;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        return false;
+      }
+    }
+    return eat('"');
+  }
+
+  /** "caps": strings we know set bits; anything else is skipped. */
+  bool caps(uint32_t& out) {
+    eat('[');
+    skip_ws();
+    if (eat(']')) return true;
+    do {
+      skip_ws();
+      if (peek() == '"') {
+        std::string_view cap;
+        if (!string(cap)) return false;
+        if (cap == "seq")  out |= kCapSeq;
+        if (cap == "zstd") out |= kCapZstd;
+      } else if (!skip_value(1)) {
+        return false;
+      }
+      skip_ws();
+    } while (eat(','));
+    return eat(']');
+  }
+
+  bool skip_value(int depth) {
+    if (depth > kMaxDepth) return false;
+    switch (peek()) {
+      case '"': return skip_string();
+      case 't': return literal("true");
+      case 'f': return literal("false");
+      case 'n': return literal("null");
+      case '{':
+      case '[': {
+        const char close = *p_++ == '{' ? '}' : ']';
+        skip_ws();
+        if (eat(close)) return true;
+        do {
+          skip_ws();
+          if (close == '}') {
+            if (!skip_string()) return false;
+            skip_ws();
+            if (!eat(':')) return false;
+            skip_ws();
+          }
+          if (!skip_value(depth + 1)) return false;
+          skip_ws();
+        } while (eat(','));
+        return eat(close);
+      }
+      default:
+        return skip_number();
+    }
+  }
+};
+
+} // namespace
 
 namespace MessageCodec {
 
-std::string encode_binary(MessageType type, const uint8_t* data, size_t len) {
-  std::string out(1 + len, '\0');
+std::string_view encode_binary(std::pmr::memory_resource& scratch, MessageType type,
+                               const uint8_t* data, size_t len) {
+  auto* out = static_cast<char*>(scratch.allocate(1 + len, 1));
   out[0] = static_cast<char>(type);
-  std::memcpy(out.data() + 1, data, len);
-  return out;
+  if (len > 0) std::memcpy(out + 1, data, len);
+  return { out, 1 + len };
 }
 
 DecodedBinary decode_binary(const uint8_t* data, size_t len) {
@@ -25,52 +385,61 @@ DecodedBinary decode_binary(const uint8_t* data, size_t len) {
   };
 }
 
-std::string encode_joined(std::string_view user_id, const std::vector<std::string>& peers) {
-  json j;
-  j["type"]   = "joined";
-  j["userId"] = user_id;
-  j["peers"]  = peers;
-  return j.dump();
+void write_seq_header(char* out, MessageType type, uint64_t seq) {
+  out[0] = static_cast<char>(type);
+  for (size_t i = 0; i < 8; ++i) {
+    out[1 + i] = static_cast<char>((seq >> (8 * i)) & 0xff);
+  }
 }
 
-std::string encode_peer_joined(std::string_view user_id) {
-  json j;
-  j["type"]   = "peer-joined";
-  j["userId"] = user_id;
-  return j.dump();
+void encode_joined(std::string& out, std::string_view user_id,
+                   std::span<const std::string_view> peers, uint64_t seq,
+                   std::string_view resume_token, uint32_t dict_id, bool viewer) {
+  write_object(out,
+    member("type", std::string_view("joined")),
+    member("userId", user_id),
+    member("peers", peers),
+    member("seq", seq),
+    member("resume", resume_token, !resume_token.empty()),
+    member("dictId", dict_id, dict_id != 0),
+    member("role", std::string_view("viewer"), viewer));
 }
 
-std::string encode_peer_left(std::string_view user_id) {
-  json j;
-  j["type"]   = "peer-left";
-  j["userId"] = user_id;
-  return j.dump();
+void encode_resumed(std::string& out, uint64_t seq, std::string_view resume_token) {
+  write_object(out,
+    member("type", std::string_view("resumed")),
+    member("seq", seq),
+    member("resume", resume_token));
 }
 
-std::string encode_error(std::string_view code, std::string_view message) {
-  json j;
-  j["type"]    = "error";
-  j["code"]    = code;
-  j["message"] = message;
-  return j.dump();
+void encode_peer_joined(std::string& out, std::string_view user_id) {
+  write_object(out, member("type", std::string_view("peer-joined")), member("userId", user_id));
 }
 
-std::string encode_pong() {
-  return R"({"type":"pong"})";
+void encode_peer_left(std::string& out, std::string_view user_id) {
+  write_object(out, member("type", std::string_view("peer-left")), member("userId", user_id));
 }
 
-ControlMessage decode_control(std::string_view text) {
-  try {
-    auto j = json::parse(text);
-    ControlMessage msg;
-    msg.type       = j.value("type", "");
-    msg.project_id = j.value("projectId", "");
-    msg.token      = j.value("token", "");
-    msg.valid      = !msg.type.empty();
-    return msg;
-  } catch (...) {
-    return { "", "", "", false };
-  }
+void encode_error(std::string& out, std::string_view code, std::string_view message,
+                  uint32_t retry_after_ms) {
+  write_object(out,
+    member("type", std::string_view("error")),
+    member("code", code),
+    member("message", message),
+    member("retryAfterMs", retry_after_ms, retry_after_ms != 0));
+}
+
+bool decode_control(std::string_view text, ControlMessage& out) {
+  out.type = out.project_id = out.token = {};
+  out.caps = 0;
+  out.from_seq = out.to_seq = 0;
+  out.dict_id  = 0;
+  out.spectate = false;
+  out.unescaped.clear();
+
+  ControlParser parser(text, out.unescaped);
+  out.valid = parser.parse(out) && !out.type.empty();
+  return out.valid;
 }
 
 } // namespace MessageCodec
@@ -2,7 +2,8 @@
 #include <string>
 #include <string_view>
 #include <cstdint>
-#include <vector>
+#include <span>
+#include <memory_resource>
 
 /**
  * WebSocket protocol message types.
@@ -15,6 +16,17 @@
  *   0x01 = yjs-sync     (server → client: full state)
  *   0x02 = yjs-update   (bidirectional: incremental update)
  *   0x03 = awareness    (bidirectional: cursor/presence)
+ *   0x04 = seq-update   (server → client: 0x02 stamped with room sequence)
+ *   0x05 = seq-ack      (server → sender: sequence assigned to its update)
+ *   0x06 = zstd-dict    (server → client: compression dictionary)
+ *
+ * With the "zstd" cap, 0x01/0x02/0x03/0x04 may carry the high bit (0x81,
+ * 0x82, 0x83, 0x84): the payload (after the seq for 0x84) is a zstd frame
+ * compressed with the dictionary negotiated at join.
+ *
+ * Sequenced frames (only sent to peers that joined with the "seq" cap):
+ *   [0x04][u64 seq, little-endian][update payload]
+ *   [0x05][u64 seq, little-endian]
  *
  * JSON control messages are sent as text frames.
  */
@@ -23,12 +35,29 @@ enum class MessageType : uint8_t {
   YjsSync     = 0x01,
   YjsUpdate   = 0x02,
   Awareness   = 0x03,
+  SeqUpdate   = 0x04,
+  SeqAck      = 0x05,
+  ZstdDict    = 0x06,
+};
+
+/** Type-byte flag: payload is zstd-compressed with the session dictionary. */
+constexpr uint8_t kCompressedFlag = 0x80;
+
+/** Optional protocol features a client opts into at join ("caps": [...]). */
+enum Capability : uint32_t {
+  kCapSeq  = 1 << 0,  // "seq": sequenced updates + range resync
+  kCapZstd = 1 << 1,  // "zstd": dictionary-compressed frames
 };
 
 namespace MessageCodec {
 
-  /** Encode binary payload with message type prefix. */
-  std::string encode_binary(MessageType type, const uint8_t* data, size_t len);
+  /**
+   * Encode binary payload with message type prefix, in memory taken from
+   * `scratch` and never given back: meant for a FrameArena, so the frame
+   * is valid until the arena's next reset.
+   */
+  std::string_view encode_binary(std::pmr::memory_resource& scratch, MessageType type,
+                                 const uint8_t* data, size_t len);
 
   /** Decode message type from binary frame. Returns type and payload offset. */
   struct DecodedBinary {
@@ -39,20 +68,68 @@ namespace MessageCodec {
   };
   DecodedBinary decode_binary(const uint8_t* data, size_t len);
 
-  /** Encode JSON control messages. */
-  std::string encode_joined(std::string_view user_id, const std::vector<std::string>& peers);
-  std::string encode_peer_joined(std::string_view user_id);
-  std::string encode_peer_left(std::string_view user_id);
-  std::string encode_error(std::string_view code, std::string_view message);
-  std::string encode_pong();
+  inline bool is_compressed(MessageType type) {
+    return static_cast<uint8_t>(type) & kCompressedFlag;
+  }
+  inline MessageType base_type(MessageType type) {
+    return static_cast<MessageType>(static_cast<uint8_t>(type) & ~kCompressedFlag);
+  }
+  inline MessageType compressed_type(MessageType type) {
+    return static_cast<MessageType>(static_cast<uint8_t>(type) | kCompressedFlag);
+  }
+
+  /** Size of the [type][u64 seq] header of sequenced frames. */
+  constexpr size_t kSeqHeaderSize = 9;
 
-  /** Decode JSON control message type. */
+  /** Write a sequenced frame header into out[0..kSeqHeaderSize). */
+  void write_seq_header(char* out, MessageType type, uint64_t seq);
+
+  /**
+   * Encode JSON control messages. Each clears `out` and writes the message
+   * into it; callers keep `out` around so steady-state encoding does not
+   * allocate.
+   */
+  void encode_joined(std::string& out, std::string_view user_id,
+                     std::span<const std::string_view> peers, uint64_t seq,
+                     std::string_view resume_token = {}, uint32_t dict_id = 0,
+                     bool viewer = false);
+  void encode_resumed(std::string& out, uint64_t seq, std::string_view resume_token);
+  void encode_peer_joined(std::string& out, std::string_view user_id);
+  void encode_peer_left(std::string& out, std::string_view user_id);
+  void encode_error(std::string& out, std::string_view code, std::string_view message,
+                    uint32_t retry_after_ms = 0);
+
+  /** Constant replies, serialized once. */
+  constexpr std::string_view kPong = R"({"type":"pong"})";
+
+  /**
+   * Decoded JSON control message. The strings point into the decoded
+   * frame, or into `unescaped` for the rare string with escapes, so they
+   * are valid as long as both are.
+   */
   struct ControlMessage {
-    std::string type;
-    std::string project_id;
-    std::string token;
-    bool valid;
+    std::string_view type;
+    std::string_view project_id;
+    std::string_view token;  // JWT ("join") or resume token ("resume")
+    bool valid = false;
+    uint32_t caps     = 0;   // Capability bits ("join")
+    uint64_t from_seq = 0;   // Range start ("resync", "resume")
+    uint64_t to_seq   = 0;   // Range end, 0 = latest ("resync")
+    uint32_t dict_id  = 0;   // zstd dictionary the client holds ("join")
+    bool     spectate = false; // Join read-only, outside the editor cap ("join")
+    std::string unescaped;   // Backing for escaped strings; reused
+
+    ControlMessage() = default;
+    ControlMessage(const ControlMessage&) = delete;   // Views would dangle
+    ControlMessage& operator=(const ControlMessage&) = delete;
   };
-  ControlMessage decode_control(std::string_view json);
+
+  /**
+   * Decode a control message in one pass over the text, without building
+   * a DOM: the known keys are picked out, anything else is validated and
+   * skipped. Returns out.valid (false for malformed JSON, a non-object,
+   * a missing "type" or a known key of the wrong type).
+   */
+  bool decode_control(std::string_view json, ControlMessage& out);
 
 } // namespace MessageCodec
@@ -0,0 +1,119 @@
+#include "op_coalescer.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+namespace {
+
+/** Strings of a JSON array, sorted; false if any element is not a string. */
+bool read_ids(const json& arr, std::vector<std::string>& out) {
+  if (!arr.is_array() || arr.empty()) return false;
+  out.reserve(arr.size());
+  for (auto& id : arr) {
+    if (!id.is_string()) return false;
+    out.push_back(id.get<std::string>());
+  }
+  std::sort(out.begin(), out.end());
+  return true;
+}
+
+} // namespace
+
+bool OpCoalescer::push(const uint8_t* data, size_t len) {
+  Pending op;
+  op.raw.assign(reinterpret_cast<const char*>(data), len);
+
+  // Only the exact shapes the client sends are merged; an op with extra
+  // fields may mean something this code does not know about
+  auto doc = json::parse(op.raw, nullptr, /*allow_exceptions=*/false);
+  if (doc.is_object() && doc.contains("o") && doc["o"].is_string()) {
+    const auto& kind = doc["o"].get_ref<const std::string&>();
+
+    if (kind == "move" && doc.size() == 4 && doc.contains("dx") && doc["dx"].is_number()
+        && doc.contains("dy") && doc["dy"].is_number()
+        && doc.contains("ids") && read_ids(doc["ids"], op.ids)) {
+      op.kind = Kind::Move;
+      op.dx   = doc["dx"].get<double>();
+      op.dy   = doc["dy"].get<double>();
+    } else if (kind == "modify" && doc.size() == 3 && doc.contains("id") && doc["id"].is_string()
+               && doc.contains("props") && doc["props"].is_object()) {
+      op.kind = Kind::Modify;
+      op.ids.push_back(doc["id"].get<std::string>());
+      for (auto& [key, value] : doc["props"].items()) {
+        op.props.emplace_back(key, value.dump());
+      }
+    }
+  }
+
+  if (op.kind != Kind::Opaque) {
+    const size_t stop = ops_.size() > kMaxScan ? ops_.size() - kMaxScan : 0;
+    for (size_t i = ops_.size(); i-- > stop; ) {
+      auto& prev = ops_[i];
+      if (prev.kind == op.kind && same_target(prev, op)) {
+        merge(prev, op);
+        ++merged_;
+        return true;
+      }
+      if (touches(prev, op.ids)) break;
+    }
+  }
+
+  bytes_ += len;
+  ops_.push_back(std::move(op));
+  return false;
+}
+
+bool OpCoalescer::touches(const Pending& op, const std::vector<std::string>& ids) {
+  if (op.kind == Kind::Opaque) return true;
+  for (auto& id : op.ids) {
+    if (std::binary_search(ids.begin(), ids.end(), id)) return true;
+  }
+  return false;
+}
+
+bool OpCoalescer::same_target(const Pending& a, const Pending& b) {
+  return a.ids == b.ids;   // Both sorted
+}
+
+void OpCoalescer::merge(Pending& into, Pending& from) {
+  into.dirty = true;
+
+  if (into.kind == Kind::Move) {
+    into.dx += from.dx;
+    into.dy += from.dy;
+    return;
+  }
+
+  // Modify: later values win, new properties keep arrival order
+  for (auto& [key, value] : from.props) {
+    auto it = std::find_if(into.props.begin(), into.props.end(),
+                           [&](const auto& p) { return p.first == key; });
+    if (it != into.props.end()) {
+      it->second = std::move(value);
+    } else {
+      into.props.emplace_back(key, std::move(value));
+    }
+  }
+}
+
+void OpCoalescer::serialize(Pending& op) {
+  std::string out;
+  if (op.kind == Kind::Move) {
+    out = "{\"o\":\"move\",\"ids\":[";
+    for (size_t i = 0; i < op.ids.size(); ++i) {
+      if (i) out += ',';
+      out += json(op.ids[i]).dump();
+    }
+    out += "],\"dx\":" + json(op.dx).dump() + ",\"dy\":" + json(op.dy).dump() + "}";
+  } else {
+    out = "{\"o\":\"modify\",\"id\":" + json(op.ids.front()).dump() + ",\"props\":{";
+    for (size_t i = 0; i < op.props.size(); ++i) {
+      if (i) out += ',';
+      out += json(op.props[i].first).dump() + ":" + op.props[i].second;
+    }
+    out += "}}";
+  }
+  op.raw   = std::move(out);
+  op.dirty = false;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Merges scene ops that supersede each other before they are stored or
+ * sent to a slow peer.
+ *
+ * A drag streams `move` ops (dx/dy deltas) and `modify` ops (property
+ * diffs) at ~30 Hz. Queued here, consecutive moves of the same id set
+ * become one move with the summed delta, and a chain of modifies of one
+ * node becomes one modify holding the last value of each property.
+ *
+ * An op merges into the newest pending op of the same kind and target
+ * as long as no op in between touches any of its nodes; ops on other
+ * nodes commute with it, so the result applies to the same scene.
+ * Anything else (create, delete, resize, batch, unparseable payloads)
+ * is kept verbatim and acts as a barrier. Untouched ops are emitted
+ * byte-for-byte; merged ones are re-serialized.
+ *
+ * Not thread-safe; owned by a Room or a socket on the event loop.
+ */
+class OpCoalescer {
+public:
+  /**
+   * Queue one 0x02 payload (JSON op, no type byte).
+   * Returns true if it was folded into an already pending op.
+   */
+  bool push(const uint8_t* data, size_t len);
+
+  bool   empty() const { return ops_.empty(); }
+  size_t size()  const { return ops_.size(); }    // Pending ops after merging
+  size_t bytes() const { return bytes_; }         // Approximate payload bytes held
+
+  /** Ops absorbed by merging since the last drain. */
+  uint64_t merged() const { return merged_; }
+
+  /** Hand every pending payload to fn(std::string_view) in order. */
+  template <typename Fn>
+  void for_each(Fn&& fn) {
+    for (auto& op : ops_) {
+      if (op.dirty) serialize(op);
+      fn(std::string_view(op.raw));
+    }
+  }
+
+  /** for_each(), then clear. */
+  template <typename Fn>
+  void drain(Fn&& fn) {
+    for_each(fn);
+    clear();
+  }
+
+  /**
+   * Hand pending payloads to fn(std::string_view) in order until it
+   * returns false; the ones it took are dropped, the rest stay pending.
+   */
+  template <typename Fn>
+  void drain_while(Fn&& fn) {
+    size_t taken = 0;
+    for (; taken < ops_.size(); ++taken) {
+      auto& op = ops_[taken];
+      if (op.dirty) serialize(op);
+      if (!fn(std::string_view(op.raw))) break;
+    }
+    if (taken == ops_.size()) {
+      clear();
+      return;
+    }
+    ops_.erase(ops_.begin(), ops_.begin() + static_cast<std::ptrdiff_t>(taken));
+    bytes_ = 0;
+    for (auto& op : ops_) bytes_ += op.raw.size();
+  }
+
+  void clear() {
+    ops_.clear();
+    bytes_  = 0;
+    merged_ = 0;
+  }
+
+private:
+  enum class Kind : uint8_t { Opaque, Move, Modify };
+
+  struct Pending {
+    Kind        kind = Kind::Opaque;
+    bool        dirty = false;                 // raw is stale after a merge
+    std::string raw;                           // Payload as received / last serialized
+    std::vector<std::string> ids;              // move: ids in order; modify: the one id
+    double      dx = 0, dy = 0;                // move
+    std::vector<std::pair<std::string, std::string>> props;  // modify: key → JSON value
+  };
+
+  /** Merge candidates are looked for this many ops back at most. */
+  static constexpr size_t kMaxScan = 32;
+
+  std::vector<Pending> ops_;
+  size_t   bytes_  = 0;
+  uint64_t merged_ = 0;
+
+  static bool touches(const Pending& op, const std::vector<std::string>& ids);
+  static bool same_target(const Pending& a, const Pending& b);
+  static void merge(Pending& into, Pending& from);
+  static void serialize(Pending& op);
+};
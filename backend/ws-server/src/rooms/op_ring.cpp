@@ -0,0 +1,72 @@
+#include "op_ring.h"
+
+OpRing::OpRing(uint32_t max_ops, uint32_t max_bytes)
+  : max_ops_(max_ops), max_bytes_(max_bytes) {}
+
+char* OpRing::push(uint64_t seq, size_t len) {
+  if (max_ops_ == 0 || len > max_bytes_) {
+    clear();
+    return nullptr;
+  }
+
+  if (!buffer_) {
+    buffer_ = std::make_unique<char[]>(max_bytes_);
+    entries_.resize(max_ops_);
+  }
+
+  if (count_ == max_ops_) evict_oldest();
+
+  const auto need = static_cast<uint32_t>(len);
+  uint32_t offset;
+  for (;;) {
+    if (count_ == 0) {
+      offset = 0;
+      break;
+    }
+    if (!wrapped_) {
+      // Live data in [tail_, head_): free space at the end, then the front
+      if (max_bytes_ - head_ >= need) { offset = head_; break; }
+      if (tail_ >= need)              { offset = 0; wrapped_ = true; break; }
+    } else if (tail_ - head_ >= need) {
+      // Live data in [tail_, end) + [0, head_): free gap in between
+      offset = head_;
+      break;
+    }
+    evict_oldest();
+  }
+
+  uint32_t idx = (first_ + count_) % max_ops_;
+  entries_[idx] = { seq, offset, need };
+  if (count_ == 0) {
+    first_ = idx;
+    tail_  = offset;
+  }
+  ++count_;
+  head_ = offset + need;
+  return buffer_.get() + offset;
+}
+
+void OpRing::clear() {
+  first_ = count_ = head_ = tail_ = 0;
+  wrapped_ = false;
+}
+
+void OpRing::release() {
+  clear();
+  buffer_.reset();
+  std::vector<Entry>().swap(entries_);
+}
+
+void OpRing::evict_oldest() {
+  first_ = (first_ + 1) % max_ops_;
+  if (--count_ == 0) {
+    clear();
+    return;
+  }
+
+  uint32_t next_tail = entries_[first_].offset;
+  if (wrapped_ && next_tail < tail_) {
+    wrapped_ = false;   // Oldest frame is now in the front region
+  }
+  tail_ = next_tail;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+/**
+ * Bounded ring of a room's most recent sequenced frames.
+ *
+ * Lets a client that detects a sequence gap fetch just the missing range
+ * instead of doing a full sync. Bounded both by frame count and by bytes;
+ * the oldest frames are evicted first, so retained sequence numbers are
+ * always one contiguous range.
+ *
+ * Storage is a single byte buffer plus an entry table, allocated on the
+ * first push and reused for the lifetime of the room. Frames are stored
+ * contiguously (a frame that does not fit at the end of the buffer wraps
+ * to the front), so each one can be sent straight out of the ring.
+ */
+class OpRing {
+public:
+  OpRing(uint32_t max_ops, uint32_t max_bytes);
+
+  /**
+   * Reserve space for frame `seq` of `len` bytes, evicting old frames as
+   * needed. `seq` must be last_seq() + 1 unless the ring is empty.
+   * Returns the write pointer, or nullptr if the frame exceeds max_bytes
+   * (the ring is then cleared, since the range would have a hole).
+   */
+  char* push(uint64_t seq, size_t len);
+
+  bool empty() const { return count_ == 0; }
+  uint64_t first_seq() const { return count_ ? entries_[first_].seq : 0; }
+  uint64_t last_seq()  const { return count_ ? first_seq() + count_ - 1 : 0; }
+
+  /** True if every frame in [from, to] is retained. */
+  bool contains(uint64_t from, uint64_t to) const {
+    return count_ > 0 && from <= to && from >= first_seq() && to <= last_seq();
+  }
+
+  /** Visit the frames in [from, to] in order. Caller checks contains() first. */
+  template <typename Fn>
+  void for_range(uint64_t from, uint64_t to, Fn&& fn) const {
+    for (uint64_t s = from; s <= to; ++s) {
+      auto& e = entries_[(first_ + (s - first_seq())) % max_ops_];
+      fn(std::string_view(buffer_.get() + e.offset, e.len));
+    }
+  }
+
+  void clear();
+
+  /** Clear and free the storage (reallocated by the next push). */
+  void release();
+
+  /** Heap bytes held (0 until the first push or after release()). */
+  size_t memory_bytes() const {
+    return buffer_ ? max_bytes_ + entries_.capacity() * sizeof(Entry) : 0;
+  }
+
+private:
+  struct Entry {
+    uint64_t seq;
+    uint32_t offset;
+    uint32_t len;
+  };
+
+  uint32_t max_ops_;
+  uint32_t max_bytes_;
+
+  std::unique_ptr<char[]> buffer_;   // max_bytes_, allocated on first push
+  std::vector<Entry> entries_;       // max_ops_ circular slots
+
+  uint32_t first_   = 0;     // Index of oldest entry
+  uint32_t count_   = 0;
+  uint32_t head_    = 0;     // Next write offset
+  uint32_t tail_    = 0;     // Offset of oldest frame
+  bool     wrapped_ = false; // Live data spans [tail_, end) + [0, head_)
+
+  void evict_oldest();
+};
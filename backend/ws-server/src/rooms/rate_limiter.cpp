@@ -0,0 +1,62 @@
+#include "rate_limiter.h"
+#include <algorithm>
+
+bool RateLimiter::refill(RateBucket& b, const Limit& limit, size_t bytes, uint64_t now_us) const {
+  const float frame_cap = limit.frames_per_sec * options_.burst_secs;
+  const float byte_cap  = limit.bytes_per_sec * options_.burst_secs;
+
+  if (b.last_us == 0) {
+    b.frames = frame_cap;
+    b.bytes  = byte_cap;
+  } else if (now_us > b.last_us) {
+    const float secs = static_cast<float>(now_us - b.last_us) * 1e-6f;
+    b.frames = std::min(frame_cap, b.frames + secs * limit.frames_per_sec);
+    b.bytes  = std::min(byte_cap, b.bytes + secs * limit.bytes_per_sec);
+  }
+  b.last_us = now_us;
+
+  const float cost = static_cast<float>(bytes);
+  const bool frames_ok = limit.frames_per_sec <= 0 || b.frames >= 1.0f;
+  const bool bytes_ok  = limit.bytes_per_sec <= 0 || b.bytes >= cost || b.bytes >= byte_cap;
+  return frames_ok && bytes_ok;
+}
+
+void RateLimiter::charge(RateBucket& b, const Limit& limit, size_t bytes) {
+  if (limit.frames_per_sec > 0) b.frames -= 1.0f;
+  if (limit.bytes_per_sec > 0)  b.bytes  -= static_cast<float>(bytes);
+}
+
+RateLimiter::Verdict RateLimiter::admit(RateState& peer, RateState& room, RateClass cls,
+                                        size_t bytes, uint64_t now_us) {
+  return take(peer, room, cls, bytes, now_us, /*count=*/true);
+}
+
+RateLimiter::Verdict RateLimiter::readmit(RateState& peer, RateState& room, RateClass cls,
+                                          size_t bytes, uint64_t now_us) {
+  return take(peer, room, cls, bytes, now_us, /*count=*/false);
+}
+
+RateLimiter::Verdict RateLimiter::take(RateState& peer, RateState& room, RateClass cls,
+                                       size_t bytes, uint64_t now_us, bool count) {
+  const size_t i = static_cast<size_t>(cls);
+  auto& pb = peer.buckets[i];
+  auto& rb = room.buckets[i];
+
+  // Both buckets are refilled before either is charged, so a frame the
+  // room refuses does not also cost the sender
+  const bool peer_ok = refill(pb, options_.peer[i], bytes, now_us);
+  const bool room_ok = refill(rb, options_.room[i], bytes, now_us);
+
+  if (!peer_ok || !room_ok) {
+    const size_t scope = peer_ok ? 1 : 0;
+    if (count) {
+      drops_[scope][i].frames += 1;
+      drops_[scope][i].bytes  += bytes;
+    }
+    return peer_ok ? Verdict::RoomLimited : Verdict::PeerLimited;
+  }
+
+  charge(pb, options_.peer[i], bytes);
+  charge(rb, options_.room[i], bytes);
+  return Verdict::Pass;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/** Message classes with independent budgets. */
+enum class RateClass : uint8_t { Update, Awareness, Other };
+constexpr size_t kRateClasses = 3;
+
+/** Token bucket pair (frames and bytes) for one RateClass. */
+struct RateBucket {
+  float    frames  = 0;
+  float    bytes   = 0;
+  uint64_t last_us = 0;   // 0 = never used; filled to capacity on first use
+};
+
+/** Bucket state kept per peer (PerSocketData) and per room (Room). */
+struct RateState {
+  std::array<RateBucket, kRateClasses> buckets;
+};
+
+/**
+ * Token-bucket flood guard for inbound binary frames.
+ *
+ * Each frame costs one frame token and its wire size in byte tokens, from
+ * both the sender's bucket and the room's bucket for its class; a frame
+ * is admitted only if both can pay. Buckets refill continuously at the
+ * configured rate and hold burst_secs worth of tokens. A frame larger
+ * than a whole bucket is admitted when the bucket is full (leaving it in
+ * debt) so oversized-but-legal frames are slowed, not banned.
+ *
+ * A rate of 0 disables that dimension. Event loop thread only.
+ */
+class RateLimiter {
+public:
+  struct Limit {
+    float frames_per_sec = 0;
+    float bytes_per_sec  = 0;
+  };
+
+  struct Options {
+    std::array<Limit, kRateClasses> peer;
+    std::array<Limit, kRateClasses> room;
+    float burst_secs = 2.0f;
+  };
+
+  enum class Verdict : uint8_t { Pass, PeerLimited, RoomLimited };
+
+  /** Drop counters for one (scope, class) pair. */
+  struct Drops {
+    uint64_t frames = 0;
+    uint64_t bytes  = 0;
+  };
+
+  explicit RateLimiter(const Options& options) : options_(options) {}
+
+  /** Charge a frame to both buckets; counts the drop when refused. */
+  Verdict admit(RateState& peer, RateState& room, RateClass cls, size_t bytes, uint64_t now_us);
+
+  /**
+   * admit() for a frame already refused once and held for later: a
+   * refusal is not counted as another drop.
+   */
+  Verdict readmit(RateState& peer, RateState& room, RateClass cls, size_t bytes, uint64_t now_us);
+
+  /** Drops by scope (0 = peer, 1 = room) and class. */
+  const Drops& drops(size_t scope, RateClass cls) const {
+    return drops_[scope][static_cast<size_t>(cls)];
+  }
+
+private:
+  Options options_;
+  std::array<std::array<Drops, kRateClasses>, 2> drops_{};
+
+  Verdict take(RateState& peer, RateState& room, RateClass cls, size_t bytes, uint64_t now_us,
+               bool count);
+
+  /** Refill b; true if it can pay for the frame. */
+  bool refill(RateBucket& b, const Limit& limit, size_t bytes, uint64_t now_us) const;
+  static void charge(RateBucket& b, const Limit& limit, size_t bytes);
+};
@@ -1,51 +1,213 @@
 #include "room.h"
+#include "protocol/message_codec.h"
+#include <cstring>
+#include <algorithm>
 
-Room::Room(std::string project_id)
-  : project_id_(std::move(project_id)) {}
+namespace {
 
-bool Room::add_peer(void* ws, const std::string& user_id) {
-  auto [it, inserted] = peers_.emplace(ws, user_id);
-  return inserted;
+// Catch-up log bound; past it the log is dropped until the next full-sync
+constexpr size_t kMaxCatchupBytes = 8 * 1024 * 1024;
+
+/** The client serializes ops with "o" first. */
+bool has_prefix(const uint8_t* payload, size_t len, std::string_view prefix) {
+  return len >= prefix.size() && std::memcmp(payload, prefix.data(), prefix.size()) == 0;
+}
+
+bool is_full_sync(const uint8_t* payload, size_t len) {
+  return has_prefix(payload, len, R"({"o":"full-sync")");
+}
+
+/** Requests between editors (state asks), not edits of the document. */
+bool is_control_op(const uint8_t* payload, size_t len) {
+  return has_prefix(payload, len, R"({"o":"sync-request")");
+}
+
+std::pmr::memory_resource* table_memory(const Room::Options& options) {
+  return options.memory ? options.memory : std::pmr::get_default_resource();
 }
 
-bool Room::remove_peer(void* ws) {
-  peers_.erase(ws);
-  return peers_.empty();
+} // namespace
+
+Room::Room(std::string project_id, const Options& options)
+  : project_id_(std::move(project_id))
+  , max_peers_(options.max_peers)
+  , max_spectators_(options.max_spectators)
+  , sockets_(table_memory(options))
+  , users_(table_memory(options))
+  , flags_(table_memory(options))
+  , back_refs_(table_memory(options))
+  , ops_(options.op_ring_ops, options.op_ring_bytes)
+  , spectators_(table_memory(options))
+  , spectator_flags_(table_memory(options))
+  , spectator_refs_(table_memory(options))
+  , spectator_awareness_(table_memory(options)) {
+  sockets_.reserve(options.max_peers);
+  users_.reserve(options.max_peers);
+  flags_.reserve(options.max_peers);
+  back_refs_.reserve(options.max_peers);
 }
 
-std::string Room::get_user_id(void* ws) const {
-  auto it = peers_.find(ws);
-  return it != peers_.end() ? it->second : "";
+bool Room::add_peer(void* ws, uint32_t user_index, uint32_t* slot_ref, uint8_t flags) {
+  if (*slot_ref != npos) return false;
+
+  *slot_ref = static_cast<uint32_t>(sockets_.size());
+  sockets_.push_back(ws);
+  users_.push_back(user_index);
+  flags_.push_back(flags);
+  back_refs_.push_back(slot_ref);
+  return true;
 }
 
-std::vector<std::string> Room::get_peer_ids() const {
-  std::vector<std::string> ids;
-  ids.reserve(peers_.size());
-  for (auto& [ws, uid] : peers_) {
-    ids.push_back(uid);
+bool Room::remove_peer(void* ws, uint32_t slot) {
+  if (slot >= sockets_.size() || sockets_[slot] != ws) return false;
+
+  // Swap-remove: move the last peer into the vacated slot
+  const uint32_t last = static_cast<uint32_t>(sockets_.size() - 1);
+  *back_refs_[slot] = npos;
+  if (slot != last) {
+    sockets_[slot]   = sockets_[last];
+    users_[slot]     = users_[last];
+    flags_[slot]     = flags_[last];
+    back_refs_[slot] = back_refs_[last];
+    *back_refs_[slot] = slot;
   }
-  return ids;
+
+  sockets_.pop_back();
+  users_.pop_back();
+  flags_.pop_back();
+  back_refs_.pop_back();
+  return true;
 }
 
-void Room::broadcast(
-    void* sender,
-    const char* data,
-    size_t len,
-    const std::function<void(void* ws, const char* data, size_t len, bool is_binary)>& send_fn) const {
-  for (auto& [ws, uid] : peers_) {
-    if (ws != sender) {
-      send_fn(ws, data, len, true);
-    }
+void Room::add_spectator(void* ws, uint32_t* slot_ref, uint8_t flags) {
+  *slot_ref = static_cast<uint32_t>(spectators_.size());
+  spectators_.push_back(ws);
+  spectator_flags_.push_back(static_cast<uint8_t>(flags | kPeerPending));
+  spectator_refs_.push_back(slot_ref);
+}
+
+bool Room::remove_spectator(void* ws, uint32_t slot) {
+  if (slot >= spectators_.size() || spectators_[slot] != ws) return false;
+
+  // Swap-remove, as for peers
+  const uint32_t last = static_cast<uint32_t>(spectators_.size() - 1);
+  *spectator_refs_[slot] = npos;
+  if (slot != last) {
+    spectators_[slot]      = spectators_[last];
+    spectator_flags_[slot] = spectator_flags_[last];
+    spectator_refs_[slot]  = spectator_refs_[last];
+    *spectator_refs_[slot] = slot;
+  }
+
+  spectators_.pop_back();
+  spectator_flags_.pop_back();
+  spectator_refs_.pop_back();
+
+  // Nothing is recorded while nobody watches, so the log would go stale
+  if (spectators_.empty()) {
+    spectator_ops_.clear();
+    spectator_awareness_.clear();
+    catchup_sync_.clear();
+    catchup_ops_.clear();
+  }
+  return true;
+}
+
+bool Room::any_spectator(uint8_t mask) const {
+  for (uint8_t f : spectator_flags_) {
+    if ((f & mask) == mask) return true;
+  }
+  return false;
+}
+
+void Room::hold_for_spectators(const uint8_t* payload, size_t len) {
+  // A spectator would answer a state request with a full-sync of its own,
+  // refused as READ_ONLY: a whole-document upload per viewer for nothing
+  if (is_control_op(payload, len)) return;
+  spectator_ops_.push(payload, len);
+
+  if (is_full_sync(payload, len)) {
+    catchup_sync_.assign(reinterpret_cast<const char*>(payload), len);
+    catchup_ops_.clear();
+  } else if (!catchup_sync_.empty()) {
+    catchup_ops_.push(payload, len);
+  }
+
+  if (catchup_sync_.size() + catchup_ops_.bytes() > kMaxCatchupBytes) {
+    catchup_sync_.clear();
+    catchup_ops_.clear();
+  }
+}
+
+void Room::hold_spectator_awareness(uint32_t user_index, const uint8_t* payload, size_t len) {
+  auto it = std::find_if(spectator_awareness_.begin(), spectator_awareness_.end(),
+                         [&](const auto& e) { return e.first == user_index; });
+  if (it == spectator_awareness_.end()) {
+    it = spectator_awareness_.emplace(spectator_awareness_.end(), user_index, std::string_view{});
+  }
+  it->second.assign(reinterpret_cast<const char*>(payload), len);
+}
+
+void* Room::pick_editor() const {
+  for (size_t i = 0; i < sockets_.size(); ++i) {
+    if (!(flags_[i] & (kPeerDetached | kPeerCongested))) return sockets_[i];
+  }
+  return nullptr;
+}
+
+bool Room::has_user(uint32_t user_index) const {
+  return std::find(users_.begin(), users_.end(), user_index) != users_.end();
+}
+
+bool Room::any_peer(uint8_t mask) const {
+  for (uint8_t f : flags_) {
+    if ((f & mask) == mask && !(f & kPeerDetached)) return true;
   }
+  return false;
+}
+
+void Room::hold_unsaved(const uint8_t* payload, size_t len, uint64_t now_us) {
+  if (unsaved_.empty()) unsaved_first_us_ = now_us;
+  unsaved_last_us_ = now_us;
+  unsaved_.push(payload, len);
+}
+
+size_t Room::memory_bytes() const {
+  constexpr size_t kPeerBytes      = sizeof(void*) + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t*);
+  constexpr size_t kSpectatorBytes = sizeof(void*) + sizeof(uint8_t) + sizeof(uint32_t*);
+
+  size_t bytes = sizeof(Room) + project_id_.capacity()
+               + sockets_.capacity() * kPeerBytes
+               + spectators_.capacity() * kSpectatorBytes
+               + ops_.memory_bytes() + oversize_frame_.capacity()
+               + sync_cache_.bytes()
+               + unsaved_.bytes() + spectator_ops_.bytes()
+               + catchup_sync_.capacity() + catchup_ops_.bytes();
+  for (auto& entry : spectator_awareness_) bytes += sizeof(entry) + entry.second.capacity();
+  return bytes;
 }
 
-void Room::broadcast_text(
-    void* sender,
-    const std::string& message,
-    const std::function<void(void* ws, const char* data, size_t len, bool is_binary)>& send_fn) const {
-  for (auto& [ws, uid] : peers_) {
-    if (ws != sender) {
-      send_fn(ws, message.data(), message.size(), false);
+void Room::restore_seq(uint64_t first_seq, const std::vector<std::string>& frames, uint64_t seq) {
+  ops_.clear();
+  for (size_t i = 0; i < frames.size(); ++i) {
+    if (char* out = ops_.push(first_seq + i, frames[i].size())) {
+      std::memcpy(out, frames[i].data(), frames[i].size());
     }
   }
+  seq_ = seq;
+}
+
+std::string_view Room::stamp(const uint8_t* payload, size_t len) {
+  const uint64_t seq  = ++seq_;
+  const size_t   size = MessageCodec::kSeqHeaderSize + len;
+
+  char* out = ops_.push(seq, size);
+  if (!out) {
+    oversize_frame_.resize(size);
+    out = oversize_frame_.data();
+  }
+
+  MessageCodec::write_seq_header(out, MessageType::SeqUpdate, seq);
+  std::memcpy(out + MessageCodec::kSeqHeaderSize, payload, len);
+  return { out, size };
 }
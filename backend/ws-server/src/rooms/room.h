@@ -1,9 +1,14 @@
 #pragma once
+#include "op_ring.h"
+#include "rate_limiter.h"
+#include "op_coalescer.h"
+#include "sync_cache.h"
+#include "room_load.h"
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
-#include <functional>
+#include <memory_resource>
+#include <algorithm>
 #include <cstdint>
 
 /**
@@ -13,62 +18,344 @@
  *   - Peer set (connected user WebSocket pointers)
  *   - Yjs update broadcasting (fan-out to all peers except sender)
  *   - Awareness state relay (cursor positions, selections)
- *   - Accumulation of Yjs updates for persistence
+ *   - Accumulation of Yjs updates for persistence (merged by OpCoalescer
+ *     until the room goes quiet)
  *
  * Design: Zero-copy broadcast — binary updates are forwarded as-is
  * without deserialization. The server is a pure relay; all CRDT
  * merging happens on the client side via Yjs.
+ *
+ * Peer storage is a structure of arrays: sockets, interned user indices
+ * and flag bytes each live in their own contiguous vector, so fan-out
+ * walks linear memory. Removal is an O(1) swap-remove; each peer's slot
+ * index lives in its per-socket data and is patched through a back-reference
+ * when another peer is swapped into its place.
+ *
+ * Each Yjs update is stamped with a monotonically increasing room sequence
+ * number and kept in a bounded ring of recent frames, so peers that see a
+ * gap can fetch just the missing range.
+ *
+ * The peer and spectator tables draw from Options::memory, normally the
+ * room manager's pool shared by all rooms, so rooms coming and going
+ * recycle each other's table blocks instead of churning the heap.
+ *
+ * The initial-sync frame sent to joiners is cached per room and rebuilt
+ * lazily once an update has moved the sequence past it (see SyncCache).
+ *
+ * Fan-out volume is counted here, loop time by the server (see RoomLoad).
+ *
+ * Spectators (viewers) live in a second, uncapped table that the per-frame
+ * fan-out never walks. Their updates are merged into one batch frame per
+ * tick; newcomers are caught up from the last full-sync an editor sent
+ * plus the (merged) ops since, without asking editors for state each time.
  */
 
 // Forward declaration — ws pointer is opaque at this level
 struct PerSocketData;
 
+/** Per-peer flag bits (one byte per peer). */
+enum PeerFlag : uint8_t {
+  kPeerCongested = 1 << 0,   // Send hit backpressure; cleared on drain
+  kPeerSeq       = 1 << 1,   // Receives sequenced (0x04) update frames
+  kPeerDetached  = 1 << 2,   // Socket dropped; slot held for resumption
+  kPeerZstd      = 1 << 3,   // Receives dictionary-compressed frames
+  kPeerPending   = 1 << 4,   // Spectator still waiting for its catch-up
+};
+
 class Room {
 public:
-  explicit Room(std::string project_id);
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  struct Options {
+    uint32_t max_peers     = 64;
+    uint32_t op_ring_ops   = 512;          // Recent frames retained for resync
+    uint32_t op_ring_bytes = 512 * 1024;
+    uint32_t max_spectators = 1024;
+    std::pmr::memory_resource* memory = nullptr;   // Peer tables (nullptr = default heap)
+  };
+
+  Room(std::string project_id, const Options& options);
 
   const std::string& id() const { return project_id_; }
-  size_t peer_count() const { return peers_.size(); }
-  bool empty() const { return peers_.empty(); }
+  size_t peer_count() const { return sockets_.size(); }
+  bool empty() const { return sockets_.empty() && spectators_.empty(); }
+
+  /** Editor slots (attached or detached) are all taken. */
+  bool full() const { return sockets_.size() >= max_peers_; }
+
+  /**
+   * Add a peer to the room. Returns false if already present.
+   * @param slot_ref Where the peer's slot index is stored (per-socket data);
+   *                 kept up to date across swap-removes.
+   */
+  bool add_peer(void* ws, uint32_t user_index, uint32_t* slot_ref, uint8_t flags = 0);
+
+  /** Remove a peer by slot. Returns false (nothing removed) if ws is not in it. */
+  bool remove_peer(void* ws, uint32_t slot);
+
+  // ── Spectators ────────────────────────────────────────────────────────────
+
+  size_t spectator_count() const { return spectators_.size(); }
+  bool spectators_full() const { return spectators_.size() >= max_spectators_; }
+
+  /** Add a read-only spectator, flagged kPeerPending until caught up. */
+  void add_spectator(void* ws, uint32_t* slot_ref, uint8_t flags = 0);
 
-  /** Add a peer to the room. Returns false if already present. */
-  bool add_peer(void* ws, const std::string& user_id);
+  /** Remove a spectator by slot. Returns false (nothing removed) if ws is not in it. */
+  bool remove_spectator(void* ws, uint32_t slot);
 
-  /** Remove a peer. Returns true if room is now empty. */
-  bool remove_peer(void* ws);
+  uint8_t spectator_flags(uint32_t slot) const { return spectator_flags_[slot]; }
+  void set_spectator_flag(uint32_t slot, PeerFlag flag, bool on) {
+    spectator_flags_[slot] = static_cast<uint8_t>(on ? (spectator_flags_[slot] | flag)
+                                                     : (spectator_flags_[slot] & ~flag));
+  }
 
-  /** Get user ID for a socket. */
-  std::string get_user_id(void* ws) const;
+  /** True if any spectator has all of the given flags. */
+  bool any_spectator(uint8_t mask) const;
 
-  /** Get all connected user IDs. */
-  std::vector<std::string> get_peer_ids() const;
+  /**
+   * Record an editor's update for spectators: merged into this tick's
+   * batch and into the catch-up log (a full-sync restarts the log).
+   * State requests between editors (sync-request) are not passed on.
+   */
+  void hold_for_spectators(const uint8_t* payload, size_t len);
+
+  /** Record an editor's latest awareness payload for the next tick. */
+  void hold_spectator_awareness(uint32_t user_index, const uint8_t* payload, size_t len);
+
+  /** This tick's merged updates. */
+  OpCoalescer& spectator_ops() { return spectator_ops_; }
+
+  /** Hand each held awareness payload to fn(std::string_view), then clear. */
+  template <typename Fn>
+  void drain_spectator_awareness(Fn&& fn) {
+    for (auto& entry : spectator_awareness_) fn(std::string_view(entry.second));
+    spectator_awareness_.clear();
+  }
+
+  /** Latest full-sync payload plus ops since; false if none is held. */
+  template <typename Fn>
+  bool for_each_catchup(Fn&& fn) {
+    if (catchup_sync_.empty()) return false;
+    fn(std::string_view(catchup_sync_));
+    catchup_ops_.for_each(fn);
+    return true;
+  }
+
+  /** Visit every attached peer and spectator socket. */
+  template <typename Fn>
+  void for_each_socket(Fn&& fn) const {
+    for (size_t i = 0; i < sockets_.size(); ++i) {
+      if (!(flags_[i] & kPeerDetached)) fn(sockets_[i]);
+    }
+    for (void* ws : spectators_) fn(ws);
+  }
+
+  /** Clear a flag on every spectator. */
+  void clear_spectator_flag(PeerFlag flag) {
+    for (auto& f : spectator_flags_) f = static_cast<uint8_t>(f & ~flag);
+  }
+
+  /** First attached, uncongested editor, or nullptr. */
+  void* pick_editor() const;
+
+  /**
+   * True (and records now) if no state request was sent to an editor on
+   * behalf of spectators within interval_us.
+   */
+  bool claim_sync_request(uint64_t now_us, uint64_t interval_us) {
+    if (sync_requested_us_ != 0 && now_us - sync_requested_us_ < interval_us) return false;
+    sync_requested_us_ = now_us;
+    return true;
+  }
+
+  /**
+   * Point a slot at a different socket and slot back-reference, e.g. when
+   * a peer detaches (ws = nullptr) or resumes on a new connection.
+   */
+  void rebind_peer(uint32_t slot, void* ws, uint32_t* slot_ref) {
+    sockets_[slot]   = ws;
+    back_refs_[slot] = slot_ref;
+    *slot_ref = slot;
+  }
+
+  /** True if any attached peer has all of the given flags. */
+  bool any_peer(uint8_t mask) const;
+
+  /** True if any slot (attached or detached) belongs to this user. */
+  bool has_user(uint32_t user_index) const;
+
+  /** Socket in a slot (nullptr while detached or past the end). */
+  void* peer_socket(uint32_t slot) const { return slot < sockets_.size() ? sockets_[slot] : nullptr; }
+
+  /** Interned user index for a slot. */
+  uint32_t user_at(uint32_t slot) const { return users_[slot]; }
+
+  /** Interned user indices of all connected peers (slot order). */
+  const std::pmr::vector<uint32_t>& peer_users() const { return users_; }
+
+  uint8_t flags(uint32_t slot) const { return flags_[slot]; }
+  void set_flag(uint32_t slot, PeerFlag flag, bool on) {
+    flags_[slot] = static_cast<uint8_t>(on ? (flags_[slot] | flag) : (flags_[slot] & ~flag));
+  }
+
+  /** Sequence number of the latest stamped update (0 = none yet). */
+  uint64_t seq() const { return seq_; }
+
+  /** Recently stamped frames, for range resync. */
+  const OpRing& recent_ops() const { return ops_; }
+
+  /**
+   * Continue a predecessor's sequence (hot restart): `frames` are its
+   * retained frames from first_seq on, `seq` its last stamped number.
+   */
+  void restore_seq(uint64_t first_seq, const std::vector<std::string>& frames, uint64_t seq);
+
+  /** Initial-sync frame for joiners, current while seq() is unchanged. */
+  SyncCache& sync_cache() { return sync_cache_; }
+
+  /** WAL LSN of the room's latest logged update (0 = none yet). */
+  uint64_t last_lsn() const { return last_lsn_; }
+  void set_last_lsn(uint64_t lsn) { last_lsn_ = lsn; }
+
+  /** Record activity (an update or a join) for cold-room eviction. */
+  void touch(uint64_t now_us) { last_active_us_ = now_us; }
+  uint64_t last_active_us() const { return last_active_us_; }
+
+  /**
+   * Approximate heap bytes held: peer tables, recent-op ring, cached sync
+   * frame and ops waiting for storage or spectators.
+   */
+  size_t memory_bytes() const;
+
+  /**
+   * Free the recent-op ring (under memory pressure, for rooms quiet long
+   * enough that no peer can still be missing a retained frame). Resync of
+   * older ranges then fails with RANGE_UNAVAILABLE, as after a wrap.
+   */
+  void release_recent_ops() { ops_.release(); }
+
+  /** Loop time and fan-out volume, sampled once a second. */
+  RoomLoad& load() { return load_; }
+  const RoomLoad& load() const { return load_; }
+
+  /** Room-wide inbound rate budget (see RateLimiter). */
+  RateState& rate_state() { return rate_; }
+
+  /**
+   * Queue an update payload for persistence, merged into pending ops where
+   * possible.
+   */
+  void hold_unsaved(const uint8_t* payload, size_t len, uint64_t now_us);
+
+  /** When pending ops are due: quiet for quiet_us, or held for max_us. */
+  uint64_t unsaved_deadline(uint64_t quiet_us, uint64_t max_us) const {
+    return std::min(unsaved_last_us_ + quiet_us, unsaved_first_us_ + max_us);
+  }
+
+  /** Ops relayed but not yet handed to persistence. */
+  OpCoalescer& unsaved() { return unsaved_; }
+  const OpCoalescer& unsaved() const { return unsaved_; }
+
+  /**
+   * Assign the next sequence number to an update payload and build its
+   * sequenced (0x04) frame, retained in the recent-op ring when it fits.
+   * The returned view is valid until the next stamp().
+   */
+  std::string_view stamp(const uint8_t* payload, size_t len);
 
   /**
    * Broadcast a binary message to all peers except the sender.
-   * @param sender Socket pointer of the sender (nullptr = broadcast to all)
-   * @param data Binary message data
-   * @param len Message length
-   * @param send_fn Callback to actually send data through WebSocket
+   * @param sender    Socket pointer of the sender (nullptr = broadcast to all)
+   * @param data      Binary message data
+   * @param len       Message length
+   * @param send_fn   Callback to actually send data through WebSocket;
+   *                  returns false if the send hit backpressure, which
+   *                  marks the peer congested
+   * @param skip_mask Peers with any of these flags set are skipped
+   * @param need_mask Only peers with all of these flags set receive it
    */
-  void broadcast(
-    void* sender,
-    const char* data,
-    size_t len,
-    const std::function<void(void* ws, const char* data, size_t len, bool is_binary)>& send_fn
-  ) const;
+  template <typename SendFn>
+  void broadcast(void* sender, const char* data, size_t len, SendFn&& send_fn,
+                 uint8_t skip_mask = 0, uint8_t need_mask = 0) {
+    const size_t sent = fan_out(sockets_, flags_, sender, data, len, true, send_fn, skip_mask, need_mask);
+    load_.add_fanout(sent, sent * len);
+  }
 
   /**
-   * Broadcast a text message to all peers except the sender.
+   * Broadcast a binary message to spectators (same masks as broadcast()).
    */
-  void broadcast_text(
-    void* sender,
-    const std::string& message,
-    const std::function<void(void* ws, const char* data, size_t len, bool is_binary)>& send_fn
-  ) const;
+  template <typename SendFn>
+  void broadcast_spectators(const char* data, size_t len, SendFn&& send_fn,
+                            uint8_t skip_mask = 0, uint8_t need_mask = 0) {
+    const size_t sent = fan_out(spectators_, spectator_flags_, nullptr, data, len, true, send_fn,
+                                skip_mask, need_mask);
+    load_.add_fanout(sent, sent * len);
+  }
+
+  /**
+   * Broadcast a text message to all peers except the sender, and to
+   * spectators (control messages are rare enough to skip the tick).
+   */
+  template <typename SendFn>
+  void broadcast_text(void* sender, const std::string& message, SendFn&& send_fn) {
+    const size_t sent =
+      fan_out(sockets_, flags_, sender, message.data(), message.size(), false, send_fn, 0, 0)
+      + fan_out(spectators_, spectator_flags_, sender, message.data(), message.size(), false, send_fn, 0, 0);
+    load_.add_fanout(sent, sent * message.size());
+  }
 
 private:
   std::string project_id_;
+  uint32_t    max_peers_;
+  uint32_t    max_spectators_;
+
+  // Structure-of-arrays peer table, indexed by slot
+  std::pmr::vector<void*>     sockets_;
+  std::pmr::vector<uint32_t>  users_;      // Interned user indices (UserTable)
+  std::pmr::vector<uint8_t>   flags_;      // PeerFlag bits
+  std::pmr::vector<uint32_t*> back_refs_;  // → PerSocketData slot index
+
+  uint64_t    seq_ = 0;
+  OpRing      ops_;
+  std::string oversize_frame_;        // Stamped frame too large for the ring
+  SyncCache   sync_cache_;
+  uint64_t    last_lsn_ = 0;
+  uint64_t    last_active_us_ = 0;
+  RateState   rate_;
+  RoomLoad    load_;
+
+  OpCoalescer unsaved_;
+  uint64_t    unsaved_first_us_ = 0;  // Oldest pending op
+  uint64_t    unsaved_last_us_  = 0;  // Newest pending op
+
+  // Spectator table, indexed by spectator slot
+  std::pmr::vector<void*>     spectators_;
+  std::pmr::vector<uint8_t>   spectator_flags_;
+  std::pmr::vector<uint32_t*> spectator_refs_;
+
+  OpCoalescer spectator_ops_;                                     // This tick
+  std::pmr::vector<std::pair<uint32_t, std::pmr::string>> spectator_awareness_; // Per user
+  std::string catchup_sync_;     // Last full-sync payload (empty = none)
+  OpCoalescer catchup_ops_;      // Ops since catchup_sync_
+  uint64_t    sync_requested_us_ = 0;
 
-  // ws pointer → user_id mapping
-  std::unordered_map<void*, std::string> peers_;
+  /** Returns the number of sockets handed the frame. */
+  template <typename SendFn>
+  static size_t fan_out(std::pmr::vector<void*>& sockets, std::pmr::vector<uint8_t>& flags,
+                        void* sender, const char* data, size_t len, bool is_binary,
+                        SendFn& send_fn, uint8_t skip_mask, uint8_t need_mask) {
+    const size_t n = sockets.size();
+    size_t sent = 0;
+    for (size_t i = 0; i < n; ++i) {
+      void* ws = sockets[i];
+      const uint8_t f = flags[i];
+      if (ws == sender || (f & (skip_mask | kPeerDetached)) || (f & need_mask) != need_mask) continue;
+      ++sent;
+      if (!send_fn(ws, data, len, is_binary)) {
+        flags[i] |= kPeerCongested;
+      }
+    }
+    return sent;
+  }
 };
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Per-room load meter: event loop time spent on the room's frames, joins
+ * and ticks, and the frames and bytes its fan-out hands to sockets.
+ *
+ * Work is added as it happens; sample(), called once a second, folds the
+ * window into decayed per-second rates (time constant about ten samples)
+ * and returns the raw window so the caller can keep process-wide totals.
+ * The rates rank rooms by cost, which a flat per-node view hides when a
+ * few rooms carry most of the traffic.
+ *
+ * Event loop thread only.
+ */
+class RoomLoad {
+public:
+  struct Window {
+    uint64_t busy_ns = 0;
+    uint64_t frames  = 0;
+    uint64_t bytes   = 0;
+  };
+
+  void add_busy(uint64_t ns) { window_.busy_ns += ns; }
+  void add_fanout(uint64_t frames, uint64_t bytes) {
+    window_.frames += frames;
+    window_.bytes  += bytes;
+  }
+
+  /** Fold the last interval_s seconds into the rates; returns and resets the window. */
+  Window sample(double interval_s) {
+    constexpr double kAlpha = 0.1;
+    const Window w = window_;
+    window_ = {};
+    if (interval_s <= 0) return w;
+    busy_   += (static_cast<double>(w.busy_ns) * 1e-9 / interval_s - busy_) * kAlpha;
+    frames_ += (static_cast<double>(w.frames) / interval_s - frames_) * kAlpha;
+    bytes_  += (static_cast<double>(w.bytes) / interval_s - bytes_) * kAlpha;
+    return w;
+  }
+
+  /** Share of the event loop (seconds per second) this room keeps busy. */
+  double busy() const { return busy_; }
+  double frames_per_sec() const { return frames_; }
+  double bytes_per_sec() const { return bytes_; }
+
+private:
+  Window window_;
+  double busy_   = 0;
+  double frames_ = 0;
+  double bytes_  = 0;
+};
@@ -1,48 +1,112 @@
 #include "room_manager.h"
 
-RoomManager::RoomManager(uint32_t max_rooms)
-  : max_rooms_(max_rooms) {}
+namespace {
 
-Room* RoomManager::get_or_create(const std::string& project_id) {
+constexpr size_t kRoomsPerChunk = 32;
+
+/** Spectator tables (up to max_spectators pointers) stay pooled too. */
+std::pmr::pool_options table_pool_options() {
+  std::pmr::pool_options options;
+  options.largest_required_pool_block = 16 * 1024;
+  return options;
+}
+
+} // namespace
+
+RoomManager::RoomManager(uint32_t max_rooms, Room::Options room_options)
+  : max_rooms_(max_rooms)
+  , table_pool_(table_pool_options(), &heap_)
+  , room_slab_(kRoomsPerChunk, &heap_)
+  , room_options_(room_options)
+  , slots_(max_rooms) {
+  if (!room_options_.memory) room_options_.memory = &table_pool_;
+  free_slots_.reserve(max_rooms);
+  for (uint32_t i = max_rooms; i > 0; --i) {
+    free_slots_.push_back(i - 1);
+  }
+}
+
+RoomManager::~RoomManager() {
+  // Rooms go before the slab and pool they live in
+  for (auto& slot : slots_) room_slab_.destroy(slot.room);
+}
+
+RoomHandle RoomManager::get_or_create(std::string_view project_id) {
   std::lock_guard lock(mutex_);
 
-  auto it = rooms_.find(project_id);
-  if (it != rooms_.end()) {
-    return it->second.get();
+  auto it = index_.find(project_id);
+  if (it != index_.end()) {
+    return { it->second, slots_[it->second].generation };
   }
 
-  if (rooms_.size() >= max_rooms_) {
-    return nullptr; // Limit reached
+  if (free_slots_.empty()) {
+    return {}; // Limit reached
   }
 
-  auto room = std::make_unique<Room>(project_id);
-  auto* ptr = room.get();
-  rooms_.emplace(project_id, std::move(room));
-  return ptr;
+  uint32_t idx = free_slots_.back();
+  free_slots_.pop_back();
+
+  auto& slot = slots_[idx];
+  try {
+    slot.room = room_slab_.create(std::string(project_id), room_options_);
+  } catch (...) {
+    free_slots_.push_back(idx);
+    throw;
+  }
+  index_.emplace(project_id, idx);
+  return { idx, slot.generation };
 }
 
-Room* RoomManager::get(const std::string& project_id) {
+RoomHandle RoomManager::find(std::string_view project_id) const {
   std::lock_guard lock(mutex_);
-  auto it = rooms_.find(project_id);
-  return it != rooms_.end() ? it->second.get() : nullptr;
+  auto it = index_.find(project_id);
+  return it != index_.end() ? RoomHandle{ it->second, slots_[it->second].generation } : RoomHandle{};
 }
 
-void RoomManager::remove_if_empty(const std::string& project_id) {
+Room* RoomManager::get(std::string_view project_id) {
   std::lock_guard lock(mutex_);
-  auto it = rooms_.find(project_id);
-  if (it != rooms_.end() && it->second->empty()) {
-    rooms_.erase(it);
-  }
+  auto it = index_.find(project_id);
+  return it != index_.end() ? slots_[it->second].room : nullptr;
+}
+
+void RoomManager::remove_if_empty(RoomHandle handle) {
+  std::lock_guard lock(mutex_);
+  auto* room = resolve(handle);
+  if (!room || !room->empty()) return;
+
+  index_.erase(room->id());
+
+  auto& slot = slots_[handle.slot];
+  room_slab_.destroy(slot.room);
+  slot.room = nullptr;
+  ++slot.generation;
+  free_slots_.push_back(handle.slot);
 }
 
 size_t RoomManager::room_count() const {
   std::lock_guard lock(mutex_);
-  return rooms_.size();
+  return index_.size();
+}
+
+size_t RoomManager::memory_bytes() const {
+  std::lock_guard lock(mutex_);
+  size_t bytes = 0;
+  for (auto& slot : slots_) {
+    if (slot.room) bytes += slot.room->memory_bytes();
+  }
+  return bytes;
 }
 
 void RoomManager::for_each(const std::function<void(Room&)>& fn) {
   std::lock_guard lock(mutex_);
-  for (auto& [id, room] : rooms_) {
-    fn(*room);
+  for (auto& slot : slots_) {
+    if (slot.room) fn(*slot.room);
+  }
+}
+
+void RoomManager::for_each_handle(const std::function<void(RoomHandle, Room&)>& fn) {
+  std::lock_guard lock(mutex_);
+  for (uint32_t i = 0; i < slots_.size(); ++i) {
+    if (slots_[i].room) fn({ i, slots_[i].generation }, *slots_[i].room);
   }
 }
@@ -1,12 +1,34 @@
 #pragma once
 #include "room.h"
+#include "memory/slab.h"
+#include "memory/counting_resource.h"
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <memory>
+#include <vector>
+#include <memory_resource>
 #include <mutex>
 #include <functional>
 #include <cstdint>
 
+/**
+ * Generation-checked reference to a room slot.
+ *
+ * Stored in per-socket data at join time. Resolving it is an array index
+ * plus a generation compare — no hashing, no locking. A handle to a room
+ * that has since been destroyed (and whose slot may have been reused)
+ * resolves to nullptr.
+ */
+struct RoomHandle {
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  uint32_t slot       = npos;
+  uint32_t generation = 0;
+
+  bool valid() const { return slot != npos; }
+  bool operator==(const RoomHandle&) const = default;
+};
+
 /**
  * Room manager — owns all active collaboration rooms.
  *
@@ -14,28 +36,53 @@
  * the event loop thread. Rooms are lazily created on first join
  * and destroyed when the last peer leaves.
  *
- * Lookup is O(1) via unordered_map with project_id as key.
+ * Rooms live in a fixed slot table sized to max_rooms, so slots never
+ * move and resolve() can run lock-free on the event loop thread.
+ * Lookup by project_id is O(1) via unordered_map (join path only).
+ *
+ * Room objects come from a slab and their peer tables from a pool shared
+ * by all rooms, both backed by one counting resource, so room churn
+ * reuses memory rather than fragmenting the heap and heap() shows what
+ * rooms hold. Rooms are only created and mutated on the event loop, which
+ * is what lets these allocators go without locks of their own.
  */
 class RoomManager {
 public:
-  explicit RoomManager(uint32_t max_rooms = 1024);
+  explicit RoomManager(uint32_t max_rooms = 1024, Room::Options room_options = {});
+  ~RoomManager();
+
+  RoomManager(const RoomManager&) = delete;
+  RoomManager& operator=(const RoomManager&) = delete;
 
   /**
    * Get or create a room for the given project.
-   * Returns nullptr if max_rooms limit is reached.
+   * Returns an invalid handle if max_rooms limit is reached.
    */
-  Room* get_or_create(const std::string& project_id);
+  RoomHandle get_or_create(std::string_view project_id);
+
+  /**
+   * Resolve a handle to its room. Returns nullptr if the room was destroyed.
+   * Lock-free — event loop thread only.
+   */
+  Room* resolve(RoomHandle handle) const {
+    if (handle.slot >= slots_.size()) return nullptr;
+    auto& slot = slots_[handle.slot];
+    return slot.generation == handle.generation ? slot.room : nullptr;
+  }
 
   /**
    * Get an existing room. Returns nullptr if not found.
    */
-  Room* get(const std::string& project_id);
+  Room* get(std::string_view project_id);
+
+  /** Handle of an existing room; invalid if there is none. */
+  RoomHandle find(std::string_view project_id) const;
 
   /**
    * Remove a room if it's empty.
    * Called after a peer leaves and room.empty() is true.
    */
-  void remove_if_empty(const std::string& project_id);
+  void remove_if_empty(RoomHandle handle);
 
   /** Number of active rooms. */
   size_t room_count() const;
@@ -43,8 +90,37 @@ public:
   /** Iterate over all rooms (for periodic tasks like compaction). */
   void for_each(const std::function<void(Room&)>& fn);
 
+  /** Same, with each room's handle. */
+  void for_each_handle(const std::function<void(RoomHandle, Room&)>& fn);
+
+  /** Sum of Room::memory_bytes() over all rooms. */
+  size_t memory_bytes() const;
+
+  /** Heap memory held by room objects and their peer tables. */
+  const CountingResource& heap() const { return heap_; }
+
+  /** Slab the room objects live in. */
+  const Slab<Room>& room_slab() const { return room_slab_; }
+
 private:
+  struct Slot {
+    Room*    room = nullptr;   // In room_slab_
+    uint32_t generation = 0;   // Bumped on destroy; invalidates old handles
+  };
+
   uint32_t max_rooms_;
+  CountingResource heap_;
+  std::pmr::unsynchronized_pool_resource table_pool_;   // Room peer tables
+  Slab<Room> room_slab_;
+  Room::Options room_options_;
   mutable std::mutex mutex_;
-  std::unordered_map<std::string, std::unique_ptr<Room>> rooms_;
+  std::vector<Slot> slots_;          // Fixed size (max_rooms_), never reallocated
+  std::vector<uint32_t> free_slots_;
+  /** Lets index_ be probed with a string_view (no key copy per join). */
+  struct IdHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view id) const { return std::hash<std::string_view>{}(id); }
+  };
+
+  std::unordered_map<std::string, uint32_t, IdHash, std::equal_to<>> index_;  // project_id → slot
 };
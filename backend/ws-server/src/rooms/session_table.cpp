@@ -0,0 +1,45 @@
+#include "session_table.h"
+#include <openssl/rand.h>
+#include <cstdio>
+
+ResumeToken ResumeToken::generate() {
+  ResumeToken t;
+  while (t.empty()) {
+    RAND_bytes(reinterpret_cast<unsigned char*>(&t.hi), sizeof(t.hi));
+    RAND_bytes(reinterpret_cast<unsigned char*>(&t.lo), sizeof(t.lo));
+  }
+  return t;
+}
+
+std::optional<ResumeToken> ResumeToken::from_hex(std::string_view hex) {
+  if (hex.size() != 32) return std::nullopt;
+
+  ResumeToken t;
+  for (size_t i = 0; i < 32; ++i) {
+    char c = hex[i];
+    uint64_t nibble;
+    if (c >= '0' && c <= '9')      nibble = static_cast<uint64_t>(c - '0');
+    else if (c >= 'a' && c <= 'f') nibble = static_cast<uint64_t>(c - 'a' + 10);
+    else return std::nullopt;
+
+    uint64_t& word = i < 16 ? t.hi : t.lo;
+    word = (word << 4) | nibble;
+  }
+  return t;
+}
+
+std::string ResumeToken::to_hex() const {
+  char buf[33];
+  std::snprintf(buf, sizeof(buf), "%016llx%016llx",
+                static_cast<unsigned long long>(hi), static_cast<unsigned long long>(lo));
+  return std::string(buf, 32);
+}
+
+DetachedSession& SessionTable::park(const ResumeToken& token, const DetachedSession& session) {
+  return sessions_.insert_or_assign(token, session).first->second;
+}
+
+DetachedSession* SessionTable::find(const ResumeToken& token) {
+  auto it = sessions_.find(token);
+  return it != sessions_.end() ? &it->second : nullptr;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "room_manager.h"
+#include <string>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Opaque 128-bit resume token, issued at join and sent to the client as
+ * 32 hex characters.
+ */
+struct ResumeToken {
+  uint64_t hi = 0;
+  uint64_t lo = 0;
+
+  bool empty() const { return hi == 0 && lo == 0; }
+  bool operator==(const ResumeToken&) const = default;
+
+  /** Fresh random token (OpenSSL CSPRNG). */
+  static ResumeToken generate();
+
+  static std::optional<ResumeToken> from_hex(std::string_view hex);
+  std::string to_hex() const;
+};
+
+/**
+ * A peer whose socket dropped but whose room slot is being held open.
+ * peer_slot is the room's back-reference target while detached, so
+ * entries must not move — the table is node-based.
+ */
+struct DetachedSession {
+  using Clock = std::chrono::steady_clock;
+
+  RoomHandle        room;
+  uint32_t          user_index = 0;
+  uint32_t          peer_slot  = 0;
+  int64_t           token_exp  = 0;   // JWT exp; resume refused after this
+  Clock::time_point deadline;         // End of the grace period
+};
+
+/**
+ * Detached sessions awaiting resumption, keyed by resume token.
+ * Event loop thread only.
+ */
+class SessionTable {
+public:
+  /** Park a session. The returned reference stays valid until erase(). */
+  DetachedSession& park(const ResumeToken& token, const DetachedSession& session);
+
+  DetachedSession* find(const ResumeToken& token);
+  void erase(const ResumeToken& token) { sessions_.erase(token); }
+
+  size_t size() const { return sessions_.size(); }
+
+  /** Call fn(token, session) on every parked session. */
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (auto& [token, session] : sessions_) fn(token, session);
+  }
+
+  /** Call fn on (then drop) every session whose grace period has ended. */
+  template <typename Fn>
+  void expire(DetachedSession::Clock::time_point now, Fn&& fn) {
+    for (auto it = sessions_.begin(); it != sessions_.end();) {
+      if (it->second.deadline <= now) {
+        fn(it->second);
+        it = sessions_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+private:
+  struct TokenHash {
+    size_t operator()(const ResumeToken& t) const { return static_cast<size_t>(t.lo ^ t.hi); }
+  };
+
+  std::unordered_map<ResumeToken, DetachedSession, TokenHash> sessions_;
+};
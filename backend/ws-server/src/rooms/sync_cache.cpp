@@ -0,0 +1,39 @@
+#include "sync_cache.h"
+#include "protocol/message_codec.h"
+#include "protocol/frame_compressor.h"
+#include <cstring>
+
+void SyncCache::rebuild(uint64_t seq, const uint8_t* state, size_t len) {
+  // Sized exactly: the frame is held as long as the room lives
+  std::string frame;
+  if (len > 0) {
+    frame.resize(1 + len);
+    frame[0] = static_cast<char>(MessageType::YjsSync);
+    std::memcpy(frame.data() + 1, state, len);
+  }
+  frame_.swap(frame);
+  std::string().swap(packed_);
+  packed_tried_ = false;
+  seq_   = seq;
+  built_ = true;
+}
+
+std::string_view SyncCache::packed(FrameCompressor& compressor) {
+  if (!packed_tried_ && frame_.size() > 1 && compressor.enabled()) {
+    packed_tried_ = true;
+    packed_.assign(1, static_cast<char>(MessageCodec::compressed_type(MessageType::YjsSync)));
+    const auto* state = reinterpret_cast<const uint8_t*>(frame_.data()) + 1;
+    if (!compressor.compress(state, frame_.size() - 1, packed_) || packed_.size() >= frame_.size()) {
+      packed_.clear();
+    }
+    packed_.shrink_to_fit();
+  }
+  return packed_;
+}
+
+void SyncCache::clear() {
+  std::string().swap(frame_);
+  std::string().swap(packed_);
+  built_ = false;
+  packed_tried_ = false;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+class FrameCompressor;
+
+/**
+ * A room's initial-sync (0x01) frame, encoded once and sent to every
+ * joiner until the document changes.
+ *
+ * The frame is tagged with the room sequence number it was built at;
+ * every relayed update advances the sequence, so a cache whose tag is
+ * behind is stale and is rebuilt from storage by the next joiner. A
+ * burst of joiners on a quiet room thus costs one load and one encode.
+ *
+ * The dictionary-compressed variant (0x81) for "zstd" joiners is built
+ * from the same frame on first use and dropped with it.
+ *
+ * Not thread-safe; owned by a Room on the event loop.
+ */
+class SyncCache {
+public:
+  /** Built at this sequence number (so still current). */
+  bool fresh(uint64_t seq) const { return built_ && seq_ == seq; }
+
+  /** Replace with the state as of seq (an empty state caches "nothing to send"). */
+  void rebuild(uint64_t seq, const uint8_t* state, size_t len);
+
+  /** The 0x01 frame; empty if the document is empty. */
+  std::string_view frame() const { return frame_; }
+
+  /**
+   * The 0x81 frame, compressed on first call per version; empty if
+   * compression fails or does not make the frame smaller.
+   */
+  std::string_view packed(FrameCompressor& compressor);
+
+  /** Bytes held by both variants. */
+  size_t bytes() const { return frame_.capacity() + packed_.capacity(); }
+
+  void clear();
+
+private:
+  std::string frame_;
+  std::string packed_;
+  uint64_t    seq_ = 0;
+  bool        built_ = false;
+  bool        packed_tried_ = false;
+};
@@ -0,0 +1,35 @@
+#include "user_table.h"
+
+uint32_t UserTable::intern(std::string_view user_id) {
+  auto it = index_.find(user_id);
+  if (it != index_.end()) {
+    ++entries_[it->second].refs;
+    return it->second;
+  }
+
+  uint32_t idx;
+  if (!free_.empty()) {
+    idx = free_.back();
+    free_.pop_back();
+  } else {
+    idx = static_cast<uint32_t>(entries_.size());
+    entries_.emplace_back();
+  }
+
+  auto& entry = entries_[idx];
+  entry.user_id.assign(user_id);
+  entry.refs = 1;
+  index_.emplace(std::string_view(entry.user_id), idx);
+  return idx;
+}
+
+void UserTable::release(uint32_t index) {
+  if (index >= entries_.size()) return;
+
+  auto& entry = entries_[index];
+  if (entry.refs == 0 || --entry.refs > 0) return;
+
+  index_.erase(std::string_view(entry.user_id));
+  entry.user_id.clear();
+  free_.push_back(index);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <deque>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Interned user ID table.
+ *
+ * Each distinct user ID (a 36-char UUID) is stored once and referred to
+ * by a small integer index. Sockets hold the index instead of a string copy,
+ * so the hot path never hashes or copies user IDs — only join does.
+ *
+ * Entries are reference-counted (one ref per joined socket) and recycled
+ * once the last socket for a user closes. Storage is a deque so views
+ * returned by view() stay valid while the entry is referenced.
+ *
+ * Not thread-safe: owned and used by the event loop thread only.
+ */
+class UserTable {
+public:
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  /** Intern a user ID (adds a reference). Returns its stable index. */
+  uint32_t intern(std::string_view user_id);
+
+  /** Drop one reference; the slot is recycled when it reaches zero. */
+  void release(uint32_t index);
+
+  /** Look up the user ID for an index. */
+  std::string_view view(uint32_t index) const { return entries_[index].user_id; }
+
+  /** Number of distinct users currently referenced. */
+  size_t size() const { return index_.size(); }
+
+private:
+  struct Entry {
+    std::string user_id;
+    uint32_t    refs = 0;
+  };
+
+  std::deque<Entry> entries_;
+  std::vector<uint32_t> free_;
+  std::unordered_map<std::string_view, uint32_t> index_;  // keys view into entries_
+};
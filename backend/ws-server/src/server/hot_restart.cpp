@@ -0,0 +1,256 @@
+#include "hot_restart.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include "log/logger.h"
+
+namespace {
+
+constexpr char     kMagic[4] = { 'W', 'G', 'H', 'O' };
+constexpr uint32_t kVersion  = 1;
+
+// ── Encoding: little-endian integers, u32-length-prefixed strings ───────────
+
+void put_u8(std::string& out, uint8_t v) { out.push_back(static_cast<char>(v)); }
+
+void put_u32(std::string& out, uint32_t v) {
+  for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+void put_u64(std::string& out, uint64_t v) {
+  for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+void put_str(std::string& out, std::string_view s) {
+  put_u32(out, static_cast<uint32_t>(s.size()));
+  out.append(s);
+}
+
+/** Bounds-checked cursor; any short read sets failed. */
+struct Reader {
+  std::string_view in;
+  bool failed = false;
+
+  bool take(size_t n, const char*& p) {
+    if (failed || in.size() < n) {
+      failed = true;
+      return false;
+    }
+    p = in.data();
+    in.remove_prefix(n);
+    return true;
+  }
+
+  uint64_t uint(size_t bytes) {
+    const char* p;
+    if (!take(bytes, p)) return 0;
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; ++i) v |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+    return v;
+  }
+
+  uint8_t  u8()  { return static_cast<uint8_t>(uint(1)); }
+  uint32_t u32() { return static_cast<uint32_t>(uint(4)); }
+  uint64_t u64() { return uint(8); }
+
+  std::string str() {
+    const uint32_t len = u32();
+    const char* p;
+    return take(len, p) ? std::string(p, len) : std::string();
+  }
+};
+
+sockaddr_un unix_address(const std::string& path, bool& ok) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  ok = path.size() < sizeof(addr.sun_path);
+  if (ok) std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return addr;
+}
+
+bool write_all(int fd, const char* p, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p   += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+} // namespace
+
+// ── HandoffState ─────────────────────────────────────────────────────────────
+
+std::string HandoffState::encode() const {
+  std::string out(kMagic, sizeof(kMagic));
+  put_u32(out, kVersion);
+
+  put_u32(out, static_cast<uint32_t>(rooms.size()));
+  for (auto& room : rooms) {
+    put_str(out, room.project_id);
+    put_u64(out, room.seq);
+    put_u64(out, room.first_seq);
+    put_u32(out, static_cast<uint32_t>(room.frames.size()));
+    for (auto& frame : room.frames) put_str(out, frame);
+  }
+
+  put_u32(out, static_cast<uint32_t>(sessions.size()));
+  for (auto& s : sessions) {
+    put_u64(out, s.token.hi);
+    put_u64(out, s.token.lo);
+    put_u32(out, s.room);
+    put_str(out, s.user_id);
+    put_u8(out, s.flags);
+    put_u64(out, static_cast<uint64_t>(s.token_exp));
+    put_u32(out, s.grace_ms);
+  }
+  return out;
+}
+
+std::optional<HandoffState> HandoffState::decode(std::string_view data) {
+  if (data.size() < sizeof(kMagic) || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+    return std::nullopt;
+  }
+  Reader r{ data.substr(sizeof(kMagic)) };
+  if (r.u32() != kVersion) return std::nullopt;
+
+  HandoffState state;
+  // Counts are checked against the bytes left so a corrupt one cannot
+  // trigger a huge allocation
+  const uint32_t room_count = r.u32();
+  if (room_count > r.in.size()) return std::nullopt;
+  state.rooms.resize(room_count);
+  for (auto& room : state.rooms) {
+    room.project_id = r.str();
+    room.seq        = r.u64();
+    room.first_seq  = r.u64();
+    const uint32_t frames = r.u32();
+    if (r.failed || frames > r.in.size()) return std::nullopt;
+    room.frames.reserve(frames);
+    for (uint32_t i = 0; i < frames; ++i) room.frames.push_back(r.str());
+  }
+
+  const uint32_t session_count = r.u32();
+  if (r.failed || session_count > r.in.size()) return std::nullopt;
+  state.sessions.resize(session_count);
+  for (auto& s : state.sessions) {
+    s.token.hi  = r.u64();
+    s.token.lo  = r.u64();
+    s.room      = r.u32();
+    s.user_id   = r.str();
+    s.flags     = r.u8();
+    s.token_exp = static_cast<int64_t>(r.u64());
+    s.grace_ms  = r.u32();
+    if (s.room >= room_count) return std::nullopt;
+  }
+
+  if (r.failed || !r.in.empty()) return std::nullopt;
+  return state;
+}
+
+// ── HandoffListener ──────────────────────────────────────────────────────────
+
+HandoffListener::HandoffListener(const std::string& path) {
+  bool ok;
+  auto addr = unix_address(path, ok);
+  if (!ok) {
+    LOG_ERROR(Ws) << "Handoff socket path too long: " << path;
+    return;
+  }
+
+  // Whoever connects gets every live resume token and shuts us down, so
+  // the socket is owner-only; nobody can connect before listen(), which
+  // follows the chmod
+  fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  ::unlink(path.c_str());   // Predecessor's, now unused
+  if (fd_ < 0
+      || ::bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+      || ::chmod(path.c_str(), 0600) != 0
+      || ::listen(fd_, 1) != 0) {
+    LOG_ERROR(Ws) << "Cannot listen on handoff socket " << path
+                  << ": " << std::strerror(errno);
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+HandoffListener::~HandoffListener() {
+  // The path is left in place: a successor may already have rebound it
+  if (fd_ >= 0) ::close(fd_);
+}
+
+int HandoffListener::accept() {
+  if (fd_ < 0) return -1;
+  int fd = ::accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+  if (fd < 0) return -1;
+
+  // Only a successor running as our own user may take over
+  ucred peer{};
+  socklen_t peer_len = sizeof(peer);
+  if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) != 0 || peer.uid != ::geteuid()) {
+    LOG_WARN(Ws) << "Refused handoff to pid " << peer.pid << " (uid " << peer.uid << ")";
+    ::close(fd);
+    return -1;
+  }
+
+  // Blocking from here: the state is written in one go, then we exit
+  int flags = ::fcntl(fd, F_GETFL);
+  ::fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+  return fd;
+}
+
+// ── Both sides ───────────────────────────────────────────────────────────────
+
+std::optional<HandoffState> request_handoff(const std::string& path, uint32_t timeout_ms) {
+  bool ok;
+  auto addr = unix_address(path, ok);
+  if (!ok) return std::nullopt;
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return std::nullopt;
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);   // Nobody running (or a stale socket file): cold start
+    return std::nullopt;
+  }
+
+  timeval tv{ static_cast<time_t>(timeout_ms / 1000), static_cast<suseconds_t>((timeout_ms % 1000) * 1000) };
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  LOG_INFO(Ws) << "Taking over from the running server...";
+  std::string data;
+  char buf[64 * 1024];
+  for (;;) {
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n > 0) {
+      data.append(buf, static_cast<size_t>(n));
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      if (n < 0) data.clear();   // Timed out: do not trust a partial state
+      break;
+    }
+  }
+  ::close(fd);
+
+  auto state = HandoffState::decode(data);
+  if (!state) {
+    LOG_ERROR(Ws) << "Handoff failed (" << data.size() << " bytes), starting cold";
+  }
+  return state;
+}
+
+bool send_handoff(int fd, const HandoffState& state) {
+  auto data = state.encode();
+  bool ok = write_all(fd, data.data(), data.size());
+  ::close(fd);
+  return ok;
+}
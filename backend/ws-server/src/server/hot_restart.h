@@ -0,0 +1,73 @@
+#pragma once
+#include "rooms/session_table.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+/**
+ * Warm state passed from a retiring server process to its successor:
+ * the rooms that still have resumable peers, with their sequence state
+ * and recent frames, and those peers' detached sessions. Clients closed
+ * with 1012 resume against it without re-auth or a full sync.
+ */
+struct HandoffState {
+  struct RoomState {
+    std::string project_id;
+    uint64_t    seq = 0;
+    uint64_t    first_seq = 0;          // Seq of frames[0]
+    std::vector<std::string> frames;    // Sequenced (0x04) frames first_seq..seq
+  };
+
+  struct Session {
+    ResumeToken token;
+    uint32_t    room = 0;               // Index in rooms
+    std::string user_id;
+    uint8_t     flags = 0;              // PeerFlag bits (seq, zstd)
+    int64_t     token_exp = 0;
+    uint32_t    grace_ms = 0;           // Remaining grace period
+  };
+
+  std::vector<RoomState> rooms;
+  std::vector<Session>   sessions;
+
+  std::string encode() const;
+  static std::optional<HandoffState> decode(std::string_view data);
+};
+
+/**
+ * Unix-socket rendezvous for zero-downtime restarts.
+ *
+ * The running process listens on HANDOFF_SOCKET. A new process binds the
+ * public port next to it (uSockets sets SO_REUSEPORT), then connects
+ * here; the old one stops accepting, closes its clients with 1012, stores
+ * what it holds, writes its HandoffState and exits. The successor then
+ * opens the WAL and takes over the socket path for the next restart.
+ */
+class HandoffListener {
+public:
+  /** Bind (replacing a stale socket file) with mode 0600 and listen; check ok(). */
+  explicit HandoffListener(const std::string& path);
+  ~HandoffListener();
+
+  HandoffListener(const HandoffListener&) = delete;
+  HandoffListener& operator=(const HandoffListener&) = delete;
+
+  bool ok() const { return fd_ >= 0; }
+
+  /** Non-blocking: a connected successor's fd, or -1. Peers of another uid are refused. */
+  int accept();
+
+private:
+  int fd_ = -1;
+};
+
+/**
+ * Ask a running predecessor for its state (blocking, up to timeout_ms).
+ * nullopt if none is listening, or it failed mid-way (cold start).
+ */
+std::optional<HandoffState> request_handoff(const std::string& path, uint32_t timeout_ms);
+
+/** Send a state to a successor and close the connection. */
+bool send_handoff(int fd, const HandoffState& state);
@@ -0,0 +1,55 @@
+#include "overload_monitor.h"
+
+OverloadMonitor::OverloadMonitor(const Thresholds& thresholds, uint32_t tick_ms)
+  : thresholds_(thresholds), tick_us_(uint64_t{tick_ms} * 1000) {}
+
+const char* OverloadMonitor::name(Level level) {
+  switch (level) {
+    case Level::Normal:            return "normal";
+    case Level::ThrottleAwareness: return "throttle-awareness";
+    case Level::DeferColdLoads:    return "defer-cold-loads";
+    case Level::RejectJoins:       return "reject-joins";
+  }
+  return "?";
+}
+
+bool OverloadMonitor::on_tick(uint64_t now_us) {
+  if (last_tick_us_ == 0) {
+    last_tick_us_ = window_start_us_ = now_us;
+    return false;
+  }
+  const uint64_t elapsed = now_us - last_tick_us_;
+  const uint64_t lag = elapsed > tick_us_ ? elapsed - tick_us_ : 0;
+  last_tick_us_ = now_us;
+
+  total_us_ += lag;
+  if (lag > window_max_us_) window_max_us_ = lag;
+  if (now_us - window_start_us_ >= 1000000) {
+    last_max_us_     = window_max_us_;
+    window_max_us_   = 0;
+    window_start_us_ = now_us;
+  }
+
+  // EWMA with weight 1/8, in integer microseconds
+  smoothed_us_ = smoothed_us_ + lag / 8 - smoothed_us_ / 8;
+
+  auto threshold_us = [this](int level) { return uint64_t{thresholds_.ms[level]} * 1000; };
+  int target = 0;
+  for (int level = 1; level < kLevels; ++level) {
+    if (thresholds_.ms[level] && smoothed_us_ >= threshold_us(level)) target = level;
+  }
+
+  int current = static_cast<int>(level_);
+  if (target > current) {
+    current = target;
+  } else {
+    // Step down only once well clear of each level's threshold
+    while (current > target
+           && (thresholds_.ms[current] == 0 || smoothed_us_ < threshold_us(current) / 2)) {
+      --current;
+    }
+  }
+  if (current == static_cast<int>(level_)) return false;
+  level_ = static_cast<Level>(current);
+  return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Event loop lag, and the overload level derived from it.
+ *
+ * The loop timer is due every tick_ms; on_tick() is given the time it
+ * actually fired, and how much later than due that was is the lag: time
+ * the loop spent on other work (or blocked) before it got to the timer.
+ * The lag is smoothed over about eight ticks so a single slow iteration
+ * does not flip the level. A level is entered when the smoothed lag
+ * reaches its threshold and left once it falls below half of it.
+ *
+ * Levels are cumulative, each adding to what the one below sheds:
+ *
+ *   ThrottleAwareness  awareness relayed at a reduced rate per peer
+ *   DeferColdLoads     joins that need a storage load are turned away
+ *   RejectJoins        every new join is turned away
+ *
+ * A threshold of 0 disables its level. Event loop thread only.
+ */
+class OverloadMonitor {
+public:
+  enum class Level : uint8_t { Normal, ThrottleAwareness, DeferColdLoads, RejectJoins };
+  static constexpr int kLevels = 4;
+
+  /** Smoothed lag at which each level starts, in ms (index = Level). */
+  struct Thresholds {
+    uint32_t ms[kLevels] = { 0, 50, 100, 250 };
+  };
+
+  OverloadMonitor(const Thresholds& thresholds, uint32_t tick_ms);
+
+  /** The loop timer fired at now_us. Returns true if the level changed. */
+  bool on_tick(uint64_t now_us);
+
+  Level level() const { return level_; }
+  bool at_least(Level level) const { return level_ >= level; }
+
+  /** Smoothed lag. */
+  uint64_t lag_us() const { return smoothed_us_; }
+
+  /** Worst single-tick lag within the last full second. */
+  uint64_t max_lag_us() const { return last_max_us_; }
+
+  /** Sum of all lag measured (a counter; its rate is the loop's overrun). */
+  uint64_t total_lag_us() const { return total_us_; }
+
+  static const char* name(Level level);
+
+private:
+  Thresholds thresholds_;
+  uint64_t tick_us_;
+  Level    level_ = Level::Normal;
+  uint64_t last_tick_us_ = 0;
+  uint64_t smoothed_us_ = 0;
+  uint64_t total_us_ = 0;
+  uint64_t window_start_us_ = 0;
+  uint64_t window_max_us_ = 0;
+  uint64_t last_max_us_ = 0;
+};
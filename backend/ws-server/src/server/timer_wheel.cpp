@@ -0,0 +1,92 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+void TimerWheel::Timer::cancel() {
+  if (wheel_) wheel_->unlink(*this);
+}
+
+TimerWheel::TimerWheel(void* owner, uint32_t tick_ms, uint64_t now_ms)
+  : owner_(owner), tick_ms_(std::max<uint32_t>(tick_ms, 1)), origin_ms_(now_ms) {}
+
+TimerWheel::~TimerWheel() {
+  // Timers may outlive the wheel; leave them unlinked
+  for (auto& level : slots_) {
+    for (auto& slot : level) {
+      while (slot.head) unlink(*slot.head);
+    }
+  }
+}
+
+void TimerWheel::schedule(Timer& t, uint64_t delay_ms, uint64_t period_ms) {
+  if (t.wheel_) unlink(t);
+  const uint64_t ticks = (delay_ms + tick_ms_ - 1) / tick_ms_;
+  t.due_    = now_ + std::max<uint64_t>(ticks, 1);
+  t.period_ = period_ms ? std::max<uint64_t>((period_ms + tick_ms_ - 1) / tick_ms_, 1) : 0;
+  link(t);
+}
+
+void TimerWheel::link(Timer& t) {
+  // Level = how many slot-widths away the deadline is
+  const uint64_t delta = t.due_ - now_;
+  uint32_t level = 0;
+  while (level + 1 < kLevels && delta >= (uint64_t{1} << (kSlotBits * (level + 1)))) ++level;
+
+  uint64_t at = t.due_;
+  const uint64_t span = uint64_t{1} << (kSlotBits * kLevels);
+  if (delta >= span) at = now_ + span - 1;   // Beyond the wheel: park in the farthest slot
+  Slot& slot = slots_[level][(at >> (kSlotBits * level)) & (kSlots - 1)];
+
+  t.wheel_ = this;
+  t.pprev_ = &slot.head;
+  t.next_  = slot.head;
+  if (slot.head) slot.head->pprev_ = &t.next_;
+  slot.head = &t;
+  ++size_;
+}
+
+void TimerWheel::unlink(Timer& t) {
+  *t.pprev_ = t.next_;
+  if (t.next_) t.next_->pprev_ = t.pprev_;
+  t.wheel_ = nullptr;
+  t.pprev_ = nullptr;
+  t.next_  = nullptr;
+  --size_;
+}
+
+void TimerWheel::cascade(uint32_t level) {
+  Slot& slot = slots_[level][(now_ >> (kSlotBits * level)) & (kSlots - 1)];
+  Timer* t = slot.head;
+  slot.head = nullptr;
+  while (t) {
+    Timer* next = t->next_;
+    --size_;
+    link(*t);   // Lands on a lower level now that it is closer
+    t = next;
+  }
+}
+
+void TimerWheel::advance(uint64_t now_ms) {
+  const uint64_t target = now_ms > origin_ms_ ? (now_ms - origin_ms_) / tick_ms_ : 0;
+
+  while (now_ < target) {
+    ++now_;
+
+    // Entering a new higher-level slot: spread its timers over the levels below
+    for (uint32_t level = 1; level < kLevels; ++level) {
+      if (now_ & ((uint64_t{1} << (kSlotBits * level)) - 1)) break;
+      cascade(level);
+    }
+
+    // Callbacks may arm or cancel anything; a timer armed now is due at
+    // least one tick later, so it never lands in the slot being drained
+    Slot& slot = slots_[0][now_ & (kSlots - 1)];
+    while (Timer* t = slot.head) {
+      unlink(*t);
+      if (t->period_) {
+        t->due_ = now_ + t->period_;
+        link(*t);
+      }
+      t->fn_(owner_, t->arg_);
+    }
+  }
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Hierarchical timing wheel: every server timer (periodic tasks, per-room
+ * save windows, per-peer deadlines) hangs off one loop timer that calls
+ * advance() once per tick.
+ *
+ * Four levels of 64 slots; level n slots span 64^n ticks, so a 10 ms tick
+ * covers about 46 hours (longer delays are parked in the last slot and
+ * re-placed when it comes round). Timers are intrusive, doubly linked
+ * nodes embedded in their owner: scheduling, rescheduling and cancelling
+ * are O(1) and never allocate. A timer unlinks itself when destroyed, so
+ * owners going away need no bookkeeping.
+ *
+ * Event loop thread only.
+ */
+class TimerWheel {
+public:
+  static constexpr uint32_t kLevels   = 4;
+  static constexpr uint32_t kSlotBits = 6;
+  static constexpr uint32_t kSlots    = 1u << kSlotBits;
+
+  /** Called with the wheel's owner and the timer's own argument. */
+  using Fn = void (*)(void* owner, void* arg);
+
+  class Timer {
+  public:
+    Timer() = default;
+    Timer(Fn fn, void* arg) : fn_(fn), arg_(arg) {}
+    ~Timer() { cancel(); }
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    void set(Fn fn, void* arg) {
+      fn_  = fn;
+      arg_ = arg;
+    }
+
+    bool scheduled() const { return wheel_ != nullptr; }
+
+    /** Disarm (no-op if not scheduled). */
+    void cancel();
+
+  private:
+    friend class TimerWheel;
+    Fn          fn_  = nullptr;
+    void*       arg_ = nullptr;
+    TimerWheel* wheel_ = nullptr;   // Set while linked
+    Timer**     pprev_ = nullptr;   // The link pointing at us (slot head or prev's next_)
+    Timer*      next_  = nullptr;
+    uint64_t    due_   = 0;         // Absolute tick
+    uint64_t    period_ = 0;        // Ticks; 0 = one-shot
+  };
+
+  /** Ticks start at now_ms; owner is passed to every callback. */
+  TimerWheel(void* owner, uint32_t tick_ms, uint64_t now_ms);
+  ~TimerWheel();
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  uint32_t tick_ms() const { return tick_ms_; }
+
+  /**
+   * Arm t to fire delay_ms from now (rounded up to whole ticks, at least
+   * one), replacing any earlier schedule. period_ms > 0 re-arms it after
+   * each firing.
+   */
+  void schedule(Timer& t, uint64_t delay_ms, uint64_t period_ms = 0);
+
+  /** Fire everything due up to now_ms, in tick order. */
+  void advance(uint64_t now_ms);
+
+  /** Armed timers. */
+  size_t size() const { return size_; }
+
+private:
+  struct Slot {
+    Timer* head = nullptr;
+  };
+
+  void*    owner_;
+  uint32_t tick_ms_;
+  uint64_t origin_ms_;   // Wall of tick 0
+  uint64_t now_ = 0;     // Last processed tick
+  size_t   size_ = 0;
+  Slot     slots_[kLevels][kSlots];
+
+  void link(Timer& t);
+  void unlink(Timer& t);
+  void cascade(uint32_t level);
+};
@@ -0,0 +1,138 @@
+#include "tls_context.h"
+#include "log/logger.h"
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/err.h>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <ctime>
+
+namespace {
+
+// AES-128-GCM first: as strong as the handshake and cheaper per record
+// than AES-256 on every frame; ChaCha20 for clients without AES hardware
+constexpr const char* kCipherSuites =
+  "TLS_AES_128_GCM_SHA256:TLS_CHACHA20_POLY1305_SHA256:TLS_AES_256_GCM_SHA384";
+constexpr unsigned char kSessionIdContext[] = "wigma";
+
+using SslCtx = std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)>;
+
+std::filesystem::file_time_type mtime_of(const std::string& path) {
+  std::error_code ec;
+  auto t = std::filesystem::last_write_time(path, ec);
+  return ec ? std::filesystem::file_time_type{} : t;
+}
+
+std::string ssl_error() {
+  char buf[256];
+  ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+  ERR_clear_error();
+  return buf;
+}
+
+bool use_pair(SSL_CTX* ctx, const std::string& cert, const std::string& key) {
+  return SSL_CTX_use_certificate_chain_file(ctx, cert.c_str()) == 1
+      && SSL_CTX_use_PrivateKey_file(ctx, key.c_str(), SSL_FILETYPE_PEM) == 1
+      && SSL_CTX_check_private_key(ctx) == 1;
+}
+
+} // namespace
+
+TlsContext::TlsContext(ssl_ctx_st* ctx, const Config& config)
+  : ctx_(ctx)
+  , cert_file_(config.tls_cert_file)
+  , key_file_(config.tls_key_file)
+  , ticket_key_file_(config.tls_ticket_key_file)
+  , cert_mtime_(mtime_of(cert_file_))
+  , key_mtime_(mtime_of(key_file_)) {
+  SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+  SSL_CTX_set_ciphersuites(ctx_, kCipherSuites);
+  SSL_CTX_set_options(ctx_, SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE
+                            | SSL_OP_PRIORITIZE_CHACHA);
+
+  // Resumption: stateless tickets (TLS 1.3 and 1.2); the id context makes
+  // 1.2 session-id resumption valid too
+  SSL_CTX_set_session_id_context(ctx_, kSessionIdContext, sizeof(kSessionIdContext) - 1);
+  SSL_CTX_set_num_tickets(ctx_, 1);
+  SSL_CTX_set_timeout(ctx_, static_cast<long>(config.tls_ticket_lifetime_s));
+
+  if (!ticket_key_file_.empty()) {
+    ticket_mtime_ = mtime_of(ticket_key_file_);
+    if (!load_ticket_key()) {
+      throw std::runtime_error("TlsContext: " + ticket_key_file_ + " must hold at least 80 bytes");
+    }
+  }
+  read_not_after();
+}
+
+bool TlsContext::load_ticket_key() {
+  // Key name, HMAC key, AES key, as OpenSSL lays them out (80 bytes in 3.x)
+  const long size = SSL_CTX_set_tlsext_ticket_keys(ctx_, nullptr, 0);
+  std::ifstream in(ticket_key_file_, std::ios::binary);
+  std::vector<unsigned char> key((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (size <= 0 || key.size() < static_cast<size_t>(size)) return false;
+  return SSL_CTX_set_tlsext_ticket_keys(ctx_, key.data(), size) == 1;
+}
+
+void TlsContext::read_not_after() {
+  X509* cert = SSL_CTX_get0_certificate(ctx_);
+  std::tm tm{};
+  if (!cert || ASN1_TIME_to_tm(X509_get0_notAfter(cert), &tm) != 1) {
+    not_after_ = 0;
+    return;
+  }
+  not_after_ = static_cast<int64_t>(timegm(&tm));
+}
+
+void TlsContext::reload_if_changed() {
+  if (!ticket_key_file_.empty()) {
+    auto mtime = mtime_of(ticket_key_file_);
+    if (mtime != ticket_mtime_) {
+      ticket_mtime_ = mtime;
+      if (load_ticket_key()) {
+        ++reloads_[0];
+        LOG_INFO(Ws) << "TLS ticket key reloaded from " << ticket_key_file_;
+      } else {
+        ++reloads_[1];
+        LOG_WARN(Ws) << "Cannot reload TLS ticket key from " << ticket_key_file_ << ", keeping the current one";
+      }
+    }
+  }
+
+  auto cert_mtime = mtime_of(cert_file_);
+  auto key_mtime  = mtime_of(key_file_);
+  if (cert_mtime == cert_mtime_ && key_mtime == key_mtime_) return;
+
+  // Certificate and key are renewed as a pair; check they match before
+  // the listener sees either
+  SslCtx scratch(SSL_CTX_new(TLS_server_method()), &SSL_CTX_free);
+  if (!scratch || !use_pair(scratch.get(), cert_file_, key_file_)) {
+    // Possibly caught between the two writes; retried on the next change
+    ++reloads_[1];
+    LOG_WARN(Ws) << "TLS certificate reload failed (" << ssl_error() << "), keeping the current one";
+    cert_mtime_ = cert_mtime;
+    key_mtime_  = key_mtime;
+    return;
+  }
+  if (!use_pair(ctx_, cert_file_, key_file_)) {
+    ++reloads_[1];
+    LOG_ERROR(Ws) << "TLS certificate reload failed on the listener: " << ssl_error();
+    return;
+  }
+  cert_mtime_ = cert_mtime;
+  key_mtime_  = key_mtime;
+  ++reloads_[0];
+  read_not_after();
+  LOG_INFO(Ws) << "TLS certificate reloaded from " << cert_file_;
+}
+
+uint64_t TlsContext::handshakes() const {
+  return static_cast<uint64_t>(SSL_CTX_sess_accept_good(ctx_));
+}
+
+uint64_t TlsContext::resumed() const {
+  return static_cast<uint64_t>(SSL_CTX_sess_hits(ctx_));
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "config.h"
+#include <string>
+#include <filesystem>
+#include <cstdint>
+
+struct ssl_ctx_st;
+
+/**
+ * Tuning and hot reload of the listener's OpenSSL context (SSLApp mode,
+ * TLS_CERT_FILE + TLS_KEY_FILE).
+ *
+ * Clients reconnect often (tab focus, network changes, hot restarts), so
+ * resumption matters more than the full handshake: the context issues one
+ * TLS 1.3 session ticket per handshake, valid for TLS_TICKET_LIFETIME_S.
+ * Ticket keys are random per process unless TLS_TICKET_KEY_FILE names a
+ * shared 80-byte key, which lets tickets survive a hot restart and work on
+ * every node of a cluster. Replacing that file rotates the key.
+ *
+ * reload_if_changed() re-reads the certificate chain, private key and
+ * ticket key when their files change. A new pair is checked on a scratch
+ * context first, so a half-written renewal never reaches the listener;
+ * established connections keep the certificate they were served.
+ *
+ * Event loop thread only.
+ */
+class TlsContext {
+public:
+  /** Tune ctx (owned by the SSLApp). Throws std::runtime_error on a bad ticket key. */
+  TlsContext(ssl_ctx_st* ctx, const Config& config);
+
+  TlsContext(const TlsContext&) = delete;
+  TlsContext& operator=(const TlsContext&) = delete;
+
+  /** Reload whichever of certificate, key and ticket key changed on disk. */
+  void reload_if_changed();
+
+  /** Completed handshakes, and how many of them resumed a session. */
+  uint64_t handshakes() const;
+  uint64_t resumed() const;
+
+  /** Reloads applied / rejected so far. */
+  uint64_t reloads() const { return reloads_[0]; }
+  uint64_t reload_failures() const { return reloads_[1]; }
+
+  /** Expiry of the served certificate (unix seconds, 0 if unknown). */
+  int64_t not_after() const { return not_after_; }
+
+private:
+  ssl_ctx_st* ctx_;
+  std::string cert_file_;
+  std::string key_file_;
+  std::string ticket_key_file_;
+  std::filesystem::file_time_type cert_mtime_{};
+  std::filesystem::file_time_type key_mtime_{};
+  std::filesystem::file_time_type ticket_mtime_{};
+  int64_t  not_after_ = 0;
+  uint64_t reloads_[2] = {};
+
+  bool load_ticket_key();
+  void read_not_after();
+};
@@ -0,0 +1,133 @@
+#include "traffic_capture.h"
+#include "protocol/message_codec.h"
+#include "log/logger.h"
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t kWakeBytes = 1024 * 1024;   // Wake the writer early past this
+
+void put_u32(std::string& out, uint32_t v) {
+  for (int i = 0; i < 4; ++i) out += static_cast<char>(v >> (8 * i));
+}
+
+void put_u64(std::string& out, uint64_t v) {
+  for (int i = 0; i < 8; ++i) out += static_cast<char>(v >> (8 * i));
+}
+
+} // namespace
+
+bool TrafficCapture::parse_redact(std::string_view text, Redact& out) {
+  if (text == "payload") { out = Redact::Payload; return true; }
+  if (text == "none")    { out = Redact::None;    return true; }
+  return false;
+}
+
+TrafficCapture::TrafficCapture(const std::string& path, Redact redact, uint64_t max_bytes)
+  : file_(std::fopen(path.c_str(), "wb")), redact_(redact), max_bytes_(max_bytes) {
+  if (!file_) {
+    throw std::runtime_error("TrafficCapture: cannot create " + path + ": " + std::strerror(errno));
+  }
+  pending_.assign(kMagic, sizeof(kMagic));
+  writer_ = std::thread([this] { run(); });
+}
+
+TrafficCapture::~TrafficCapture() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  std::fclose(file_);
+}
+
+void TrafficCapture::record(Kind kind, uint64_t t_us, uint32_t peer, uint32_t room,
+                            const char* data, size_t len) {
+  std::string_view payload(data, len);
+  uint8_t type = 0;
+
+  if (kind == Kind::Text) {
+    // Cut the token out; if it cannot be located in the text, keep nothing
+    MessageCodec::ControlMessage msg;
+    if (!MessageCodec::decode_control(payload, msg)) {
+      payload = {};
+    } else if (!msg.token.empty()) {
+      const char* at = msg.token.data();
+      if (at >= data && at + msg.token.size() <= data + len) {
+        scratch_.assign(data, at);
+        scratch_.append(at + msg.token.size(), data + len);
+        payload = scratch_;
+      } else {
+        payload = {};   // Escaped: the view is into decoded scratch
+      }
+    }
+  } else if (kind == Kind::Binary && len > 0) {
+    type = static_cast<uint8_t>(data[0]);
+    if (redact_ == Redact::Payload && MessageCodec::is_compressed(static_cast<MessageType>(type))) {
+      payload = {};
+    } else if (redact_ == Redact::Payload) {
+      scratch_.assign(len, '\0');
+      scratch_[0] = data[0];
+      payload = scratch_;
+    }
+  }
+
+  if (payload.size() > kMaxPayload) payload = {};   // Not readable back
+  const uint64_t size = kHeaderSize + payload.size();
+  if (reserved_ + size > max_bytes_) {
+    if (reserved_ <= max_bytes_) {
+      reserved_ = max_bytes_ + 1;   // Warn once
+      LOG_WARN(Ws) << "Traffic capture reached its size cap, no longer recording";
+    }
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  bool wake;
+  {
+    std::lock_guard lock(mutex_);
+    if (pending_.size() + size > kMaxPending) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    put_u32(pending_, static_cast<uint32_t>(size - 4));
+    pending_ += static_cast<char>(kind);
+    pending_ += static_cast<char>(type);
+    put_u64(pending_, t_us);
+    put_u32(pending_, peer);
+    put_u32(pending_, room);
+    pending_.append(payload);
+    wake = pending_.size() >= kWakeBytes;
+  }
+  reserved_ += size;
+  records_.fetch_add(1, std::memory_order_relaxed);
+  if (wake) wake_.notify_one();
+}
+
+void TrafficCapture::run() {
+  std::string batch;
+  bool failed = false;
+  for (;;) {
+    bool stop;
+    {
+      std::unique_lock lock(mutex_);
+      wake_.wait_for(lock, std::chrono::milliseconds(100),
+                     [this] { return stop_ || pending_.size() >= kWakeBytes; });
+      batch.swap(pending_);
+      stop = stop_;
+    }
+
+    if (!batch.empty() && !failed) {
+      if (std::fwrite(batch.data(), 1, batch.size(), file_) != batch.size() || std::fflush(file_) != 0) {
+        failed = true;
+        LOG_ERROR(Ws) << "Traffic capture write failed: " << std::strerror(errno);
+      }
+    }
+    batch.clear();
+    if (stop) return;
+  }
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+
+/**
+ * Capture of inbound client traffic for later replay (tools/replay.cpp).
+ *
+ * File layout (all integers little-endian):
+ *
+ *   header = "WGCAP001"
+ *   record = [u32 body_len][u8 kind][u8 type][u64 t_us][u32 peer][u32 room][payload]
+ *
+ * body_len counts everything after itself. t_us is microseconds since
+ * capture start; peer numbers the sessions of one capture from 1; room is
+ * the room slot + 1 (0 before the session joined); type repeats the first
+ * payload byte of binary frames (MessageType) for filtering, 0 otherwise.
+ *
+ * Credentials never reach the file: the token of a join or resume is cut
+ * out of the JSON (leaving ""), and a control message whose token cannot
+ * be located is written without payload. With Redact::Payload, binary
+ * payloads past the type byte are zeroed: sizes, timing and the frame mix
+ * replay faithfully, document contents do not. Compressed frames (0x8x)
+ * are written without payload instead, since zeroes do not decompress
+ * and the compressed bytes would give the contents away; the header's
+ * type still counts them.
+ *
+ * The file carries no header beyond the magic; a record that was cut short
+ * (the server died mid-write) ends the trace.
+ *
+ * record() runs on the event loop and only appends to an in-memory buffer;
+ * a writer thread drains it to disk. Records are dropped (and counted)
+ * when the writer falls behind by more than kMaxPending bytes or the file
+ * reaches its size cap.
+ */
+class TrafficCapture {
+public:
+  enum class Kind : uint8_t { Text = 1, Binary = 2, Close = 3 };
+  enum class Redact : uint8_t { None, Payload };
+
+  static constexpr char   kMagic[8]   = { 'W', 'G', 'C', 'A', 'P', '0', '0', '1' };
+  static constexpr size_t kHeaderSize = 4 + 1 + 1 + 8 + 4 + 4;   // Record header
+  static constexpr size_t kMaxPayload = 16 * 1024 * 1024;        // The server's message limit
+  static constexpr size_t kMaxPending = 32 * 1024 * 1024;
+
+  /** Fixed part of a record, as read back by tools/replay. */
+  struct Record {
+    Kind     kind = Kind::Close;
+    uint8_t  type = 0;
+    uint64_t t_us = 0;
+    uint32_t peer = 0;
+    uint32_t room = 0;
+  };
+
+  /**
+   * Decode a kHeaderSize-byte record header and its payload length. False
+   * if body_len is shorter than the header or the payload longer than
+   * kMaxPayload: the file is corrupt (or not a capture) from here on.
+   */
+  static bool read_header(const char* p, Record& out, size_t& payload_len) {
+    auto get = [p](size_t at, size_t bytes) {
+      uint64_t v = 0;
+      for (size_t i = 0; i < bytes; ++i) v |= uint64_t{static_cast<uint8_t>(p[at + i])} << (8 * i);
+      return v;
+    };
+    const uint64_t body = get(0, 4);
+    if (body + 4 < kHeaderSize || body + 4 - kHeaderSize > kMaxPayload) return false;
+    payload_len = static_cast<size_t>(body + 4 - kHeaderSize);
+    out.kind = static_cast<Kind>(p[4]);
+    out.type = static_cast<uint8_t>(p[5]);
+    out.t_us = get(6, 8);
+    out.peer = static_cast<uint32_t>(get(14, 4));
+    out.room = static_cast<uint32_t>(get(18, 4));
+    return true;
+  }
+
+  /** Parse CAPTURE_REDACT ("payload" or "none"); false if unknown. */
+  static bool parse_redact(std::string_view text, Redact& out);
+
+  /** Create the file and start the writer. Throws std::runtime_error on failure. */
+  TrafficCapture(const std::string& path, Redact redact, uint64_t max_bytes);
+  ~TrafficCapture();
+
+  TrafficCapture(const TrafficCapture&) = delete;
+  TrafficCapture& operator=(const TrafficCapture&) = delete;
+
+  /** Record one frame (or a close, with no payload). */
+  void record(Kind kind, uint64_t t_us, uint32_t peer, uint32_t room, const char* data, size_t len);
+
+  uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  std::FILE* file_;
+  Redact     redact_;
+  uint64_t   max_bytes_;
+  uint64_t   reserved_ = sizeof(kMagic);   // File bytes accepted so far (loop thread)
+  std::string scratch_;                    // Redacted payload (loop thread)
+
+  std::mutex              mutex_;
+  std::condition_variable wake_;
+  std::string             pending_;        // Guarded by mutex_
+  bool                    stop_ = false;   // Guarded by mutex_
+  std::atomic<uint64_t>   records_{0};
+  std::atomic<uint64_t>   dropped_{0};
+  std::thread             writer_;
+
+  void run();
+};
@@ -1,34 +1,345 @@
 #include "ws_server.h"
 #include <App.h>   // uWebSockets
-#include <iostream>
+#include "log/logger.h"
+#include "log/tracer.h"
 #include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace {
+
+using WebSocket    = uWS::WebSocket<false, true, PerSocketData>;
+using SslWebSocket = uWS::WebSocket<true, true, PerSocketData>;
+
+constexpr size_t kMaxPayload = 16 * 1024 * 1024;  // 16 MB max message
+constexpr size_t kMaxBackpressure = 1024 * 1024;
+constexpr size_t kMaxUnsavedBytes = 1024 * 1024;  // Save a room early past this
+constexpr size_t kMaxHeldBytes = 256 * 1024;      // Rate-limited updates held per peer
+constexpr uint32_t kHeldRetryMs = 50;             // Release attempt interval for held updates
+constexpr uint32_t kSaveRetryMs = 1000;           // Delay before retrying a room's failed save
+constexpr uint32_t kWheelTickMs = 10;             // Timer resolution
+constexpr size_t kFrameArenaBytes = 256 * 1024;   // Scratch before spilling to the heap
+
+/** Remote peers travel as tagged pointers wherever a uWS socket would. */
+void* tag_remote(RemotePeer* peer) {
+  return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(peer) | 1);
+}
+
+RemotePeer* as_remote(void* ws) {
+  auto bits = reinterpret_cast<uintptr_t>(ws);
+  return (bits & 1) ? reinterpret_cast<RemotePeer*>(bits & ~uintptr_t{1}) : nullptr;
+}
+
+// Client sockets are all of one type, fixed by run() before the first opens
+bool tls_sockets = false;
+
+/** Call fn with a client socket cast to the listener's socket type. */
+template <typename Fn>
+decltype(auto) with_socket(void* ws, Fn&& fn) {
+  if (tls_sockets) return fn(static_cast<SslWebSocket*>(ws));
+  return fn(static_cast<WebSocket*>(ws));
+}
+
+/** WebSocket::send() with the status reduced to "not backpressured". */
+template <typename Socket>
+bool send_ws(Socket* ws, std::string_view data, uWS::OpCode op) {
+  return ws->send(data, op) == Socket::SUCCESS;
+}
+
+PerSocketData* user_data(void* ws) {
+  if (auto* remote = as_remote(ws)) return &remote->data;
+  return with_socket(ws, [](auto* socket) { return socket->getUserData(); });
+}
+
+uint64_t remote_key(const ClusterLink& link, uint32_t sid) {
+  return (uint64_t{link.id()} << 32) | sid;
+}
+
+/** Room fan-out sender. Returns false when the peer is backpressured. */
+bool send_to_peer(void* ws, const char* d, size_t len, bool is_binary) {
+  if (auto* remote = as_remote(ws)) {
+    return remote->link->send(is_binary ? LinkFrame::Binary : LinkFrame::Text, remote->sid, d, len);
+  }
+  return with_socket(ws, [&](auto* socket) {
+    return send_ws(socket, std::string_view(d, len), is_binary ? uWS::OpCode::BINARY : uWS::OpCode::TEXT);
+  });
+}
+
+/**
+ * Fan-out sender for peers already congested: the update is merged into
+ * the peer's backlog instead of queueing behind uWS backpressure.
+ */
+bool queue_backlog(void* ws, const char* d, size_t len, bool /*is_binary*/) {
+  auto* data = user_data(ws);
+  if (data->backlog.bytes() >= kMaxBackpressure) {
+    data->backlog_overflow = true;   // Resolved by reconnect + full sync
+  } else {
+    data->backlog.push(reinterpret_cast<const uint8_t*>(d), len);
+  }
+  return true;
+}
+
+/** Open the write-ahead log (if configured), replaying into the backend. */
+std::unique_ptr<WriteAheadLog> make_wal(const Config& config, PersistenceBackend& replay_backend,
+                                        std::atomic<uint64_t>& coalesced) {
+  if (config.wal_dir.empty()) return nullptr;
+
+  WriteAheadLog::Options options;
+  options.dir                = config.wal_dir;
+  options.segment_bytes      = static_cast<uint64_t>(config.wal_segment_mb) * 1024 * 1024;
+  options.commit_interval_ms = config.wal_commit_interval_ms;
+  options.replay_batch       = config.wal_replay_batch;
+
+  // Ops are durable once logged, so only the database write is coalesced:
+  // each replay batch is merged per project before the bulk insert. Rows
+  // carry the batch's log position; records the database already holds
+  // (stored just before a crash, cursor not yet saved) are skipped.
+  return std::make_unique<WriteAheadLog>(options,
+    [&replay_backend, &coalesced, stored = int64_t{-1}](
+        std::string_view log_id, const std::vector<WriteAheadLog::Record>& batch) mutable {
+      if (stored < 0 && (stored = replay_backend.replayed_through(log_id)) < 0) return false;
+
+      std::vector<std::pair<std::string_view, OpCoalescer>> projects;
+      for (auto& rec : batch) {
+        if (static_cast<int64_t>(rec.position) <= stored) continue;
+        auto it = std::find_if(projects.begin(), projects.end(),
+                               [&](const auto& p) { return p.first == rec.project_id; });
+        if (it == projects.end()) it = projects.emplace(projects.end(), rec.project_id, OpCoalescer{});
+        it->second.push(reinterpret_cast<const uint8_t*>(rec.payload.data()), rec.payload.size());
+      }
+      if (projects.empty()) return true;
+
+      std::vector<PersistenceBackend::UpdateRow> rows;
+      rows.reserve(batch.size());
+      uint64_t merged = 0;
+      for (auto& [project_id, ops] : projects) {
+        merged += ops.merged();
+        ops.for_each([&](std::string_view op) {
+          rows.push_back({ project_id, reinterpret_cast<const uint8_t*>(op.data()), op.size() });
+        });
+      }
+      const auto position = static_cast<int64_t>(batch.back().position);
+      if (!replay_backend.append_updates(rows, log_id, position)) return false;
+      stored = position;
+      coalesced.fetch_add(merged, std::memory_order_relaxed);
+      return true;
+    });
+}
+
+RateLimiter::Options rate_options(const Config& config) {
+  auto limit = [](const RateSpec& spec) {
+    return RateLimiter::Limit{ static_cast<float>(spec.frames_per_sec),
+                               static_cast<float>(spec.kb_per_sec) * 1024.0f };
+  };
+
+  RateLimiter::Options options;
+  options.peer = { limit(config.rate_peer.update), limit(config.rate_peer.awareness), limit(config.rate_peer.other) };
+  options.room = { limit(config.rate_room.update), limit(config.rate_room.awareness), limit(config.rate_room.other) };
+  options.burst_secs = config.rate_burst_secs;
+  return options;
+}
+
+OverloadMonitor::Thresholds overload_thresholds(const Config& config) {
+  OverloadMonitor::Thresholds thresholds;
+  thresholds.ms[1] = config.overload_awareness_lag_ms;
+  thresholds.ms[2] = config.overload_defer_lag_ms;
+  thresholds.ms[3] = config.overload_reject_lag_ms;
+  return thresholds;
+}
+
+RateClass rate_class(MessageType type) {
+  switch (type) {
+    case MessageType::YjsUpdate: return RateClass::Update;
+    case MessageType::Awareness: return RateClass::Awareness;
+    default:                     return RateClass::Other;
+  }
+}
+
+/**
+ * Metric label for a room: 12 hex digits of an FNV-1a hash of its project
+ * id. /metrics is unauthenticated and a project id opens a link-shared
+ * project, so the id itself is never exported.
+ */
+std::string room_label(std::string_view project_id) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (unsigned char c : project_id) {
+    h ^= c;
+    h *= 0x100000001b3ULL;
+  }
+  static constexpr char kHex[] = "0123456789abcdef";
+  std::string out(12, '0');
+  for (size_t i = out.size(); i-- > 0; h >>= 4) out[i] = kHex[h & 0xf];
+  return out;
+}
+
+uint64_t monotonic_us() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t monotonic_ns() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/** Charges the loop time of its scope to a room, if the room still exists. */
+class ChargeRoom {
+public:
+  ChargeRoom(const RoomManager& rooms, RoomHandle room)
+    : rooms_(rooms), room_(room), start_ns_(monotonic_ns()) {}
+  ~ChargeRoom() {
+    if (auto* room = rooms_.resolve(room_)) room->load().add_busy(monotonic_ns() - start_ns_);
+  }
+
+  ChargeRoom(const ChargeRoom&) = delete;
+  ChargeRoom& operator=(const ChargeRoom&) = delete;
+
+private:
+  const RoomManager& rooms_;
+  RoomHandle room_;
+  uint64_t   start_ns_;
+};
+
+} // namespace
 
 WsServer::WsServer(const Config& config)
   : config_(config)
-  , room_manager_(config.max_rooms)
+  , room_manager_(config.max_rooms, Room::Options{
+      config.max_peers, config.op_ring_ops, config.op_ring_kb * 1024, config.max_spectators })
   , jwt_verifier_(config.supabase_url, config.jwt_secret)
-  , supabase_client_(config.supabase_url, config.supabase_service_key)
-  , persistence_(supabase_client_) {}
+  , backend_(PersistenceBackend::create(config))
+  , replay_backend_(PersistenceBackend::create(config))
+  , persistence_(*backend_)
+  , rate_limiter_(rate_options(config))
+  , wheel_(this, kWheelTickMs, monotonic_us() / 1000)
+  , room_timers_(std::make_unique<RoomTimer[]>(config.max_rooms))
+  , overload_(overload_thresholds(config), kWheelTickMs)
+  , jitter_state_(monotonic_us() | 1)
+  , frame_arena_(kFrameArenaBytes, &arena_heap_) {
+  if (config.memory_budget_mb > 0 && !config.spill_file.empty()) {
+    spill_ = std::make_unique<RoomSpill>(config.spill_file);
+  }
+  if (!config.capture_file.empty()) {
+    TrafficCapture::Redact redact;
+    if (!TrafficCapture::parse_redact(config.capture_redact, redact)) {
+      throw std::runtime_error("CAPTURE_REDACT must be \"payload\" or \"none\"");
+    }
+    capture_ = std::make_unique<TrafficCapture>(config.capture_file, redact,
+                                                uint64_t{config.capture_max_mb} << 20);
+    capture_origin_us_ = monotonic_us();
+  }
+  if (!config.zstd_dict_path.empty()
+      && compressor_.load_dictionary(config.zstd_dict_path, config.zstd_level)) {
+    LOG_INFO(Zstd) << "dictionary " << compressor_.dict_id() << " loaded";
+  }
+}
 
 void WsServer::run() {
-  running_ = true;
+  Tracer::set_thread_name("event-loop");
+
+  // 1 Hz sweep of detached sessions past their grace period
+  if (config_.resume_grace_ms > 0) {
+    start_timer(1000, [](WsServer& s) { s.expire_sessions(); });
+  }
+
+  // Spectator fan-out tier: one prepared batch per room per tick
+  if (config_.max_spectators > 0) {
+    start_timer(std::max<uint32_t>(config_.spectator_tick_ms, kWheelTickMs),
+                [](WsServer& s) { s.spectator_tick(); });
+  }
+
+  // Cluster links, plus a 1 Hz membership check and overflow sweep
+  if (!config_.cluster_node_id.empty()) {
+    start_cluster();
+    start_timer(1000, [](WsServer& s) {
+      s.cluster_->sweep();
+      if (!s.config_.cluster_discovery_file.empty()) s.reload_cluster();
+    });
+  }
+
+  // Per-room loop time and fan-out rates
+  load_sampled_us_ = monotonic_us();
+  start_timer(1000, [](WsServer& s) { s.sample_room_load(); });
+
+  // Keep room memory within its budget, coldest rooms evicted first
+  if (config_.memory_budget_mb > 0) {
+    start_timer(1000, [](WsServer& s) { s.enforce_memory_budget(); });
+  }
 
-  uWS::App()
-    .ws<PerSocketData>("/*", {
+  // Shutdown requests and successors are picked up on the loop thread
+  start_timer(100, [](WsServer& s) { s.poll_control(); });
+
+  // One OS timer drives the wheel that all of the above (and the
+  // per-room and per-peer timers) hang off
+  wheel_timer_ = us_create_timer(reinterpret_cast<us_loop_t*>(uWS::Loop::get()), 0, sizeof(WsServer*));
+  *static_cast<WsServer**>(us_timer_ext(wheel_timer_)) = this;
+  us_timer_set(wheel_timer_, [](us_timer_t* t) {
+    auto* s = *static_cast<WsServer**>(us_timer_ext(t));
+    const uint64_t now = monotonic_us();
+    s->check_overload(now);   // How late this tick is = loop lag
+    if (!s->pending_acks_.empty()) s->release_acks();
+    s->wheel_.advance(now / 1000);
+  }, kWheelTickMs, kWheelTickMs);
+
+  // Scratch frames only live until they are in a send buffer
+  uWS::Loop::get()->addPreHandler(this, [this](uWS::Loop*) { frame_arena_.reset(); });
+
+  tls_sockets = !config_.tls_cert_file.empty() && !config_.tls_key_file.empty();
+  if (tls_sockets) {
+    uWS::SSLApp app({
+      .key_file_name  = config_.tls_key_file.c_str(),
+      .cert_file_name = config_.tls_cert_file.c_str(),
+    });
+    if (app.constructorFailed()) {
+      LOG_ERROR(Ws) << "Cannot load TLS certificate " << config_.tls_cert_file
+                    << " / key " << config_.tls_key_file;
+    } else {
+      tls_ = std::make_unique<TlsContext>(static_cast<ssl_ctx_st*>(app.getNativeHandle()), config_);
+      start_timer(5000, [](WsServer& s) { s.tls_->reload_if_changed(); });
+      serve(app);
+    }
+  } else {
+    uWS::App app;
+    serve(app);
+  }
+
+  uWS::Loop::get()->removePreHandler(this);
+  shutdown(1001, "Server shutting down");
+}
+
+template <bool SSL>
+void WsServer::serve(uWS::TemplatedApp<SSL>& app) {
+  app.template ws<PerSocketData>("/*", {
       .compression    = uWS::SHARED_COMPRESSOR,
-      .maxPayloadLength = 16 * 1024 * 1024,  // 16 MB max message
+      .maxPayloadLength = kMaxPayload,
       .idleTimeout    = 120,
-      .maxBackpressure = 1024 * 1024,
+      .maxBackpressure = kMaxBackpressure,
 
-      .open = [](auto* ws) {
+      .open = [this](auto* ws) {
         // Socket opened — wait for "join" message before allowing data
         auto* data = ws->getUserData();
         data->authenticated = false;
+        if (config_.join_timeout_ms > 0) {
+          data->deadline.set([](void* owner, void* socket) {
+            static_cast<WsServer*>(owner)->close_peer(socket, 1008, "Join timeout");
+          }, static_cast<void*>(ws));
+          wheel_.schedule(data->deadline, config_.join_timeout_ms);
+        }
       },
 
       .message = [this](auto* ws, std::string_view message, uWS::OpCode opCode) {
         auto* data = ws->getUserData();
 
+        // Room lives on another node: relay the frame untouched
+        if (data->proxy) {
+          if (opCode == uWS::OpCode::TEXT || opCode == uWS::OpCode::BINARY) {
+            data->proxy->send(opCode == uWS::OpCode::TEXT ? LinkFrame::Text : LinkFrame::Binary,
+                              data->proxy_sid, message.data(), message.size());
+          }
+          return;
+        }
+
         if (opCode == uWS::OpCode::TEXT) {
           on_text_message(static_cast<void*>(ws), data, message);
         } else if (opCode == uWS::OpCode::BINARY) {
@@ -40,166 +351,1579 @@ void WsServer::run() {
         }
       },
 
-      .close = [this](auto* ws, int /*code*/, std::string_view /*message*/) {
+      .drain = [this](auto* ws) {
+        auto* data = ws->getUserData();
+        if (ws->getBufferedAmount() > 0) return;
+        if (data->proxy) {
+          if (data->proxy_congested) {
+            data->proxy_congested = false;
+            data->proxy->send(LinkFrame::Drain, data->proxy_sid, nullptr, 0);
+          }
+          return;
+        }
+        on_drain(static_cast<void*>(ws), data);
+      },
+
+      .close = [this](auto* ws, int code, std::string_view /*message*/) {
         auto* data = ws->getUserData();
+        if (data->proxy) {
+          data->proxy->send_close(data->proxy_sid, static_cast<uint16_t>(code), {});
+          proxied_.erase(data->proxy_sid);
+          data->proxy = nullptr;
+          return;
+        }
         on_close(static_cast<void*>(ws), data);
       }
     })
+    .get("/metrics", [this](auto* res, auto* /*req*/) {
+      res->writeHeader("Content-Type", "text/plain; version=0.0.4")->end(render_metrics());
+    })
     .listen(config_.port, [this](auto* listen_socket) {
+      listen_socket_ = listen_socket;
       if (listen_socket) {
-        std::cout << "[wigma-ws] Listening on port " << config_.port << std::endl;
+        LOG_INFO(Ws) << "Listening on port " << config_.port << (SSL ? " (TLS)" : "");
       } else {
-        std::cerr << "[wigma-ws] Failed to listen on port " << config_.port << std::endl;
-        running_ = false;
+        LOG_ERROR(Ws) << "Failed to listen on port " << config_.port;
       }
-    })
-    .run();
+    });
+
+  close_app_ = [&app] { app.close(); };
+
+  // Bound next to any predecessor (SO_REUSEPORT): clients connecting
+  // during the handoff wait in our backlog until the loop starts
+  if (listen_socket_ && !config_.handoff_socket.empty()) {
+    if (auto state = request_handoff(config_.handoff_socket, config_.handoff_timeout_ms)) {
+      adopt(*state);
+    }
+  }
+  open_wal();
+  if (!config_.handoff_socket.empty()) {
+    handoff_ = std::make_unique<HandoffListener>(config_.handoff_socket);
+  }
+
+  if (listen_socket_) app.run();
+  close_app_ = nullptr;
 }
 
+
 void WsServer::stop() {
-  running_ = false;
-  // uWebSockets will exit run() when the loop is drained
+  stop_requested_.store(true, std::memory_order_relaxed);
+}
+
+void WsServer::dump_trace() {
+  trace_requested_.store(true, std::memory_order_relaxed);
+}
+
+void WsServer::start_timer(uint32_t interval_ms, void (*fn)(WsServer&)) {
+  auto task = std::make_unique<Periodic>();
+  task->fn = fn;
+  task->timer.set([](void* owner, void* arg) {
+    static_cast<Periodic*>(arg)->fn(*static_cast<WsServer*>(owner));
+  }, task.get());
+  wheel_.schedule(task->timer, interval_ms, interval_ms);
+  periodic_.push_back(std::move(task));
+}
+
+void WsServer::schedule_save(RoomHandle handle, const Room& room, uint64_t now_us) {
+  const auto& t = room_timers_[handle.slot];
+  if (t.retrying && t.room == handle && t.save.scheduled()) return;   // Backing off
+  const uint64_t due = room.unsaved_deadline(uint64_t{config_.coalesce_window_ms} * 1000,
+                                             uint64_t{config_.coalesce_max_ms} * 1000);
+  // Re-armed on every op: one O(1) unlink/link, no scan of quiet rooms
+  arm_save(handle, static_cast<uint32_t>(due > now_us ? (due - now_us) / 1000 : 0));
+}
+
+void WsServer::arm_save(RoomHandle handle, uint32_t delay_ms) {
+  auto& t = room_timers_[handle.slot];
+  if (!t.save.scheduled() || t.room.generation != handle.generation) {
+    if (t.room != handle) t.retrying = false;
+    t.room = handle;
+    t.save.set([](void* owner, void* arg) {
+      auto& server = *static_cast<WsServer*>(owner);
+      auto& timer  = *static_cast<RoomTimer*>(arg);
+      auto* room   = server.room_manager_.resolve(timer.room);
+      if (!room) return;
+      // A room kept only because its ops could not be stored is retired
+      // once they are
+      if (server.save_room(timer.room, *room) && room->empty() && !timer.linger.scheduled()) {
+        server.retire_room(timer.room, *room);
+      }
+    }, &t);
+  }
+  wheel_.schedule(t.save, delay_ms);
+}
+
+void WsServer::poll_control() {
+  if (stop_requested_.load(std::memory_order_relaxed)) {
+    shutdown(1001, "Server shutting down");
+    return;
+  }
+  if (trace_requested_.exchange(false, std::memory_order_relaxed)) {
+    size_t events = 0;
+    if (!Tracer::enabled()) {
+      LOG_WARN(Ws) << "Trace dump requested but tracing is off (TRACE_SAMPLE=0)";
+    } else if (Tracer::dump(config_.trace_file, &events)) {
+      LOG_INFO(Ws) << "Wrote " << events << " trace events to " << config_.trace_file;
+    } else {
+      LOG_ERROR(Ws) << "Cannot write trace to " << config_.trace_file;
+    }
+  }
+  if (handoff_) {
+    int fd = handoff_->accept();
+    if (fd >= 0) hand_off(fd);
+  }
+}
+
+void WsServer::shutdown(int code, std::string_view reason) {
+  if (shutting_down_) return;
+  shutting_down_ = true;
+
+  // Timers, listener and links hold the loop open; closing them (and
+  // every socket) lets run() return
+  if (wheel_timer_) {
+    us_timer_close(wheel_timer_);
+    wheel_timer_ = nullptr;
+  }
+  periodic_.clear();
+  if (listen_socket_) {
+    us_listen_socket_close(tls_sockets ? 1 : 0, listen_socket_);
+    listen_socket_ = nullptr;
+  }
+  handoff_.reset();
+
+  // Resumable peers are parked by on_close, so a successor can take them
+  std::vector<void*> sockets;
+  room_manager_.for_each([&](Room& room) {
+    room.for_each_socket([&](void* ws) { sockets.push_back(ws); });
+  });
+  for (auto& [sid, ws] : proxied_) sockets.push_back(ws);
+  for (void* ws : sockets) close_peer(ws, code, reason);
+
+  cluster_.reset();
+  flush_unsaved();
+  if (close_app_) close_app_();   // Sockets that never joined
+}
+
+void WsServer::open_wal() {
+  wal_ = make_wal(config_, *replay_backend_, wal_coalesced_);
+  persistence_.set_wal(wal_.get());
+}
+
+void WsServer::hand_off(int fd) {
+  LOG_INFO(Ws) << "Successor connected, handing over";
+  shutdown(1012, "Server restarting, reconnect");
+  auto state = export_state();
+
+  // Everything is stored by now; closing the WAL commits its tail, and
+  // the successor replays whatever the database has not acknowledged
+  persistence_.set_wal(nullptr);
+  wal_.reset();
+
+  if (send_handoff(fd, state)) {
+    LOG_INFO(Ws) << "Handed over " << state.rooms.size() << " rooms, "
+                 << state.sessions.size() << " sessions";
+  } else {
+    LOG_ERROR(Ws) << "Handoff write failed; successor starts cold";
+  }
+}
+
+HandoffState WsServer::export_state() const {
+  HandoffState state;
+  std::unordered_map<const Room*, uint32_t> index;
+  const auto now = DetachedSession::Clock::now();
+
+  sessions_.for_each([&](const ResumeToken& token, const DetachedSession& session) {
+    const auto* room = room_manager_.resolve(session.room);
+    if (!room || session.deadline <= now) return;
+
+    auto [it, added] = index.try_emplace(room, static_cast<uint32_t>(state.rooms.size()));
+    if (added) {
+      auto& out = state.rooms.emplace_back();
+      out.project_id = room->id();
+      out.seq        = room->seq();
+      auto& ops = room->recent_ops();
+      if (!ops.empty()) {
+        out.first_seq = ops.first_seq();
+        ops.for_range(ops.first_seq(), ops.last_seq(), [&](std::string_view frame) {
+          out.frames.emplace_back(frame);
+        });
+      }
+    }
+
+    auto& out = state.sessions.emplace_back();
+    out.token     = token;
+    out.room      = it->second;
+    out.user_id   = users_.view(session.user_index);
+    out.flags     = room->flags(session.peer_slot) & (kPeerSeq | kPeerZstd);
+    out.token_exp = session.token_exp;
+    out.grace_ms  = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(session.deadline - now).count());
+  });
+  return state;
+}
+
+void WsServer::adopt(const HandoffState& state) {
+  std::vector<RoomHandle> handles;
+  handles.reserve(state.rooms.size());
+  for (auto& in : state.rooms) {
+    auto handle = room_manager_.get_or_create(in.project_id);
+    if (auto* room = room_manager_.resolve(handle)) {
+      room->restore_seq(in.first_seq, in.frames, in.seq);
+    }
+    handles.push_back(handle);
+  }
+
+  const auto now = DetachedSession::Clock::now();
+  const uint8_t keep = compressor_.enabled() ? (kPeerSeq | kPeerZstd) : kPeerSeq;
+  size_t adopted = 0;
+  for (auto& in : state.sessions) {
+    auto* room = room_manager_.resolve(handles[in.room]);
+    if (!room || room->full()) continue;
+
+    DetachedSession session;
+    session.room       = handles[in.room];
+    session.user_index = users_.intern(in.user_id);
+    session.peer_slot  = Room::npos;
+    session.token_exp  = in.token_exp;
+    session.deadline   = now + std::chrono::milliseconds(in.grace_ms);
+
+    auto& parked = sessions_.park(in.token, session);
+    room->add_peer(nullptr, parked.user_index, &parked.peer_slot, (in.flags & keep) | kPeerDetached);
+    ++adopted;
+  }
+
+  for (auto handle : handles) room_manager_.remove_if_empty(handle);
+  LOG_INFO(Ws) << "Took over " << adopted << " resumable sessions in "
+               << state.rooms.size() << " rooms";
+}
+
+std::string WsServer::render_metrics() const {
+  static constexpr const char* kScopes[]  = { "peer", "room" };
+  static constexpr const char* kClasses[] = { "update", "awareness", "other" };
+
+  std::string out;
+  out += "# HELP wigma_rooms Active rooms.\n# TYPE wigma_rooms gauge\n";
+  out += "wigma_rooms " + std::to_string(room_manager_.room_count()) + "\n";
+  out += "# HELP wigma_detached_sessions Dropped peers awaiting resume.\n# TYPE wigma_detached_sessions gauge\n";
+  out += "wigma_detached_sessions " + std::to_string(sessions_.size()) + "\n";
+  out += "# HELP wigma_spectators Connected read-only viewers.\n# TYPE wigma_spectators gauge\n";
+  out += "wigma_spectators " + std::to_string(spectators_) + "\n";
+  if (cluster_) {
+    out += "# HELP wigma_cluster_links Open inter-node links.\n# TYPE wigma_cluster_links gauge\n";
+    out += "wigma_cluster_links " + std::to_string(cluster_->link_count()) + "\n";
+    out += "# HELP wigma_proxied_sessions Local clients whose room is on another node.\n"
+           "# TYPE wigma_proxied_sessions gauge\n";
+    out += "wigma_proxied_sessions " + std::to_string(proxied_.size()) + "\n";
+    out += "# HELP wigma_remote_peers Sessions served here for clients on other nodes.\n"
+           "# TYPE wigma_remote_peers gauge\n";
+    out += "wigma_remote_peers " + std::to_string(remote_peers_.size()) + "\n";
+  }
+  out += "# HELP wigma_ops_coalesced_total Scene ops merged into an earlier op.\n"
+         "# TYPE wigma_ops_coalesced_total counter\n";
+  out += "wigma_ops_coalesced_total{stage=\"persist\"} "
+         + std::to_string(coalesced_[0] + wal_coalesced_.load(std::memory_order_relaxed)) + "\n";
+  out += "wigma_ops_coalesced_total{stage=\"backlog\"} " + std::to_string(coalesced_[1]) + "\n";
+  out += "wigma_ops_coalesced_total{stage=\"rate_limit\"} " + std::to_string(coalesced_[2]) + "\n";
+  out += "# HELP wigma_sync_cache_total Joins served from the room's cached sync frame (hit) or after a reload (build).\n"
+         "# TYPE wigma_sync_cache_total counter\n";
+  out += "wigma_sync_cache_total{result=\"hit\"} " + std::to_string(sync_cache_[0]) + "\n";
+  out += "wigma_sync_cache_total{result=\"build\"} " + std::to_string(sync_cache_[1]) + "\n";
+  out += "wigma_sync_cache_total{result=\"spill\"} " + std::to_string(sync_cache_[2]) + "\n";
+
+  out += "# HELP wigma_room_memory_bytes Approximate heap bytes held by rooms.\n# TYPE wigma_room_memory_bytes gauge\n";
+  out += "wigma_room_memory_bytes " + std::to_string(room_manager_.memory_bytes()) + "\n";
+  if (config_.memory_budget_mb > 0) {
+    out += "# HELP wigma_room_memory_budget_bytes MEMORY_BUDGET_MB.\n# TYPE wigma_room_memory_budget_bytes gauge\n";
+    out += "wigma_room_memory_budget_bytes " + std::to_string(uint64_t{config_.memory_budget_mb} << 20) + "\n";
+    out += "# HELP wigma_room_evictions_total Cached room state evicted to stay within the budget.\n"
+           "# TYPE wigma_room_evictions_total counter\n";
+    out += "wigma_room_evictions_total{state=\"sync_frame\"} " + std::to_string(evictions_[0]) + "\n";
+    out += "wigma_room_evictions_total{state=\"op_ring\"} " + std::to_string(evictions_[1]) + "\n";
+  }
+  if (spill_) {
+    out += "# HELP wigma_spill_file_bytes Size of the room spill file.\n# TYPE wigma_spill_file_bytes gauge\n";
+    out += "wigma_spill_file_bytes " + std::to_string(spill_->file_bytes()) + "\n";
+    out += "# HELP wigma_spill_records Rooms with state in the spill file.\n# TYPE wigma_spill_records gauge\n";
+    out += "wigma_spill_records " + std::to_string(spill_->records()) + "\n";
+  }
+  out += "# HELP wigma_room_busy_seconds_total Event loop time spent on room work (frames, joins, ticks).\n"
+         "# TYPE wigma_room_busy_seconds_total counter\n";
+  out += "wigma_room_busy_seconds_total " + std::to_string(static_cast<double>(load_totals_.busy_ns) * 1e-9) + "\n";
+  out += "# HELP wigma_room_busy_ratio Share of the event loop rooms keep busy (decayed rate).\n"
+         "# TYPE wigma_room_busy_ratio gauge\n";
+  out += "wigma_room_busy_ratio " + std::to_string(load_busy_) + "\n";
+  out += "# HELP wigma_room_fanout_frames_total Frames handed to sockets by room fan-out.\n"
+         "# TYPE wigma_room_fanout_frames_total counter\n";
+  out += "wigma_room_fanout_frames_total " + std::to_string(load_totals_.frames) + "\n";
+  out += "# HELP wigma_room_fanout_bytes_total Bytes handed to sockets by room fan-out.\n"
+         "# TYPE wigma_room_fanout_bytes_total counter\n";
+  out += "wigma_room_fanout_bytes_total " + std::to_string(load_totals_.bytes) + "\n";
+  if (!hot_rooms_.empty()) {
+    std::string frames = "# HELP wigma_hot_room_fanout_frames_per_second Fan-out frame rate of the busiest rooms.\n"
+                         "# TYPE wigma_hot_room_fanout_frames_per_second gauge\n";
+    std::string bytes  = "# HELP wigma_hot_room_fanout_bytes_per_second Fan-out byte rate of the busiest rooms.\n"
+                         "# TYPE wigma_hot_room_fanout_bytes_per_second gauge\n";
+    out += "# HELP wigma_hot_room_busy_ratio Share of the event loop each of the busiest rooms keeps busy.\n"
+           "# TYPE wigma_hot_room_busy_ratio gauge\n";
+    for (const auto& hot : hot_rooms_) {
+      const std::string label = "{room=\"" + room_label(hot.id) + "\"} ";
+      out    += "wigma_hot_room_busy_ratio" + label + std::to_string(hot.busy) + "\n";
+      frames += "wigma_hot_room_fanout_frames_per_second" + label + std::to_string(hot.frames_per_sec) + "\n";
+      bytes  += "wigma_hot_room_fanout_bytes_per_second" + label + std::to_string(hot.bytes_per_sec) + "\n";
+    }
+    out += frames;
+    out += bytes;
+  }
+  out += "# HELP wigma_loop_lag_seconds Event loop lag: how late the loop timer fires (smoothed).\n"
+         "# TYPE wigma_loop_lag_seconds gauge\n";
+  out += "wigma_loop_lag_seconds " + std::to_string(static_cast<double>(overload_.lag_us()) * 1e-6) + "\n";
+  out += "# HELP wigma_loop_lag_max_seconds Worst single loop timer delay within the last second.\n"
+         "# TYPE wigma_loop_lag_max_seconds gauge\n";
+  out += "wigma_loop_lag_max_seconds " + std::to_string(static_cast<double>(overload_.max_lag_us()) * 1e-6) + "\n";
+  out += "# HELP wigma_loop_lag_seconds_total Sum of loop timer delays.\n"
+         "# TYPE wigma_loop_lag_seconds_total counter\n";
+  out += "wigma_loop_lag_seconds_total " + std::to_string(static_cast<double>(overload_.total_lag_us()) * 1e-6) + "\n";
+  out += "# HELP wigma_overload_level Load shedding stage (0 normal, 1 awareness thinned, 2 cold joins refused, 3 joins refused).\n"
+         "# TYPE wigma_overload_level gauge\n";
+  out += "wigma_overload_level " + std::to_string(static_cast<int>(overload_.level())) + "\n";
+  out += "# HELP wigma_overload_shed_total Work turned away under overload.\n"
+         "# TYPE wigma_overload_shed_total counter\n";
+  out += "wigma_overload_shed_total{action=\"awareness\"} " + std::to_string(shed_[0]) + "\n";
+  out += "wigma_overload_shed_total{action=\"cold_join\"} " + std::to_string(shed_[1]) + "\n";
+  out += "wigma_overload_shed_total{action=\"join\"} " + std::to_string(shed_[2]) + "\n";
+  if (tls_) {
+    out += "# HELP wigma_tls_handshakes_total Completed TLS handshakes, by whether a session was resumed.\n"
+           "# TYPE wigma_tls_handshakes_total counter\n";
+    out += "wigma_tls_handshakes_total{mode=\"full\"} " + std::to_string(tls_->handshakes() - tls_->resumed()) + "\n";
+    out += "wigma_tls_handshakes_total{mode=\"resumed\"} " + std::to_string(tls_->resumed()) + "\n";
+    out += "# HELP wigma_tls_reloads_total Certificate / ticket key reloads.\n# TYPE wigma_tls_reloads_total counter\n";
+    out += "wigma_tls_reloads_total{result=\"ok\"} " + std::to_string(tls_->reloads()) + "\n";
+    out += "wigma_tls_reloads_total{result=\"failed\"} " + std::to_string(tls_->reload_failures()) + "\n";
+    out += "# HELP wigma_tls_cert_not_after_seconds Expiry of the served certificate (unix time).\n"
+           "# TYPE wigma_tls_cert_not_after_seconds gauge\n";
+    out += "wigma_tls_cert_not_after_seconds " + std::to_string(tls_->not_after()) + "\n";
+  }
+  if (capture_) {
+    out += "# HELP wigma_capture_records_total Frames written to the traffic capture.\n"
+           "# TYPE wigma_capture_records_total counter\n";
+    out += "wigma_capture_records_total " + std::to_string(capture_->records()) + "\n";
+    out += "# HELP wigma_capture_dropped_total Frames the traffic capture could not keep up with or hold.\n"
+           "# TYPE wigma_capture_dropped_total counter\n";
+    out += "wigma_capture_dropped_total " + std::to_string(capture_->dropped()) + "\n";
+  }
+
+  out += "# HELP wigma_rate_limited_frames_total Inbound frames refused by the flood guard.\n"
+         "# TYPE wigma_rate_limited_frames_total counter\n";
+  std::string bytes = "# HELP wigma_rate_limited_bytes_total Bytes of refused inbound frames.\n"
+                      "# TYPE wigma_rate_limited_bytes_total counter\n";
+  for (size_t scope = 0; scope < 2; ++scope) {
+    for (size_t cls = 0; cls < kRateClasses; ++cls) {
+      auto& d = rate_limiter_.drops(scope, static_cast<RateClass>(cls));
+      std::string labels = std::string("{scope=\"") + kScopes[scope] + "\",class=\"" + kClasses[cls] + "\"} ";
+      out   += "wigma_rate_limited_frames_total" + labels + std::to_string(d.frames) + "\n";
+      bytes += "wigma_rate_limited_bytes_total" + labels + std::to_string(d.bytes) + "\n";
+    }
+  }
+  out += bytes;
+
+  out += "# HELP wigma_log_records_dropped_total Log records lost to a full log ring.\n"
+         "# TYPE wigma_log_records_dropped_total counter\n";
+  out += "wigma_log_records_dropped_total " + std::to_string(Logger::instance().dropped()) + "\n";
+
+  const auto& rooms_heap = room_manager_.heap();
+  out += "# HELP wigma_pool_bytes Heap bytes held by each pooled allocator.\n# TYPE wigma_pool_bytes gauge\n";
+  out += "wigma_pool_bytes{pool=\"rooms\"} " + std::to_string(rooms_heap.bytes()) + "\n";
+  out += "wigma_pool_bytes{pool=\"frame_arena\"} " + std::to_string(kFrameArenaBytes + arena_heap_.bytes()) + "\n";
+  out += "# HELP wigma_pool_heap_allocations_total Allocations each pooled allocator made on the heap.\n"
+         "# TYPE wigma_pool_heap_allocations_total counter\n";
+  out += "wigma_pool_heap_allocations_total{pool=\"rooms\"} " + std::to_string(rooms_heap.allocations()) + "\n";
+  out += "wigma_pool_heap_allocations_total{pool=\"frame_arena\"} " + std::to_string(arena_heap_.allocations()) + "\n";
+  out += "# HELP wigma_slab_objects Live objects per slab.\n# TYPE wigma_slab_objects gauge\n";
+  out += "wigma_slab_objects{slab=\"room\"} " + std::to_string(room_manager_.room_slab().size()) + "\n";
+  out += "wigma_slab_objects{slab=\"remote_peer\"} " + std::to_string(remote_slab_.size()) + "\n";
+  out += "# HELP wigma_slab_capacity Object slots allocated per slab (live and free).\n"
+         "# TYPE wigma_slab_capacity gauge\n";
+  out += "wigma_slab_capacity{slab=\"room\"} " + std::to_string(room_manager_.room_slab().capacity()) + "\n";
+  out += "wigma_slab_capacity{slab=\"remote_peer\"} " + std::to_string(remote_slab_.capacity()) + "\n";
+  out += "# HELP wigma_frame_arena_high_water_bytes Most scratch bytes used in one loop iteration.\n"
+         "# TYPE wigma_frame_arena_high_water_bytes gauge\n";
+  out += "wigma_frame_arena_high_water_bytes " + std::to_string(frame_arena_.high_water()) + "\n";
+  return out;
 }
 
 void WsServer::on_text_message(void* ws, PerSocketData* data, std::string_view message) {
+  if (capture_) capture(data, TrafficCapture::Kind::Text, message.data(), message.size());
   try {
-  auto msg = MessageCodec::decode_control(message);
-  if (!msg.valid) return;
+  MessageCodec::ControlMessage msg;
+  if (!MessageCodec::decode_control(message, msg)) return;
 
   // Handle "ping" from any state
   if (msg.type == "ping") {
-    auto pong = MessageCodec::encode_pong();
-    auto* typed_ws = static_cast<uWS::WebSocket<false, true, PerSocketData>*>(ws);
-    typed_ws->send(pong, uWS::OpCode::TEXT);
+    send_to_peer(ws, MessageCodec::kPong.data(), MessageCodec::kPong.size(), false);
+    return;
+  }
+
+  // Handle "resync" — replay a missed range of sequenced updates
+  if (msg.type == "resync" && data->authenticated && !data->spectator) {
+    auto* room = room_manager_.resolve(data->room);
+    if (!room) return;
+
+    ChargeRoom charge(room_manager_, data->room);
+    uint64_t to = msg.to_seq ? std::min(msg.to_seq, room->seq()) : room->seq();
+    send_range(ws, *room, msg.from_seq, to);
+    return;
+  }
+
+  // Handle "resume" — reattach a detached session without re-auth
+  if (msg.type == "resume" && !data->authenticated) {
+    on_resume(ws, data, msg);
     return;
   }
 
   // Handle "join" — authenticate and enter room
   if (msg.type == "join" && !data->authenticated) {
+    // 0. In a cluster, hand the session to the node that owns the room.
+    //    Sessions arriving over a link are always served here, so nodes
+    //    that briefly disagree on membership cannot bounce them around
+    if (cluster_ && !as_remote(ws) && !owns(msg.project_id)) {
+      proxy_join(ws, data, message, *ring_.owner(msg.project_id));
+      return;
+    }
+
+    // Shed load before any auth or storage work: an overloaded loop turns
+    // away joins that would load a room, then every join (resumes still
+    // go through; those clients already hold state)
+    if (overload_.at_least(OverloadMonitor::Level::RejectJoins)) {
+      refuse_join(ws, false);
+      return;
+    }
+    if (overload_.at_least(OverloadMonitor::Level::DeferColdLoads)
+        && needs_storage_load(msg.project_id)) {
+      refuse_join(ws, true);
+      return;
+    }
+
+    // Every join is traced while tracing is on; one span per phase
+    const uint64_t trace = Tracer::always();
+    TraceSpan join_span(trace, "join", "join");
+
     // 1. Verify JWT
+    TraceSpan auth_span(trace, "join", "join.auth");
     auto claims = jwt_verifier_.verify(msg.token);
+    auth_span.end();
     if (!claims.has_value()) {
-      auto err = MessageCodec::encode_error("AUTH_FAILED", "Invalid or expired token");
-      auto* typed_ws = static_cast<uWS::WebSocket<false, true, PerSocketData>*>(ws);
-      typed_ws->send(err, uWS::OpCode::TEXT);
-      typed_ws->close();
+      MessageCodec::encode_error(text_buf_, "AUTH_FAILED", "Invalid or expired token");
+      send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+      close_peer(ws);
       return;
     }
 
-    // 2. Check project access
-    if (!supabase_client_.check_project_access(msg.project_id, claims->sub)) {
-      auto err = MessageCodec::encode_error("ACCESS_DENIED", "No access to this project");
-      auto* typed_ws = static_cast<uWS::WebSocket<false, true, PerSocketData>*>(ws);
-      typed_ws->send(err, uWS::OpCode::TEXT);
-      typed_ws->close();
+    // 2. Check project access; viewers can only spectate
+    TraceSpan access_span(trace, "join", "join.access");
+    auto role = backend_->check_project_access(msg.project_id, claims->sub);
+    access_span.end();
+    if (role == ProjectRole::None) {
+      MessageCodec::encode_error(text_buf_, "ACCESS_DENIED", "No access to this project");
+      send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+      close_peer(ws);
       return;
     }
 
     // 3. Join room
-    auto* room = room_manager_.get_or_create(msg.project_id);
+    TraceSpan room_span(trace, "join", "join.room");
+    auto handle = room_manager_.get_or_create(msg.project_id);
+    if (!room_manager_.resolve(handle) && reap_lingering()) {
+      handle = room_manager_.get_or_create(msg.project_id);
+    }
+    auto* room  = room_manager_.resolve(handle);
+    ChargeRoom charge(room_manager_, handle);   // Joining (mostly the sync) costs the room
     if (!room) {
-      auto err = MessageCodec::encode_error("ROOM_LIMIT", "Server room limit reached");
-      auto* typed_ws = static_cast<uWS::WebSocket<false, true, PerSocketData>*>(ws);
-      typed_ws->send(err, uWS::OpCode::TEXT);
-      typed_ws->close();
+      MessageCodec::encode_error(text_buf_, "ROOM_LIMIT", "Server room limit reached");
+      send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+      close_peer(ws);
+      return;
+    }
+
+    const bool spectator = role == ProjectRole::Viewer || msg.spectate;
+    if (spectator ? room->spectators_full() : room->full()) {
+      MessageCodec::encode_error(text_buf_, "ROOM_FULL", spectator
+        ? "Spectator limit reached" : "Editor limit reached, join as spectator");
+      send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+      close_peer(ws);
+      room_manager_.remove_if_empty(handle);
       return;
     }
 
-    data->user_id    = claims->sub;
-    data->project_id = msg.project_id;
+    data->room       = handle;
+    data->user_index = users_.intern(claims->sub);
     data->authenticated = true;
-    room->add_peer(ws, claims->sub);
+    data->token_exp  = claims->exp;
+    data->spectator  = spectator;
+    arm_token_expiry(ws, data);
+    room_timers_[handle.slot].linger.cancel();
+    const bool zstd = (msg.caps & kCapZstd) && compressor_.enabled();
+    if (spectator) {
+      // Fed from the spectator tick; no sequencing, no resume
+      room->add_spectator(ws, &data->peer_slot, zstd ? kPeerZstd : 0);
+      // The room may still be listed from an earlier spectator, until the
+      // next tick prunes it
+      if (room->spectator_count() == 1
+          && std::find(spectated_rooms_.begin(), spectated_rooms_.end(), handle) == spectated_rooms_.end()) {
+        spectated_rooms_.push_back(handle);
+      }
+      ++spectators_;
+    } else {
+      uint8_t flags = (msg.caps & kCapSeq) ? kPeerSeq : 0;
+      if (zstd) flags |= kPeerZstd;
+      room->add_peer(ws, data->user_index, &data->peer_slot, flags);
+    }
+
+    room_span.end();
 
     // 4. Send "joined" confirmation
-    auto peers  = room->get_peer_ids();
-    auto joined = MessageCodec::encode_joined(claims->sub, peers);
-    auto* typed_ws = static_cast<uWS::WebSocket<false, true, PerSocketData>*>(ws);
-    typed_ws->send(joined, uWS::OpCode::TEXT);
-
-    // 5. Notify other peers
-    auto peer_joined = MessageCodec::encode_peer_joined(claims->sub);
-    room->broadcast_text(ws, peer_joined, [](void* peer_ws, const char* d, size_t len, bool) {
-      auto* typed = static_cast<uWS::WebSocket<false, true, PerSocketData>*>(peer_ws);
-      typed->send(std::string_view(d, len), uWS::OpCode::TEXT);
-    });
+    TraceSpan reply_span(trace, "join", "join.reply");
+    std::pmr::vector<std::string_view> peers(&frame_arena_);
+    peers.reserve(room->peer_count());
+    for (uint32_t user : room->peer_users()) {
+      peers.push_back(users_.view(user));
+    }
+
+    // Resumable sessions need sequence numbers to know what was missed.
+    // Remote sessions are not: a resume arrives at whichever node the
+    // client reconnects to, which cannot route it by token
+    std::string resume;
+    if (!spectator && (msg.caps & kCapSeq) && config_.resume_grace_ms > 0 && !as_remote(ws)) {
+      data->resume    = ResumeToken::generate();
+      resume = data->resume.to_hex();
+    }
+    MessageCodec::encode_joined(text_buf_, claims->sub, peers, room->seq(), resume,
+                                zstd ? compressor_.dict_id() : 0, spectator);
+    send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+
+    // Push the dictionary if the client holds a different version
+    if (zstd && msg.dict_id != compressor_.dict_id()) {
+      auto dict = compressor_.dictionary();
+      auto dict_msg = MessageCodec::encode_binary(
+        frame_arena_, MessageType::ZstdDict, reinterpret_cast<const uint8_t*>(dict.data()), dict.size());
+      send_to_peer(ws, dict_msg.data(), dict_msg.size(), true);
+    }
 
-    // 6. Send initial Yjs state
-    auto state = persistence_.load_state(msg.project_id);
-    if (!state.empty()) {
-      auto sync_msg = MessageCodec::encode_binary(
-        MessageType::YjsSync, state.data(), state.size());
-      typed_ws->send(sync_msg, uWS::OpCode::BINARY);
+    // 5. Notify other peers (spectators come and go unannounced)
+    if (!spectator) {
+      MessageCodec::encode_peer_joined(text_buf_, claims->sub);
+      room->broadcast_text(ws, text_buf_, send_to_peer);
+    }
+
+    reply_span.end();
+
+    // 6. Send initial Yjs state: the room's cached frame if no update has
+    //    arrived since it was built, else read back from the spill file
+    //    if it was evicted unchanged, else reloaded (with ops still being
+    //    coalesced) and cached for the joiners after this one. A reload
+    //    made while the room's updates are still in the WAL (or the WAL
+    //    is replaying an earlier process's records) lacks them, so it is
+    //    sent but not kept: the next joiner reloads
+    TraceSpan sync_span(trace, "join", "join.sync");
+    room->touch(monotonic_us());
+    auto& cache = room->sync_cache();
+    std::vector<uint8_t> spilled;
+    bool current = true;
+    if (cache.fresh(room->seq())) {
+      ++sync_cache_[0];
+    } else if (spill_ && spill_->load(handle.slot, handle.generation, room->seq(), spilled)) {
+      cache.rebuild(room->seq(), spilled.data(), spilled.size());
+      ++sync_cache_[2];
+    } else {
+      const bool saved = save_room(handle, *room);
+      auto state = persistence_.load_state(room->id());
+      cache.rebuild(room->seq(), state.data(), state.size());
+      current = saved && (!wal_ || wal_->replayed_lsn() >= std::max(room->last_lsn(), WriteAheadLog::kRecoveredLsn));
+      ++sync_cache_[1];
+    }
+    std::string_view sync = cache.frame();
+    if (zstd && !sync.empty()) {
+      if (auto packed = cache.packed(compressor_); !packed.empty()) sync = packed;
     }
+    if (!sync.empty()) send_to_peer(ws, sync.data(), sync.size(), true);
+    if (!current) cache.clear();
+    sync_span.arg("bytes", sync.size());
+    sync_span.end();
 
-    std::cout << "[wigma-ws] User " << claims->sub
-              << " joined room " << msg.project_id
-              << " (" << room->peer_count() << " peers)" << std::endl;
+    LOG_INFO(Ws).field("user", claims->sub).field("room", msg.project_id)
+                 << "User " << claims->sub
+                 << (spectator ? " spectating room " : " joined room ") << msg.project_id
+                 << " (" << room->peer_count() << " peers, "
+                 << room->spectator_count() << " spectators)";
     return;
   }
 
   } catch (const std::exception& e) {
-    std::cerr << "[wigma-ws] EXCEPTION in on_text_message: " << e.what() << std::endl;
-    std::cerr.flush();
+    LOG_ERROR(Ws) << "EXCEPTION in on_text_message: " << e.what();
   } catch (...) {
-    std::cerr << "[wigma-ws] UNKNOWN EXCEPTION in on_text_message" << std::endl;
-    std::cerr.flush();
+    LOG_ERROR(Ws) << "UNKNOWN EXCEPTION in on_text_message";
   }
 }
 
 void WsServer::on_binary_message(void* ws, PerSocketData* data,
                                   const uint8_t* payload, size_t len) {
+  if (capture_) capture(data, TrafficCapture::Kind::Binary, reinterpret_cast<const char*>(payload), len);
   if (!data->authenticated) return;
+  ChargeRoom charge(room_manager_, data->room);
+
+  // Sampled: frame ⊃ decode → broadcast → persist, sharing one id
+  const uint64_t trace = Tracer::sample();
+  TraceSpan frame_span(trace, "frame", "frame");
+  frame_span.arg("bytes", len);
+  TraceSpan decode_span(trace, "frame", "decode");
 
   try {
     auto decoded = MessageCodec::decode_binary(payload, len);
     if (!decoded.valid) return;
 
-    auto* room = room_manager_.get(data->project_id);
+    auto* room = room_manager_.resolve(data->room);
     if (!room) return;
 
-    // Broadcast to all peers (zero-copy relay)
-    room->broadcast(ws, reinterpret_cast<const char*>(payload), len,
-      [](void* peer_ws, const char* d, size_t l, bool) {
-        auto* typed = static_cast<uWS::WebSocket<false, true, PerSocketData>*>(peer_ws);
-        typed->send(std::string_view(d, l), uWS::OpCode::BINARY);
-      });
+    // Spectators are read-only. Their client's connect-time sync-request
+    // and awareness are dropped silently (catch-up comes from the tick).
+    if (data->spectator) {
+      constexpr std::string_view kSyncRequest = R"({"o":"sync-request"})";
+      std::string_view op(reinterpret_cast<const char*>(decoded.payload), decoded.payload_len);
+      const uint64_t now = monotonic_us();
+      if (MessageCodec::base_type(decoded.type) == MessageType::YjsUpdate && op != kSyncRequest
+          && now - data->rate_notice_us >= 1000000) {
+        data->rate_notice_us = now;
+        MessageCodec::encode_error(text_buf_, "READ_ONLY", "Spectators cannot edit");
+        send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+      }
+      return;
+    }
+
+    // Flood guard, charged at wire size before any decompression work.
+    // Updates queue behind any of the sender's already held, keeping order
+    const auto type = MessageCodec::base_type(decoded.type);
+    const auto cls  = rate_class(type);
+    const uint64_t now = monotonic_us();
+    bool hold = cls == RateClass::Update && !data->held.empty();
+    if (!hold && rate_limiter_.admit(data->rate, room->rate_state(), cls, len, now)
+                   != RateLimiter::Verdict::Pass) {
+      // Excess awareness is superseded by the next tick and dropped
+      // silently. Excess updates are already applied on their sender, so
+      // they are held and merged instead, and relayed as the budget refills
+      if (cls != RateClass::Update) return;
+      hold = true;
+    }
+
+    // Overloaded: thin each peer's awareness to one frame per interval.
+    // Presence is a snapshot, so the next frame relayed supersedes those
+    // dropped
+    if (type == MessageType::Awareness
+        && overload_.at_least(OverloadMonitor::Level::ThrottleAwareness)) {
+      if (now - data->awareness_us < uint64_t{config_.overload_awareness_interval_ms} * 1000) {
+        ++shed_[0];
+        return;
+      }
+      data->awareness_us = now;
+    }
+
+    std::string_view plain(reinterpret_cast<const char*>(payload), len);
+    std::string_view packed;   // Dictionary-compressed variant, if any
+
+    if (MessageCodec::is_compressed(decoded.type)) {
+      // Client already compressed: relay as-is, inflate once for the rest
+      if (!(room->flags(data->peer_slot) & kPeerZstd)) return;
+      packed = plain;
+      inflate_buf_.assign(1, static_cast<char>(type));
+      if (!compressor_.decompress(decoded.payload, decoded.payload_len, kMaxPayload, inflate_buf_)) return;
+      plain = inflate_buf_;
+      decoded.payload     = reinterpret_cast<const uint8_t*>(inflate_buf_.data()) + 1;
+      decoded.payload_len = inflate_buf_.size() - 1;
+    } else if ((type == MessageType::YjsUpdate || type == MessageType::Awareness) && !hold
+               && compressor_.enabled() && room->any_peer(kPeerZstd)) {
+      // Compress once on ingress; every zstd peer gets the same bytes
+      deflate_buf_.assign(1, static_cast<char>(MessageCodec::compressed_type(type)));
+      if (compressor_.compress(decoded.payload, decoded.payload_len, deflate_buf_)) {
+        packed = deflate_buf_;
+      }
+    }
+
+    decode_span.end();
+
+    if (hold) {
+      hold_update(ws, data, decoded.payload, decoded.payload_len);
+      return;
+    }
+    if (type == MessageType::YjsUpdate) {
+      publish_update(ws, data, *room, plain, packed, now, trace);
+      return;
+    }
 
-    // Persist Yjs updates (not awareness)
-    if (decoded.type == MessageType::YjsUpdate) {
-      persistence_.persist_update(data->project_id, decoded.payload, decoded.payload_len);
+    // Broadcast to all peers (zero-copy relay). Awareness is superseded
+    // by the next tick, so congested peers skip it instead of queueing.
+    TraceSpan broadcast_span(trace, "frame", "broadcast");
+    broadcast_span.arg("peers", room->peer_count());
+    uint8_t skip = type == MessageType::Awareness ? kPeerCongested : 0;
+    relay(ws, *room, plain, packed, skip, 0);
+    if (type == MessageType::Awareness && room->spectator_count()) {
+      room->hold_spectator_awareness(data->user_index, decoded.payload, decoded.payload_len);
     }
   } catch (const std::exception& e) {
-    std::cerr << "[wigma-ws] EXCEPTION in on_binary_message: " << e.what() << std::endl;
+    LOG_ERROR(Ws) << "EXCEPTION in on_binary_message: " << e.what();
   } catch (...) {
-    std::cerr << "[wigma-ws] UNKNOWN EXCEPTION in on_binary_message" << std::endl;
+    LOG_ERROR(Ws) << "UNKNOWN EXCEPTION in on_binary_message";
   }
 }
 
+void WsServer::publish_update(void* ws, PerSocketData* data, Room& room, std::string_view plain,
+                              std::string_view packed, uint64_t now, uint64_t trace) {
+  auto* payload = reinterpret_cast<const uint8_t*>(plain.data()) + 1;
+  const size_t len = plain.size() - 1;
+
+  // Updates that are stored on arrival are stored before anyone sees
+  // them. With the WAL every update is logged as it comes in (merged
+  // only on its way to the database) and is durable at the end of the
+  // first wal.commit span whose lsn reaches this one's; an op the log
+  // rejects is reported to the sender and never relayed
+  uint64_t lsn = 0;
+  if (wal_ || config_.coalesce_window_ms == 0) {
+    TraceSpan persist_span(trace, "frame", "persist");
+    const auto stored = persistence_.persist_update(room.id(), payload, len);
+    if (!stored) {
+      MessageCodec::encode_error(text_buf_, "PERSIST_FAILED", "Update could not be stored");
+      send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+      return;
+    }
+    lsn = *stored;
+    persist_span.arg("lsn", lsn);
+    if (lsn) room.set_last_lsn(lsn);
+  }
+
+  TraceSpan broadcast_span(trace, "frame", "broadcast");
+  broadcast_span.arg("peers", room.peer_count());
+
+  // Stamp with the room sequence once, then relay the original frame to
+  // legacy peers and the sequenced frame to "seq" peers
+  auto frame = room.stamp(payload, len);
+  room.touch(now);
+  std::string_view packed_seq;
+  if (!packed.empty()) {
+    seq_deflate_buf_.resize(MessageCodec::kSeqHeaderSize);
+    MessageCodec::write_seq_header(seq_deflate_buf_.data(),
+      MessageCodec::compressed_type(MessageType::SeqUpdate), room.seq());
+    seq_deflate_buf_.append(packed.substr(1));
+    packed_seq = seq_deflate_buf_;
+  }
+  // Legacy peers that are behind get the op merged into their backlog
+  // (before the relay, which may mark more peers congested)
+  room.broadcast(ws, reinterpret_cast<const char*>(payload), len, queue_backlog, kPeerSeq, kPeerCongested);
+  relay(ws, room, plain, packed, kPeerSeq | kPeerCongested, 0);
+  relay(ws, room, frame, packed_seq, 0, kPeerSeq);
+  if (room.spectator_count()) room.hold_for_spectators(payload, len);
+
+  broadcast_span.end();
+
+  // Without the WAL, ops are coalesced per room and stored once the room
+  // goes quiet. Either way the ack waits until the op is stored
+  if (!wal_ && config_.coalesce_window_ms > 0) {
+    TraceSpan persist_span(trace, "frame", "persist");
+    room.hold_unsaved(payload, len, now);
+    if (room.unsaved().bytes() >= kMaxUnsavedBytes && !room_timers_[data->room.slot].retrying) {
+      save_room(data->room, room);
+    } else {
+      schedule_save(data->room, room, now);
+    }
+  }
+
+  if (room.flags(data->peer_slot) & kPeerSeq) ack_update(ws, data, room, lsn);
+}
+
+void WsServer::relay(void* ws, Room& room, std::string_view plain, std::string_view packed,
+                     uint8_t skip, uint8_t need) {
+  if (packed.empty()) {
+    room.broadcast(ws, plain.data(), plain.size(), send_to_peer, skip, need);
+    return;
+  }
+  room.broadcast(ws, plain.data(), plain.size(), send_to_peer, skip | kPeerZstd, need);
+  room.broadcast(ws, packed.data(), packed.size(), send_to_peer, skip, need | kPeerZstd);
+}
+
+void WsServer::hold_update(void* ws, PerSocketData* data, const uint8_t* payload, size_t len) {
+  if (data->held.bytes() + len > kMaxHeldBytes) {
+    // Peers never saw these ops; a rejoin replaces the sender's scene
+    close_peer(ws, 1013, "Too many updates, reconnect");
+    return;
+  }
+  if (data->held.push(payload, len)) ++coalesced_[2];
+  if (!data->release.scheduled()) {
+    data->release.set([](void* owner, void* socket) {
+      static_cast<WsServer*>(owner)->release_held(socket, user_data(socket));
+    }, ws);
+    wheel_.schedule(data->release, kHeldRetryMs);
+  }
+}
+
+void WsServer::release_held(void* ws, PerSocketData* data) {
+  auto* room = data->authenticated ? room_manager_.resolve(data->room) : nullptr;
+  if (!room) {
+    data->held.clear();
+    return;
+  }
+  ChargeRoom charge(room_manager_, data->room);
+
+  const uint64_t now = monotonic_us();
+  const bool zstd = compressor_.enabled() && room->any_peer(kPeerZstd);
+  data->held.drain_while([&](std::string_view op) {
+    auto* p = reinterpret_cast<const uint8_t*>(op.data());
+    auto plain = MessageCodec::encode_binary(frame_arena_, MessageType::YjsUpdate, p, op.size());
+    if (rate_limiter_.readmit(data->rate, room->rate_state(), RateClass::Update, plain.size(), now)
+        != RateLimiter::Verdict::Pass) {
+      return false;
+    }
+    std::string_view packed;
+    deflate_buf_.assign(1, static_cast<char>(MessageCodec::compressed_type(MessageType::YjsUpdate)));
+    if (zstd && compressor_.compress(p, op.size(), deflate_buf_)) packed = deflate_buf_;
+    publish_update(ws, data, *room, plain, packed, now, 0);
+    return true;
+  });
+  if (!data->held.empty()) wheel_.schedule(data->release, kHeldRetryMs);
+}
+
 void WsServer::on_close(void* ws, PerSocketData* data) {
+  if (capture_ && data->capture_id) capture(data, TrafficCapture::Kind::Close, nullptr, 0);
+  data->release.cancel();
+  data->held.clear();
   if (!data->authenticated) return;
+  data->authenticated = false;
+
+  auto* room = room_manager_.resolve(data->room);
+  if (!room) {
+    users_.release(data->user_index);
+    if (data->spectator) --spectators_;
+    return;
+  }
+
+  if (data->spectator) {
+    --spectators_;
+    if (room->remove_spectator(ws, data->peer_slot) && room->empty()) {
+      retire_room(data->room, *room);
+    }
+    users_.release(data->user_index);
+    data->user_index = UserTable::npos;
+    return;
+  }
+
+  if (!data->resume.empty() && config_.resume_grace_ms > 0) {
+    // Hold the slot open: peers see no peer-left unless the grace period ends
+    DetachedSession session;
+    session.room       = data->room;
+    session.user_index = data->user_index;
+    session.token_exp  = data->token_exp;
+    session.deadline   = DetachedSession::Clock::now()
+                       + std::chrono::milliseconds(config_.resume_grace_ms);
+
+    auto& parked = sessions_.park(data->resume, session);
+    room->rebind_peer(data->peer_slot, nullptr, &parked.peer_slot);
+    room->set_flag(parked.peer_slot, kPeerCongested, false);
+    room->set_flag(parked.peer_slot, kPeerDetached, true);
+
+    LOG_INFO(Ws) << "User " << users_.view(data->user_index)
+                 << " detached from room " << room->id() << " (resumable)";
+    return;
+  }
+
+  drop_peer(data->room, ws, data->peer_slot, data->user_index);
+  data->user_index = UserTable::npos;
+}
 
-  auto* room = room_manager_.get(data->project_id);
+void WsServer::capture(PerSocketData* data, TrafficCapture::Kind kind, const char* payload, size_t len) {
+  if (!data->capture_id) data->capture_id = ++capture_peers_;
+  const uint32_t room = data->authenticated ? data->room.slot + 1 : 0;
+  capture_->record(kind, monotonic_us() - capture_origin_us_, data->capture_id, room, payload, len);
+}
+
+void WsServer::on_drain(void* ws, PerSocketData* data) {
+  // Peer caught up — send what it missed, merged, and resume the live
+  // relay once its buffer is empty
+  if (!data->authenticated) return;
+  if (data->backlog_overflow) {
+    close_peer(ws, 1013, "Too far behind, reconnect");
+    return;
+  }
+  auto* room = room_manager_.resolve(data->room);
   if (!room) return;
+  if (data->spectator) {
+    room->set_spectator_flag(data->peer_slot, kPeerCongested, false);
+  } else {
+    flush_backlog(ws, data, *room);
+  }
+}
 
-  std::string user_id = data->user_id;
-  std::string project_id = data->project_id;
+void WsServer::close_peer(void* ws, int code, std::string_view reason) {
+  if (auto* remote = as_remote(ws)) {
+    // The edge closes the client socket; the session ends here right away
+    remote->link->send_close(remote->sid, static_cast<uint16_t>(code), reason);
+    const uint64_t key = remote_key(*remote->link, remote->sid);
+    on_close(ws, &remote->data);
+    remote_peers_.erase(key);
+    remote_slab_.destroy(remote);
+    return;
+  }
+  with_socket(ws, [&](auto* socket) {
+    if (code) {
+      socket->end(code, reason);
+    } else {
+      socket->close();
+    }
+  });
+}
+
+void WsServer::on_resume(void* ws, PerSocketData* data, const MessageCodec::ControlMessage& msg) {
+  auto token   = ResumeToken::from_hex(msg.token);
+  auto* parked = token ? sessions_.find(*token) : nullptr;
+  auto* room   = parked ? room_manager_.resolve(parked->room) : nullptr;
+
+  const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+
+  if (!room || now >= parked->token_exp) {
+    // Client falls back to a normal join
+    MessageCodec::encode_error(text_buf_, "RESUME_FAILED", "Session expired or unknown");
+    send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+    return;
+  }
+
+  room->rebind_peer(parked->peer_slot, ws, &data->peer_slot);
+  room->set_flag(data->peer_slot, kPeerDetached, false);
+
+  data->room          = parked->room;
+  data->user_index    = parked->user_index;
+  data->token_exp     = parked->token_exp;
+  data->resume        = ResumeToken::generate();
+  data->authenticated = true;
+  arm_token_expiry(ws, data);
+  sessions_.erase(*token);
+
+  MessageCodec::encode_resumed(text_buf_, room->seq(), data->resume.to_hex());
+  send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+  send_range(ws, *room, msg.from_seq, room->seq());
+
+  LOG_INFO(Ws) << "User " << users_.view(data->user_index)
+               << " resumed in room " << room->id();
+}
+
+void WsServer::send_range(void* ws, const Room& room, uint64_t from, uint64_t to) {
+  from = std::max<uint64_t>(from, 1);
+  if (from > to) return;  // Nothing missed
+
+  auto& ops = room.recent_ops();
+  if (!ops.contains(from, to)) {
+    MessageCodec::encode_error(text_buf_, "RANGE_UNAVAILABLE", "Requested range no longer retained");
+    send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+    return;
+  }
+  ops.for_range(from, to, [ws](std::string_view frame) {
+    send_to_peer(ws, frame.data(), frame.size(), true);
+  });
+}
+
+void WsServer::drop_peer(RoomHandle handle, void* ws, uint32_t slot, uint32_t user_index) {
+  auto* room    = room_manager_.resolve(handle);
+  auto  user_id = users_.view(user_index);
+
+  if (room && room->remove_peer(ws, slot)) {
+    LOG_INFO(Ws).field("user", user_id).field("room", room->id())
+                 << "User " << user_id
+                 << " left room " << room->id();
+
+    if (!room->empty()) {
+      // Notify remaining peers (unless the user is still here on another socket)
+      if (!room->has_user(user_index)) {
+        MessageCodec::encode_peer_left(text_buf_, user_id);
+        room->broadcast_text(nullptr, text_buf_, send_to_peer);
+      }
+    } else {
+      retire_room(handle, *room);
+    }
+  }
+
+  users_.release(user_index);
+}
+
+void WsServer::retire_room(RoomHandle handle, Room& room) {
+  // Kept while its ops cannot be stored; the save retry retires it
+  if (!save_room(handle, room) && !shutting_down_) return;
+  // Kept warm so a page reload rejoins from memory, unless the room is
+  // going away anyway or now belongs to another node (whose edits this
+  // copy would miss)
+  if (config_.room_linger_ms == 0 || shutting_down_ || !owns(room.id())) {
+    room_manager_.remove_if_empty(handle);
+    return;
+  }
+  auto& t = room_timers_[handle.slot];
+  t.room = handle;
+  t.linger.set([](void* owner, void* arg) {
+    auto& server = *static_cast<WsServer*>(owner);
+    server.room_manager_.remove_if_empty(static_cast<RoomTimer*>(arg)->room);
+  }, &t);
+  wheel_.schedule(t.linger, config_.room_linger_ms);
+}
+
+bool WsServer::reap_lingering() {
+  RoomHandle coldest{};
+  uint64_t   coldest_us = UINT64_MAX;
+  for (uint32_t slot = 0; slot < config_.max_rooms; ++slot) {
+    auto& t = room_timers_[slot];
+    if (!t.linger.scheduled()) continue;
+    auto* room = room_manager_.resolve(t.room);
+    if (room && room->empty() && room->last_active_us() < coldest_us) {
+      coldest    = t.room;
+      coldest_us = room->last_active_us();
+    }
+  }
+  if (coldest_us == UINT64_MAX) return false;
+  room_timers_[coldest.slot].linger.cancel();
+  room_manager_.remove_if_empty(coldest);
+  return true;
+}
+
+void WsServer::arm_token_expiry(void* ws, PerSocketData* data) {
+  data->deadline.cancel();
+  if (data->token_exp <= 0) return;   // Token without exp
+  const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  data->deadline.set([](void* owner, void* socket) {
+    auto& server = *static_cast<WsServer*>(owner);
+    MessageCodec::encode_error(server.text_buf_, "TOKEN_EXPIRED", "Session token expired, rejoin");
+    send_to_peer(socket, server.text_buf_.data(), server.text_buf_.size(), false);
+    user_data(socket)->resume = {};   // Not resumable: the token has run out
+    server.close_peer(socket, 1008, "Token expired");
+  }, ws);
+  wheel_.schedule(data->deadline, data->token_exp > now ? uint64_t(data->token_exp - now) * 1000 : 0);
+}
+
+void WsServer::expire_sessions() {
+  sessions_.expire(DetachedSession::Clock::now(), [this](DetachedSession& s) {
+    drop_peer(s.room, nullptr, s.peer_slot, s.user_index);
+  });
+}
+
+void WsServer::ack_update(void* ws, const PerSocketData* data, const Room& room, uint64_t lsn) {
+  const bool stored = lsn ? wal_ && wal_->durable_lsn() >= lsn : room.unsaved().empty();
+  PendingAck ack{ ws, data->room, data->peer_slot, room.seq(), lsn };
+  if (stored) {
+    send_ack(ack);
+  } else {
+    pending_acks_.push_back(ack);
+  }
+}
 
-  bool empty = room->remove_peer(ws);
+void WsServer::send_ack(const PendingAck& ack) {
+  // The sender may have left or resumed elsewhere since; it then
+  // learns the outcome from the sequence (resync / resume) instead
+  auto* room = room_manager_.resolve(ack.room);
+  if (!room || room->peer_socket(ack.slot) != ack.ws) return;
+  char frame[MessageCodec::kSeqHeaderSize];
+  MessageCodec::write_seq_header(frame, MessageType::SeqAck, ack.seq);
+  send_to_peer(ack.ws, frame, sizeof(frame), true);
+}
+
+void WsServer::release_acks() {
+  // Acks waiting on the WAL, in LSN order. Without a WAL (closed for
+  // handoff) everything it held has been committed
+  const uint64_t durable = wal_ ? wal_->durable_lsn() : UINT64_MAX;
+  while (!pending_acks_.empty() && pending_acks_.front().lsn != 0
+         && pending_acks_.front().lsn <= durable) {
+    send_ack(pending_acks_.front());
+    pending_acks_.pop_front();
+  }
+}
 
-  // Notify remaining peers
-  if (!empty) {
-    auto left_msg = MessageCodec::encode_peer_left(user_id);
-    room->broadcast_text(nullptr, left_msg, [](void* peer_ws, const char* d, size_t l, bool) {
-      auto* typed = static_cast<uWS::WebSocket<false, true, PerSocketData>*>(peer_ws);
-      typed->send(std::string_view(d, l), uWS::OpCode::TEXT);
+bool WsServer::save_room(RoomHandle handle, Room& room) {
+  auto& ops = room.unsaved();
+  if (ops.empty()) return true;
+
+  const uint64_t merged = ops.merged();
+  TraceSpan span(Tracer::always(), "frame", "save_room");
+  uint64_t lsn = 0;
+  ops.drain_while([&](std::string_view op) {
+    const auto stored = persistence_.persist_update(room.id(), reinterpret_cast<const uint8_t*>(op.data()),
+                                                    op.size());
+    if (stored) lsn = *stored;
+    return stored.has_value();
+  });
+  span.arg("lsn", lsn);
+  if (lsn) room.set_last_lsn(lsn);
+
+  // Stored ops are gone from the coalescer; the rest keep their acks
+  // held until the retry stores them
+  auto& t = room_timers_[handle.slot];
+  if (!ops.empty()) {
+    LOG_SAMPLED(Ws, Warn, 1) << "Could not store " << ops.size() << " ops of room " << room.id()
+                             << ", retrying in " << kSaveRetryMs << " ms";
+    arm_save(handle, kSaveRetryMs);
+    t.retrying = true;
+    return false;
+  }
+  if (t.room == handle) t.retrying = false;
+  coalesced_[0] += merged;
+
+  // Acks held for this room's coalesced ops (no WAL); those of rooms
+  // gone meanwhile are dropped
+  if (!wal_ && !pending_acks_.empty()) {
+    std::erase_if(pending_acks_, [&](const PendingAck& held) {
+      auto* owner = room_manager_.resolve(held.room);
+      if (owner && owner != &room) return false;
+      send_ack(held);
+      return true;
     });
   }
+}
+
+void WsServer::flush_unsaved() {
+  room_manager_.for_each_handle([this](RoomHandle handle, Room& room) { save_room(handle, room); });
+}
 
-  // Clean up empty room
-  if (empty) {
-    room_manager_.remove_if_empty(project_id);
+void WsServer::enforce_memory_budget() {
+  const uint64_t budget = uint64_t{config_.memory_budget_mb} << 20;
+  struct Candidate {
+    uint64_t   last_active_us;
+    RoomHandle handle;
+    Room*      room;
+  };
+  std::pmr::vector<Candidate> rooms(&frame_arena_);
+  uint64_t total = 0;
+  room_manager_.for_each_handle([&](RoomHandle handle, Room& room) {
+    total += room.memory_bytes();
+    rooms.push_back({ room.last_active_us(), handle, &room });
+  });
+  if (spill_) {
+    spill_->retain([&](uint32_t slot, uint32_t generation) {
+      return room_manager_.resolve({ slot, generation }) != nullptr;
+    });
   }
+  if (total <= budget) return;
+
+  // A room quiet this long has no peer still waiting on a retained frame
+  const uint64_t now     = monotonic_us();
+  const uint64_t cold_us = std::max<uint64_t>(60000000, uint64_t{config_.resume_grace_ms} * 1000);
 
-  std::cout << "[wigma-ws] User " << user_id
-            << " left room " << project_id << std::endl;
+  std::sort(rooms.begin(), rooms.end(),
+            [](const Candidate& a, const Candidate& b) { return a.last_active_us < b.last_active_us; });
+  for (auto& c : rooms) {
+    if (total <= budget) break;
+    Room& room = *c.room;
+    const size_t before = room.memory_bytes();
+
+    auto& cache = room.sync_cache();
+    if (cache.bytes() > 0) {
+      auto frame = cache.frame();
+      if (spill_ && cache.fresh(room.seq()) && frame.size() > 1) {
+        spill_->store(c.handle.slot, c.handle.generation, room.seq(),
+                      reinterpret_cast<const uint8_t*>(frame.data()) + 1, frame.size() - 1);
+      }
+      cache.clear();
+      ++evictions_[0];
+    }
+    if (now - c.last_active_us >= cold_us && room.recent_ops().memory_bytes() > 0) {
+      room.release_recent_ops();
+      ++evictions_[1];
+    }
+    total -= before - room.memory_bytes();
+  }
+
+  if (total > budget) {
+    LOG_SAMPLED(Ws, Warn, 1) << "Rooms hold " << total << " bytes after eviction, over the "
+                             << config_.memory_budget_mb << " MB budget";
+  }
+}
+
+void WsServer::check_overload(uint64_t now_us) {
+  const auto before = overload_.level();
+  if (!overload_.on_tick(now_us)) return;
+  const auto after = overload_.level();
+  if (after > before) {
+    LOG_WARN(Ws).field("lag_ms", overload_.lag_us() / 1000).field("level", OverloadMonitor::name(after))
+      << "Event loop lagging " << overload_.lag_us() / 1000 << " ms, shedding load: "
+      << OverloadMonitor::name(after);
+  } else {
+    LOG_INFO(Ws).field("lag_ms", overload_.lag_us() / 1000).field("level", OverloadMonitor::name(after))
+      << "Event loop lag down to " << overload_.lag_us() / 1000 << " ms, now "
+      << OverloadMonitor::name(after);
+  }
+}
+
+bool WsServer::needs_storage_load(std::string_view project_id) {
+  const auto handle = room_manager_.find(project_id);
+  auto* room = room_manager_.resolve(handle);
+  if (!room) return true;
+  if (room->sync_cache().fresh(room->seq())) return false;
+  return !(spill_ && spill_->holds(handle.slot, handle.generation, room->seq()));
+}
+
+void WsServer::refuse_join(void* ws, bool cold) {
+  ++shed_[cold ? 1 : 2];
+  // Jitter the hint (1x-2x) so refused clients do not all come back at once
+  jitter_state_ ^= jitter_state_ << 13;
+  jitter_state_ ^= jitter_state_ >> 7;
+  jitter_state_ ^= jitter_state_ << 17;
+  const uint32_t base = config_.overload_retry_after_ms;
+  const uint32_t retry_ms = base + static_cast<uint32_t>(jitter_state_ % (uint64_t{base} + 1));
+  MessageCodec::encode_error(text_buf_, "RETRY_AFTER", "Server overloaded, retry later", retry_ms);
+  send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+  close_peer(ws, 1013, "Try again later");
+}
+
+void WsServer::sample_room_load() {
+  constexpr size_t kHotRooms = 5;
+  constexpr double kHogShare = 0.5;   // One room keeping the loop this busy is worth a warning
+
+  const uint64_t now = monotonic_us();
+  const double interval = static_cast<double>(now - load_sampled_us_) * 1e-6;
+  load_sampled_us_ = now;
+
+  load_busy_ = 0;
+  hot_rooms_.clear();
+  room_manager_.for_each([&](Room& room) {
+    auto& load = room.load();
+    auto w = load.sample(interval);
+    load_totals_.busy_ns += w.busy_ns;
+    load_totals_.frames  += w.frames;
+    load_totals_.bytes   += w.bytes;
+    load_busy_ += load.busy();
+
+    // Keep the kHotRooms busiest, in order
+    if (hot_rooms_.size() == kHotRooms && load.busy() <= hot_rooms_.back().busy) return;
+    if (hot_rooms_.size() == kHotRooms) hot_rooms_.pop_back();
+    HotRoom hot{ room.id(), load.busy(), load.frames_per_sec(), load.bytes_per_sec(), room.peer_count() };
+    auto at = std::upper_bound(hot_rooms_.begin(), hot_rooms_.end(), hot.busy,
+                               [](double busy, const HotRoom& h) { return busy > h.busy; });
+    hot_rooms_.insert(at, std::move(hot));
+  });
+
+  // Warn once per episode, not every second a hot room stays hot
+  if (hot_rooms_.empty() || hot_rooms_.front().busy < kHogShare) {
+    hog_room_.clear();
+  } else if (hot_rooms_.front().id != hog_room_) {
+    const auto& top = hot_rooms_.front();
+    hog_room_ = top.id;
+    LOG_WARN(Ws).field("room", top.id).field("room_label", room_label(top.id))
+      << "Room " << top.id << " keeps the event loop " << static_cast<int>(top.busy * 100)
+      << "% busy (" << top.peers << " peers, " << static_cast<uint64_t>(top.bytes_per_sec) << " B/s fan-out)";
+  }
+}
+
+void WsServer::flush_backlog(void* ws, PerSocketData* data, Room& room) {
+  auto& ops = data->backlog;
+  const bool zstd = (room.flags(data->peer_slot) & kPeerZstd) && compressor_.enabled();
+
+  bool ok = true;
+  coalesced_[1] += ops.merged();
+  ops.drain([&](std::string_view op) {
+    auto* p = reinterpret_cast<const uint8_t*>(op.data());
+    deflate_buf_.assign(1, static_cast<char>(MessageCodec::compressed_type(MessageType::YjsUpdate)));
+    if (zstd && compressor_.compress(p, op.size(), deflate_buf_)) {
+      ok &= send_to_peer(ws, deflate_buf_.data(), deflate_buf_.size(), true);
+    } else {
+      auto frame = MessageCodec::encode_binary(frame_arena_, MessageType::YjsUpdate, p, op.size());
+      ok &= send_to_peer(ws, frame.data(), frame.size(), true);
+    }
+  });
+
+  // Still backpressured: stay congested and catch the rest on the next drain
+  room.set_flag(data->peer_slot, kPeerCongested, !ok);
+}
+
+void WsServer::send_spectators(Room& room, std::string_view payload, uint8_t skip, uint8_t need) {
+  auto frame = MessageCodec::encode_binary(
+    frame_arena_, MessageType::YjsUpdate, reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+
+  deflate_buf_.clear();
+  if (compressor_.enabled() && room.any_spectator(need | kPeerZstd)) {
+    deflate_buf_.assign(1, static_cast<char>(MessageCodec::compressed_type(MessageType::YjsUpdate)));
+    if (!compressor_.compress(reinterpret_cast<const uint8_t*>(payload.data()), payload.size(), deflate_buf_)) {
+      deflate_buf_.clear();
+    }
+  }
+
+  if (deflate_buf_.empty()) {
+    room.broadcast_spectators(frame.data(), frame.size(), send_to_peer, skip, need);
+    return;
+  }
+  room.broadcast_spectators(frame.data(), frame.size(), send_to_peer, skip | kPeerZstd, need);
+  room.broadcast_spectators(deflate_buf_.data(), deflate_buf_.size(), send_to_peer, skip, need | kPeerZstd);
+}
+
+void WsServer::spectator_tick() {
+  constexpr std::string_view kSyncRequest = R"({"o":"sync-request"})";
+  constexpr uint64_t kSyncRequestInterval = 2000000;   // 2 s between asks
+
+  // Several ops go out as one {"o":"batch"} op, which clients apply in order
+  constexpr std::string_view kBatchOpen = R"({"o":"batch","ops":[)";
+  std::pmr::string batch(&frame_arena_);
+  size_t count = 0;
+  auto add = [&](std::string_view op) {
+    batch += count++ ? std::string_view(",") : kBatchOpen;
+    batch += op;
+  };
+  auto finish = [&]() -> std::string_view {
+    if (count == 1) return std::string_view(batch).substr(kBatchOpen.size());
+    batch += "]}";
+    return batch;
+  };
+
+  const uint64_t now = monotonic_us();
+  std::erase_if(spectated_rooms_, [&](RoomHandle handle) {
+    auto* room = room_manager_.resolve(handle);
+    if (!room || room->spectator_count() == 0) return true;
+    ChargeRoom charge(room_manager_, handle);
+
+    // 1. This tick's updates, merged, to spectators already caught up
+    if (!room->spectator_ops().empty()) {
+      batch.clear();
+      count = 0;
+      room->spectator_ops().drain(add);
+      send_spectators(*room, finish(), kPeerPending, 0);
+    }
+
+    // 2. Latest presence of each editor; congested viewers skip it
+    room->drain_spectator_awareness([&](std::string_view p) {
+      auto frame = MessageCodec::encode_binary(
+        frame_arena_, MessageType::Awareness, reinterpret_cast<const uint8_t*>(p.data()), p.size());
+      room->broadcast_spectators(frame.data(), frame.size(), send_to_peer,
+                                 kPeerPending | kPeerCongested, 0);
+    });
+
+    // 3. Newcomers: last full-sync + ops since, built once for all of them
+    if (room->any_spectator(kPeerPending)) {
+      batch.clear();
+      count = 0;
+      if (room->for_each_catchup(add)) {
+        send_spectators(*room, finish(), 0, kPeerPending);
+        room->clear_spectator_flag(kPeerPending);
+      } else if (auto* editor = room->pick_editor()) {
+        // No state held yet: ask one editor; its full-sync reaches everyone
+        if (room->claim_sync_request(now, kSyncRequestInterval)) {
+          auto frame = MessageCodec::encode_binary(
+            frame_arena_, MessageType::YjsUpdate,
+            reinterpret_cast<const uint8_t*>(kSyncRequest.data()), kSyncRequest.size());
+          send_to_peer(editor, frame.data(), frame.size(), true);
+        }
+      } else {
+        // Nobody can change the document; go live on the loaded state
+        room->clear_spectator_flag(kPeerPending);
+      }
+    }
+    return false;
+  });
+}
+
+// ── Cluster ──────────────────────────────────────────────────────────────────
+
+void WsServer::start_cluster() {
+  reload_cluster();
+
+  cluster_ = std::make_unique<ClusterTransport>(
+    reinterpret_cast<us_loop_t*>(uWS::Loop::get()),
+    ClusterTransport::Handlers{
+      [this](ClusterLink& link, LinkFrame kind, uint32_t sid, std::string_view payload) {
+        on_link_frame(link, kind, sid, payload);
+      },
+      [this](ClusterLink& link) { on_link_drain(link); },
+      [this](ClusterLink& link) { on_link_closed(link); },
+    });
+
+  std::string address = config_.cluster_listen;
+  if (auto* self = ring_.find(config_.cluster_node_id); self && address.empty()) {
+    address = self->address;
+  }
+  if (address.empty()) {
+    LOG_INFO(Cluster) << "Node " << config_.cluster_node_id
+                      << " is not a member; proxying every room";
+    return;
+  }
+  cluster_->listen(address);
+}
+
+void WsServer::reload_cluster() {
+  if (!config_.cluster_discovery_file.empty()) {
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(config_.cluster_discovery_file, ec);
+    if (ec || mtime == discovery_mtime_) return;
+    discovery_mtime_ = mtime;
+  }
+
+  std::vector<ClusterNode> nodes;
+  if (!parse_cluster_nodes(config_.cluster_nodes, nodes)) {
+    LOG_WARN(Cluster) << "Skipping malformed CLUSTER_NODES entries";
+  }
+  if (!config_.cluster_discovery_file.empty()
+      && !load_cluster_nodes(config_.cluster_discovery_file, nodes)) {
+    // Possibly caught mid-write; keep the current ring until it parses
+    LOG_WARN(Cluster) << "Cannot parse " << config_.cluster_discovery_file
+                      << ", keeping " << ring_.nodes().size() << " nodes";
+    discovery_mtime_ = {};
+    return;
+  }
+
+  HashRing next(config_.cluster_vnodes);
+  next.set_nodes(std::move(nodes));
+  if (next.nodes() == ring_.nodes()) return;
+  ring_ = std::move(next);
+
+  std::string list;
+  for (auto& node : ring_.nodes()) list += ' ' + node.id + '=' + node.address;
+  LOG_INFO(Cluster) << ring_.nodes().size() << " nodes:" << list;
+  migrate_rooms();
+}
+
+void WsServer::migrate_rooms() {
+  // Collected first: closing runs on_close, which can free the room
+  std::vector<void*> moved;
+  size_t rooms = 0;
+  room_manager_.for_each([&](Room& room) {
+    if (owns(room.id())) return;
+    ++rooms;
+    room.for_each_socket([&](void* ws) { moved.push_back(ws); });
+  });
+  if (moved.empty()) return;
+
+  LOG_INFO(Cluster) << rooms << " rooms moved to other nodes, closing "
+                    << moved.size() << " sockets";
+  for (void* ws : moved) close_peer(ws, 1012, "Room moved, reconnect");
+}
+
+bool WsServer::owns(std::string_view project_id) const {
+  auto* node = ring_.owner(project_id);
+  return !node || node->id == config_.cluster_node_id;
+}
+
+void WsServer::proxy_join(void* ws, PerSocketData* data, std::string_view join, const ClusterNode& owner) {
+  auto* link = cluster_->link_to(owner);
+  if (!link) {
+    MessageCodec::encode_error(text_buf_, "NODE_UNAVAILABLE", "Room owner unreachable, retry");
+    send_to_peer(ws, text_buf_.data(), text_buf_.size(), false);
+    close_peer(ws, 1013, "Room owner unreachable");
+    return;
+  }
+
+  if (++next_sid_ == 0) ++next_sid_;
+  data->deadline.cancel();
+  data->proxy     = link;
+  data->proxy_sid = next_sid_;
+  proxied_[next_sid_] = ws;
+  link->send(LinkFrame::Text, next_sid_, join.data(), join.size());
+}
+
+void WsServer::on_link_frame(ClusterLink& link, LinkFrame kind, uint32_t sid, std::string_view payload) {
+  if (!link.node_id().empty()) {
+    // Edge side: the owner's replies for one of our clients
+    auto it = proxied_.find(sid);
+    if (it == proxied_.end()) return;   // Client already gone
+    void* ws   = it->second;
+    auto* data = user_data(ws);
+
+    if (kind == LinkFrame::Text || kind == LinkFrame::Binary) {
+      bool sent = send_to_peer(ws, payload.data(), payload.size(), kind == LinkFrame::Binary);
+      if (!sent && !data->proxy_congested) {
+        data->proxy_congested = true;
+        link.send(LinkFrame::Backpressure, sid, nullptr, 0);
+      }
+    } else if (kind == LinkFrame::Close) {
+      int code = payload.size() >= 2
+        ? static_cast<uint8_t>(payload[0]) | (static_cast<uint8_t>(payload[1]) << 8) : 0;
+      proxied_.erase(it);
+      data->proxy = nullptr;   // The close handler must not echo it back
+      close_peer(ws, code, payload.size() >= 2 ? payload.substr(2) : std::string_view{});
+    }
+    return;
+  }
+
+  // Owner side: frames from a client connected to another node
+  const uint64_t key = remote_key(link, sid);
+  auto it = remote_peers_.find(key);
+  if (it == remote_peers_.end()) {
+    if (kind != LinkFrame::Text) return;
+    auto* peer = remote_slab_.create();
+    peer->link = &link;
+    peer->sid  = sid;
+    it = remote_peers_.emplace(key, peer).first;
+  }
+  auto* peer = it->second;
+
+  switch (kind) {
+    case LinkFrame::Text:
+      on_text_message(tag_remote(peer), &peer->data, payload);
+      break;
+    case LinkFrame::Binary:
+      on_binary_message(tag_remote(peer), &peer->data,
+                        reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+      break;
+    case LinkFrame::Close:
+      on_close(tag_remote(peer), &peer->data);
+      remote_peers_.erase(it);
+      remote_slab_.destroy(peer);
+      break;
+    case LinkFrame::Backpressure:
+      peer->held = true;
+      if (auto* room = peer->data.authenticated ? room_manager_.resolve(peer->data.room) : nullptr) {
+        if (peer->data.spectator) {
+          room->set_spectator_flag(peer->data.peer_slot, kPeerCongested, true);
+        } else {
+          room->set_flag(peer->data.peer_slot, kPeerCongested, true);
+        }
+      }
+      break;
+    case LinkFrame::Drain:
+      peer->held = false;
+      on_drain(tag_remote(peer), &peer->data);
+      break;
+  }
+}
+
+void WsServer::on_link_drain(ClusterLink& link) {
+  // Sessions stalled by the link itself (not by their own client) resume
+  std::vector<RemotePeer*> ready;
+  for (auto& [key, peer] : remote_peers_) {
+    if (peer->link == &link && !peer->held) ready.push_back(peer);
+  }
+  for (auto* peer : ready) {
+    if (peer->data.authenticated && !peer->data.spectator) {
+      auto* room = room_manager_.resolve(peer->data.room);
+      if (!room || !(room->flags(peer->data.peer_slot) & kPeerCongested)) continue;
+    }
+    on_drain(tag_remote(peer), &peer->data);
+  }
+}
+
+void WsServer::on_link_closed(ClusterLink& link) {
+  if (!link.node_id().empty()) {
+    // Lost the owner: clients reconnect and are routed afresh
+    std::vector<void*> orphans;
+    for (auto& [sid, ws] : proxied_) {
+      if (user_data(ws)->proxy == &link) orphans.push_back(ws);
+    }
+    for (void* ws : orphans) {
+      auto* data = user_data(ws);
+      proxied_.erase(data->proxy_sid);
+      data->proxy = nullptr;
+      close_peer(ws, 1013, "Cluster link lost, reconnect");
+    }
+    if (!orphans.empty()) {
+      LOG_WARN(Cluster) << "Link to " << link.node_id() << " lost, closed "
+                        << orphans.size() << " sessions";
+    }
+    return;
+  }
+
+  // Lost an edge: its clients leave their rooms here
+  std::vector<uint64_t> gone;
+  for (auto& [key, peer] : remote_peers_) {
+    if (peer->link == &link) gone.push_back(key);
+  }
+  for (uint64_t key : gone) {
+    auto it = remote_peers_.find(key);
+    auto* peer = it->second;
+    on_close(tag_remote(peer), &peer->data);
+    remote_peers_.erase(it);
+    remote_slab_.destroy(peer);
+  }
 }
@@ -1,21 +1,81 @@
 #pragma once
 #include "rooms/room_manager.h"
+#include "rooms/user_table.h"
+#include "rooms/session_table.h"
+#include "rooms/rate_limiter.h"
+#include "rooms/op_coalescer.h"
 #include "auth/jwt_verifier.h"
 #include "persistence/yjs_persistence.h"
-#include "persistence/supabase_client.h"
+#include "persistence/persistence_backend.h"
+#include "persistence/write_ahead_log.h"
+#include "persistence/room_spill.h"
 #include "protocol/message_codec.h"
+#include "protocol/frame_compressor.h"
+#include "cluster/hash_ring.h"
+#include "cluster/cluster_link.h"
+#include "server/hot_restart.h"
+#include "server/timer_wheel.h"
+#include "server/tls_context.h"
+#include "server/traffic_capture.h"
+#include "server/overload_monitor.h"
+#include "memory/slab.h"
+#include "memory/frame_arena.h"
+#include "memory/counting_resource.h"
 #include "config.h"
 #include <string>
+#include <vector>
 #include <functional>
+#include <memory>
+#include <unordered_map>
+#include <deque>
+#include <filesystem>
+#include <atomic>
+
+struct us_timer_t;
+struct us_listen_socket_t;
+namespace uWS { template <bool SSL> struct TemplatedApp; }
 
 /**
  * Per-socket user data stored by uWebSockets.
  * Allocated on ws open, freed on ws close.
+ *
+ * Room and user are bound once at join time, so per-frame handling
+ * never hashes or copies the project/user ID strings.
  */
 struct PerSocketData {
-  std::string user_id;
-  std::string project_id;
+  RoomHandle room;                          // Generation-checked room binding
+  uint32_t   user_index = UserTable::npos;  // Interned user ID
+  uint32_t   peer_slot  = Room::npos;       // Index in the room's peer table
+  ResumeToken resume;                       // Empty = session not resumable
+  int64_t    token_exp  = 0;                // JWT expiry (unix seconds)
+  RateState  rate;                          // Inbound frame budget
+  uint64_t   rate_notice_us = 0;            // Last RATE_LIMITED / READ_ONLY error sent
+  uint64_t   awareness_us = 0;              // Last awareness frame relayed (overload thinning)
+  OpCoalescer backlog;                      // Updates held while congested
+  bool       backlog_overflow = false;      // Backlog hit its cap; ops were lost
+  OpCoalescer held;                         // Own updates over the rate limit, merged
+  TimerWheel::Timer release;                // Relays held updates as the budget refills
   bool authenticated = false;
+  bool spectator     = false;               // Read-only; peer_slot is a spectator slot
+  TimerWheel::Timer deadline;               // Join timeout, then token expiry: closes the socket
+  uint32_t   capture_id = 0;                // Peer number in the traffic capture (0 = none yet)
+
+  // Cluster edge: the room lives on another node; frames are forwarded
+  ClusterLink* proxy     = nullptr;
+  uint32_t     proxy_sid = 0;
+  bool         proxy_congested = false;     // Owner was told to hold back
+};
+
+/**
+ * Owner side of a proxied session: a client whose socket is on another
+ * node. It is handed to the room code as a tagged pointer in place of a
+ * uWS socket (see send_to_peer), so rooms need not know the difference.
+ */
+struct RemotePeer {
+  PerSocketData data;
+  ClusterLink*  link;
+  uint32_t      sid;
+  bool          held = false;               // Edge reported the client backed up
 };
 
 /**
@@ -27,7 +87,23 @@ struct PerSocketData {
  *   3. Server verifies JWT, checks project access, joins room
  *   4. Server sends initial Yjs state (loaded from Supabase)
  *   5. All subsequent binary frames are Yjs updates/awareness → broadcast
- *   6. On disconnect, peer is removed; if room empty, persist + destroy room
+ *   6. On disconnect, peer is removed; if room empty, persist it and drop
+ *      it once it has stayed empty for the linger period.
+ *      Peers holding a resume token are detached instead and can reattach
+ *      with "resume" within the grace period, receiving only missed frames.
+ *
+ * In cluster mode each project hashes (consistent hashing over the node
+ * list) to one owner node that hosts its room. A node that receives a join
+ * for a room it does not own forwards the session's frames to the owner
+ * over a persistent inter-node link and relays the replies back.
+ *
+ * Restarts hand over: a new process started with the same HANDOFF_SOCKET
+ * takes the detached sessions and recent frames of the old one, which
+ * closes its clients with 1012 so they resume against warm state.
+ *
+ * Viewers (project role 'viewer', or a join with "spectate": true) join as
+ * spectators: read-only, not counted against max_peers, and fed by a
+ * per-room batch built once per spectator tick instead of per frame.
  *
  * Single-threaded event loop (uWebSockets) — no locking needed for I/O,
  * only RoomManager uses a mutex for safety with potential timer callbacks.
@@ -39,16 +115,151 @@ public:
   /** Start the event loop (blocking). */
   void run();
 
-  /** Request graceful shutdown. */
+  /**
+   * Request graceful shutdown: stop accepting, close clients with 1001,
+   * store pending ops, let run() return. Safe from a signal handler.
+   */
   void stop();
 
+  /**
+   * Request a trace dump to TRACE_FILE (written by the loop thread).
+   * Safe from a signal handler.
+   */
+  void dump_trace();
+
 private:
   Config config_;
   RoomManager room_manager_;
+  UserTable users_;
   JwtVerifier jwt_verifier_;
-  SupabaseClient supabase_client_;
+  std::unique_ptr<PersistenceBackend> backend_;
+  std::unique_ptr<PersistenceBackend> replay_backend_;  // WAL replay thread's own instance
+  std::unique_ptr<WriteAheadLog> wal_;      // Null when WAL_DIR is unset; opened in run()
+  std::unique_ptr<RoomSpill> spill_;        // Evicted sync state; null without SPILL_FILE
+  std::unique_ptr<TrafficCapture> capture_; // Inbound frame recorder; null without CAPTURE_FILE
+  uint64_t capture_origin_us_ = 0;          // Capture timestamps count from here
+  uint32_t capture_peers_ = 0;
   YjsPersistence persistence_;
-  bool running_ = false;
+  SessionTable sessions_;                   // Detached peers awaiting resume
+  FrameCompressor compressor_;              // zstd dictionary (optional)
+  RateLimiter rate_limiter_;                // Per-peer / per-room flood guard
+  std::atomic<bool> stop_requested_{false};
+  std::atomic<bool> trace_requested_{false};
+  bool shutting_down_ = false;
+
+  std::function<void()> close_app_;         // Closes the App / SSLApp while run() is active
+  std::unique_ptr<TlsContext> tls_;         // SSLApp mode only
+  us_listen_socket_t* listen_socket_ = nullptr;
+
+  // All timers run off one wheel, advanced by a single loop timer
+  struct Periodic {
+    TimerWheel::Timer timer;
+    void (*fn)(WsServer&);
+  };
+  struct RoomTimer {
+    TimerWheel::Timer save;                 // Coalescing window of the room's pending ops
+    TimerWheel::Timer linger;               // Drops the room once it has stayed empty
+    RoomHandle        room;
+    bool              retrying = false;     // Last save failed; save is the retry
+  };
+  TimerWheel wheel_;
+  us_timer_t* wheel_timer_ = nullptr;
+  std::vector<std::unique_ptr<Periodic>> periodic_;
+  std::unique_ptr<RoomTimer[]> room_timers_; // By room slot
+  std::unique_ptr<HandoffListener> handoff_; // Waits for our successor
+
+  // SeqAcks held until the update they acknowledge is durable
+  struct PendingAck {
+    void*      ws;
+    RoomHandle room;
+    uint32_t   slot;                        // Sender's peer slot, checked on release
+    uint64_t   seq;
+    uint64_t   lsn;                         // WAL record (0 = waits for the room's save)
+  };
+  std::deque<PendingAck> pending_acks_;     // LSN order
+  std::atomic<uint64_t> wal_coalesced_{0};  // Ops merged by the WAL replay sink
+
+  std::vector<RoomHandle> spectated_rooms_; // Rooms with at least one spectator
+  size_t   spectators_ = 0;                 // Across all rooms
+  uint64_t coalesced_[3] = {};              // Ops merged away: persist, backlog, rate limit
+  uint64_t sync_cache_[3] = {};             // Joins: cached sync frame hit, rebuilt, read from spill
+  uint64_t evictions_[2] = {};              // Under the memory budget: sync frames, op rings
+
+  // Room load, sampled once a second (see RoomLoad)
+  struct HotRoom {
+    std::string id;
+    double busy;                            // Loop seconds per second
+    double frames_per_sec;
+    double bytes_per_sec;
+    size_t peers;
+  };
+  RoomLoad::Window load_totals_;            // All rooms, since start
+  double   load_busy_ = 0;                  // Sum of room busy() rates
+  uint64_t load_sampled_us_ = 0;
+  std::vector<HotRoom> hot_rooms_;          // Busiest first
+  std::string hog_room_;                    // Last room warned about (until it cools down)
+
+  // Loop lag, measured on wheel_timer_, and the shedding it drives
+  OverloadMonitor overload_;
+  uint64_t shed_[3] = {};                   // Awareness frames dropped, cold joins and joins refused
+  uint64_t jitter_state_;                   // RETRY_AFTER jitter (xorshift)
+
+  // Per-iteration scratch (encoded frames, tick batches), reset before
+  // each loop iteration
+  CountingResource arena_heap_;             // Frames too big for the arena block
+  FrameArena frame_arena_;
+
+  // Reused per-frame scratch buffers (event loop thread only)
+  std::string inflate_buf_;
+  std::string deflate_buf_;
+  std::string seq_deflate_buf_;
+  std::string text_buf_;                    // Outgoing control messages
+
+  // Cluster mode (null transport = single node)
+  HashRing ring_;
+  std::filesystem::file_time_type discovery_mtime_{};
+  std::unordered_map<uint32_t, void*> proxied_;                    // Edge: sid → client socket
+  uint32_t next_sid_ = 0;
+  Slab<RemotePeer> remote_slab_;
+  std::unordered_map<uint64_t, RemotePeer*> remote_peers_;  // Owner: link id, sid → in remote_slab_
+  std::unique_ptr<ClusterTransport> cluster_;   // Last: its teardown reports into the maps above
+
+  /** Register the client endpoints on app, listen, and run the loop. */
+  template <bool SSL>
+  void serve(uWS::TemplatedApp<SSL>& app);
+
+  /** Repeating wheel timer calling fn(*this); cancelled by shutdown(). */
+  void start_timer(uint32_t interval_ms, void (*fn)(WsServer&));
+
+  /**
+   * (Re)arm a room's save timer for the end of its coalescing window;
+   * left alone while a failed save waits for its retry.
+   */
+  void schedule_save(RoomHandle handle, const Room& room, uint64_t now_us);
+
+  /** Arm a room's save timer to fire in delay_ms. */
+  void arm_save(RoomHandle handle, uint32_t delay_ms);
+
+  /** 10 Hz: act on stop(), dump_trace() and on a successor connecting. */
+  void poll_control();
+
+  /** Stop accepting, close every client with code, store pending ops. */
+  void shutdown(int code, std::string_view reason);
+
+  /** Open the write-ahead log; after any handoff, as it shares the dir. */
+  void open_wal();
+
+  /** Retire: shut down with 1012 and send our state to a successor. */
+  void hand_off(int fd);
+
+  /** Rooms and detached sessions that clients can still resume into. */
+  HandoffState export_state() const;
+
+  /** Take over a predecessor's state (before the loop starts). */
+  void adopt(const HandoffState& state);
+
+  /** Prometheus text exposition for GET /metrics. */
+  std::string render_metrics() const;
 
   /** Handle incoming text message (JSON control). */
   void on_text_message(void* ws, PerSocketData* data, std::string_view message);
@@ -56,6 +267,134 @@ private:
   /** Handle incoming binary message (Yjs data). */
   void on_binary_message(void* ws, PerSocketData* data, const uint8_t* payload, size_t len);
 
+  /**
+   * Store (when stored on arrival), stamp and relay a sender's update,
+   * then queue it for saving and ack it. plain is the 0x02 frame, packed
+   * its compressed form if any.
+   */
+  void publish_update(void* ws, PerSocketData* data, Room& room, std::string_view plain,
+                      std::string_view packed, uint64_t now, uint64_t trace);
+
+  /** Fan a frame out in plain and (where negotiated) compressed form. */
+  void relay(void* ws, Room& room, std::string_view plain, std::string_view packed,
+             uint8_t skip, uint8_t need);
+
+  /**
+   * Hold an update its sender's (or the room's) budget refused: merged
+   * with the sender's other held ops and relayed as the budget refills.
+   * Past the cap the sender is closed and rejoins with a full sync.
+   */
+  void hold_update(void* ws, PerSocketData* data, const uint8_t* payload, size_t len);
+
+  /** Relay held updates, oldest first, while the budget allows. */
+  void release_held(void* ws, PerSocketData* data);
+
   /** Handle peer disconnect. */
   void on_close(void* ws, PerSocketData* data);
+
+  /** Append an inbound frame (or the close) of a session to the capture. */
+  void capture(PerSocketData* data, TrafficCapture::Kind kind, const char* payload, size_t len);
+
+  /** Socket buffer emptied: flush the backlog, resume the live relay. */
+  void on_drain(void* ws, PerSocketData* data);
+
+  /** Close a local or remote peer (code 0 = abort); runs on_close. */
+  void close_peer(void* ws, int code = 0, std::string_view reason = {});
+
+  /** Reattach a detached session to a new socket ("resume"). */
+  void on_resume(void* ws, PerSocketData* data, const MessageCodec::ControlMessage& msg);
+
+  /** Send retained sequenced frames [from, to], or RANGE_UNAVAILABLE. */
+  void send_range(void* ws, const Room& room, uint64_t from, uint64_t to);
+
+  /** Remove a peer slot for good and tell the rest of the room. */
+  void drop_peer(RoomHandle handle, void* ws, uint32_t slot, uint32_t user_index);
+
+  /** Save a room its last client left; drop it after ROOM_LINGER_MS. */
+  void retire_room(RoomHandle handle, Room& room);
+
+  /** Drop the least recently active lingering room (at MAX_ROOMS). */
+  bool reap_lingering();
+
+  /** Close a joined socket with TOKEN_EXPIRED when its JWT expires. */
+  void arm_token_expiry(void* ws, PerSocketData* data);
+
+  /** Drop detached sessions whose grace period has ended (1 Hz timer). */
+  void expire_sessions();
+
+  /**
+   * Acknowledge an update (0x05) once it is durable: when the WAL has
+   * synced lsn, or without a WAL once save_room() has stored the room's
+   * coalesced ops (at once if it was stored synchronously).
+   */
+  void ack_update(void* ws, const PerSocketData* data, const Room& room, uint64_t lsn);
+
+  /** Send a held ack if its sender is still on the same socket and slot. */
+  void send_ack(const PendingAck& ack);
+
+  /** Send held acks whose WAL record has been synced (per loop tick). */
+  void release_acks();
+
+  /**
+   * Hand a room's pending (coalesced) ops to persistence and release the
+   * acks held for them. If one is rejected, it and the ops after it stay
+   * pending with their acks and the save is retried a second later.
+   * Returns whether nothing is left unsaved.
+   */
+  bool save_room(RoomHandle handle, Room& room);
+
+  /**
+   * 1 Hz with MEMORY_BUDGET_MB: while rooms hold more than the budget,
+   * evict cached state from the least recently active first.
+   */
+  void enforce_memory_budget();
+
+  /**
+   * 1 Hz: fold each room's load window into its rates and the totals,
+   * rank the hottest rooms for /metrics, warn about any that hog the loop.
+   */
+  void sample_room_load();
+
+  /** Per loop tick: measure lag, log and apply overload level changes. */
+  void check_overload(uint64_t now_us);
+
+  /**
+   * Whether a join for project_id would have to load the room from
+   * storage: no such room, or its sync state is neither cached nor spilled.
+   */
+  bool needs_storage_load(std::string_view project_id);
+
+  /** Refuse a join (cold: it needed a storage load) with RETRY_AFTER, close 1013. */
+  void refuse_join(void* ws, bool cold);
+
+  /** Save every room's pending ops (shutdown). */
+  void flush_unsaved();
+
+  /** Send a drained peer the updates merged while it was congested. */
+  void flush_backlog(void* ws, PerSocketData* data, Room& room);
+
+  /** Send each spectated room's batched updates, awareness and catch-ups. */
+  void spectator_tick();
+
+  /** Send one 0x02 payload to spectators, compressed where negotiated. */
+  void send_spectators(Room& room, std::string_view payload, uint8_t skip, uint8_t need);
+
+  /** Load the node list, open the link listener (cluster mode). */
+  void start_cluster();
+
+  /** Re-read the discovery file; on change, move rooms this node lost. */
+  void reload_cluster();
+
+  /** Close the sockets of local rooms now owned by another node. */
+  void migrate_rooms();
+
+  /** True if this node hosts the project's room. */
+  bool owns(std::string_view project_id) const;
+
+  /** Edge: forward a join (and the rest of the session) to the owner. */
+  void proxy_join(void* ws, PerSocketData* data, std::string_view join, const ClusterNode& owner);
+
+  void on_link_frame(ClusterLink& link, LinkFrame kind, uint32_t sid, std::string_view payload);
+  void on_link_closed(ClusterLink& link);
+  void on_link_drain(ClusterLink& link);
 };
@@ -0,0 +1,181 @@
+#include "protocol/message_codec.h"
+#include <gtest/gtest.h>
+#include <string>
+
+using MessageCodec::ControlMessage;
+using MessageCodec::decode_control;
+
+namespace {
+
+bool parses(std::string_view json) {
+  ControlMessage msg;
+  return decode_control(json, msg);
+}
+
+} // namespace
+
+// ── Control messages ─────────────────────────────────────────────────────────
+
+TEST(ControlParser, JoinFields) {
+  ControlMessage msg;
+  ASSERT_TRUE(decode_control(
+    R"({"type":"join","projectId":"p-1","token":"t.k.n","caps":["seq","zstd"],)"
+    R"("dictId":7,"spectate":true})", msg));
+  EXPECT_EQ(msg.type, "join");
+  EXPECT_EQ(msg.project_id, "p-1");
+  EXPECT_EQ(msg.token, "t.k.n");
+  EXPECT_EQ(msg.caps, kCapSeq | kCapZstd);
+  EXPECT_EQ(msg.dict_id, 7u);
+  EXPECT_TRUE(msg.spectate);
+}
+
+TEST(ControlParser, ResyncRangeAndWhitespace) {
+  ControlMessage msg;
+  ASSERT_TRUE(decode_control(" \t\r\n{ \"type\" : \"resync\" , \"from\" : 12 ,\"to\":0 }\n", msg));
+  EXPECT_EQ(msg.type, "resync");
+  EXPECT_EQ(msg.from_seq, 12u);
+  EXPECT_EQ(msg.to_seq, 0u);
+  ASSERT_TRUE(decode_control(R"({"type":"resync","from":18446744073709551615})", msg));
+  EXPECT_EQ(msg.from_seq, UINT64_MAX);
+}
+
+TEST(ControlParser, StateIsResetBetweenMessages) {
+  ControlMessage msg;
+  ASSERT_TRUE(decode_control(R"({"type":"join","projectId":"a","caps":["seq"],"spectate":true})", msg));
+  ASSERT_TRUE(decode_control(R"({"type":"ping"})", msg));
+  EXPECT_TRUE(msg.project_id.empty());
+  EXPECT_EQ(msg.caps, 0u);
+  EXPECT_FALSE(msg.spectate);
+}
+
+TEST(ControlParser, Escapes) {
+  ControlMessage msg;
+  ASSERT_TRUE(decode_control(R"({"type":"join","projectId":"a\"b\\c\/d\b\f\n\r\t"})", msg));
+  EXPECT_EQ(msg.project_id, "a\"b\\c/d\b\f\n\r\t");
+  ASSERT_TRUE(decode_control(R"({"type":"join","token":"\u00e9\u20AC"})", msg));
+  EXPECT_EQ(msg.type, "join");
+  EXPECT_EQ(msg.token, "\xC3\xA9\xE2\x82\xAC");   // é €
+}
+
+TEST(ControlParser, EscapedViewsStayValid) {
+  // Several escaped strings decode into the same scratch buffer
+  ControlMessage msg;
+  ASSERT_TRUE(decode_control(R"({"type":"join","projectId":"p\u0031","token":"t\u006fk"})", msg));
+  EXPECT_EQ(msg.type, "join");
+  EXPECT_EQ(msg.project_id, "p1");
+  EXPECT_EQ(msg.token, "tok");
+}
+
+TEST(ControlParser, SurrogatePairs) {
+  ControlMessage msg;
+  ASSERT_TRUE(decode_control(R"({"type":"x","token":"\ud83d\ude00"})", msg));
+  EXPECT_EQ(msg.token, "\xF0\x9F\x98\x80");   // U+1F600
+  EXPECT_FALSE(parses(R"({"type":"x","token":"\ud83d"})"));          // High alone
+  EXPECT_FALSE(parses(R"({"type":"x","token":"\ud83dx"})"));
+  EXPECT_FALSE(parses(R"({"type":"x","token":"\ud83d\u0041"})"));   // Not a low one
+  EXPECT_FALSE(parses(R"({"type":"x","token":"\ude00"})"));          // Low alone
+  EXPECT_FALSE(parses(R"({"type":"x","other":"\ude00"})"));          // Also when skipped
+}
+
+TEST(ControlParser, BadEscapesAndControlCharacters) {
+  EXPECT_FALSE(parses(R"({"type":"a\x"})"));
+  EXPECT_FALSE(parses(R"({"type":"\u12G4"})"));
+  EXPECT_FALSE(parses(R"({"type":"\u12"})"));
+  EXPECT_FALSE(parses("{\"type\":\"a\nb\"}"));
+  EXPECT_FALSE(parses("{\"type\":\"a\\n\tb\"}"));
+}
+
+TEST(ControlParser, Numbers) {
+  ControlMessage msg;
+  ASSERT_TRUE(decode_control(R"({"type":"resync","from":0})", msg));
+  EXPECT_EQ(msg.from_seq, 0u);
+  EXPECT_FALSE(parses(R"({"type":"resync","from":01})"));
+  EXPECT_FALSE(parses(R"({"type":"resync","from":00})"));
+  EXPECT_FALSE(parses(R"({"type":"resync","from":-1})"));
+  EXPECT_FALSE(parses(R"({"type":"resync","from":1.5})"));
+  EXPECT_FALSE(parses(R"({"type":"resync","from":1e3})"));
+  EXPECT_FALSE(parses(R"({"type":"resync","from":18446744073709551616})"));   // Overflow
+  EXPECT_FALSE(parses(R"({"type":"join","dictId":4294967296})"));
+  EXPECT_FALSE(parses(R"({"type":"resync","from":"1"})"));
+
+  // Unknown keys take any JSON number, and only JSON numbers
+  EXPECT_TRUE(parses(R"({"type":"x","n":-0.5e-3,"m":0,"k":10E+2})"));
+  EXPECT_FALSE(parses(R"({"type":"x","n":012})"));
+  EXPECT_FALSE(parses(R"({"type":"x","n":1.})"));
+  EXPECT_FALSE(parses(R"({"type":"x","n":.5})"));
+  EXPECT_FALSE(parses(R"({"type":"x","n":1e})"));
+  EXPECT_FALSE(parses(R"({"type":"x","n":+1})"));
+}
+
+TEST(ControlParser, CapsArray) {
+  ControlMessage msg;
+  ASSERT_TRUE(decode_control(R"({"type":"join","caps":[]})", msg));
+  EXPECT_EQ(msg.caps, 0u);
+  ASSERT_TRUE(decode_control(R"({"type":"join","caps":[ "zstd" , 3, {"a":[1]}, null, "future", "seq" ]})", msg));
+  EXPECT_EQ(msg.caps, kCapSeq | kCapZstd);
+  EXPECT_FALSE(parses(R"({"type":"join","caps":"seq"})"));   // Not an array
+  EXPECT_FALSE(parses(R"({"type":"join","caps":{"seq":true}})"));
+  EXPECT_FALSE(parses(R"({"type":"join","caps":null})"));
+  EXPECT_FALSE(parses(R"({"type":"join","caps":["seq",]})"));
+  EXPECT_FALSE(parses(R"({"type":"join","caps":["seq")"));
+  EXPECT_FALSE(parses(R"({"type":"join","caps":["seq" "zstd"]})"));
+}
+
+TEST(ControlParser, NestingDepth) {
+  auto nested = [](int depth) {
+    std::string s = R"({"type":"x","deep":)";
+    s.append(static_cast<size_t>(depth), '[');
+    s.append(static_cast<size_t>(depth), ']');
+    return s + "}";
+  };
+  EXPECT_TRUE(parses(nested(32)));
+  EXPECT_FALSE(parses(nested(34)));
+  EXPECT_FALSE(parses(nested(100000)));   // Rejected, not a stack overflow
+  EXPECT_TRUE(parses(R"({"type":"x","o":{"a":{"b":[1,{"c":null}]},"d":true}})"));
+}
+
+TEST(ControlParser, TruncatedInput) {
+  const std::string full = R"({"type":"join","projectId":"p","caps":["seq"],"from":5,"x":{"y":[true,"\u00e9"]}})";
+  ASSERT_TRUE(parses(full));
+  for (size_t len = 0; len < full.size(); ++len) {
+    EXPECT_FALSE(parses(std::string_view(full).substr(0, len))) << "prefix of " << len << " bytes";
+  }
+}
+
+TEST(ControlParser, MalformedInput) {
+  EXPECT_FALSE(parses(""));
+  EXPECT_FALSE(parses("[]"));
+  EXPECT_FALSE(parses(R"("type")"));
+  EXPECT_FALSE(parses("{}"));                              // No type
+  EXPECT_FALSE(parses(R"({"type":""})"));
+  EXPECT_FALSE(parses(R"({"type":1})"));                   // Known key, wrong type
+  EXPECT_FALSE(parses(R"({"type":"x","spectate":1})"));
+  EXPECT_FALSE(parses(R"({"type":"x",})"));
+  EXPECT_FALSE(parses(R"({"type" "x"})"));
+  EXPECT_FALSE(parses(R"({type:"x"})"));
+  EXPECT_FALSE(parses(R"({'type':'x'})"));
+  EXPECT_FALSE(parses(R"({"type":"x"} {})"));              // Trailing data
+  EXPECT_FALSE(parses(R"({"type":"x","a":tru})"));
+  EXPECT_FALSE(parses(R"({"type":"x","a":nul})"));
+  EXPECT_FALSE(parses(R"({"type":"x","a":{"k"}})"));
+  EXPECT_FALSE(parses(R"({"type":"x","a":[1 2]})"));
+  EXPECT_FALSE(parses(std::string_view("{\"type\":\"x\"}\0", 13)));
+}
+
+// ── Encoding ─────────────────────────────────────────────────────────────────
+
+TEST(MessageCodec, ErrorRetryAfter) {
+  std::string out;
+  MessageCodec::encode_error(out, "RATE_LIMITED", "slow \"down\"");
+  EXPECT_EQ(out, R"({"type":"error","code":"RATE_LIMITED","message":"slow \"down\""})");
+  MessageCodec::encode_error(out, "RETRY_AFTER", "later", 2500);
+  EXPECT_EQ(out, R"({"type":"error","code":"RETRY_AFTER","message":"later","retryAfterMs":2500})");
+}
+
+TEST(MessageCodec, SeqHeader) {
+  char header[MessageCodec::kSeqHeaderSize];
+  MessageCodec::write_seq_header(header, MessageType::SeqAck, 0x0102030405060708ull);
+  EXPECT_EQ(static_cast<uint8_t>(header[0]), 0x05);
+  EXPECT_EQ(static_cast<uint8_t>(header[1]), 0x08);
+  EXPECT_EQ(static_cast<uint8_t>(header[8]), 0x01);
+}
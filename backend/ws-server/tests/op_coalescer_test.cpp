@@ -0,0 +1,114 @@
+#include "rooms/op_coalescer.h"
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+
+bool push(OpCoalescer& c, std::string_view op) {
+  return c.push(reinterpret_cast<const uint8_t*>(op.data()), op.size());
+}
+
+std::vector<std::string> drain(OpCoalescer& c) {
+  std::vector<std::string> out;
+  c.drain([&](std::string_view op) { out.emplace_back(op); });
+  return out;
+}
+
+} // namespace
+
+TEST(OpCoalescer, SumsConsecutiveMovesOfTheSameIds) {
+  OpCoalescer c;
+  EXPECT_FALSE(push(c, R"({"o":"move","ids":["b","a"],"dx":1,"dy":2})"));
+  EXPECT_TRUE(push(c, R"({"o":"move","ids":["a","b"],"dx":0.5,"dy":-1})"));   // Same set, other order
+  EXPECT_TRUE(push(c, R"({"o":"move","ids":["a","b"],"dx":3,"dy":0})"));
+  EXPECT_EQ(c.size(), 1u);
+  EXPECT_EQ(c.merged(), 2u);
+
+  auto out = drain(c);
+  ASSERT_EQ(out.size(), 1u);
+  auto op = json::parse(out[0]);
+  EXPECT_EQ(op["o"], "move");
+  EXPECT_EQ(op["ids"], json::array({ "a", "b" }));
+  EXPECT_DOUBLE_EQ(op["dx"].get<double>(), 4.5);
+  EXPECT_DOUBLE_EQ(op["dy"].get<double>(), 1.0);
+  EXPECT_TRUE(c.empty());
+  EXPECT_EQ(c.merged(), 0u);
+}
+
+TEST(OpCoalescer, KeepsLastValueOfEachModifiedProperty) {
+  OpCoalescer c;
+  push(c, R"({"o":"modify","id":"n1","props":{"fill":"#f00","x":1}})");
+  EXPECT_TRUE(push(c, R"({"o":"modify","id":"n1","props":{"x":2,"name":"a \"b\""}})"));
+  auto out = drain(c);
+  ASSERT_EQ(out.size(), 1u);
+  auto op = json::parse(out[0]);
+  EXPECT_EQ(op["id"], "n1");
+  EXPECT_EQ(op["props"], json::parse(R"({"fill":"#f00","x":2,"name":"a \"b\""})"));
+}
+
+TEST(OpCoalescer, MergesAcrossOpsOnOtherNodesOnly) {
+  OpCoalescer c;
+  push(c, R"({"o":"move","ids":["a"],"dx":1,"dy":1})");
+  push(c, R"({"o":"modify","id":"b","props":{"x":1}})");
+  EXPECT_TRUE(push(c, R"({"o":"move","ids":["a"],"dx":1,"dy":1})"));    // b commutes with a
+  push(c, R"({"o":"modify","id":"a","props":{"x":5}})");
+  EXPECT_FALSE(push(c, R"({"o":"move","ids":["a"],"dx":1,"dy":1})"));   // Would jump the modify of a
+  EXPECT_FALSE(push(c, R"({"o":"move","ids":["a","b"],"dx":1,"dy":1})"));   // Different id set
+  EXPECT_EQ(c.size(), 5u);
+}
+
+TEST(OpCoalescer, OpaqueOpsAreBarriersAndKeptVerbatim) {
+  OpCoalescer c;
+  const std::string create = R"({"o":"create","node":{"id":"z"}})";
+  const std::string move   = R"({"o":"move","ids":["a"],"dx":1,"dy":1})";
+  push(c, move);
+  push(c, create);
+  EXPECT_FALSE(push(c, move));
+  EXPECT_FALSE(push(c, R"({"o":"move","ids":["a"],"dx":1,"dy":1,"snap":true})"));   // Unknown field
+  EXPECT_FALSE(push(c, R"({"o":"move","ids":["a"],"dx":"1","dy":1})"));
+  EXPECT_FALSE(push(c, "not json"));
+  auto out = drain(c);
+  ASSERT_EQ(out.size(), 6u);
+  EXPECT_EQ(out[0], move);    // Never merged: emitted byte-for-byte
+  EXPECT_EQ(out[1], create);
+  EXPECT_EQ(out[5], "not json");
+}
+
+TEST(OpCoalescer, LooksBackABoundedNumberOfOps) {
+  OpCoalescer c;
+  push(c, R"({"o":"move","ids":["a"],"dx":1,"dy":0})");
+  for (int i = 0; i < 40; ++i) {
+    push(c, R"({"o":"modify","id":"n)" + std::to_string(i) + R"(","props":{"x":1}})");
+  }
+  EXPECT_FALSE(push(c, R"({"o":"move","ids":["a"],"dx":1,"dy":0})"));
+  EXPECT_EQ(c.size(), 42u);
+}
+
+TEST(OpCoalescer, DrainWhileKeepsTheRestPending) {
+  OpCoalescer c;
+  push(c, R"({"o":"delete","id":"a"})");
+  push(c, R"({"o":"move","ids":["b"],"dx":1,"dy":1})");
+  push(c, R"({"o":"delete","id":"c"})");
+
+  std::vector<std::string> out;
+  c.drain_while([&](std::string_view op) {
+    if (out.size() == 2) return false;
+    out.emplace_back(op);
+    return true;
+  });
+  ASSERT_EQ(out.size(), 2u);
+  EXPECT_EQ(out[0], R"({"o":"delete","id":"a"})");
+  ASSERT_EQ(c.size(), 1u);
+  EXPECT_EQ(c.bytes(), std::string_view(R"({"o":"delete","id":"c"})").size());
+
+  // Later ops still merge into what is left
+  push(c, R"({"o":"move","ids":["d"],"dx":1,"dy":0})");
+  EXPECT_TRUE(push(c, R"({"o":"move","ids":["d"],"dx":2,"dy":0})"));
+  c.drain_while([](std::string_view) { return true; });
+  EXPECT_TRUE(c.empty());
+  EXPECT_EQ(c.bytes(), 0u);
+}
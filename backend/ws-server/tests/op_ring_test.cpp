@@ -0,0 +1,112 @@
+#include "rooms/op_ring.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+void push(OpRing& ring, uint64_t seq, const std::string& frame) {
+  char* dst = ring.push(seq, frame.size());
+  ASSERT_NE(dst, nullptr);
+  std::memcpy(dst, frame.data(), frame.size());
+}
+
+std::vector<std::string> range(const OpRing& ring, uint64_t from, uint64_t to) {
+  std::vector<std::string> out;
+  ring.for_range(from, to, [&](std::string_view f) { out.emplace_back(f); });
+  return out;
+}
+
+std::string frame(uint64_t seq, size_t len) {
+  std::string f(len, static_cast<char>('a' + seq % 26));
+  if (len >= 8) std::memcpy(f.data(), &seq, 8);
+  return f;
+}
+
+} // namespace
+
+TEST(OpRing, EmptyUntilFirstPush) {
+  OpRing ring(4, 64);
+  EXPECT_TRUE(ring.empty());
+  EXPECT_EQ(ring.first_seq(), 0u);
+  EXPECT_EQ(ring.last_seq(), 0u);
+  EXPECT_FALSE(ring.contains(0, 0));
+  EXPECT_EQ(ring.memory_bytes(), 0u);
+}
+
+TEST(OpRing, EvictsOldestByCount) {
+  OpRing ring(3, 1024);
+  for (uint64_t s = 10; s < 15; ++s) push(ring, s, "op" + std::to_string(s));
+  EXPECT_EQ(ring.first_seq(), 12u);
+  EXPECT_EQ(ring.last_seq(), 14u);
+  EXPECT_TRUE(ring.contains(12, 14));
+  EXPECT_FALSE(ring.contains(11, 14));
+  EXPECT_FALSE(ring.contains(13, 15));
+  EXPECT_FALSE(ring.contains(14, 13));
+  EXPECT_EQ(range(ring, 12, 14), (std::vector<std::string>{ "op12", "op13", "op14" }));
+  EXPECT_EQ(range(ring, 13, 13), (std::vector<std::string>{ "op13" }));
+}
+
+TEST(OpRing, EvictsOldestByBytesAndWraps) {
+  OpRing ring(100, 100);
+  push(ring, 1, std::string(40, 'a'));
+  push(ring, 2, std::string(40, 'b'));
+  push(ring, 3, std::string(40, 'c'));   // Needs the front: evicts 1 and wraps
+  EXPECT_EQ(ring.first_seq(), 2u);
+  EXPECT_EQ(range(ring, 2, 3), (std::vector<std::string>{ std::string(40, 'b'), std::string(40, 'c') }));
+  push(ring, 4, std::string(50, 'd'));   // Gap before 2 is too small: evicts 2
+  EXPECT_EQ(ring.first_seq(), 3u);
+  EXPECT_EQ(range(ring, 3, 4), (std::vector<std::string>{ std::string(40, 'c'), std::string(50, 'd') }));
+}
+
+TEST(OpRing, OversizedFrameClearsTheRange) {
+  OpRing ring(8, 32);
+  push(ring, 1, "x");
+  push(ring, 2, "y");
+  EXPECT_EQ(ring.push(3, 33), nullptr);
+  EXPECT_TRUE(ring.empty());
+  EXPECT_FALSE(ring.contains(1, 2));
+  push(ring, 4, std::string(32, 'z'));   // A frame of exactly max_bytes fits
+  EXPECT_TRUE(ring.contains(4, 4));
+}
+
+TEST(OpRing, ReleaseFreesStorage) {
+  OpRing ring(8, 256);
+  push(ring, 1, "x");
+  EXPECT_GT(ring.memory_bytes(), 0u);
+  ring.release();
+  EXPECT_TRUE(ring.empty());
+  EXPECT_EQ(ring.memory_bytes(), 0u);
+  push(ring, 2, "y");
+  EXPECT_EQ(range(ring, 2, 2), (std::vector<std::string>{ "y" }));
+}
+
+TEST(OpRing, MatchesAModelUnderRandomTraffic) {
+  // The retained range is always a contiguous suffix within both bounds
+  const uint32_t max_ops = 16, max_bytes = 512;
+  OpRing ring(max_ops, max_bytes);
+  std::deque<std::pair<uint64_t, std::string>> model;
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> size(1, 120);
+
+  for (uint64_t seq = 1; seq <= 5000; ++seq) {
+    std::string f = frame(seq, size(rng));
+    push(ring, seq, f);
+    model.emplace_back(seq, f);
+    while (model.size() > ring.last_seq() - ring.first_seq() + 1) model.pop_front();
+
+    ASSERT_EQ(ring.last_seq(), seq);
+    ASSERT_EQ(model.front().first, ring.first_seq());
+    ASSERT_LE(model.size(), max_ops);
+    size_t bytes = 0;
+    for (auto& [s, m] : model) bytes += m.size();
+    ASSERT_LE(bytes, max_bytes);
+
+    auto got = range(ring, ring.first_seq(), seq);
+    ASSERT_EQ(got.size(), model.size());
+    for (size_t i = 0; i < got.size(); ++i) ASSERT_EQ(got[i], model[i].second) << "seq " << model[i].first;
+  }
+}
@@ -0,0 +1,124 @@
+#include "persistence/room_spill.h"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<uint8_t> document(uint32_t seed, size_t len) {
+  std::vector<uint8_t> out(len);
+  std::mt19937 rng(seed);
+  for (auto& b : out) b = static_cast<uint8_t>(rng());
+  return out;
+}
+
+class RoomSpillTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    path_ = (fs::temp_directory_path() / ("wigma-spill-test-" + std::to_string(::getpid()))).string();
+  }
+
+  bool store(RoomSpill& spill, uint32_t slot, uint32_t gen, uint64_t seq, const std::vector<uint8_t>& doc) {
+    return spill.store(slot, gen, seq, doc.data(), doc.size());
+  }
+
+  std::string path_;
+};
+
+} // namespace
+
+TEST_F(RoomSpillTest, FileIsUnlinkedOnOpen) {
+  RoomSpill spill(path_);
+  EXPECT_FALSE(fs::exists(path_));
+}
+
+TEST_F(RoomSpillTest, LoadsWhatWasStored) {
+  RoomSpill spill(path_);
+  auto a = document(1, 5000), b = document(2, 70000);
+  ASSERT_TRUE(store(spill, 3, 1, 10, a));
+  ASSERT_TRUE(store(spill, 7, 4, 99, b));
+  EXPECT_EQ(spill.records(), 2u);
+  EXPECT_TRUE(spill.holds(3, 1, 10));
+
+  std::vector<uint8_t> out;
+  ASSERT_TRUE(spill.load(7, 4, 99, out));
+  EXPECT_EQ(out, b);
+  ASSERT_TRUE(spill.load(3, 1, 10, out));
+  EXPECT_EQ(out, a);
+  ASSERT_TRUE(spill.load(3, 1, 10, out));   // Kept after a load
+  EXPECT_EQ(out, a);
+}
+
+TEST_F(RoomSpillTest, StaleVersionsAreDropped) {
+  RoomSpill spill(path_);
+  auto doc = document(1, 1000);
+  ASSERT_TRUE(store(spill, 0, 1, 5, doc));
+  ASSERT_TRUE(store(spill, 1, 1, 5, doc));
+
+  std::vector<uint8_t> out;
+  EXPECT_FALSE(spill.holds(0, 1, 6));
+  EXPECT_FALSE(spill.load(0, 1, 6, out));    // An update arrived since
+  EXPECT_FALSE(spill.load(0, 1, 5, out));    // ... and the record is gone
+  EXPECT_FALSE(spill.load(1, 2, 5, out));    // Slot reused by another room
+  EXPECT_EQ(spill.records(), 0u);
+  EXPECT_EQ(spill.file_bytes(), 0u);         // Nothing live: file started over
+}
+
+TEST_F(RoomSpillTest, StoringASlotAgainReplacesIt) {
+  RoomSpill spill(path_);
+  auto v1 = document(1, 4000), v2 = document(2, 3000);
+  ASSERT_TRUE(store(spill, 2, 1, 1, v1));
+  const uint64_t bytes = spill.file_bytes();
+  ASSERT_TRUE(store(spill, 2, 1, 1, v1));    // Same version: no write
+  EXPECT_EQ(spill.file_bytes(), bytes);
+  ASSERT_TRUE(store(spill, 2, 1, 2, v2));
+  EXPECT_EQ(spill.records(), 1u);
+  EXPECT_FALSE(spill.holds(2, 1, 1));
+
+  std::vector<uint8_t> out;
+  ASSERT_TRUE(spill.load(2, 1, 2, out));
+  EXPECT_EQ(out, v2);
+}
+
+TEST_F(RoomSpillTest, RetainDropsRoomsThatAreGone) {
+  RoomSpill spill(path_);
+  auto doc = document(1, 100);
+  for (uint32_t slot = 0; slot < 6; ++slot) ASSERT_TRUE(store(spill, slot, slot, 1, doc));
+  spill.retain([](uint32_t slot, uint32_t) { return slot % 2 == 0; });
+  EXPECT_EQ(spill.records(), 3u);
+  EXPECT_TRUE(spill.holds(4, 4, 1));
+  EXPECT_FALSE(spill.holds(5, 5, 1));
+}
+
+TEST_F(RoomSpillTest, CompactsOnceMostOfTheFileIsGarbage) {
+  RoomSpill spill(path_);
+  const size_t mb = 1024 * 1024;
+  auto keep = document(7, mb);
+  ASSERT_TRUE(store(spill, 0, 1, 1, keep));
+
+  // Rewrite another slot until replaced records pass the compaction floor
+  std::vector<uint8_t> last;
+  int compactions = 0;
+  for (uint64_t seq = 1; seq <= 80; ++seq) {
+    const uint64_t before = spill.file_bytes();
+    last = document(static_cast<uint32_t>(100 + seq), mb);
+    ASSERT_TRUE(store(spill, 1, 1, seq, last));
+    if (spill.file_bytes() < before) {
+      ++compactions;
+      EXPECT_GT(before, 63u * mb);             // Not before the floor
+      EXPECT_LT(spill.file_bytes(), 3u * mb);  // Only the two live records left
+    }
+  }
+  EXPECT_EQ(compactions, 1);
+
+  std::vector<uint8_t> out;
+  ASSERT_TRUE(spill.load(0, 1, 1, out));
+  EXPECT_EQ(out, keep);
+  ASSERT_TRUE(spill.load(1, 1, 80, out));
+  EXPECT_EQ(out, last);
+}
@@ -0,0 +1,165 @@
+#include "server/timer_wheel.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+/** Owner passed to callbacks: the wheel's current time and a firing log. */
+struct Clock {
+  uint64_t now_ms = 0;
+  std::vector<std::pair<int, uint64_t>> fired;   // Timer id, time
+};
+
+struct Probe {
+  Clock* clock;
+  int    id;
+  TimerWheel::Timer timer;
+
+  Probe(Clock& c, int i) : clock(&c), id(i) {
+    timer.set([](void* owner, void* arg) {
+      auto& clock = *static_cast<Clock*>(owner);
+      clock.fired.emplace_back(static_cast<Probe*>(arg)->id, clock.now_ms);
+    }, this);
+  }
+};
+
+/** Advance one millisecond at a time, as the loop timer would (roughly). */
+void run_until(TimerWheel& wheel, Clock& clock, uint64_t until_ms) {
+  while (clock.now_ms < until_ms) wheel.advance(++clock.now_ms);
+}
+
+} // namespace
+
+TEST(TimerWheel, FiresOnceAtTheRoundedUpTick) {
+  Clock clock;
+  TimerWheel wheel(&clock, 10, 0);
+  Probe a(clock, 1), b(clock, 2), c(clock, 3);
+  wheel.schedule(a.timer, 25);   // 3 ticks
+  wheel.schedule(b.timer, 0);    // At least one tick
+  wheel.schedule(c.timer, 10);
+  EXPECT_EQ(wheel.size(), 3u);
+
+  run_until(wheel, clock, 100);
+  ASSERT_EQ(clock.fired.size(), 3u);
+  std::sort(clock.fired.begin(), clock.fired.begin() + 2);   // Same tick: any order
+  EXPECT_EQ(clock.fired[0], std::make_pair(2, uint64_t{10}));
+  EXPECT_EQ(clock.fired[1], std::make_pair(3, uint64_t{10}));
+  EXPECT_EQ(clock.fired[2], std::make_pair(1, uint64_t{30}));
+  EXPECT_EQ(wheel.size(), 0u);
+  EXPECT_FALSE(a.timer.scheduled());
+}
+
+TEST(TimerWheel, PeriodicTimersRearm) {
+  Clock clock;
+  TimerWheel wheel(&clock, 10, 0);
+  Probe p(clock, 1);
+  wheel.schedule(p.timer, 50, 20);
+  run_until(wheel, clock, 115);
+  ASSERT_EQ(clock.fired.size(), 4u);   // 50, 70, 90, 110
+  EXPECT_EQ(clock.fired[3].second, 110u);
+  EXPECT_TRUE(p.timer.scheduled());
+  p.timer.cancel();
+  run_until(wheel, clock, 300);
+  EXPECT_EQ(clock.fired.size(), 4u);
+}
+
+TEST(TimerWheel, CancelRescheduleAndDestroy) {
+  Clock clock;
+  TimerWheel wheel(&clock, 1, 0);
+  Probe a(clock, 1), b(clock, 2);
+  wheel.schedule(a.timer, 10);
+  wheel.schedule(b.timer, 10);
+  wheel.schedule(a.timer, 30);   // Replaces the earlier schedule
+  {
+    Probe gone(clock, 3);
+    wheel.schedule(gone.timer, 5);
+  }                              // Unlinks itself
+  EXPECT_EQ(wheel.size(), 2u);
+  b.timer.cancel();
+  b.timer.cancel();              // No-op
+  run_until(wheel, clock, 50);
+  ASSERT_EQ(clock.fired.size(), 1u);
+  EXPECT_EQ(clock.fired[0], std::make_pair(1, uint64_t{30}));
+}
+
+TEST(TimerWheel, CallbacksMayCancelAndArmTimers) {
+  struct State {
+    TimerWheel* wheel;
+    TimerWheel::Timer first, second, rearmed;
+    int second_fired = 0, rearmed_fired = 0;
+  } s;
+  TimerWheel wheel(&s, 1, 0);
+  s.wheel = &wheel;
+
+  // Both due on the same tick: the first cancels the second and arms a third
+  s.first.set([](void* owner, void*) {
+    auto& s = *static_cast<State*>(owner);
+    s.second.cancel();
+    s.wheel->schedule(s.rearmed, 0);
+  }, nullptr);
+  s.second.set([](void* owner, void*) { ++static_cast<State*>(owner)->second_fired; }, nullptr);
+  s.rearmed.set([](void* owner, void*) { ++static_cast<State*>(owner)->rearmed_fired; }, nullptr);
+  wheel.schedule(s.second, 5);
+  wheel.schedule(s.first, 5);    // Linked at the head: runs first
+
+  wheel.advance(5);
+  EXPECT_EQ(s.second_fired, 0);
+  EXPECT_EQ(s.rearmed_fired, 0); // Armed for the next tick, not this one
+  wheel.advance(6);
+  EXPECT_EQ(s.rearmed_fired, 1);
+}
+
+TEST(TimerWheel, CatchesUpAfterALongStall) {
+  Clock clock;
+  TimerWheel wheel(&clock, 10, 1000);
+  Probe a(clock, 1), b(clock, 2);
+  wheel.schedule(a.timer, 20);
+  wheel.schedule(b.timer, 70);
+  clock.now_ms = 2000;
+  wheel.advance(2000);           // One call covers every missed tick, in order
+  ASSERT_EQ(clock.fired.size(), 2u);
+  EXPECT_EQ(clock.fired[0].first, 1);
+  EXPECT_EQ(clock.fired[1].first, 2);
+}
+
+TEST(TimerWheel, CascadesFromHigherLevelsOnTime) {
+  // Random delays across all four levels and past the wheel's span
+  Clock clock;
+  TimerWheel wheel(&clock, 1, 0);
+  std::mt19937_64 rng(7);
+  const uint64_t delays[] = { 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 300000,
+                              (uint64_t{1} << 24) - 1, (uint64_t{1} << 24) + 1000 };
+  std::vector<std::unique_ptr<Probe>> probes;
+  std::vector<uint64_t> due;
+  for (uint64_t d : delays) {
+    probes.push_back(std::make_unique<Probe>(clock, static_cast<int>(probes.size())));
+    due.push_back(d);
+  }
+  for (int i = 0; i < 200; ++i) {
+    probes.push_back(std::make_unique<Probe>(clock, static_cast<int>(probes.size())));
+    due.push_back(1 + rng() % 400000);
+  }
+  for (size_t i = 0; i < probes.size(); ++i) wheel.schedule(probes[i]->timer, due[i]);
+
+  // Advance in uneven steps, as a loop timer under load would
+  uint64_t now = 0;
+  const uint64_t end = (uint64_t{1} << 24) + 2000;
+  while (now < end) {
+    now = std::min(end, now + 1 + rng() % 3000);
+    clock.now_ms = now;
+    wheel.advance(now);
+  }
+
+  ASSERT_EQ(clock.fired.size(), probes.size());
+  EXPECT_EQ(wheel.size(), 0u);
+  uint64_t last_due = 0;
+  for (auto& [id, at] : clock.fired) {
+    const uint64_t d = due[static_cast<size_t>(id)];
+    EXPECT_GE(at, d) << "timer " << id << " fired early";
+    EXPECT_GE(d, last_due) << "timer " << id << " fired out of order";
+    last_due = d;
+  }
+}
@@ -0,0 +1,262 @@
+#include "persistence/write_ahead_log.h"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/** Replay sink that keeps what it was handed; accepts batches while `accept`. */
+struct Sink {
+  std::mutex mutex;
+  std::vector<std::pair<std::string, std::string>> stored;
+  std::vector<uint64_t> positions;
+  std::string log_id;
+  std::atomic<bool> accept{true};
+
+  WriteAheadLog::ReplaySink fn() {
+    return [this](std::string_view id, const std::vector<WriteAheadLog::Record>& batch) {
+      if (!accept.load()) return false;
+      std::lock_guard lock(mutex);
+      log_id = id;
+      for (auto& rec : batch) {
+        stored.emplace_back(rec.project_id, rec.payload);
+        positions.push_back(rec.position);
+      }
+      return true;
+    };
+  }
+
+  size_t size() {
+    std::lock_guard lock(mutex);
+    return stored.size();
+  }
+
+  /** Wait for the replayer to hand over `n` records in total. */
+  bool wait_for(size_t n) {
+    for (int i = 0; i < 500 && size() < n; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return size() == n;
+  }
+};
+
+class WalTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    dir_ = fs::temp_directory_path() / ("wigma-wal-test-" + std::to_string(::getpid()));
+    fs::remove_all(dir_);
+  }
+  void TearDown() override { fs::remove_all(dir_); }
+
+  WriteAheadLog::Options options() const {
+    WriteAheadLog::Options o;
+    o.dir = dir_.string();
+    o.commit_interval_ms = 1;
+    o.replay_batch = 16;
+    return o;
+  }
+
+  static uint64_t append(WriteAheadLog& wal, std::string_view project, std::string_view payload) {
+    return wal.append(project, reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+  }
+
+  std::vector<fs::path> segments() const {
+    std::vector<fs::path> out;
+    for (auto& e : fs::directory_iterator(dir_)) {
+      if (e.path().extension() == ".wal") out.push_back(e.path());
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+  }
+
+  fs::path dir_;
+};
+
+} // namespace
+
+TEST_F(WalTest, ReplaysInOrderAndBecomesDurable) {
+  Sink sink;
+  WriteAheadLog wal(options(), sink.fn());
+  EXPECT_EQ(wal.replayed_lsn(), WriteAheadLog::kRecoveredLsn);   // Nothing recovered
+  uint64_t last = WriteAheadLog::kRecoveredLsn;
+  for (int i = 0; i < 100; ++i) {
+    uint64_t lsn = append(wal, i % 2 ? "odd" : "even", "op-" + std::to_string(i));
+    EXPECT_EQ(lsn, last + 1);
+    last = lsn;
+  }
+  ASSERT_TRUE(sink.wait_for(100));
+  EXPECT_GE(wal.durable_lsn(), last);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(sink.stored[static_cast<size_t>(i)].first, i % 2 ? "odd" : "even");
+    EXPECT_EQ(sink.stored[static_cast<size_t>(i)].second, "op-" + std::to_string(i));
+  }
+}
+
+TEST_F(WalTest, RecoversUnreplayedRecordsAndDropsTornTail) {
+  {
+    Sink refusing;
+    refusing.accept = false;   // Database down: nothing is acknowledged
+    WriteAheadLog wal(options(), refusing.fn());
+    for (int i = 0; i < 20; ++i) append(wal, "p", "update-" + std::to_string(i));
+    const uint64_t last = WriteAheadLog::kRecoveredLsn + 20;
+    for (int i = 0; i < 200 && wal.durable_lsn() < last; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    ASSERT_EQ(wal.durable_lsn(), last);
+    EXPECT_EQ(wal.replayed_lsn(), WriteAheadLog::kRecoveredLsn);
+  }
+
+  // A crash mid-write leaves half a record at the end of the last segment
+  auto segs = segments();
+  ASSERT_FALSE(segs.empty());
+  {
+    std::ofstream torn(segs.back(), std::ios::binary | std::ios::app);
+    const char partial[] = { 64, 0, 0, 0, 1, 2, 3, 4, 'p' };
+    torn.write(partial, sizeof(partial));
+  }
+
+  Sink sink;
+  sink.accept = false;
+  WriteAheadLog wal(options(), sink.fn());
+  EXPECT_EQ(wal.replayed_lsn(), 0u);   // Database lacks the recovered records
+  sink.accept = true;
+  ASSERT_TRUE(sink.wait_for(20));
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_EQ(sink.stored[static_cast<size_t>(i)].second, "update-" + std::to_string(i));
+  }
+  // Writing moved to a fresh segment, so the replayed one is unlinked
+  for (int i = 0; i < 200 && fs::exists(segs.back()); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_FALSE(fs::exists(segs.back()));
+
+  // New appends continue after the recovered ones
+  append(wal, "p", "after-restart");
+  ASSERT_TRUE(sink.wait_for(21));
+  EXPECT_EQ(sink.stored.back().second, "after-restart");
+}
+
+TEST_F(WalTest, AcknowledgedRecordsAreNotReplayedAgain) {
+  {
+    Sink sink;
+    WriteAheadLog wal(options(), sink.fn());
+    for (int i = 0; i < 10; ++i) append(wal, "p", "x");
+    ASSERT_TRUE(sink.wait_for(10));
+  }
+  Sink sink;
+  WriteAheadLog wal(options(), sink.fn());
+  append(wal, "p", "only-new");
+  ASSERT_TRUE(sink.wait_for(1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ASSERT_EQ(sink.size(), 1u);
+  EXPECT_EQ(sink.stored[0].second, "only-new");
+}
+
+TEST_F(WalTest, FailedBatchesAreRetried) {
+  Sink sink;
+  sink.accept = false;
+  WriteAheadLog wal(options(), sink.fn());
+  append(wal, "p", "a");
+  append(wal, "p", "b");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(sink.size(), 0u);
+  sink.accept = true;
+  ASSERT_TRUE(sink.wait_for(2));
+  EXPECT_EQ(sink.stored[1].second, "b");
+}
+
+TEST_F(WalTest, RejectsProjectIdsTooLongToFrame) {
+  Sink sink;
+  WriteAheadLog wal(options(), sink.fn());
+  EXPECT_EQ(append(wal, std::string(70000, 'p'), "x"), 0u);
+  EXPECT_EQ(append(wal, "p", "x"), WriteAheadLog::kRecoveredLsn + 1);
+  ASSERT_TRUE(sink.wait_for(1));
+}
+
+TEST_F(WalTest, ReplayedLsnFollowsTheSink) {
+  Sink sink;
+  sink.accept = false;
+  WriteAheadLog wal(options(), sink.fn());
+  const uint64_t first = append(wal, "p", "a");
+  const uint64_t second = append(wal, "p", "b");
+  for (int i = 0; i < 200 && wal.durable_lsn() < second; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  ASSERT_EQ(wal.durable_lsn(), second);
+  EXPECT_LT(wal.replayed_lsn(), first);   // Durable, not yet in the database
+
+  sink.accept = true;
+  ASSERT_TRUE(sink.wait_for(2));
+  for (int i = 0; i < 200 && wal.replayed_lsn() < second; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_EQ(wal.replayed_lsn(), second);
+}
+
+TEST_F(WalTest, PositionsKeepIncreasingAcrossRestarts) {
+  std::string id;
+  std::vector<uint64_t> positions;
+  for (int run = 0; run < 3; ++run) {
+    Sink sink;
+    WriteAheadLog wal(options(), sink.fn());
+    if (run == 0) id = wal.id();
+    EXPECT_EQ(wal.id(), id);   // Kept in the directory
+    EXPECT_FALSE(wal.id().empty());
+
+    for (int i = 0; i < 5; ++i) append(wal, "p", "run-" + std::to_string(run));
+    ASSERT_TRUE(sink.wait_for(5));
+    EXPECT_EQ(sink.log_id, id);
+    positions.insert(positions.end(), sink.positions.begin(), sink.positions.end());
+  }
+  ASSERT_EQ(positions.size(), 15u);
+  EXPECT_TRUE(std::is_sorted(positions.begin(), positions.end()));
+  EXPECT_EQ(std::adjacent_find(positions.begin(), positions.end()), positions.end());
+}
+
+TEST_F(WalTest, NewDirectoryGetsANewId) {
+  std::string first;
+  {
+    Sink sink;
+    WriteAheadLog wal(options(), sink.fn());
+    first = wal.id();
+  }
+  fs::remove_all(dir_);
+  Sink sink;
+  WriteAheadLog wal(options(), sink.fn());
+  EXPECT_NE(wal.id(), first);
+}
+
+TEST_F(WalTest, SkipsASealedSegmentRemovedFromDisk) {
+  auto opts = options();
+  opts.segment_bytes = 1;   // Every commit seals its segment
+  {
+    Sink refusing;
+    refusing.accept = false;
+    WriteAheadLog wal(opts, refusing.fn());
+    for (int i = 0; i < 3; ++i) {
+      const uint64_t lsn = append(wal, "p", "seg-" + std::to_string(i));
+      for (int j = 0; j < 200 && wal.durable_lsn() < lsn; ++j) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    }
+  }
+  auto segs = segments();
+  ASSERT_GE(segs.size(), 3u);
+  fs::remove(segs[1]);
+
+  Sink sink;
+  WriteAheadLog wal(opts, sink.fn());
+  ASSERT_TRUE(sink.wait_for(2));
+  EXPECT_EQ(sink.stored[0].second, "seg-0");
+  EXPECT_EQ(sink.stored[1].second, "seg-2");
+}
@@ -0,0 +1,556 @@
+/**
+ * wigma-replay: feed a traffic capture (CAPTURE_FILE) back to a server.
+ *
+ *   wigma-replay <trace> <host:port> [--speed N|max] [--token JWT] [--path /]
+ *
+ * Every captured session gets its own WebSocket connection, opened when
+ * the session's first frame is due, and each frame is sent at its
+ * captured offset divided by --speed. Sessions therefore overlap and
+ * interleave as they did on the recorded server. With "max" frames go out
+ * as fast as the sockets take them, in capture order.
+ *
+ * Captures hold no credentials. --token is spliced into every "join"; a
+ * token whose claims do not cover the captured project ids is refused by
+ * the server, as is every "resume" (resume tokens are never recorded).
+ * A payload-redacted capture replays frame sizes and timing, not content:
+ * zeroed updates reach the server as malformed Yjs, which is fine for
+ * load tests of the relay and persistence path and for nothing else.
+ * Compressed frames carry no payload in such a capture and are skipped.
+ *
+ * Plain ws:// only. One thread, one uSockets loop.
+ */
+#include "server/traffic_capture.h"
+#include "protocol/message_codec.h"
+#include <libusockets.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+using Kind = TrafficCapture::Kind;
+
+constexpr int      kTickMs       = 1;
+constexpr size_t   kMaxPerTick   = 4096;               // Frames dispatched per tick at --speed max
+constexpr size_t   kMaxBuffered  = 16 * 1024 * 1024;   // --speed max waits for a socket past this
+constexpr size_t   kMaxHandshake = 16 * 1024;
+constexpr uint64_t kLingerUs     = 1'000'000;          // Replies collected after the last frame
+
+enum : uint8_t { kOpText = 0x1, kOpBinary = 0x2, kOpClose = 0x8, kOpPing = 0x9, kOpPong = 0xA };
+
+uint64_t monotonic_us() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct Options {
+  std::string trace;
+  std::string host;
+  int         port  = 0;
+  double      speed = 1.0;   // 0 = as fast as possible
+  std::string token;
+  std::string path  = "/";
+};
+
+struct Client {
+  enum class State : uint8_t { Connecting, Upgrading, Open, Closed };
+
+  us_socket_t* socket = nullptr;
+  State        state  = State::Connecting;
+  bool         closing = false;   // Trace closed the session; the server's close is expected
+  std::string  out;               // Bytes the socket has not taken yet
+  std::string  held;              // Frames waiting for the upgrade to finish
+  std::string  in;                // Unparsed input
+};
+
+struct Stats {
+  uint64_t sessions = 0;
+  uint64_t frames_sent = 0;
+  uint64_t bytes_sent = 0;
+  uint64_t frames_received = 0;
+  uint64_t bytes_received = 0;
+  uint64_t frames_skipped = 0;    // Session already gone, or payload not captured
+  uint64_t connect_failures = 0;
+  uint64_t upgrade_failures = 0;
+  uint64_t server_closes = 0;     // Sessions the server closed before the trace did
+  uint64_t open_at_end = 0;       // Sessions the trace never closed, closed by us at the end
+  uint64_t max_lag_us = 0;        // Worst delay of a frame past its due time
+  uint64_t trace_us = 0;          // Offset of the last record
+};
+
+class Replay {
+public:
+  Replay(Options options, us_loop_t* loop);
+  ~Replay();
+
+  /** Open the trace and arm the dispatch timer. False (with a message) on failure. */
+  bool start();
+
+  void print_summary(uint64_t wall_us) const;
+
+private:
+  Options  options_;
+  us_loop_t* loop_;
+  us_socket_context_t* context_ = nullptr;
+  us_timer_t* timer_ = nullptr;
+
+  std::ifstream trace_;
+  TrafficCapture::Record next_;
+  std::string next_payload_;
+  bool        have_next_ = false;
+
+  std::unordered_map<uint32_t, std::unique_ptr<Client>> clients_;
+  std::unordered_set<uint32_t> rooms_;
+  std::string request_;   // Upgrade request, same for every session
+  std::string frame_;     // Scratch for one outgoing frame
+  std::string join_;      // Scratch for a join with the token spliced in
+  uint32_t    mask_seed_ = 0x9E3779B9;
+  uint64_t    start_us_ = 0;
+  uint64_t    drained_us_ = 0;   // When the trace ran out (0 = still reading)
+  bool        finished_ = false; // Closing the sessions the trace left open
+  Stats       stats_;
+
+  static Replay* from(us_socket_t* s);
+  static Client*& client_of(us_socket_t* s);
+
+  bool read_next();
+  void tick();
+  void dispatch(const TrafficCapture::Record& rec, std::string_view payload);
+  void connect(Client& c);
+  void send_frame(Client& c, uint8_t opcode, const char* data, size_t len);
+  void write(Client& c, const char* data, size_t len);
+  void flush(Client& c);
+  void receive(Client& c, const char* data, size_t len);
+  void upgraded(Client& c);
+  void lost(Client& c);
+  bool idle() const;
+};
+
+Replay* Replay::from(us_socket_t* s) {
+  return *static_cast<Replay**>(us_socket_context_ext(0, us_socket_context(0, s)));
+}
+
+Client*& Replay::client_of(us_socket_t* s) {
+  return *static_cast<Client**>(us_socket_ext(0, s));
+}
+
+Replay::Replay(Options options, us_loop_t* loop)
+  : options_(std::move(options)), loop_(loop) {
+  request_ = "GET " + options_.path + " HTTP/1.1\r\n"
+             "Host: " + options_.host + ":" + std::to_string(options_.port) + "\r\n"
+             "Upgrade: websocket\r\n"
+             "Connection: Upgrade\r\n"
+             "Sec-WebSocket-Key: d2lnbWEtcmVwbGF5LWtleQ==\r\n"
+             "Sec-WebSocket-Version: 13\r\n\r\n";
+}
+
+Replay::~Replay() {
+  if (context_) us_socket_context_free(0, context_);
+}
+
+bool Replay::start() {
+  trace_.open(options_.trace, std::ios::binary);
+  char magic[sizeof(TrafficCapture::kMagic)];
+  if (!trace_ || !trace_.read(magic, sizeof(magic))
+      || std::memcmp(magic, TrafficCapture::kMagic, sizeof(magic)) != 0) {
+    std::fprintf(stderr, "%s: not a traffic capture\n", options_.trace.c_str());
+    return false;
+  }
+  have_next_ = read_next();
+
+  us_socket_context_options_t ctx_options{};
+  context_ = us_create_socket_context(0, loop_, sizeof(Replay*), ctx_options);
+  if (!context_) {
+    std::fprintf(stderr, "cannot create socket context\n");
+    return false;
+  }
+  *static_cast<Replay**>(us_socket_context_ext(0, context_)) = this;
+
+  us_socket_context_on_open(0, context_, [](us_socket_t* s, int, char*, int) {
+    if (auto* c = client_of(s)) {
+      c->state = Client::State::Upgrading;
+      from(s)->write(*c, from(s)->request_.data(), from(s)->request_.size());
+    }
+    return s;
+  });
+  us_socket_context_on_data(0, context_, [](us_socket_t* s, char* data, int length) {
+    if (auto* c = client_of(s)) from(s)->receive(*c, data, static_cast<size_t>(length));
+    return s;
+  });
+  us_socket_context_on_writable(0, context_, [](us_socket_t* s) {
+    if (auto* c = client_of(s)) from(s)->flush(*c);
+    return s;
+  });
+  us_socket_context_on_close(0, context_, [](us_socket_t* s, int, void*) {
+    if (auto* c = client_of(s)) {
+      client_of(s) = nullptr;
+      from(s)->lost(*c);
+    }
+    return s;
+  });
+  us_socket_context_on_connect_error(0, context_, [](us_socket_t* s, int) {
+    if (auto* c = client_of(s)) {
+      client_of(s) = nullptr;
+      ++from(s)->stats_.connect_failures;
+      c->socket = nullptr;
+      c->state  = Client::State::Closed;
+    }
+    return s;
+  });
+  us_socket_context_on_end(0, context_, [](us_socket_t* s) {
+    return us_socket_close(0, s, 0, nullptr);
+  });
+  us_socket_context_on_timeout(0, context_, [](us_socket_t* s) { return s; });
+
+  timer_ = us_create_timer(loop_, 0, sizeof(Replay*));
+  *static_cast<Replay**>(us_timer_ext(timer_)) = this;
+  us_timer_set(timer_, [](us_timer_t* t) {
+    (*static_cast<Replay**>(us_timer_ext(t)))->tick();
+  }, kTickMs, kTickMs);
+
+  start_us_ = monotonic_us();
+  return true;
+}
+
+bool Replay::read_next() {
+  char header[TrafficCapture::kHeaderSize];
+  if (!trace_.read(header, sizeof(header))) return false;
+  size_t len;
+  if (!TrafficCapture::read_header(header, next_, len)) {
+    std::fprintf(stderr, "corrupt record at offset %lld, trace ends here\n",
+                 static_cast<long long>(trace_.tellg()) - static_cast<long long>(sizeof(header)));
+    return false;
+  }
+  next_payload_.resize(len);
+  if (len > 0 && !trace_.read(next_payload_.data(), static_cast<std::streamsize>(len))) return false;
+  return true;
+}
+
+void Replay::tick() {
+  const uint64_t now = monotonic_us() - start_us_;
+
+  size_t budget = options_.speed > 0 ? SIZE_MAX : kMaxPerTick;
+  while (have_next_ && budget-- > 0) {
+    uint64_t due = 0;
+    if (options_.speed > 0) {
+      due = static_cast<uint64_t>(static_cast<double>(next_.t_us) / options_.speed);
+      if (due > now) break;
+    } else if (auto it = clients_.find(next_.peer);
+               it != clients_.end() && it->second->out.size() > kMaxBuffered) {
+      break;   // Keep capture order: wait for this socket rather than skip ahead
+    }
+    if (options_.speed > 0 && now - due > stats_.max_lag_us) stats_.max_lag_us = now - due;
+
+    dispatch(next_, next_payload_);
+    stats_.trace_us = next_.t_us;
+    have_next_ = read_next();
+  }
+  if (have_next_) return;
+
+  // Trace done: wait for our buffers to drain, collect replies, then stop
+  if (!drained_us_) drained_us_ = now;
+  if (!idle() && now - drained_us_ < 10 * kLingerUs) return;
+  if (now - drained_us_ < kLingerUs) return;
+
+  us_timer_close(timer_);
+  timer_ = nullptr;
+  finished_ = true;
+  us_socket_context_close(0, context_);   // Reports every open session as closed
+}
+
+bool Replay::idle() const {
+  for (auto& [peer, c] : clients_) {
+    if (c->state == Client::State::Connecting || c->state == Client::State::Upgrading) return false;
+    if (c->state == Client::State::Open && !c->out.empty()) return false;
+  }
+  return true;
+}
+
+void Replay::dispatch(const TrafficCapture::Record& rec, std::string_view payload) {
+  auto& slot = clients_[rec.peer];
+  if (!slot) {
+    slot = std::make_unique<Client>();
+    ++stats_.sessions;
+    connect(*slot);
+  }
+  Client& c = *slot;
+  if (rec.room) rooms_.insert(rec.room);
+
+  if (c.state == Client::State::Closed || c.closing) {
+    ++stats_.frames_skipped;
+    return;
+  }
+
+  switch (rec.kind) {
+    case Kind::Text: {
+      if (payload.empty()) {   // Unparseable control message; not recorded
+        ++stats_.frames_skipped;
+        return;
+      }
+      MessageCodec::ControlMessage msg;
+      if (!options_.token.empty() && MessageCodec::decode_control(payload, msg)
+          && msg.type == "join" && msg.token.empty()
+          && msg.token.data() >= payload.data() && msg.token.data() <= payload.data() + payload.size()) {
+        const size_t at = static_cast<size_t>(msg.token.data() - payload.data());
+        join_.assign(payload.substr(0, at));
+        join_.append(options_.token);
+        join_.append(payload.substr(at));
+        payload = join_;
+      }
+      send_frame(c, kOpText, payload.data(), payload.size());
+      break;
+    }
+    case Kind::Binary:
+      if (payload.empty()) {   // Compressed frame of a redacted capture
+        ++stats_.frames_skipped;
+        return;
+      }
+      send_frame(c, kOpBinary, payload.data(), payload.size());
+      break;
+    case Kind::Close: {
+      static constexpr char kNormal[2] = { static_cast<char>(1000 >> 8), static_cast<char>(1000 & 0xFF) };
+      send_frame(c, kOpClose, kNormal, sizeof(kNormal));
+      c.closing = true;
+      break;
+    }
+    default:
+      ++stats_.frames_skipped;
+      return;
+  }
+  ++stats_.frames_sent;
+  stats_.bytes_sent += payload.size();
+}
+
+void Replay::connect(Client& c) {
+  c.socket = us_socket_context_connect(0, context_, options_.host.c_str(), options_.port,
+                                       nullptr, 0, sizeof(Client*));
+  if (!c.socket) {
+    ++stats_.connect_failures;
+    c.state = Client::State::Closed;
+    return;
+  }
+  client_of(c.socket) = &c;
+}
+
+void Replay::send_frame(Client& c, uint8_t opcode, const char* data, size_t len) {
+  // Client frames are masked (RFC 6455 5.3); the key only has to vary
+  mask_seed_ ^= mask_seed_ << 13;
+  mask_seed_ ^= mask_seed_ >> 17;
+  mask_seed_ ^= mask_seed_ << 5;
+  char mask[4];
+  std::memcpy(mask, &mask_seed_, sizeof(mask));
+
+  frame_.clear();
+  frame_ += static_cast<char>(0x80 | opcode);
+  if (len < 126) {
+    frame_ += static_cast<char>(0x80 | len);
+  } else if (len <= 0xFFFF) {
+    frame_ += static_cast<char>(0x80 | 126);
+    for (int i = 1; i >= 0; --i) frame_ += static_cast<char>(len >> (8 * i));
+  } else {
+    frame_ += static_cast<char>(0x80 | 127);
+    for (int i = 7; i >= 0; --i) frame_ += static_cast<char>(static_cast<uint64_t>(len) >> (8 * i));
+  }
+  frame_.append(mask, sizeof(mask));
+  const size_t body = frame_.size();
+  frame_.append(data, len);
+  for (size_t i = 0; i < len; ++i) frame_[body + i] ^= mask[i & 3];
+
+  if (c.state == Client::State::Open) {
+    write(c, frame_.data(), frame_.size());
+  } else {
+    c.held.append(frame_);
+  }
+}
+
+void Replay::write(Client& c, const char* data, size_t len) {
+  if (c.state != Client::State::Connecting && c.out.empty()) {
+    int n = us_socket_write(0, c.socket, data, static_cast<int>(len), 0);
+    if (n > 0) {
+      data += n;
+      len  -= static_cast<size_t>(n);
+    }
+  }
+  c.out.append(data, len);
+}
+
+void Replay::flush(Client& c) {
+  if (c.out.empty()) return;
+  int n = us_socket_write(0, c.socket, c.out.data(), static_cast<int>(c.out.size()), 0);
+  if (n > 0) c.out.erase(0, static_cast<size_t>(n));
+}
+
+void Replay::receive(Client& c, const char* data, size_t len) {
+  c.in.append(data, len);
+
+  if (c.state == Client::State::Upgrading) {
+    const size_t end = c.in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+      if (c.in.size() <= kMaxHandshake) return;
+    } else if (c.in.compare(0, 12, "HTTP/1.1 101") == 0) {
+      c.in.erase(0, end + 4);
+      upgraded(c);
+    }
+    if (c.state != Client::State::Open) {
+      if (stats_.upgrade_failures++ == 0) {
+        std::fprintf(stderr, "upgrade refused: %s\n", c.in.substr(0, c.in.find("\r\n")).c_str());
+      }
+      c.state = Client::State::Closed;
+      us_socket_close(0, c.socket, 0, nullptr);
+      return;
+    }
+  }
+
+  // Server frames: answer pings and closes, count the rest
+  size_t at = 0;
+  while (c.in.size() - at >= 2) {
+    const auto* p = reinterpret_cast<const uint8_t*>(c.in.data() + at);
+    const uint8_t opcode = p[0] & 0x0F;
+    uint64_t body = p[1] & 0x7F;
+    size_t header = 2;
+    if (body == 126) {
+      header += 2;
+      if (c.in.size() - at < header) break;
+      body = (uint64_t{p[2]} << 8) | p[3];
+    } else if (body == 127) {
+      header += 8;
+      if (c.in.size() - at < header) break;
+      body = 0;
+      for (int i = 0; i < 8; ++i) body = (body << 8) | p[2 + i];
+    }
+    if (p[1] & 0x80) header += 4;   // Servers must not mask; skip the key if one does
+    if (c.in.size() - at < header + body) break;
+
+    const char* payload = c.in.data() + at + header;
+    ++stats_.frames_received;
+    stats_.bytes_received += body;
+    at += header + static_cast<size_t>(body);
+
+    if (opcode == kOpPing) {
+      send_frame(c, kOpPong, payload, static_cast<size_t>(body));
+    } else if (opcode == kOpClose) {
+      if (!c.closing) ++stats_.server_closes;
+      c.state = Client::State::Closed;
+      us_socket_close(0, c.socket, 0, nullptr);
+      return;
+    }
+  }
+  c.in.erase(0, at);
+}
+
+void Replay::upgraded(Client& c) {
+  c.state = Client::State::Open;
+  if (!c.held.empty()) {
+    write(c, c.held.data(), c.held.size());
+    c.held.clear();
+    c.held.shrink_to_fit();
+  }
+}
+
+void Replay::lost(Client& c) {
+  if (c.state != Client::State::Closed && !c.closing) {
+    if (finished_) {
+      ++stats_.open_at_end;
+    } else {
+      ++stats_.server_closes;
+    }
+  }
+  c.socket = nullptr;
+  c.state  = Client::State::Closed;
+  c.out.clear();
+  c.held.clear();
+}
+
+void Replay::print_summary(uint64_t wall_us) const {
+  auto ms = [](uint64_t us) { return static_cast<double>(us) / 1000.0; };
+  std::printf("trace        %.1f ms, %zu rooms\n", ms(stats_.trace_us), rooms_.size());
+  std::printf("replay       %.1f ms wall, worst frame lag %.1f ms\n", ms(wall_us), ms(stats_.max_lag_us));
+  std::printf("sessions     %llu (%llu connect failures, %llu upgrades refused, %llu closed by server, "
+              "%llu still open at the end)\n",
+              static_cast<unsigned long long>(stats_.sessions),
+              static_cast<unsigned long long>(stats_.connect_failures),
+              static_cast<unsigned long long>(stats_.upgrade_failures),
+              static_cast<unsigned long long>(stats_.server_closes),
+              static_cast<unsigned long long>(stats_.open_at_end));
+  std::printf("sent         %llu frames, %llu bytes (%llu skipped)\n",
+              static_cast<unsigned long long>(stats_.frames_sent),
+              static_cast<unsigned long long>(stats_.bytes_sent),
+              static_cast<unsigned long long>(stats_.frames_skipped));
+  std::printf("received     %llu frames, %llu bytes\n",
+              static_cast<unsigned long long>(stats_.frames_received),
+              static_cast<unsigned long long>(stats_.bytes_received));
+}
+
+/** "host:port" or "[v6]:port". */
+bool parse_target(std::string_view text, Options& out) {
+  auto colon = text.rfind(':');
+  if (colon == std::string_view::npos) return false;
+  out.host = std::string(text.substr(0, colon));
+  if (out.host.size() >= 2 && out.host.front() == '[' && out.host.back() == ']') {
+    out.host = out.host.substr(1, out.host.size() - 2);
+  }
+  out.port = std::atoi(std::string(text.substr(colon + 1)).c_str());
+  return !out.host.empty() && out.port > 0 && out.port < 65536;
+}
+
+int usage() {
+  std::fprintf(stderr,
+    "usage: wigma-replay <trace> <host:port> [--speed N|max] [--token JWT] [--path /]\n"
+    "  --speed  time scale (default 1; 2 = twice as fast; max = no pacing)\n"
+    "  --token  JWT spliced into every join (captures hold none)\n"
+    "  --path   WebSocket upgrade path (default /)\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (argc < 3 || !parse_target(argv[2], options)) return usage();
+  options.trace = argv[1];
+
+  for (int i = 3; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (i + 1 >= argc) return usage();
+    std::string_view value = argv[++i];
+    if (arg == "--speed") {
+      if (value == "max") {
+        options.speed = 0;
+      } else {
+        options.speed = std::atof(std::string(value).c_str());
+        if (options.speed <= 0) return usage();
+      }
+    } else if (arg == "--token") {
+      options.token = std::string(value);
+    } else if (arg == "--path") {
+      options.path = std::string(value);
+    } else {
+      return usage();
+    }
+  }
+
+  us_loop_t* loop = us_create_loop(nullptr, [](us_loop_t*) {}, [](us_loop_t*) {}, [](us_loop_t*) {}, 0);
+  if (!loop) {
+    std::fprintf(stderr, "cannot create event loop\n");
+    return 1;
+  }
+
+  int rc = 1;
+  {
+    Replay replay(options, loop);
+    if (replay.start()) {
+      const uint64_t started = monotonic_us();
+      us_loop_run(loop);   // Returns once the timer and every socket are closed
+      replay.print_summary(monotonic_us() - started);
+      rc = 0;
+    }
+  }
+  us_loop_free(loop);
+  return rc;
+}